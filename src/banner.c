@@ -0,0 +1,334 @@
+/*************************************************************************
+ * banner.c
+ *
+ * This module remembers what the signatures made of a payload.  Many
+ * servers send byte for byte the same banner, so the outcome of running
+ * the signature list (the matching signature and the application string
+ * built from it, or no match at all) is kept in a cache keyed by a hash
+ * of the payload.  A repeated banner then costs one hash and one compare.
+ *
+ * A banner is keyed on the length and a 64 bit hash of the whole
+ * payload;  its first BANNER_PREFIX bytes are kept and compared as well.
+ * A hit is therefore the same payload (short of a hash collision in the
+ * bytes that are not kept), and the cache never changes the result.  The
+ * cache has a fixed number of entries;  when it is full the least
+ * recently used banner is dropped.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "banner.h"
+#include "slab.h"
+#include "util.h"
+
+/* Variable Declarations */
+Banner *banner_pool;            /* Banner Records */
+u_int32_t *banner_buckets;      /* Hash Buckets (index of first banner) */
+u_int32_t banner_mask;          /* Number of buckets - 1 */
+u_int32_t banner_max;           /* Number of banner records */
+u_int32_t banner_used;          /* Records handed out so far */
+u_int32_t banner_lru_head;      /* Most recently used banner */
+u_int32_t banner_lru_tail;      /* Least recently used banner */
+BannerStats banner_stats;
+Slab banner_slab;               /* Banner data (BANNER_PREFIX bytes each) */
+pthread_mutex_t banner_lock = PTHREAD_MUTEX_INITIALIZER;  /* Shared by all workers */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: banner_kept
+ * DESCRIPTION	: This function will return the number of
+ *		: leading payload bytes that a banner keeps.
+ * INPUT	: 0 - Payload Length
+ * RETURN	: Bytes kept
+ * ---------------------------------------------------------- */
+static inline int
+banner_kept (int len)
+{
+    return (len < BANNER_PREFIX) ? len : BANNER_PREFIX;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: banner_hash
+ * DESCRIPTION	: This function will hash a whole payload,
+ *		: eight bytes at a time.
+ * INPUT	: 0 - Payload
+ *		: 1 - Payload Length
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+u_int64_t
+banner_hash (const u_char *data, int len)
+{
+    u_int64_t h = 0x9e3779b97f4a7c15ULL ^ (u_int64_t)len;
+    u_int64_t k;
+    int i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+	memcpy(&k, data + i, 8);
+	k *= 0x87c37b91114253d5ULL;
+	k = (k << 31) | (k >> 33);
+	h ^= k * 0x4cf5ad432745937fULL;
+	h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+    }
+
+    for (k = 0; i < len; i++)
+	k = (k << 8) | data[i];
+    h ^= k * 0x87c37b91114253d5ULL;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: lru_unlink
+ * DESCRIPTION	: This function will take a banner off of the
+ *		: LRU list.
+ * INPUT	: 0 - Banner Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+lru_unlink (u_int32_t i)
+{
+    Banner *b = &banner_pool[i];
+
+    if (b->lru_prev != BANNER_NIL)
+	banner_pool[b->lru_prev].lru_next = b->lru_next;
+    else
+	banner_lru_head = b->lru_next;
+
+    if (b->lru_next != BANNER_NIL)
+	banner_pool[b->lru_next].lru_prev = b->lru_prev;
+    else
+	banner_lru_tail = b->lru_prev;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: lru_push
+ * DESCRIPTION	: This function will place a banner at the head
+ *		: (most recently used end) of the LRU list.
+ * INPUT	: 0 - Banner Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+lru_push (u_int32_t i)
+{
+    Banner *b = &banner_pool[i];
+
+    b->lru_prev = BANNER_NIL;
+    b->lru_next = banner_lru_head;
+    if (banner_lru_head != BANNER_NIL)
+	banner_pool[banner_lru_head].lru_prev = i;
+    banner_lru_head = i;
+    if (banner_lru_tail == BANNER_NIL)
+	banner_lru_tail = i;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: banner_release
+ * DESCRIPTION	: This function will unlink a banner from its
+ *		: hash bucket and the LRU list and free the
+ *		: data it holds.
+ * INPUT	: 0 - Banner Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+banner_release (u_int32_t i)
+{
+    Banner *b = &banner_pool[i];
+    u_int32_t *link;
+
+    link = &banner_buckets[b->hash & banner_mask];
+    while (*link != i)
+	link = &banner_pool[*link].hnext;
+    *link = b->hnext;
+
+    lru_unlink(i);
+
+    slab_free(&banner_slab, b->data);
+    b->data = NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_banner_cache
+ * DESCRIPTION	: This function will allocate the banner cache.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_banner_cache (void)
+{
+    u_int32_t i;
+
+    banner_max = (gc.banner_cache > 0) ? gc.banner_cache : BANNER_CACHE_SIZE;
+
+    /* Use one bucket per banner, rounded up to a power of 2. */
+    for (i = 1; i < banner_max; i <<= 1);
+    banner_mask = i - 1;
+
+    banner_pool = (Banner *) calloc(banner_max, sizeof(Banner));
+    banner_buckets = (u_int32_t *) malloc((banner_mask + 1) * sizeof(u_int32_t));
+    if (banner_pool == NULL || banner_buckets == NULL)
+	err_message("Unable to allocate banner cache (%u banners)", banner_max);
+
+    memset(banner_buckets, 0xff, (banner_mask + 1) * sizeof(u_int32_t));
+    slab_init(&banner_slab, "Banners", BANNER_PREFIX, 0, 0);
+    banner_used = 0;
+    banner_lru_head = BANNER_NIL;
+    banner_lru_tail = BANNER_NIL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: banner_find
+ * DESCRIPTION	: This function will look up a payload in the
+ *		: banner cache.  The entry may be evicted by
+ *		: another worker at any time, so its result is
+ *		: copied out.
+ * INPUT	: 0 - Payload
+ *		: 1 - Payload Length
+ *		: 2 - Payload Hash (banner_hash)
+ *		: 3 - Matching Signature (set to NULL if none)
+ *		: 4 - Application string (set if there is a
+ *		:     signature)
+ *		: 5 - Growing (set to 1 if the result also
+ *		:     holds while more data is coming)
+ * RETURN	: 0 - Not Cached
+ *		: 1 - Cached
+ * ---------------------------------------------------------- */
+int
+banner_find (const u_char *data, int len, u_int64_t hash,
+	     Signature **sig, StrId *app, int *growing)
+{
+    Banner *b;
+    u_int32_t i;
+
+    if (banner_pool == NULL)
+	return 0;
+
+    pthread_mutex_lock(&banner_lock);
+    for (i = banner_buckets[hash & banner_mask]; i != BANNER_NIL; i = b->hnext) {
+	b = &banner_pool[i];
+	if (b->hash == hash && b->len == len && memcmp(b->data, data, banner_kept(len)) == 0) {
+	    if (banner_lru_head != i) {
+		lru_unlink(i);
+		lru_push(i);
+	    }
+	    *sig = b->sig;
+	    *app = b->app;
+	    *growing = b->growing;
+	    banner_stats.hits++;
+	    pthread_mutex_unlock(&banner_lock);
+	    return 1;
+	}
+    }
+
+    banner_stats.misses++;
+    pthread_mutex_unlock(&banner_lock);
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: banner_add
+ * DESCRIPTION	: This function will cache the result of
+ *		: matching a payload.  When the cache is full,
+ *		: the least recently used banner is dropped.
+ * INPUT	: 0 - Payload
+ *		: 1 - Payload Length
+ *		: 2 - Payload Hash (banner_hash)
+ *		: 3 - Matching Signature (or NULL)
+ *		: 4 - Application string (or STR_NONE)
+ *		: 5 - Growing (the result also holds while
+ *		:     more data is coming)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+banner_add (const u_char *data, int len, u_int64_t hash,
+	    Signature *sig, StrId app, int growing)
+{
+    Banner *b;
+    u_int32_t i;
+
+    if (banner_pool == NULL)
+	return;
+
+    pthread_mutex_lock(&banner_lock);
+    if (banner_used < banner_max) {
+	i = banner_used++;
+    } else {
+	i = banner_lru_tail;
+	banner_release(i);
+	banner_stats.evicted++;
+    }
+
+    b = &banner_pool[i];
+    b->data = (u_char *) slab_alloc(&banner_slab);
+    memcpy(b->data, data, banner_kept(len));
+    b->len = len;
+    b->hash = hash;
+    b->sig = sig;
+    b->app = app;
+    b->growing = growing;
+
+    b->hnext = banner_buckets[hash & banner_mask];
+    banner_buckets[hash & banner_mask] = i;
+    lru_push(i);
+    pthread_mutex_unlock(&banner_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_banner_stats
+ * DESCRIPTION	: This function will return the banner cache
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to BannerStats
+ * ---------------------------------------------------------- */
+BannerStats *
+get_banner_stats (void)
+{
+    return &banner_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_banner_cache
+ * DESCRIPTION	: This function will free the banner cache.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_banner_cache (void)
+{
+    if (banner_pool != NULL)
+	free(banner_pool);
+    slab_destroy(&banner_slab);
+    if (banner_buckets != NULL)
+	free(banner_buckets);
+
+    banner_pool = NULL;
+    banner_buckets = NULL;
+    banner_used = 0;
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
@@ -0,0 +1,70 @@
+/*************************************************************************
+ * banner.h
+ *
+ * This header file contains information relating to the banner.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_BANNER_H
+#define INCLUDED_BANNER_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define BANNER_CACHE_SIZE 4096      /* Default number of cached banners. */
+#define BANNER_PREFIX 512           /* Bytes of a payload kept for comparing. */
+#define BANNER_NIL 0xffffffff       /* Empty entry index. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * Banner:  The result of running the signatures against a payload, keyed on
+ * its length and hash.  A NULL signature means that nothing matched.
+ * -------------------------------------------------------------------------- */
+typedef struct _Banner
+{
+    u_int64_t hash;             /* Payload Hash (all bytes) */
+    u_char *data;               /* First BANNER_PREFIX bytes of the payload */
+    int len;                    /* Payload Length */
+    Signature *sig;             /* Matching Signature (or NULL) */
+    StrId app;                  /* Application string built from the match. */
+    int growing;                /* Result holds for a stream still growing. */
+    u_int32_t hnext;            /* Next banner in hash bucket */
+    u_int32_t lru_prev;         /* Next most recently used banner */
+    u_int32_t lru_next;         /* Next least recently used banner */
+} Banner;
+
+/* --------------------------------------------------------------------------
+ * BannerStats:  Banner cache counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _BannerStats
+{
+    unsigned long hits;         /* Payloads answered from the cache. */
+    unsigned long misses;       /* Payloads that had to be matched. */
+    unsigned long evicted;      /* Banners dropped because the cache was full. */
+} BannerStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_banner_cache (void);
+u_int64_t banner_hash (const u_char *data, int len);
+int banner_find (const u_char *data, int len, u_int64_t hash, Signature **sig, StrId *app, int *growing);
+void banner_add (const u_char *data, int len, u_int64_t hash, Signature *sig, StrId app, int growing);
+BannerStats *get_banner_stats (void);
+void end_banner_cache (void);
+
+#endif /* INCLUDED_BANNER_H */
@@ -0,0 +1,205 @@
+/*************************************************************************
+ * batch.c
+ *
+ * This module hands packets to the decoders in batches.  Instead of decoding
+ * and processing each packet on its own, up to BATCH_SIZE packets are
+ * collected and then worked on in passes:
+ *
+ *   1. Every packet is decoded (link layer, IP, TCP / UDP / ICMP) into a small
+ *      Decoded record while the headers of the next packets are prefetched,
+ *      and is put in a group by what it will be used for.
+ *   2. The pending filter blocks and flow table buckets of the whole data
+ *      segment group, and the pending filter blocks of the UDP group, are
+ *      prefetched.
+ *   3. The groups are processed one after the other:  ARP, ICMP, SYN-ACK,
+ *      data segments, FIN / RST, neighbor advertisements, UDP.
+ *
+ * The cache misses of a batch overlap instead of being taken one after the
+ * other.  Packets within a group keep their order.  The packets of one TCP
+ * connection are never reordered:  when a packet would be processed before
+ * an earlier packet of the same 4-tuple (data after its FIN, or the SYN-ACK
+ * of a reused port pair), the packets collected before it are processed
+ * first.
+ *
+ * The packet data is not copied, so every capture backend calls
+ * batch_flush() before it gives the packet memory back.  Each thread has
+ * its own batch.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include "batch.h"
+#include "flow.h"
+#include "pending.h"
+#include "util.h"
+
+/* Variable Declarations */
+static __thread Batch batch;            /* Packets collected by this thread */
+static unsigned int batch_max;          /* Packets per batch */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_batch
+ * DESCRIPTION	: This function will set the batch size.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_batch (void)
+{
+    batch_max = (gc.batch_size > 0 && gc.batch_size < BATCH_SIZE) ? gc.batch_size : BATCH_SIZE;
+    verbose_message("Batching:  %u packets", batch_max);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: batch_add
+ * DESCRIPTION	: This function will add a packet to the
+ *		: current thread's batch, and process the batch
+ *		: once it is full.  The packet must stay valid
+ *		: until batch_flush() has been called.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+batch_add (const struct pcap_pkthdr *pkthdr, const u_char *packet)
+{
+    BatchEntry *e = &batch.entry[batch.count];
+
+    /* The headers are needed in the first pass. */
+    __builtin_prefetch(packet, 0, 1);
+
+    e->hdr = *pkthdr;
+    e->packet = packet;
+
+    if (++batch.count >= batch_max)
+	batch_flush();
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: batch_reorders
+ * DESCRIPTION	: This function will check whether grouping a
+ *		: packet would move it ahead of an earlier
+ *		: packet of the same TCP connection.
+ * INPUT	: 0 - First Entry of the Run
+ *		: 1 - Entry to Check
+ * RETURN	: 1 - It would be reordered
+ *		: 0 - It would not
+ * ---------------------------------------------------------- */
+static int
+batch_reorders (unsigned int start, unsigned int i)
+{
+    const Decoded *d = &batch.entry[i].d;
+    const Decoded *p;
+    unsigned int j;
+
+    /* Only the TCP groups share flow state;  nothing runs after a FIN. */
+    if (d->action != PKT_SYNACK && d->action != PKT_DATA)
+	return 0;
+
+    for (j = start; j < i; j++) {
+	p = &batch.entry[j].d;
+	if (p->action <= d->action || p->action > PKT_CLOSE)
+	    continue;
+
+	/* A FIN / RST may come from either side. */
+	if ((p->ip_src.s_addr == d->ip_src.s_addr && p->sport == d->sport
+		    && p->ip_dst.s_addr == d->ip_dst.s_addr && p->dport == d->dport)
+		|| (p->ip_src.s_addr == d->ip_dst.s_addr && p->sport == d->dport
+		    && p->ip_dst.s_addr == d->ip_src.s_addr && p->dport == d->sport))
+	    return 1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: batch_run
+ * DESCRIPTION	: This function will process a run of decoded
+ *		: packets, one group after the other.
+ * INPUT	: 0 - Entries per Group
+ *		: 1 - Number of Entries per Group
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+batch_run (u_int8_t group[PKT_ACTIONS][BATCH_SIZE], unsigned int count[PKT_ACTIONS])
+{
+    unsigned int i, a;
+    BatchEntry *e;
+
+    /* Start loading what the data segments will look up. */
+    for (i = 0; i < count[PKT_DATA]; i++) {
+	e = &batch.entry[group[PKT_DATA][i]];
+	pending_prefetch(e->d.ip_src, e->d.sport, IPPROTO_TCP);
+	flow_prefetch(e->d.ip_src, e->d.sport, e->d.ip_dst, e->d.dport);
+    }
+    for (i = 0; i < count[PKT_UDP]; i++) {
+	e = &batch.entry[group[PKT_UDP][i]];
+	pending_prefetch(e->d.ip_src, e->d.sport, IPPROTO_UDP);
+    }
+
+    /* Process the groups in order. */
+    for (a = PKT_NONE + 1; a < PKT_ACTIONS; a++) {
+	for (i = 0; i < count[a]; i++) {
+	    e = &batch.entry[group[a][i]];
+	    process_decoded(&e->hdr, e->packet, &e->d);
+	}
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: batch_flush
+ * DESCRIPTION	: This function will process the packets in the
+ *		: current thread's batch.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+batch_flush (void)
+{
+    u_int8_t group[PKT_ACTIONS][BATCH_SIZE];
+    unsigned int count[PKT_ACTIONS];
+    unsigned int i, a, start;
+    BatchEntry *e;
+
+    if (batch.count == 0)
+	return;
+
+    /* Decode everything and sort it into groups. */
+    memset(count, 0, sizeof(count));
+    for (i = start = 0; i < batch.count; i++) {
+	if (i + BATCH_PREFETCH < batch.count)
+	    __builtin_prefetch(batch.entry[i + BATCH_PREFETCH].packet + 64, 0, 1);
+
+	e = &batch.entry[i];
+	decode_packet(&e->hdr, e->packet, &e->d);
+
+	/* Keep the connection in order:  finish the run so far. */
+	if (batch_reorders(start, i)) {
+	    batch_run(group, count);
+	    memset(count, 0, sizeof(count));
+	    start = i;
+	}
+
+	a = e->d.action;
+	group[a][count[a]++] = i;
+    }
+
+    batch_run(group, count);
+    batch.count = 0;
+}
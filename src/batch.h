@@ -0,0 +1,59 @@
+/*************************************************************************
+ * batch.h
+ *
+ * This header file contains information relating to the batch.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_BATCH_H
+#define INCLUDED_BATCH_H
+
+#include "global.h"
+#include "packet.h"
+
+/* DEFINES ----------------------------------------- */
+#define BATCH_SIZE 64               /* Largest (and default) batch. */
+#define BATCH_PREFETCH 4            /* Packets decoded ahead of a prefetch. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * BatchEntry:  One packet waiting in a batch.
+ * -------------------------------------------------------------------------- */
+typedef struct _BatchEntry
+{
+    struct pcap_pkthdr hdr;     /* Packet Header (copied) */
+    const u_char *packet;       /* Packet Data (owned by the capture backend) */
+    Decoded d;                  /* Decoded Headers */
+} BatchEntry;
+
+/* --------------------------------------------------------------------------
+ * Batch:  The packets a thread has collected so far.
+ * -------------------------------------------------------------------------- */
+typedef struct _Batch
+{
+    BatchEntry entry[BATCH_SIZE];
+    unsigned int count;
+} Batch;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_batch (void);
+void batch_add (const struct pcap_pkthdr *pkthdr, const u_char *packet);
+void batch_flush (void);
+
+#endif /* INCLUDED_BATCH_H */
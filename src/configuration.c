@@ -29,6 +29,7 @@
 #include "global.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include "util.h"
 #include "bstring/util.h"
@@ -132,6 +133,26 @@ void parse_line (bstring line)
         /* SIGNATURE FILE */
         gc.sig_file = bstrcpy(value);
    
+    } else if ((biseqcstr(param, "snapshot_file")) == 1) {
+        /* SNAPSHOT FILE */
+        gc.snapshot_file = bstrcpy(value);
+
+    } else if ((biseqcstr(param, "snapshot_interval")) == 1) {
+        /* SNAPSHOT INTERVAL */
+        gc.snapshot_interval = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "wal_file")) == 1) {
+        /* WRITE-AHEAD LOG FILE */
+        gc.wal_file = bstrcpy(value);
+
+    } else if ((biseqcstr(param, "wal_sync")) == 1) {
+        /* WRITE-AHEAD LOG SYNC INTERVAL */
+        gc.wal_sync = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "wal_max")) == 1) {
+        /* WRITE-AHEAD LOG SIZE */
+        gc.wal_max = strtoul(bdata(value), NULL, 10);
+
     } else if ((biseqcstr(param, "mac_file")) == 1) {
         /* MAC / VENDOR RESOLUTION FILE */
         gc.mac_file = bstrcpy(value);
@@ -160,6 +181,137 @@ void parse_line (bstring line)
         /* NETWORK */
         parse_networks(bdata(value));
 
+    } else if ((biseqcstr(param, "pcre_jit")) == 1) {
+        /* PCRE JIT */
+        if (value->data[0] == '0')
+            gc.disable_jit = 1;
+        else
+            gc.disable_jit = 0;
+
+    } else if ((biseqcstr(param, "capture")) == 1) {
+        /* CAPTURE BACKEND */
+        if (biseqcstr(value, "tpacket") == 1)
+            gc.capture = CAPTURE_TPACKET;
+        else if (biseqcstr(value, "xdp") == 1)
+            gc.capture = CAPTURE_XDP;
+        else
+            gc.capture = CAPTURE_PCAP;
+
+    } else if ((biseqcstr(param, "encapsulation")) == 1) {
+        /* ETHERNET ENCAPSULATION */
+        if (biseqcstr(value, "eth") == 1)
+            gc.encap = ENCAP_ETH;
+        else if (biseqcstr(value, "vlan") == 1)
+            gc.encap = ENCAP_VLAN;
+        else if (biseqcstr(value, "qinq") == 1)
+            gc.encap = ENCAP_QINQ;
+        else if (biseqcstr(value, "mpls") == 1)
+            gc.encap = ENCAP_MPLS;
+        else if (biseqcstr(value, "gre") == 1 || biseqcstr(value, "erspan") == 1)
+            gc.encap = ENCAP_GRE;
+        else if (biseqcstr(value, "vxlan") == 1)
+            gc.encap = ENCAP_VXLAN;
+        else
+            gc.encap = ENCAP_AUTO;
+
+    } else if ((biseqcstr(param, "tpacket_block_size")) == 1) {
+        /* TPACKET BLOCK SIZE */
+        gc.tpacket_block_size = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "tpacket_block_count")) == 1) {
+        /* TPACKET BLOCK COUNT */
+        gc.tpacket_block_count = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "tpacket_snaplen")) == 1) {
+        /* TPACKET SNAPLEN */
+        gc.tpacket_snaplen = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "tpacket_timeout")) == 1) {
+        /* TPACKET BLOCK TIMEOUT */
+        gc.tpacket_timeout = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "xdp_frames")) == 1) {
+        /* AF_XDP UMEM FRAMES */
+        gc.xdp_frames = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "ebpf")) == 1) {
+        /* EBPF SOCKET FILTER */
+        if (value->data[0] == '1')
+            gc.ebpf = 1;
+        else
+            gc.ebpf = 0;
+
+    } else if ((biseqcstr(param, "ebpf_map_size")) == 1) {
+        /* EBPF MAP SIZE */
+        gc.ebpf_map_size = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "workers")) == 1) {
+        /* WORKER THREADS */
+        gc.workers = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "ring_slots")) == 1) {
+        /* CAPTURE RING SIZE */
+        gc.ring_slots = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "ring_snaplen")) == 1) {
+        /* CAPTURE RING SNAPLEN */
+        gc.ring_snaplen = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "batch_size")) == 1) {
+        /* DECODE BATCH SIZE */
+        gc.batch_size = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "banner_cache")) == 1) {
+        /* BANNER CACHE SIZE */
+        gc.banner_cache = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "flow_max")) == 1) {
+        /* FLOW TABLE SIZE */
+        gc.flow_max = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "flow_timeout")) == 1) {
+        /* FLOW TIMEOUT */
+        gc.flow_timeout = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "reassembly")) == 1) {
+        /* TCP REASSEMBLY */
+        if (value->data[0] == '0')
+            gc.disable_reasm = 1;
+        else
+            gc.disable_reasm = 0;
+
+    } else if ((biseqcstr(param, "reassembly_size")) == 1) {
+        /* TCP REASSEMBLY SIZE */
+        gc.reassembly_size = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "asset_ttl")) == 1) {
+        /* ASSET TIME TO LIVE */
+        gc.asset_ttl = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "asset_ttl_tcp")) == 1) {
+        /* TCP ASSET TIME TO LIVE */
+        gc.asset_ttl_tcp = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "asset_ttl_udp")) == 1) {
+        /* UDP ASSET TIME TO LIVE */
+        gc.asset_ttl_udp = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "asset_ttl_icmp")) == 1) {
+        /* ICMP ASSET TIME TO LIVE */
+        gc.asset_ttl_icmp = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "arp_ttl")) == 1) {
+        /* ARP ENTRY TIME TO LIVE */
+        gc.arp_ttl = atoi(bdata(value));
+
+    } else if ((biseqcstr(param, "asset_max")) == 1) {
+        /* ASSET LIMIT */
+        gc.asset_max = strtoul(bdata(value), NULL, 10);
+
+    } else if ((biseqcstr(param, "arp_max")) == 1) {
+        /* ARP ENTRY LIMIT */
+        gc.arp_max = strtoul(bdata(value), NULL, 10);
+
     }
 
     verbose_message("config - PARAM:  |%s| / VALUE:  |%s|", bdata(param), bdata(value));
@@ -0,0 +1,657 @@
+/*************************************************************************
+ * ebpf.c
+ *
+ * This module replaces the classic socket filter of the tpacket sockets
+ * with an eBPF program.  The program passes the same packets as the
+ * filter built by packet_filter(), except that data segments sent by
+ * endpoints that have been identified are dropped in the kernel:  a
+ * hash map holds every TCP endpoint whose identification attempts are
+ * used up, and the storage module keeps it up to date.  Without it every
+ * payload packet of a known server still crosses into userspace just to
+ * be thrown away by the pending filter.
+ *
+ * The map holds the endpoints that are done rather than the ones that
+ * are pending.  An endpoint that is not in the map is passed, so the
+ * first segments of a connection are never lost while its SYN-ACK is
+ * still waiting in the ring, and a full map only costs performance.
+ *
+ * The module also provides the XDP program used by the AF_XDP capture
+ * backend, which does nothing but hand each packet to the socket of its
+ * receive queue.
+ *
+ * The programs are assembled here and loaded with the bpf() system call,
+ * so there is no need for a compiler or a loader library at run time.
+ * Loading them needs root (or CAP_BPF), as does updating the maps.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_EBPF
+#include <stddef.h>
+#include <sys/syscall.h>
+#include <netinet/tcp.h>
+#include <linux/if_link.h>
+/* libpcap already has a (classic) struct bpf_insn. */
+#define bpf_insn ebpf_insn
+#include <linux/bpf.h>
+#undef bpf_insn
+#endif /* HAVE_EBPF */
+
+#include "ebpf.h"
+#include "identification.h"
+#include "monnet.h"
+#include "ip6.h"
+#include "util.h"
+
+#ifdef HAVE_EBPF
+
+/* Instruction encoding (see linux/bpf.h). */
+#define INSN(c, d, s, o, i) \
+    ((struct ebpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#define MOV64_REG(d, s)     INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define MOV64_IMM(d, i)     INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define MOV32_IMM(d, i)     INSN(BPF_ALU | BPF_MOV | BPF_K, d, 0, 0, i)
+#define ALU64_IMM(op, d, i) INSN(BPF_ALU64 | (op) | BPF_K, d, 0, 0, i)
+#define ALU64_REG(op, d, s) INSN(BPF_ALU64 | (op) | BPF_X, d, s, 0, 0)
+#define ALU32_IMM(op, d, i) INSN(BPF_ALU | (op) | BPF_K, d, 0, 0, i)
+#define LD_ABS(sz, i)       INSN(BPF_LD | (sz) | BPF_ABS, 0, 0, 0, i)
+#define LD_IND(sz, s, i)    INSN(BPF_LD | (sz) | BPF_IND, 0, s, 0, i)
+#define STX_W(d, s, o)      INSN(BPF_STX | BPF_W | BPF_MEM, d, s, o, 0)
+#define JMP_IMM(op, d, i)   INSN(BPF_JMP | (op) | BPF_K, d, 0, 0, i)
+#define JMP_REG(op, d, s)   INSN(BPF_JMP | (op) | BPF_X, d, s, 0, 0)
+#define JA                  INSN(BPF_JMP | BPF_JA, 0, 0, 0, 0)
+#define CALL(f)             INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define EXIT                INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+/* Registers:  r6 packet (needed by LD_ABS/LD_IND), r7 IP header, r8 TCP header. */
+#define R_PKT 6
+#define R_L3 7
+#define R_L4 8
+#define R_LEN 9
+
+/* Jump targets resolved once the program is complete. */
+enum { L_PASS, L_DROP, L_LOCAL, L_TCP, L_DATA, L_COUNT };
+
+/* --------------------------------------------------------------------------
+ * EbpfKey:  Map key.  Both fields are in host byte order, as LD_ABS and
+ *           LD_IND load them.
+ * -------------------------------------------------------------------------- */
+typedef struct _EbpfKey
+{
+    u_int32_t ip;
+    u_int32_t port;
+} EbpfKey;
+
+/* Variable Declarations */
+int ebpf_map_fd = -1;               /* Identified endpoints */
+int ebpf_prog_fd = -1;              /* Socket filter */
+EbpfStats ebpf_stats;
+int ebpf_xsk_map_fd = -1;           /* AF_XDP sockets by receive queue */
+int ebpf_xsk_link_fd = -1;          /* XDP program attached to the interface */
+
+struct ebpf_insn *ebpf_insns;       /* Program being assembled */
+int ebpf_len;
+int ebpf_labels[L_COUNT];
+int ebpf_fixups[EBPF_INSNS][2];     /* (instruction, label) still to patch */
+int ebpf_nfixups;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: sys_bpf
+ * DESCRIPTION	: This function will call bpf(2).
+ * INPUT	: 0 - Command
+ *		: 1 - Attributes
+ * RETURN	: System call result
+ * ---------------------------------------------------------- */
+static int
+sys_bpf (int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_load
+ * DESCRIPTION	: This function will load a program.  When the
+ *		: verifier refuses it, its reasons are logged
+ *		: in verbose mode.
+ * INPUT	: 0 - Program Type
+ *		: 1 - Expected Attach Type
+ *		: 2 - Instructions
+ *		: 3 - Number of Instructions
+ * RETURN	: Program file descriptor (-1 = error)
+ * ---------------------------------------------------------- */
+static int
+ebpf_load (int type, int attach, struct ebpf_insn *insns, int len)
+{
+    union bpf_attr attr;
+    char *log;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = type;
+    attr.expected_attach_type = attach;
+    attr.insns = (unsigned long) insns;
+    attr.insn_cnt = len;
+    attr.license = (unsigned long) "GPL";
+    if ((fd = sys_bpf(BPF_PROG_LOAD, &attr)) >= 0)
+	return fd;
+
+    log_message("WARNING:  ebpf:  unable to load program (%s)\n", strerror(errno));
+
+    /* Ask the verifier why. */
+    if (gc.verbose && (log = (char *) calloc(1, 65536)) != NULL) {
+	attr.log_buf = (unsigned long) log;
+	attr.log_size = 65536;
+	attr.log_level = 1;
+	sys_bpf(BPF_PROG_LOAD, &attr);
+	log_message("%s\n", log);
+	free(log);
+    }
+
+    return -1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: emit
+ * DESCRIPTION	: This function will append an instruction to
+ *		: the program.  A label other than -1 makes it
+ *		: a jump to that label.
+ * INPUT	: 0 - Instruction
+ *		: 1 - Label (-1 = none)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+emit (struct ebpf_insn insn, int label)
+{
+    if (ebpf_len >= EBPF_INSNS)
+	return;
+
+    if (label >= 0) {
+	ebpf_fixups[ebpf_nfixups][0] = ebpf_len;
+	ebpf_fixups[ebpf_nfixups][1] = label;
+	ebpf_nfixups++;
+    }
+    ebpf_insns[ebpf_len++] = insn;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_assemble
+ * DESCRIPTION	: This function will assemble the socket
+ *		: filter.  Packets are passed when
+ *		:   - they are ARP replies, or
+ *		:   - they come from a monitored network and
+ *		:     are ICMP echo replies, TCP SYN-ACKs,
+ *		:     FINs or RSTs, TCP data segments from
+ *		:     an endpoint that is not in the map, or
+ *		:     UDP datagrams from a UDP signature port,
+ *		:     or
+ *		:   - they are QinQ, MPLS, GRE, VXLAN or IPv6
+ *		:     packets, which are left to userspace.
+ *		: One 802.1Q tag is skipped.
+ * INPUT	: 0 - Snaplen
+ * RETURN	: Number of instructions (-1 on overflow)
+ * ---------------------------------------------------------- */
+static int
+ebpf_assemble (int snaplen)
+{
+    struct mon_net *net;
+    UdpPort *ports;
+    unsigned int count;
+    int nets, i;
+
+    ebpf_len = 0;
+    ebpf_nfixups = 0;
+
+    /* Ethernet */
+    emit(MOV64_REG(R_PKT, BPF_REG_1), -1);
+    emit(MOV64_IMM(R_L3, 14), -1);
+    emit(LD_ABS(BPF_H, 12), -1);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, 0x8100), -1);
+    ebpf_insns[ebpf_len - 1].off = 2;
+    emit(MOV64_IMM(R_L3, 18), -1);
+    emit(LD_ABS(BPF_H, 16), -1);
+
+    /* QinQ, MPLS and IPv6 */
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0x8100), L_PASS);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0x88a8), L_PASS);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0x9100), L_PASS);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0x8847), L_PASS);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0x86dd), L_PASS);
+
+    /* ARP replies */
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, 0x0806), -1);
+    ebpf_insns[ebpf_len - 1].off = 3;
+    emit(LD_IND(BPF_H, R_L3, 6), -1);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 2), L_PASS);
+    emit(JA, L_DROP);
+
+    /* IPv4, first fragment only */
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, 0x0800), L_DROP);
+    emit(LD_IND(BPF_B, R_L3, 0), -1);
+    emit(ALU64_IMM(BPF_AND, BPF_REG_0, 0x0f), -1);
+    emit(ALU64_IMM(BPF_LSH, BPF_REG_0, 2), -1);
+    emit(MOV64_REG(R_L4, R_L3), -1);
+    emit(ALU64_REG(BPF_ADD, R_L4, BPF_REG_0), -1);
+    emit(LD_IND(BPF_H, R_L3, 6), -1);
+    emit(ALU64_IMM(BPF_AND, BPF_REG_0, 0x1fff), -1);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, 0), L_DROP);
+
+    /* GRE and VXLAN (UDP port 4789) */
+    emit(LD_IND(BPF_B, R_L3, 9), -1);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, IPPROTO_GRE), L_PASS);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, IPPROTO_UDP), -1);
+    ebpf_insns[ebpf_len - 1].off = 2;
+    emit(LD_IND(BPF_H, R_L4, 2), -1);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 4789), L_PASS);
+
+    /* The source address is the first half of the key. */
+    emit(LD_IND(BPF_W, R_L3, 12), -1);
+    emit(STX_W(BPF_REG_10, BPF_REG_0, -8), -1);
+
+    /* Monitored networks (too many are left to userspace). */
+    for (nets = 0, net = mn; net != NULL; net = net->next)
+	nets++;
+    if (nets > 0 && nets <= EBPF_NETWORKS) {
+	for (net = mn; net != NULL; net = net->next) {
+	    emit(MOV64_REG(BPF_REG_1, BPF_REG_0), -1);
+	    emit(ALU32_IMM(BPF_AND, BPF_REG_1, (int)ntohl(net->netmask)), -1);
+	    emit(MOV32_IMM(BPF_REG_2, (int)ntohl(net->network)), -1);
+	    emit(JMP_REG(BPF_JEQ, BPF_REG_1, BPF_REG_2), L_LOCAL);
+	}
+	emit(JA, L_DROP);
+    } else if (nets == 0 && mn6 != NULL) {
+	/* Only IPv6 networks are monitored. */
+	emit(JA, L_DROP);
+    }
+    ebpf_labels[L_LOCAL] = ebpf_len;
+
+    /* ICMP echo replies */
+    emit(LD_IND(BPF_B, R_L3, 9), -1);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, IPPROTO_ICMP), -1);
+    ebpf_insns[ebpf_len - 1].off = 3;
+    emit(LD_IND(BPF_B, R_L4, 0), -1);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, 0), L_PASS);
+    emit(JA, L_DROP);
+
+    /* UDP from the ports of the UDP signatures (too many are left to
+     * userspace). */
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, IPPROTO_UDP), L_TCP);
+    ports = get_udp_ports(&count);
+    if (count <= EBPF_UDP_PORTS) {
+	emit(LD_IND(BPF_H, R_L4, 0), -1);
+	for (i = 0; i < count; i++)
+	    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, ports[i].port), L_PASS);
+	emit(JA, L_DROP);
+    } else {
+	emit(JA, L_PASS);
+    }
+    ebpf_labels[L_TCP] = ebpf_len;
+
+    /* TCP:  SYN-ACK, FIN and RST always pass. */
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, IPPROTO_TCP), L_DROP);
+    emit(LD_IND(BPF_B, R_L4, 13), -1);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, TH_SYN | TH_ACK), L_PASS);
+    emit(MOV64_REG(BPF_REG_1, BPF_REG_0), -1);
+    emit(ALU64_IMM(BPF_AND, BPF_REG_1, TH_FIN | TH_RST), -1);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_1, 0), L_PASS);
+    emit(JMP_IMM(BPF_JEQ, BPF_REG_0, TH_ACK), L_DATA);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, TH_ACK | TH_PUSH), L_DROP);
+
+    /* TCP data:  total length - IP header - TCP header > 0 */
+    ebpf_labels[L_DATA] = ebpf_len;
+    emit(LD_IND(BPF_H, R_L3, 2), -1);
+    emit(MOV64_REG(R_LEN, BPF_REG_0), -1);
+    emit(ALU64_REG(BPF_ADD, R_LEN, R_L3), -1);
+    emit(ALU64_REG(BPF_SUB, R_LEN, R_L4), -1);
+    emit(LD_IND(BPF_B, R_L4, 12), -1);
+    emit(ALU64_IMM(BPF_RSH, BPF_REG_0, 4), -1);
+    emit(ALU64_IMM(BPF_LSH, BPF_REG_0, 2), -1);
+    emit(ALU64_REG(BPF_SUB, R_LEN, BPF_REG_0), -1);
+    emit(JMP_IMM(BPF_JSLE, R_LEN, 0), L_DROP);
+
+    /* ... from an endpoint that has not been identified yet. */
+    emit(LD_IND(BPF_H, R_L4, 0), -1);
+    emit(STX_W(BPF_REG_10, BPF_REG_0, -4), -1);
+    emit(INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, ebpf_map_fd), -1);
+    emit(INSN(0, 0, 0, 0, 0), -1);
+    emit(MOV64_REG(BPF_REG_2, BPF_REG_10), -1);
+    emit(ALU64_IMM(BPF_ADD, BPF_REG_2, -8), -1);
+    emit(CALL(BPF_FUNC_map_lookup_elem), -1);
+    emit(JMP_IMM(BPF_JNE, BPF_REG_0, 0), L_DROP);
+
+    /* The return value is the number of bytes kept. */
+    ebpf_labels[L_PASS] = ebpf_len;
+    emit(MOV64_IMM(BPF_REG_0, snaplen), -1);
+    emit(EXIT, -1);
+    ebpf_labels[L_DROP] = ebpf_len;
+    emit(MOV64_IMM(BPF_REG_0, 0), -1);
+    emit(EXIT, -1);
+
+    if (ebpf_len >= EBPF_INSNS)
+	return -1;
+
+    for (i = 0; i < ebpf_nfixups; i++)
+	ebpf_insns[ebpf_fixups[i][0]].off =
+	    ebpf_labels[ebpf_fixups[i][1]] - ebpf_fixups[i][0] - 1;
+
+    return ebpf_len;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_ebpf
+ * DESCRIPTION	: This function will create the endpoint map
+ *		: and load the socket filter.
+ * INPUT	: 0 - Snaplen
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+init_ebpf (int snaplen)
+{
+    union bpf_attr attr;
+    unsigned int size;
+    int len;
+
+    memset(&ebpf_stats, 0, sizeof(EbpfStats));
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_HASH;
+    attr.key_size = sizeof(EbpfKey);
+    attr.value_size = sizeof(u_int32_t);
+    attr.max_entries = size = (gc.ebpf_map_size > 0) ? gc.ebpf_map_size : EBPF_MAP_SIZE;
+    if ((ebpf_map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+	log_message("WARNING:  ebpf:  unable to create map (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    if ((ebpf_insns = (struct ebpf_insn *) calloc(EBPF_INSNS, sizeof(struct ebpf_insn))) == NULL)
+	err_message("Unable to allocate eBPF program");
+    if ((len = ebpf_assemble(snaplen)) == -1) {
+	log_message("WARNING:  ebpf:  program too large\n");
+	end_ebpf();
+	return -1;
+    }
+
+    if ((ebpf_prog_fd = ebpf_load(BPF_PROG_TYPE_SOCKET_FILTER, 0, ebpf_insns, len)) < 0) {
+	end_ebpf();
+	return -1;
+    }
+
+    verbose_message("ebpf:  %d instructions, %u endpoints", len, size);
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_program
+ * DESCRIPTION	: This function will return the loaded socket
+ *		: filter.
+ * INPUT	: None!
+ * RETURN	: Program file descriptor (-1 = none)
+ * ---------------------------------------------------------- */
+int
+ebpf_program (void)
+{
+    return ebpf_prog_fd;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_identified
+ * DESCRIPTION	: This function will let the kernel drop the
+ *		: data segments of an endpoint.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ebpf_identified (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    union bpf_attr attr;
+    EbpfKey key;
+    u_int32_t value = 1;
+
+    /* The map only knows IPv4 endpoints. */
+    if (ebpf_map_fd < 0 || proto != IPPROTO_TCP || IP6_KEY(ip_addr))
+	return;
+
+    key.ip = ntohl(ip_addr.s_addr);
+    key.port = ntohs(port);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ebpf_map_fd;
+    attr.key = (unsigned long) &key;
+    attr.value = (unsigned long) &value;
+    attr.flags = BPF_NOEXIST;
+
+    /* Updates are serialized by the storage lock. */
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) == 0) {
+	ebpf_stats.inserts++;
+	ebpf_stats.entries++;
+    } else if (errno != EEXIST) {
+	ebpf_stats.errors++;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_pending
+ * DESCRIPTION	: This function will let the data segments of
+ *		: an endpoint through again.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ebpf_pending (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    union bpf_attr attr;
+    EbpfKey key;
+
+    /* The map only knows IPv4 endpoints. */
+    if (ebpf_map_fd < 0 || proto != IPPROTO_TCP || IP6_KEY(ip_addr))
+	return;
+
+    key.ip = ntohl(ip_addr.s_addr);
+    key.port = ntohs(port);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ebpf_map_fd;
+    attr.key = (unsigned long) &key;
+
+    if (sys_bpf(BPF_MAP_DELETE_ELEM, &attr) == 0) {
+	ebpf_stats.deletes++;
+	ebpf_stats.entries--;
+    } else if (errno != ENOENT) {
+	ebpf_stats.errors++;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_xsk_attach
+ * DESCRIPTION	: This function will attach an XDP program to an
+ *		: interface that redirects every packet to the
+ *		: AF_XDP socket of its receive queue.  Queues
+ *		: without a socket pass their packets on to the
+ *		: kernel.  Native (driver) mode is tried first,
+ *		: generic (SKB) mode second.
+ * INPUT	: 0 - Interface Index
+ *		: 1 - Number of Queues
+ * RETURN	: 1 - Native Mode
+ *		: 0 - Generic Mode
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+ebpf_xsk_attach (int ifindex, int queues)
+{
+    struct ebpf_insn prog[6];
+    union bpf_attr attr;
+    int prog_fd, native;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(u_int32_t);
+    attr.value_size = sizeof(u_int32_t);
+    attr.max_entries = queues;
+    if ((ebpf_xsk_map_fd = sys_bpf(BPF_MAP_CREATE, &attr)) < 0) {
+	log_message("WARNING:  ebpf:  unable to create XSK map (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    /* return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS); */
+    prog[0] = INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1,
+		   offsetof(struct xdp_md, rx_queue_index), 0);
+    prog[1] = INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, ebpf_xsk_map_fd);
+    prog[2] = INSN(0, 0, 0, 0, 0);
+    prog[3] = MOV64_IMM(BPF_REG_3, XDP_PASS);
+    prog[4] = CALL(BPF_FUNC_redirect_map);
+    prog[5] = EXIT;
+    if ((prog_fd = ebpf_load(BPF_PROG_TYPE_XDP, BPF_XDP, prog, 6)) < 0) {
+	ebpf_xsk_detach();
+	return -1;
+    }
+
+    /* The link goes away with us, and takes the program along. */
+    for (native = 1; native >= 0; native--) {
+	memset(&attr, 0, sizeof(attr));
+	attr.link_create.prog_fd = prog_fd;
+	attr.link_create.target_ifindex = ifindex;
+	attr.link_create.attach_type = BPF_XDP;
+	attr.link_create.flags = native ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+	if ((ebpf_xsk_link_fd = sys_bpf(BPF_LINK_CREATE, &attr)) >= 0)
+	    break;
+    }
+    close(prog_fd);
+
+    if (ebpf_xsk_link_fd < 0) {
+	log_message("WARNING:  ebpf:  unable to attach XDP program (%s)\n", strerror(errno));
+	ebpf_xsk_detach();
+	return -1;
+    }
+
+    return native;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_xsk_add
+ * DESCRIPTION	: This function will make an AF_XDP socket the
+ *		: destination of a receive queue.
+ * INPUT	: 0 - Queue
+ *		: 1 - Bound AF_XDP Socket
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+ebpf_xsk_add (int queue, int fd)
+{
+    union bpf_attr attr;
+    u_int32_t key = queue, value = fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ebpf_xsk_map_fd;
+    attr.key = (unsigned long) &key;
+    attr.value = (unsigned long) &value;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+	log_message("WARNING:  ebpf:  unable to add socket to XSK map (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ebpf_xsk_detach
+ * DESCRIPTION	: This function will detach the XDP program and
+ *		: release the map.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ebpf_xsk_detach (void)
+{
+    if (ebpf_xsk_link_fd >= 0)
+	close(ebpf_xsk_link_fd);
+    if (ebpf_xsk_map_fd >= 0)
+	close(ebpf_xsk_map_fd);
+    ebpf_xsk_link_fd = -1;
+    ebpf_xsk_map_fd = -1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_ebpf_stats
+ * DESCRIPTION	: This function will return the map counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to EbpfStats
+ * ---------------------------------------------------------- */
+EbpfStats *
+get_ebpf_stats (void)
+{
+    return &ebpf_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_ebpf
+ * DESCRIPTION	: This function will release the program and
+ *		: the map.  Sockets that still have the program
+ *		: attached keep it alive.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_ebpf (void)
+{
+    if (ebpf_prog_fd >= 0)
+	close(ebpf_prog_fd);
+    if (ebpf_map_fd >= 0)
+	close(ebpf_map_fd);
+    ebpf_prog_fd = -1;
+    ebpf_map_fd = -1;
+
+    if (ebpf_insns != NULL)
+	free(ebpf_insns);
+    ebpf_insns = NULL;
+}
+
+#else /* HAVE_EBPF */
+
+EbpfStats ebpf_stats;
+
+int
+init_ebpf (int snaplen)
+{
+    log_message("WARNING:  ebpf:  not supported on this system\n");
+    return -1;
+}
+
+int ebpf_program (void) { return -1; }
+void ebpf_identified (struct in_addr ip_addr, u_int16_t port, unsigned short proto) { }
+void ebpf_pending (struct in_addr ip_addr, u_int16_t port, unsigned short proto) { }
+int ebpf_xsk_attach (int ifindex, int queues) { return -1; }
+int ebpf_xsk_add (int queue, int fd) { return -1; }
+void ebpf_xsk_detach (void) { }
+EbpfStats *get_ebpf_stats (void) { return &ebpf_stats; }
+void end_ebpf (void) { }
+
+#endif /* HAVE_EBPF */
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
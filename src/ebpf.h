@@ -0,0 +1,58 @@
+/*************************************************************************
+ * ebpf.h
+ *
+ * This header file contains information relating to the ebpf.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_EBPF_H
+#define INCLUDED_EBPF_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define EBPF_MAP_SIZE 65536         /* Default number of endpoints in the map. */
+#define EBPF_NETWORKS 64            /* Monitored networks checked in the kernel. */
+#define EBPF_UDP_PORTS 64           /* UDP signature ports checked in the kernel. */
+#define EBPF_INSNS 512              /* Room for the generated program. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * EbpfStats:  Kernel endpoint map counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _EbpfStats
+{
+    unsigned long entries;      /* Endpoints currently in the map. */
+    unsigned long inserts;      /* Endpoints added once identified. */
+    unsigned long deletes;      /* Endpoints removed to be identified again. */
+    unsigned long errors;       /* Map updates the kernel refused. */
+} EbpfStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+int init_ebpf (int snaplen);
+int ebpf_program (void);
+void ebpf_identified (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+void ebpf_pending (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+int ebpf_xsk_attach (int ifindex, int queues);
+int ebpf_xsk_add (int queue, int fd);
+void ebpf_xsk_detach (void);
+EbpfStats *get_ebpf_stats (void);
+void end_ebpf (void);
+
+#endif /* INCLUDED_EBPF_H */
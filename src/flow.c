@@ -0,0 +1,594 @@
+/*************************************************************************
+ * flow.c
+ *
+ * This module keeps track of TCP connections to servers that are still
+ * being identified.  A flow is created when a server answers with a
+ * SYN-ACK and is dropped as soon as the asset has been identified, the
+ * connection closes or it has been idle for too long.  ACK packets that do
+ * not belong to a tracked flow never reach the identification engine.
+ *
+ * The table uses a fixed amount of memory.  All flow records are allocated
+ * up front and chained into hash buckets by index.  A least recently used
+ * list is used both to expire idle flows and to make room when the table
+ * is full.
+ *
+ * Banners do not always fit in one segment.  When the first segment of a
+ * flow does not identify the server, it is kept and the following in-order
+ * segments are appended to it, up to a fixed prefix of the server's data.
+ * The signatures pick up where they stopped on the previous segment, so
+ * only the new bytes are scanned.  A missing segment ends the reassembly of
+ * that flow.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "flow.h"
+#include "identification.h"
+#include "slab.h"
+#include "util.h"
+
+/*
+ * Variable Declarations:  Each worker thread tracks the flows that the
+ * kernel hands to it in a table of its own.  Every other thread uses
+ * 'flow_table'.
+ */
+FlowTable flow_table;
+__thread FlowTable *ft = &flow_table;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_hash
+ * DESCRIPTION	: This function will hash a flow's 4-tuple.
+ * INPUT	: 0 - Server IP
+ *		: 1 - Server Port
+ *		: 2 - Client IP
+ *		: 3 - Client Port
+ * RETURN	: Bucket Index
+ * ---------------------------------------------------------- */
+static inline u_int32_t
+flow_hash (u_int32_t s_ip, u_int16_t s_port, u_int32_t c_ip, u_int16_t c_port)
+{
+    u_int64_t h;
+
+    h = ((u_int64_t)s_ip << 32) | c_ip;
+    h ^= ((u_int64_t)s_port << 16 | c_port) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (u_int32_t)h & ft->mask;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: lru_unlink
+ * DESCRIPTION	: This function will take a flow off of the
+ *		: LRU list.
+ * INPUT	: 0 - Flow Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+lru_unlink (u_int32_t i)
+{
+    Flow *flow = &ft->pool[i];
+
+    if (flow->lru_prev != FLOW_NIL)
+	ft->pool[flow->lru_prev].lru_next = flow->lru_next;
+    else
+	ft->lru_head = flow->lru_next;
+
+    if (flow->lru_next != FLOW_NIL)
+	ft->pool[flow->lru_next].lru_prev = flow->lru_prev;
+    else
+	ft->lru_tail = flow->lru_prev;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: lru_push
+ * DESCRIPTION	: This function will place a flow at the head
+ *		: (most recently used end) of the LRU list.
+ * INPUT	: 0 - Flow Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+lru_push (u_int32_t i)
+{
+    Flow *flow = &ft->pool[i];
+
+    flow->lru_prev = FLOW_NIL;
+    flow->lru_next = ft->lru_head;
+    if (ft->lru_head != FLOW_NIL)
+	ft->pool[ft->lru_head].lru_prev = i;
+    ft->lru_head = i;
+    if (ft->lru_tail == FLOW_NIL)
+	ft->lru_tail = i;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_drop_data
+ * DESCRIPTION	: This function will return the data and
+ *		: match stream reassembled for a flow to the
+ *		: table's slab.
+ * INPUT	: 0 - Flow
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+flow_drop_data (Flow *flow)
+{
+    if (flow->stream != NULL) {
+	slab_free(&ft->data, flow->stream);
+	flow->stream = NULL;
+	flow->buf = NULL;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_flush
+ * DESCRIPTION	: This function will identify the data kept for
+ *		: a flow for the last time, when nothing more
+ *		: will be added to it (a gap, FIN / RST, or the
+ *		: flow being dropped), and let go of it.  A
+ *		: fallback signature held back for more data
+ *		: can match now;  otherwise the flow uses up
+ *		: its identification attempt.
+ * INPUT	: 0 - Flow
+ * RETURN	: Return value of tcp_identify() (0 = nothing
+ *		: was kept)
+ * ---------------------------------------------------------- */
+int
+flow_flush (Flow *flow)
+{
+    struct in_addr ip;
+    int ret = 0;
+
+    if (flow->buf != NULL) {
+	ip.s_addr = flow->s_ip;
+	ret = tcp_identify(ip, flow->s_port, NULL, 0, (const char *)flow->buf,
+			   (int)flow->buf_len, flow->stream, 1);
+	flow_drop_data(flow);
+    }
+
+    return ret;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_flush_all
+ * DESCRIPTION	: This function will flush the flows of the
+ *		: calling thread's table once capture has
+ *		: ended, as nothing more will be added to them.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+flow_flush_all (void)
+{
+    u_int32_t i;
+
+    if (ft->pool == NULL)
+	return;
+
+    for (i = ft->lru_head; i != FLOW_NIL; i = ft->pool[i].lru_next)
+	flow_flush(&ft->pool[i]);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_release
+ * DESCRIPTION	: This function will unlink a flow from its
+ *		: hash bucket and the LRU list and return it
+ *		: to the free list.
+ * INPUT	: 0 - Flow Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+flow_release (u_int32_t i)
+{
+    Flow *flow = &ft->pool[i];
+    u_int32_t *link;
+
+    link = &ft->buckets[flow_hash(flow->s_ip, flow->s_port, flow->c_ip, flow->c_port)];
+    while (*link != i)
+	link = &ft->pool[*link].hnext;
+    *link = flow->hnext;
+
+    lru_unlink(i);
+    flow_drop_data(flow);
+
+    flow->hnext = ft->free;
+    ft->free = i;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_expire
+ * DESCRIPTION	: This function will drop idle flows from the
+ *		: tail of the LRU list.
+ * INPUT	: 0 - Current Time
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+flow_expire (time_t now)
+{
+    while (ft->lru_tail != FLOW_NIL
+	    && ft->pool[ft->lru_tail].last_seen + ft->timeout < now) {
+	flow_flush(&ft->pool[ft->lru_tail]);
+	flow_release(ft->lru_tail);
+	ft->stats.expired++;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_flow
+ * DESCRIPTION	: This function will allocate the calling
+ *		: thread's flow table.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_flow (void)
+{
+    u_int32_t i;
+
+    ft->max = (gc.flow_max > 0) ? gc.flow_max : FLOW_MAX;
+    if (ft->max > FLOW_MAX_LIMIT)
+	ft->max = FLOW_MAX_LIMIT;
+    ft->timeout = (gc.flow_timeout > 0) ? gc.flow_timeout : FLOW_TIMEOUT;
+    ft->reasm_size = (gc.reassembly_size > 0) ? gc.reassembly_size : REASM_SIZE;
+    if (gc.disable_reasm)
+	ft->reasm_size = 0;
+
+    /* Use one bucket per flow, rounded up to a power of 2. */
+    for (i = 1; i < ft->max; i <<= 1);
+    ft->mask = i - 1;
+
+    ft->pool = (Flow *) calloc(ft->max, sizeof(Flow));
+    ft->buckets = (u_int32_t *) malloc((ft->mask + 1) * sizeof(u_int32_t));
+    if (ft->pool == NULL || ft->buckets == NULL)
+	err_message("Unable to allocate flow table (%u flows)", ft->max);
+
+    memset(ft->buckets, 0xff, (ft->mask + 1) * sizeof(u_int32_t));
+
+    /* Chain every record onto the free list. */
+    for (i = 0; i < ft->max; i++)
+	ft->pool[i].hnext = (i + 1 < ft->max) ? i + 1 : FLOW_NIL;
+    ft->free = 0;
+    ft->lru_head = FLOW_NIL;
+    ft->lru_tail = FLOW_NIL;
+
+    /* A flow's match stream and data share one slab object.  Only the
+     * shared table's slab is shown;  the workers' are added to it. */
+    slab_init(&ft->data, (ft == &flow_table) ? "Reassembly" : NULL,
+	      SLAB_SIZE(stream_size()) + ft->reasm_size, 0, 0);
+
+    verbose_message("Flow table:  %u flows, %d second timeout, %u byte reassembly",
+		    ft->max, (int)ft->timeout, ft->reasm_size);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_thread_table
+ * DESCRIPTION	: This function will make the calling thread
+ *		: use a flow table of its own.
+ * INPUT	: 0 - Flow Table (NULL = shared table)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+flow_thread_table (FlowTable *table)
+{
+    ft = (table != NULL) ? table : &flow_table;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_find
+ * DESCRIPTION	: This function will look up a flow by its
+ *		: 4-tuple.  Flows that have been idle for
+ *		: longer than the timeout are dropped.
+ * INPUT	: 0 - Server IP
+ *		: 1 - Server Port
+ *		: 2 - Client IP
+ *		: 3 - Client Port
+ *		: 4 - Current Time
+ * RETURN	: Pointer to Flow or NULL
+ * ---------------------------------------------------------- */
+Flow *
+flow_find (struct in_addr s_ip, u_int16_t s_port,
+	   struct in_addr c_ip, u_int16_t c_port, time_t now)
+{
+    Flow *flow;
+    u_int32_t i;
+
+    for (i = ft->buckets[flow_hash(s_ip.s_addr, s_port, c_ip.s_addr, c_port)];
+	    i != FLOW_NIL; i = flow->hnext) {
+	flow = &ft->pool[i];
+	if (flow->s_ip == s_ip.s_addr && flow->c_ip == c_ip.s_addr
+		&& flow->s_port == s_port && flow->c_port == c_port) {
+
+	    /* Found!  Make sure that it has not timed out. */
+	    if (flow->last_seen + ft->timeout < now) {
+		flow_flush(flow);
+		flow_release(i);
+		ft->stats.expired++;
+		return NULL;
+	    }
+
+	    flow->last_seen = now;
+	    if (ft->lru_head != i) {
+		lru_unlink(i);
+		lru_push(i);
+	    }
+	    return flow;
+	}
+    }
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_prefetch
+ * DESCRIPTION	: This function will start loading the hash
+ *		: bucket of a 4-tuple, ahead of flow_find().
+ * INPUT	: 0 - Server IP
+ *		: 1 - Server Port
+ *		: 2 - Client IP
+ *		: 3 - Client Port
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+flow_prefetch (struct in_addr s_ip, u_int16_t s_port,
+	       struct in_addr c_ip, u_int16_t c_port)
+{
+    __builtin_prefetch(&ft->buckets[flow_hash(s_ip.s_addr, s_port, c_ip.s_addr, c_port)], 0, 1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_add
+ * DESCRIPTION	: This function will start tracking a flow.
+ *		: If the flow exists already (retransmitted
+ *		: SYN-ACK), its sequence number and
+ *		: reassembly buffer are reset.
+ *		: When the table is full, the least recently
+ *		: used flow is dropped.
+ * INPUT	: 0 - Server IP
+ *		: 1 - Server Port
+ *		: 2 - Client IP
+ *		: 3 - Client Port
+ *		: 4 - Next expected server sequence number
+ *		: 5 - Current Time
+ * RETURN	: Pointer to Flow
+ * ---------------------------------------------------------- */
+Flow *
+flow_add (struct in_addr s_ip, u_int16_t s_port,
+	  struct in_addr c_ip, u_int16_t c_port,
+	  u_int32_t next_seq, time_t now)
+{
+    Flow *flow;
+    u_int32_t i, bucket;
+
+    if ((flow = flow_find(s_ip, s_port, c_ip, c_port, now)) != NULL) {
+	flow_flush(flow);
+	flow->next_seq = next_seq;
+	flow->buf_len = (ft->reasm_size > 0) ? 0 : REASM_OFF;
+	return flow;
+    }
+
+    /* Make room:  drop idle flows, then the oldest flow if still full. */
+    flow_expire(now);
+    if (ft->free == FLOW_NIL) {
+	flow_flush(&ft->pool[ft->lru_tail]);
+	flow_release(ft->lru_tail);
+	ft->stats.evicted++;
+    }
+
+    i = ft->free;
+    flow = &ft->pool[i];
+    ft->free = flow->hnext;
+
+    flow->s_ip = s_ip.s_addr;
+    flow->c_ip = c_ip.s_addr;
+    flow->s_port = s_port;
+    flow->c_port = c_port;
+    flow->next_seq = next_seq;
+    flow->buf_len = (ft->reasm_size > 0) ? 0 : REASM_OFF;
+    flow->buf = NULL;
+    flow->stream = NULL;
+    flow->last_seen = now;
+
+    bucket = flow_hash(flow->s_ip, s_port, flow->c_ip, c_port);
+    flow->hnext = ft->buckets[bucket];
+    ft->buckets[bucket] = i;
+    lru_push(i);
+
+    ft->stats.created++;
+
+    return flow;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_reassemble
+ * DESCRIPTION	: This function will append a server segment
+ *		: to the data kept for its flow.  It must be
+ *		: called before next_seq is moved past the
+ *		: segment.  A segment that does not start at
+ *		: next_seq ends the flow's reassembly (what
+ *		: was kept must have been flushed).  The data
+ *		: is complete once the buffer is full, or when
+ *		: the segment was not captured in full.
+ * INPUT	: 0 - Flow
+ *		: 1 - Segment Sequence Number
+ *		: 2 - Segment Payload
+ *		: 3 - Pointer to Payload Length (set to the
+ *		:     length of the data returned)
+ *		: 4 - Segment was cut short by the snaplen
+ *		: 5 - Pointer to Match Stream (set to NULL
+ *		:     when the flow is not reassembled)
+ *		: 6 - Pointer to Last (set to 1 when nothing
+ *		:     more will be added to the data)
+ * RETURN	: Data to identify (the reassembled buffer,
+ *		: or the segment itself)
+ * ---------------------------------------------------------- */
+char *
+flow_reassemble (Flow *flow, u_int32_t seq, char *payload, int *plen,
+		 int clipped, struct _MatchStream **ms, int *last)
+{
+    u_int32_t n;
+
+    *ms = NULL;
+    *last = 1;
+    if (flow->buf_len == REASM_OFF)
+	return payload;
+
+    /* Gap:  identify segments on their own. */
+    if (seq != flow->next_seq) {
+	flow_drop_data(flow);
+	flow->buf_len = REASM_OFF;
+	ft->stats.gaps++;
+	return payload;
+    }
+
+    if (flow->buf == NULL) {
+	/* Nothing kept yet:  the first segment is matched in place, with
+	 * the thread's stream. */
+	*ms = stream_start();
+    } else {
+	*ms = flow->stream;
+
+	n = ft->reasm_size - flow->buf_len;
+	if ((u_int32_t)*plen < n)
+	    n = *plen;
+	memcpy(flow->buf + flow->buf_len, payload, n);
+	flow->buf_len += n;
+	ft->stats.reassembled++;
+
+	*plen = flow->buf_len;
+	payload = (char *)flow->buf;
+    }
+
+    /* Nothing more is added once the buffer is full, or after a segment
+     * that was cut short. */
+    if ((u_int32_t)*plen >= ft->reasm_size)
+	ft->stats.full++;
+    else if (!clipped)
+	*last = 0;
+
+    return payload;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_keep
+ * DESCRIPTION	: This function will be called when a segment
+ *		: did not identify its server.  The first
+ *		: segment of a flow is copied into a new
+ *		: buffer, together with the thread's match
+ *		: stream.  Once the data is complete (see
+ *		: flow_reassemble), the flow stops being
+ *		: reassembled.
+ * INPUT	: 0 - Flow
+ *		: 1 - Segment Payload
+ *		: 2 - Payload Length
+ *		: 3 - Last (from flow_reassemble)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+flow_keep (Flow *flow, const char *payload, int plen, int last)
+{
+    char *mem;
+
+    if (flow->buf_len == REASM_OFF)
+	return;
+
+    /* Complete data has been identified for the last time. */
+    if (last) {
+	flow_drop_data(flow);
+	flow->buf_len = REASM_OFF;
+	return;
+    }
+
+    if (flow->buf != NULL)
+	return;
+
+    mem = (char *) slab_alloc(&ft->data);
+    flow->stream = stream_keep(mem);
+    flow->buf = (u_char *)mem + SLAB_SIZE(stream_size());
+    memcpy(flow->buf, payload, plen);
+    flow->buf_len = plen;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: flow_remove
+ * DESCRIPTION	: This function will stop tracking a flow.
+ * INPUT	: 0 - Flow
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+flow_remove (Flow *flow)
+{
+    if (flow == NULL)
+	return;
+
+    flow_release((u_int32_t)(flow - ft->pool));
+    ft->stats.removed++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_flow_stats
+ * DESCRIPTION	: This function will return the flow table
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to FlowStats
+ * ---------------------------------------------------------- */
+FlowStats *
+get_flow_stats (void)
+{
+    return &ft->stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_flow_slab
+ * DESCRIPTION	: This function will return the slab holding
+ *		: the reassembled data of the calling thread's
+ *		: flow table.
+ * INPUT	: None!
+ * RETURN	: Pointer to Slab
+ * ---------------------------------------------------------- */
+Slab *
+get_flow_slab (void)
+{
+    return &ft->data;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_flow
+ * DESCRIPTION	: This function will free the calling thread's
+ *		: flow table.  Its counters are kept.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_flow (void)
+{
+    if (ft->pool != NULL)
+	free(ft->pool);
+    if (ft->buckets != NULL)
+	free(ft->buckets);
+    slab_destroy(&ft->data);
+
+    ft->pool = NULL;
+    ft->buckets = NULL;
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
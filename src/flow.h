@@ -0,0 +1,112 @@
+/*************************************************************************
+ * flow.h
+ *
+ * This header file contains information relating to the flow.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_FLOW_H
+#define INCLUDED_FLOW_H
+
+#include "global.h"
+#include "slab.h"
+
+/* DEFINES ----------------------------------------- */
+#define FLOW_MAX 65536              /* Default number of tracked flows. */
+#define FLOW_MAX_LIMIT 0x01000000   /* Largest accepted flow_max. */
+#define FLOW_TIMEOUT 120            /* Default idle timeout (seconds). */
+#define FLOW_NIL 0xffffffff         /* Empty flow index. */
+#define REASM_SIZE 2048             /* Default reassembled server prefix (bytes). */
+#define REASM_OFF 0xffffffff        /* Flow is no longer reassembled. */
+
+/* Sequence number comparison (RFC 1982 serial arithmetic). */
+#define SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * Flow:  A TCP connection to a server that is still being identified.  The
+ * server is the host that sent the SYN-ACK, or the first data segment of a
+ * pending asset when the handshake was missed.
+ * -------------------------------------------------------------------------- */
+typedef struct _Flow
+{
+    u_int32_t s_ip;             /* Server IP Address */
+    u_int32_t c_ip;             /* Client IP Address */
+    u_int16_t s_port;           /* Server Port */
+    u_int16_t c_port;           /* Client Port */
+    u_int32_t next_seq;         /* Next expected server -> client sequence */
+    u_int32_t buf_len;          /* Bytes reassembled (or REASM_OFF) */
+    u_char *buf;                /* Server data reassembled so far */
+    struct _MatchStream *stream; /* Signature state over 'buf' */
+    time_t last_seen;           /* Time of the last packet on this flow. */
+    u_int32_t hnext;            /* Next flow in hash bucket */
+    u_int32_t lru_prev;         /* Next most recently used flow */
+    u_int32_t lru_next;         /* Next least recently used flow */
+} Flow;
+
+/* --------------------------------------------------------------------------
+ * FlowStats:  Flow table counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _FlowStats
+{
+    unsigned long created;      /* Flows created on SYN-ACK. */
+    unsigned long removed;      /* Flows dropped (identified / closed). */
+    unsigned long expired;      /* Flows dropped after the idle timeout. */
+    unsigned long evicted;      /* Flows dropped because the table was full. */
+    unsigned long inspected;    /* Segments passed on to identification. */
+    unsigned long skipped;      /* Pure ACKs and retransmissions. */
+    unsigned long reassembled;  /* Segments matched together with earlier ones. */
+    unsigned long gaps;         /* Reassembly stopped at a missing segment. */
+    unsigned long full;         /* Reassembly stopped at the size limit. */
+} FlowStats;
+
+/* --------------------------------------------------------------------------
+ * FlowTable:  A fixed size table of flows with an LRU list.
+ * -------------------------------------------------------------------------- */
+typedef struct _FlowTable
+{
+    Flow *pool;                 /* Flow Records */
+    u_int32_t *buckets;         /* Hash Buckets (index of first flow) */
+    u_int32_t mask;             /* Number of buckets - 1 */
+    u_int32_t max;              /* Number of flow records */
+    u_int32_t free;             /* Free list (chained through hnext) */
+    u_int32_t lru_head;         /* Most recently used flow */
+    u_int32_t lru_tail;         /* Least recently used flow */
+    time_t timeout;             /* Idle Timeout */
+    u_int32_t reasm_size;       /* Reassembly buffer size (0 = disabled) */
+    Slab data;                  /* Match streams and reassembly buffers */
+    FlowStats stats;
+} FlowTable;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_flow (void);
+void flow_thread_table (FlowTable *table);
+Flow *flow_add (struct in_addr s_ip, u_int16_t s_port, struct in_addr c_ip, u_int16_t c_port, u_int32_t next_seq, time_t now);
+Flow *flow_find (struct in_addr s_ip, u_int16_t s_port, struct in_addr c_ip, u_int16_t c_port, time_t now);
+void flow_prefetch (struct in_addr s_ip, u_int16_t s_port, struct in_addr c_ip, u_int16_t c_port);
+char *flow_reassemble (Flow *flow, u_int32_t seq, char *payload, int *plen, int clipped, struct _MatchStream **ms, int *last);
+void flow_keep (Flow *flow, const char *payload, int plen, int last);
+int flow_flush (Flow *flow);
+void flow_flush_all (void);
+void flow_remove (Flow *flow);
+FlowStats *get_flow_stats (void);
+Slab *get_flow_slab (void);
+void end_flow (void);
+
+#endif /* INCLUDED_FLOW_H */
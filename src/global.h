@@ -40,6 +40,9 @@
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
 #endif /* ifdef LINUX */
  
 #define MAX_LENGTH 500
@@ -54,6 +57,18 @@
 
 #define I_ATTEMPTS 4
 
+#define CAPTURE_PCAP 0
+#define CAPTURE_TPACKET 1
+#define CAPTURE_XDP 2
+
+#define ENCAP_AUTO 0                /* Probe the first packets. */
+#define ENCAP_ETH 1
+#define ENCAP_VLAN 2
+#define ENCAP_QINQ 3
+#define ENCAP_MPLS 4
+#define ENCAP_GRE 5                 /* GRE and ERSPAN */
+#define ENCAP_VXLAN 6
+
 #define DEBUG
 
 #define PADS_SIGNATURE_LIST "pads-signature-list"
@@ -79,7 +94,8 @@
 #include <net/if_arp.h>
 #include <netinet/if_ether.h>
 #include <pcap.h>
-#include <pcre.h>
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
 
 #include "bstring/bstrlib.h"
 
@@ -104,6 +120,8 @@ typedef struct _globalconf
     bstring pid_file;           /* PID file created with '-D' is used. */
     bstring sig_file;           /* File containing signatures. */
     bstring mac_file;           /* File containing MAC to Vendor translations. */
+    bstring snapshot_file;      /* Binary snapshot of the assets. */
+    bstring wal_file;           /* Write-ahead log of asset changes. */
 
     /* Drop Privileges */
     bstring priv_user;          /* Drop privileges to this user. */
@@ -113,11 +131,69 @@ typedef struct _globalconf
     int daemon_mode;            /* Daemon Mode - 0 = No, 1 = Yes */
     int hide_unknowns;          /* Display unknown devices - 0 = No, 1 = Yes */
     int verbose;                /* Verbose - 0 = No, 1 = Yes */
+    int disable_jit;            /* Interpret signatures - 0 = No, 1 = Yes */
+
+    /* Flow Tracking */
+    unsigned int flow_max;      /* Maximum number of tracked TCP flows. */
+    int flow_timeout;           /* Idle timeout for tracked flows (seconds). */
+    unsigned int reassembly_size; /* Server data reassembled per flow (bytes). */
+    int disable_reasm;          /* Match segments alone - 0 = No, 1 = Yes */
+
+    /* Capture Backend */
+    int capture;                /* CAPTURE_PCAP, CAPTURE_TPACKET or CAPTURE_XDP */
+    unsigned int tpacket_block_size;  /* Bytes per TPACKET_V3 block. */
+    unsigned int tpacket_block_count; /* Number of TPACKET_V3 blocks. */
+    unsigned int tpacket_snaplen;     /* Bytes captured per packet. */
+    int tpacket_timeout;        /* Block retire timeout (milliseconds). */
+    unsigned int xdp_frames;    /* UMEM frames per AF_XDP socket. */
+    int workers;                /* Worker threads (tpacket fanout / XDP queues). */
+    int encap;                  /* Ethernet encapsulation (ENCAP_*) */
+    int ebpf;                   /* eBPF socket filter - 0 = No, 1 = Yes */
+    unsigned int ebpf_map_size; /* Identified endpoints dropped in the kernel. */
+
+    /* Capture Ring */
+    unsigned int ring_slots;    /* Packets queued for the analysis thread. */
+    unsigned int ring_snaplen;  /* Bytes kept from each queued packet. */
+    unsigned int batch_size;    /* Packets decoded together (1 = no batching). */
+
+    /* Identification */
+    unsigned int banner_cache;  /* Number of banners to remember. */
+
+    /* Asset Aging */
+    int asset_ttl;              /* Idle time before an asset expires (0 = never). */
+    int asset_ttl_tcp;          /* TCP assets (0 = asset_ttl). */
+    int asset_ttl_udp;          /* UDP assets (0 = asset_ttl). */
+    int asset_ttl_icmp;         /* ICMP assets (0 = asset_ttl). */
+    int arp_ttl;                /* ARP entries (0 = asset_ttl). */
+    unsigned int asset_max;     /* Assets kept at most (0 = no limit). */
+    unsigned int arp_max;       /* ARP entries kept at most (0 = no limit). */
+
+    /* Snapshot */
+    int snapshot_interval;      /* Seconds between snapshots. */
+
+    /* Write-Ahead Log */
+    int wal_sync;               /* Milliseconds between syncs of the log. */
+    unsigned int wal_max;       /* Megabytes logged before an early snapshot. */
 
 } GC;
 
 /* --------------------------------------------------------------------------
- * Asset:  Data structure used to store TCP / ICMP assets.
+ * WheelEntry:  Link of a record on a timing wheel (see wheel.c).
+ * -------------------------------------------------------------------------- */
+typedef struct _WheelEntry
+{
+    struct _WheelEntry *next;   /* Next entry in the same slot */
+    time_t when;                /* Time it was scheduled for */
+} WheelEntry;
+
+/* --------------------------------------------------------------------------
+ * StrId:  A string in the string pool (see strpool.c).
+ * -------------------------------------------------------------------------- */
+typedef u_int32_t StrId;
+
+/* --------------------------------------------------------------------------
+ * Asset:  Data structure used to pass TCP / ICMP assets around.  Storage
+ * keeps them split into an index slot and an asset record (see storage.h).
  * -------------------------------------------------------------------------- */
 typedef struct _Asset
 {
@@ -126,12 +202,12 @@ typedef struct _Asset
     u_int16_t port;             /* Asset Port */
     u_int16_t c_port;           /* Clients Port */
     unsigned short proto;       /* Asset Protocol */
-    bstring service;            /* Asset Service (i.e. SSH, WWW, etc.) */
-    bstring application;        /* Asset Application (i.e. Apache, etc.) */
+    unsigned short i_attempts;  /* Attempts at identifying the asset. */
+    StrId service;              /* Asset Service (i.e. SSH, WWW, etc.) */
+    StrId application;          /* Asset Application (i.e. Apache, etc.) */
     bstring hex_payload;        /* Hex data for detected banner */
     time_t discovered;          /* Time at which asset was first seen. */
-    unsigned short i_attempts;  /* Attempts at identifying the asset. */
-    struct _Asset *next;        /* Next Signature Structure */
+    time_t last_seen;           /* Time at which asset was last seen. */
 } Asset;
 
 /* --------------------------------------------------------------------------
@@ -141,8 +217,11 @@ typedef struct _ArpAsset
 {
     struct in_addr ip_addr;     /* Asset IP Address */
     char mac_addr[MAC_LEN];     /* Asset MAC Address */
-    bstring mac_resolved;       /* Asset MAC Vendor Name */
+    StrId mac_resolved;         /* Asset MAC Vendor Name (STR_NONE = unknown) */
     time_t discovered;          /* Time at which asset was first seen. */
+    time_t last_seen;           /* Time at which asset was last seen. */
+    WheelEntry timer;           /* Expiry (asset aging) */
+    struct _ArpAsset *prev;     /* Previous ARP Structure */
     struct _ArpAsset *next;     /* Next ARP Structure */
 } ArpAsset;
 
@@ -150,14 +229,18 @@ typedef struct _ArpAsset
  * Signature:  Data structure used to store PCRE signatures.
  * -------------------------------------------------------------------------- */
 typedef struct _Signature {
-    bstring service;            /* Service (i.e. SSH, WWW, etc.) */
+    StrId service;              /* Service (i.e. SSH, WWW, etc.) */
     struct {                    /* Application Title, broken up into 3 parts. */
         bstring app;
         bstring ver;
         bstring misc;
     } title;
-    pcre *regex;                /* Signature - Compiled Regular Expression */
-    pcre_extra *study;          /* Studied version of the compiled regex. */
+    pcre2_code *regex;          /* Signature - Compiled Regular Expression */
+    int jit;                    /* JIT compiled - 0 = No, 1 = Yes */
+    int anchored;               /* Only matches at offset 0 - 0 = No, 1 = Yes */
+    int soft;                   /* Fallback (s/ title) - 0 = No, 1 = Yes */
+    unsigned short proto;       /* IPPROTO_TCP / IPPROTO_UDP */
+    unsigned int id;            /* Position in the signature file (from 0). */
     struct _Signature *next;    /* Next Signature Structure */
 } Signature;
 
@@ -166,7 +249,7 @@ typedef struct _Signature {
  * -------------------------------------------------------------------------- */
 typedef struct _Vendor {
     unsigned int mac;
-    bstring vendor;
+    StrId vendor;
     struct _Vendor *next;
 } Vendor;
 
@@ -34,15 +34,32 @@
  
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
+#include <netdb.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
  
+#include "banner.h"
 #include "identification.h"
+#include "prefilter.h"
+#include "slab.h"
 #include "util.h"
 #include "storage.h"
+#include "strpool.h"
 #include "output/output.h"
 
 Signature *signature_list;
+Signature **signature_index;            /* Signatures by ID (file order) */
+unsigned int signature_count;
+unsigned int signature_jit;             /* Signatures that were JIT compiled */
+UdpPort *udp_ports;                     /* UDP signatures by port (sorted) */
+unsigned int udp_port_count;
+u_int64_t udp_port_map[65536 / 64];     /* Ports that have UDP signatures */
+static __thread MatchState *match_state;
+Slab signature_slab = SLAB_INITIALIZER("Signatures", Signature, 0);
+
+static void udp_port_add (u_int16_t port, Signature *sig);
+static void udp_ports_build (void);
 
 /* ----------------------------------------------------------
  * FUNCTION     : init_identification
@@ -84,6 +101,13 @@ int init_identification()
         }
     }
 
+    /* Build the literal prefilter over all (TCP) signatures. */
+    prefilter_build();
+    udp_ports_build();
+    init_banner_cache();
+    verbose_message("Signatures:  %u loaded, %u JIT compiled, UDP on %u ports",
+                    signature_count, signature_jit, udp_port_count);
+
     /* Clean Up */
     bdestroy(filename);
     bdestroy(filedata);
@@ -93,6 +117,63 @@ int init_identification()
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION     : parse_service
+ * DESCRIPTION  : This function will parse the service field of
+ *              : a signature.  It is either the service alone
+ *              : (TCP), or the service, a colon and the
+ *              : protocol, followed by the ports the signature
+ *              : is run on:  "dns:udp/53" or "snmp:udp/161/162".
+ *              : A UDP signature without ports is run on the
+ *              : port of its service in /etc/services.
+ * INPUT        : 0 - Service Field
+ *              : 1 - Service (returned)
+ *              : 2 - Protocol (returned)
+ *              : 3 - Ports (returned, UDP_SIG_PORTS at most)
+ * RETURN       : Number of ports (-1 - Error)
+ * ---------------------------------------------------------- */
+static int
+parse_service (bstring field, bstring *service, unsigned short *proto, u_int16_t *ports)
+{
+    struct bstrList *list;
+    struct servent *se;
+    int pos, port, nports = 0, i;
+
+    *proto = IPPROTO_TCP;
+    if ((pos = bstrchr(field, ':')) == BSTR_ERR) {
+        *service = bstrcpy(field);
+        return 0;
+    }
+
+    *service = bmidstr(field, 0, pos);
+    if ((list = bsplit(field, '/')) == NULL)
+        return -1;
+
+    /* The first entry still holds the service. */
+    bdelete(list->entry[0], 0, pos + 1);
+    if (biseqcstr(list->entry[0], "udp") == 1)
+        *proto = IPPROTO_UDP;
+    else if (biseqcstr(list->entry[0], "tcp") != 1)
+        nports = -1;
+
+    for (i = 1; i < list->qty && nports >= 0; i++) {
+        port = atoi(bdata(list->entry[i]));
+        if (port < 1 || port > 65535 || nports == UDP_SIG_PORTS)
+            nports = -1;
+        else
+            ports[nports++] = port;
+    }
+    bstrListDestroy(list);
+
+    if (nports == 0 && *proto == IPPROTO_UDP) {
+        if ((se = getservbyname(bdata(*service), "udp")) == NULL)
+            return -1;
+        ports[nports++] = ntohs(se->s_port);
+    }
+
+    return nports;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION     : parse_raw_signature
  * DESCRIPTION  : This function will take a line from the
@@ -108,9 +189,15 @@ int parse_raw_signature (bstring line, int lineno)
     struct bstrList *raw_sig;
     struct bstrList *title = NULL;
     Signature *sig;
+    bstring service = NULL;
     bstring pcre_string = NULL;
-    const char *err;            /* PCRE */
-    int erroffset;              /* PCRE */
+    u_int16_t ports[UDP_SIG_PORTS];
+    unsigned short proto;
+    int nports = 0;
+    PCRE2_UCHAR err[256];       /* PCRE */
+    PCRE2_SIZE erroffset;       /* PCRE */
+    int errcode;                /* PCRE */
+    u_int32_t options;          /* PCRE */
     int ret = 0;
     int i;
 
@@ -138,19 +225,26 @@ int parse_raw_signature (bstring line, int lineno)
         pcre_string = bstrcpy(raw_sig->entry[2]);
     }
 
-    /* Split Title */
-    if (raw_sig->entry[1] != NULL && ret != -1)
-        if ((title = bsplit(raw_sig->entry[1], '/')) == NULL)
-            ret = -1;
-    if (title->qty < 3)
+    /* Split Title:  v/application/version/misc/ (s/ for a fallback) */
+    if (ret != -1 && (title = bsplit(raw_sig->entry[1], '/')) == NULL)
+        ret = -1;
+    if (ret != -1 && title->qty < 4)
         ret = -1;
 
+    /* Split Service */
+    if (ret != -1 && (nports = parse_service(raw_sig->entry[0], &service, &proto, ports)) == -1)
+        err_message("Unable to parse signature service:  %s at line %d",
+                    bdata(raw_sig->entry[0]), lineno);
+
     /* Create signature data structure for this record. */
     if (ret != -1) {
-        sig = (Signature*)malloc(sizeof(Signature));
+        sig = (Signature *) slab_alloc(&signature_slab);
         sig->next = NULL;
-        if (raw_sig->entry[0] != NULL)
-            sig->service = bstrcpy(raw_sig->entry[0]);
+        sig->jit = 0;
+        sig->anchored = 0;
+        sig->soft = (biseqcstr(title->entry[0], "s") == 1) ? 1 : 0;
+        sig->proto = proto;
+        sig->service = str_intern(service);
         if (title->entry[1] != NULL)
             sig->title.app = bstrcpy(title->entry[1]);
         if (title->entry[2] != NULL)
@@ -159,22 +253,48 @@ int parse_raw_signature (bstring line, int lineno)
             sig->title.misc = bstrcpy(title->entry[3]);
 
         /* PCRE */
-        if (pcre_string != NULL) {
-            if ((sig->regex = pcre_compile (bdata(pcre_string), 0, &err, &erroffset, NULL)) == NULL) {
-                err_message("Unable to compile signature:  %s at line %d (%s)",
-                err, lineno, bdata(line));
+        if ((sig->regex = pcre2_compile((PCRE2_SPTR)bdata(pcre_string), PCRE2_ZERO_TERMINATED,
+                0, &errcode, &erroffset, NULL)) == NULL) {
+            pcre2_get_error_message(errcode, err, sizeof(err));
+            err_message("Unable to compile signature:  %s at line %d (%s)",
+                        err, lineno, bdata(line));
             ret = -1;
         }
     }
+
+#ifndef DISABLE_PCRE_JIT
+    /* JIT compile the signature;  fall back to the interpreter if the
+     * pattern (or the library) does not support it.  Reassembled streams
+     * are matched with partial matching, which needs code of its own. */
+    if (ret != -1 && !gc.disable_jit) {
+        if ((errcode = pcre2_jit_compile(sig->regex,
+                PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD)) == 0) {
+            sig->jit = 1;
+            signature_jit++;
+        } else {
+            pcre2_get_error_message(errcode, err, sizeof(err));
+            verbose_message("Signature at line %d will be interpreted:  %s", lineno, err);
+        }
+    }
+#endif /* DISABLE_PCRE_JIT */
+
+    /* A signature that is anchored at the start of the data is given up
+     * on as soon as it fails on the start of a stream. */
     if (ret != -1) {
-        sig->study = pcre_study (sig->regex, 0, &err);
-        if (err != NULL)
-            err_message("Unable to study signature:  %s", err);
+        pcre2_pattern_info(sig->regex, PCRE2_INFO_ALLOPTIONS, &options);
+        sig->anchored = (options & PCRE2_ANCHORED) ? 1 : 0;
     }
 
-    /* Add signature to 'signature_list' data structure. */
-    if (ret != -1)
+    /* Add signature to 'signature_list' data structure.  UDP signatures
+     * are only run on their ports, so the prefilter never sees them. */
+    if (ret != -1) {
         add_signature (sig);
+        if (sig->proto == IPPROTO_UDP) {
+            for (i = 0; i < nports; i++)
+                udp_port_add(ports[i], sig);
+        } else {
+            prefilter_add(bdata(pcre_string), sig->id);
+        }
     }
 
     /* Garbage Collection */
@@ -184,6 +304,8 @@ int parse_raw_signature (bstring line, int lineno)
         bstrListDestroy(title);
     if (pcre_string != NULL)
         bdestroy(pcre_string);
+    if (service != NULL)
+        bdestroy(service);
 
     return ret;
 }
@@ -191,7 +313,7 @@ int parse_raw_signature (bstring line, int lineno)
 /* ----------------------------------------------------------
  * FUNCTION     : add_signature
  * DESCRIPTION  : This function will add a signature to the
- *              : signature list.
+ *              : signature list and give it the next ID.
  * INPUT        : 0 - Signature Data Structure
  * RETURN       : 0 - Success
  *              : -1 - Error
@@ -200,6 +322,16 @@ int add_signature (Signature *sig)
 {
     Signature *list;
 
+    /* Index the signature by its ID. */
+    if ((signature_count & (signature_count - 1)) == 0) {
+        signature_index = (Signature **) realloc(signature_index,
+                (signature_count ? signature_count * 2 : 64) * sizeof(Signature *));
+        if (signature_index == NULL)
+            err_message("Unable to allocate signature index");
+    }
+    sig->id = signature_count;
+    signature_index[signature_count++] = sig;
+
     if (signature_list == NULL) {
         signature_list = sig;
     } else {
@@ -217,57 +349,117 @@ int add_signature (Signature *sig)
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION     : match_signature
+ * DESCRIPTION  : This function will run one signature over a
+ *              : payload.
+ * INPUT        : 0 - Match State
+ *              : 1 - Signature
+ *              : 2 - Payload
+ *              : 3 - Payload Length
+ *              : 4 - Start Offset
+ *              : 5 - Match Options (0 or PCRE2_PARTIAL_HARD)
+ * RETURN       : pcre2_match() result (>= 0 - Matched)
+ * ---------------------------------------------------------- */
+static inline int
+match_signature (MatchState *state, Signature *sig, const char *payload, int plen,
+                 u_int32_t start, u_int32_t options)
+{
+#ifndef DISABLE_PCRE_JIT
+    if (sig->jit)
+        return pcre2_jit_match(sig->regex, (PCRE2_SPTR)payload, plen,
+            start, options, state->match_data, state->context);
+#endif /* DISABLE_PCRE_JIT */
+    return pcre2_match(sig->regex, (PCRE2_SPTR)payload, plen,
+        start, options, state->match_data, state->context);
+}
+
 /* ----------------------------------------------------------
  * FUNCTION     : tcp_identify
  * DESCRIPTION  : This function will take a TCP payload and
- *              : match it against the signature base.
+ *              : match it against the signature base.  The
+ *              : signatures are run over the server data
+ *              : reassembled so far, which ends with the
+ *              : payload.  With a match stream, they resume
+ *              : where the previous segment left them.  A
+ *              : reassembled flow uses up one attempt, once
+ *              : its data is complete;  a segment that is
+ *              : not reassembled is an attempt of its own.
  * INPUT        : 0 - IP Address
  *              : 1 - TCP Port
- *              : 2 - Packet Payload
+ *              : 2 - Packet Payload (NULL = none)
  *              : 3 - Packet Payload Length
- * RETURN       : 0 - i_attempts = 0
- *              : 1 - i_attempts > 0
+ *              : 4 - Reassembled Data (or the payload)
+ *              : 5 - Reassembled Data Length
+ *              : 6 - Match Stream (NULL = not reassembled)
+ *              : 7 - Nothing more will be added to the data
+ * RETURN       : 0 - i_attempts = 0 (nothing to do)
+ *              : 1 - Payload inspected, asset still unidentified
+ *              : 2 - Payload inspected, asset is finished
+ *              :     (identified or out of attempts)
  * ---------------------------------------------------------- */
 int tcp_identify (struct in_addr ip_addr,
            u_int16_t port,
            char *payload,
-           int plen)
+           int plen,
+           const char *data,
+           int dlen,
+           MatchStream *ms,
+           int last)
 {
+    int matched;
     unsigned short i_attempts;
     char *hex_payload;
+    size_t mark;
 
 
-    /* Retrieve i_attempts for this asset. */
-    i_attempts = get_i_attempts(ip_addr, port, IPPROTO_TCP);
-
-    if (i_attempts > 0) {
-        i_attempts--;
-        update_i_attempts(ip_addr, port, IPPROTO_TCP, i_attempts);
+    /* Is this asset still being identified? */
+    if (get_i_attempts(ip_addr, port, IPPROTO_TCP) == 0)
+        return 0;
 
+    if (payload != NULL) {
+        mark = arena_mark();
         hex_payload = fasthex((u_char *) payload, plen); 
         add_hex_payload(ip_addr, port, IPPROTO_TCP, hex_payload);
+        arena_release(mark);
+    }
 
-        if (pcre_identify(ip_addr, port, IPPROTO_TCP, payload, plen) == 1) {
-            /* MATCH! */
-            i_attempts = 0;
-            update_i_attempts(ip_addr, port, IPPROTO_TCP, 0);
-        }
+    if (ms != NULL)
+        matched = stream_identify(ip_addr, port, data, dlen, ms, last);
+    else
+        matched = pcre_identify(ip_addr, port, IPPROTO_TCP, data, dlen);
 
-        /* Print asset if this is the last time to identify it. */
-        if (i_attempts == 0) {
-            print_asset(ip_addr, port, IPPROTO_TCP);
-        }
+    if (matched == 1) {
+        /* MATCH! */
+        update_i_attempts(ip_addr, port, IPPROTO_TCP, 0);
+        print_asset(ip_addr, port, IPPROTO_TCP);
+        return 2;
+    }
 
+    /* More data is on its way. */
+    if (ms != NULL && !last)
         return 1;
+
+    /* Use up one of this asset's identification attempts, and print the
+     * asset if this was the last time to identify it. */
+    i_attempts = take_i_attempt(ip_addr, port, IPPROTO_TCP);
+    if (i_attempts <= 1) {
+        if (i_attempts == 1)
+            print_asset(ip_addr, port, IPPROTO_TCP);
+        return 2;
     }
 
-    return 0;
+    return 1;
 }
 
 /* ----------------------------------------------------------
  * FUNCTION     : pcre_identify
  * DESCRIPTION  : This function will match a string against
- *              : all the known signatures.
+ *              : all the known signatures.  The prefilter
+ *              : picks out the signatures that can possibly
+ *              : match;  these are tried in file order.
+ *              : Results are cached by payload, so a
+ *              : repeated banner is only matched once.
  * INPUT        : 0 - IP Address
  *              : 1 - Port
  *              : 2 - Proto
@@ -282,48 +474,401 @@ int pcre_identify (struct in_addr ip_addr,
            const char *payload,
            int plen)
 {
-    Signature *list = signature_list;
+    MatchState *state = get_match_state();
+    Signature *list;
     int rc;
-    int ovector[15];
-    bstring app;
+    StrId app;
+    unsigned int w, words;
+    u_int64_t bits, hash;
+    int growing;
 
-    while (list != NULL) {
-        /* Execute Regular Expression */
-        rc = pcre_exec(list->regex, list->study, payload, plen,
-            0, 0, ovector, 15);
-
-        if (rc != -1) {
-            app = get_app_name(list, payload, ovector, rc);
-            update_asset(ip_addr, port, proto, list->service, app);
-            return 1;
+    /* Have we seen this banner before? */
+    hash = banner_hash((const u_char *)payload, plen);
+    if (banner_find((const u_char *)payload, plen, hash, &list, &app, &growing)) {
+        if (list == NULL)
+            return 0;
+        update_asset(ip_addr, port, proto, list->service, app);
+        return 1;
+    }
+
+    prefilter_scan((const u_char *)payload, plen, state->candidates);
+    words = prefilter_words();
+
+    for (w = 0; w < words; w++) {
+        for (bits = state->candidates[w]; bits != 0; bits &= bits - 1) {
+            list = signature_index[w * 64 + __builtin_ctzll(bits)];
+
+            /* Execute Regular Expression */
+            if ((rc = match_signature(state, list, payload, plen, 0, 0)) >= 0) {
+                app = get_app_name(list, state->match_data);
+                update_asset(ip_addr, port, proto, list->service, app);
+                banner_add((const u_char *)payload, plen, hash, list, app, 0);
+                return 1;
+            }
         }
+    }
 
-        list = list->next;
+    banner_add((const u_char *)payload, plen, hash, NULL, STR_NONE, 0);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : stream_identify
+ * DESCRIPTION  : This function will match the server data of
+ *              : a TCP flow that grows by one segment at a
+ *              : time.  The prefilter only scans the new
+ *              : bytes.  Each signature is resumed where it
+ *              : stopped:  at the start of a partial match
+ *              : that ran into the end of the data, or else
+ *              : past the data already seen.  Anchored
+ *              : signatures that fail are dropped for the
+ *              : rest of the stream.  While a signature has
+ *              : a partial match, later signatures may not
+ *              : match:  it goes first once it completes.
+ *              : Fallback signatures (s/ titles) are held
+ *              : back until the data is complete, so that a
+ *              : specific signature matching on a later
+ *              : segment wins.  Only matches are added to
+ *              : the banner cache, as a miss has to leave
+ *              : the stream state behind anyway.  See
+ *              : pcre_identify.
+ * INPUT        : 0 - IP Address
+ *              : 1 - Port
+ *              : 2 - Data (the whole stream so far)
+ *              : 3 - Data Length
+ *              : 4 - Match Stream
+ *              : 5 - Nothing more will be added to the data
+ * RETURN       : 0 - Not Matched
+ *              : 1 - Matched
+ * ---------------------------------------------------------- */
+int stream_identify (struct in_addr ip_addr,
+           u_int16_t port,
+           const char *data,
+           int dlen,
+           MatchStream *ms,
+           int last)
+{
+    MatchState *state = get_match_state();
+    Signature *list;
+    PCRE2_SIZE *ovector;
+    int rc;
+    StrId app;
+    unsigned int w, words, id;
+    u_int64_t bits, hash;
+    int growing, partial = 0;
+
+    /* A banner identified before needs no stream, unless the result
+     * could still change with more data. */
+    hash = banner_hash((const u_char *)data, dlen);
+    if (banner_find((const u_char *)data, dlen, hash, &list, &app, &growing) && list != NULL
+            && (last || growing)) {
+        update_asset(ip_addr, port, IPPROTO_TCP, list->service, app);
+        return 1;
+    }
+
+    if ((u_int32_t)dlen > ms->scanned) {
+        prefilter_resume((const u_char *)data + ms->scanned, dlen - ms->scanned,
+                         &ms->pf_state, ms->candidates);
+        ms->scanned = dlen;
+    }
+    words = prefilter_words();
+    ovector = pcre2_get_ovector_pointer(state->match_data);
+
+    for (w = 0; w < words; w++) {
+        for (bits = ms->candidates[w] & ~ms->dead[w]; bits != 0; bits &= bits - 1) {
+            id = w * 64 + __builtin_ctzll(bits);
+            list = signature_index[id];
+
+            rc = match_signature(state, list, data, dlen, ms->resume[id],
+                                 last ? 0 : PCRE2_PARTIAL_HARD);
+
+            /* Wait for the partial matches before this one, and for the
+             * end of the data if this is a fallback. */
+            if (rc >= 0 && !last && (partial || list->soft))
+                continue;
+            if (rc >= 0) {
+                app = get_app_name(list, state->match_data);
+                update_asset(ip_addr, port, IPPROTO_TCP, list->service, app);
+                banner_add((const u_char *)data, dlen, hash, list, app,
+                           !partial && !list->soft);
+                return 1;
+            }
+
+            /* Nothing before a partial match can match any more. */
+            if (rc == PCRE2_ERROR_PARTIAL) {
+                ms->resume[id] = ovector[0];
+                partial = 1;
+            } else if (list->anchored)
+                ms->dead[w] |= bits & -bits;
+            else
+                ms->resume[id] = dlen;
+        }
     }
 
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION     : stream_size
+ * DESCRIPTION  : This function will return the size of a
+ *              : match stream, arrays included.
+ * INPUT        : None!
+ * RETURN       : Size in bytes
+ * ---------------------------------------------------------- */
+size_t stream_size (void)
+{
+    unsigned int words = prefilter_words();
+
+    return sizeof(MatchStream) + words * 2 * sizeof(u_int64_t)
+           + words * 64 * sizeof(u_int32_t);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : stream_layout
+ * DESCRIPTION  : This function will point the arrays of a
+ *              : match stream into the memory that follows
+ *              : it.
+ * INPUT        : 0 - Match Stream
+ * RETURN       : None!
+ * ---------------------------------------------------------- */
+static void
+stream_layout (MatchStream *ms)
+{
+    unsigned int words = prefilter_words();
+
+    ms->candidates = (u_int64_t *)(ms + 1);
+    ms->dead = ms->candidates + words;
+    ms->resume = (u_int32_t *)(ms->dead + words);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : stream_start
+ * DESCRIPTION  : This function will reset the calling
+ *              : thread's match stream for the first segment
+ *              : of a flow.  Nothing is allocated:  the flow
+ *              : copies it with stream_keep() if it has to
+ *              : be carried on.
+ * INPUT        : None!
+ * RETURN       : Pointer to MatchStream
+ * ---------------------------------------------------------- */
+MatchStream *stream_start (void)
+{
+    MatchStream *ms = get_match_state()->stream;
+    unsigned int words = prefilter_words();
+
+    ms->scanned = 0;
+    ms->pf_state = 0;
+    prefilter_scan(NULL, 0, ms->candidates);    /* Signatures without a literal */
+    memset(ms->dead, 0, words * sizeof(u_int64_t));
+    memset(ms->resume, 0, words * 64 * sizeof(u_int32_t));
+    return ms;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : stream_keep
+ * DESCRIPTION  : This function will copy the calling thread's
+ *              : match stream for a flow.
+ * INPUT        : 0 - Memory for the copy (stream_size() bytes)
+ * RETURN       : Pointer to MatchStream
+ * ---------------------------------------------------------- */
+MatchStream *stream_keep (void *mem)
+{
+    MatchStream *ms = (MatchStream *) mem;
+
+    memcpy(ms, get_match_state()->stream, stream_size());
+    stream_layout(ms);
+    return ms;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : udp_port_add
+ * DESCRIPTION  : This function will register a UDP signature
+ *              : for a port.
+ * INPUT        : 0 - Port (host order)
+ *              : 1 - Signature
+ * RETURN       : None!
+ * ---------------------------------------------------------- */
+static void
+udp_port_add (u_int16_t port, Signature *sig)
+{
+    UdpPort *up = NULL;
+    unsigned int i;
+
+    /* Signatures are only read once;  a linear search will do. */
+    for (i = 0; i < udp_port_count; i++) {
+        if (udp_ports[i].port == port) {
+            up = &udp_ports[i];
+            break;
+        }
+    }
+
+    if (up == NULL) {
+        udp_ports = (UdpPort *) realloc(udp_ports, (udp_port_count + 1) * sizeof(UdpPort));
+        if (udp_ports == NULL)
+            err_message("Unable to allocate UDP signature index");
+        up = &udp_ports[udp_port_count++];
+        up->port = port;
+        up->count = 0;
+        up->sigs = NULL;
+    }
+
+    up->sigs = (Signature **) realloc(up->sigs, (up->count + 1) * sizeof(Signature *));
+    if (up->sigs == NULL)
+        err_message("Unable to allocate UDP signature index");
+    up->sigs[up->count++] = sig;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : udp_port_cmp
+ * DESCRIPTION  : This function will order UDP ports for qsort()
+ *              : and bsearch().
+ * INPUT        : 0 - UdpPort
+ *              : 1 - UdpPort
+ * RETURN       : <0, 0, >0
+ * ---------------------------------------------------------- */
+static int
+udp_port_cmp (const void *a, const void *b)
+{
+    return (int)((const UdpPort *)a)->port - (int)((const UdpPort *)b)->port;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : udp_ports_build
+ * DESCRIPTION  : This function will sort the UDP signature
+ *              : index and mark its ports.  It is called once
+ *              : all signatures have been read.
+ * INPUT        : None!
+ * RETURN       : None!
+ * ---------------------------------------------------------- */
+static void
+udp_ports_build (void)
+{
+    unsigned int i;
+
+    if (udp_port_count > 0)
+        qsort(udp_ports, udp_port_count, sizeof(UdpPort), udp_port_cmp);
+
+    memset(udp_port_map, 0, sizeof(udp_port_map));
+    for (i = 0; i < udp_port_count; i++)
+        udp_port_map[udp_ports[i].port >> 6] |= 1ULL << (udp_ports[i].port & 63);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : udp_port_known
+ * DESCRIPTION  : This function will tell whether UDP
+ *              : signatures are registered for a port, i.e.
+ *              : whether datagrams from it are responses of
+ *              : a server worth identifying.
+ * INPUT        : 0 - Port (host order)
+ * RETURN       : 0 - No
+ *              : 1 - Yes
+ * ---------------------------------------------------------- */
+int udp_port_known (u_int16_t port)
+{
+    return (udp_port_map[port >> 6] >> (port & 63)) & 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : get_udp_ports
+ * DESCRIPTION  : This function will return the UDP signature
+ *              : index, sorted by port.
+ * INPUT        : 0 - Number of Ports (returned)
+ * RETURN       : UdpPort Array
+ * ---------------------------------------------------------- */
+UdpPort *get_udp_ports (unsigned int *count)
+{
+    *count = udp_port_count;
+    return udp_ports;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : udp_identify
+ * DESCRIPTION  : This function will take a UDP payload sent
+ *              : from a server port and match it against the
+ *              : signatures registered for that port only.
+ *              : Each datagram uses up one of the endpoint's
+ *              : identification attempts.
+ * INPUT        : 0 - IP Address
+ *              : 1 - UDP Port
+ *              : 2 - Packet Payload
+ *              : 3 - Packet Payload Length
+ * RETURN       : 0 - i_attempts = 0 (nothing to do)
+ *              : 1 - Payload inspected, asset still unidentified
+ *              : 2 - Payload inspected, asset is finished
+ *              :     (identified or out of attempts)
+ * ---------------------------------------------------------- */
+int udp_identify (struct in_addr ip_addr,
+           u_int16_t port,
+           char *payload,
+           int plen)
+{
+    MatchState *state;
+    UdpPort key, *up;
+    unsigned short i_attempts;
+    char *hex_payload;
+    size_t mark;
+    unsigned int i;
+    StrId app;
+
+    key.port = ntohs(port);
+    if ((up = bsearch(&key, udp_ports, udp_port_count, sizeof(UdpPort), udp_port_cmp)) == NULL)
+        return 0;
+
+    if ((i_attempts = take_i_attempt(ip_addr, port, IPPROTO_UDP)) == 0)
+        return 0;
+    i_attempts--;
+
+    mark = arena_mark();
+    hex_payload = fasthex((u_char *) payload, plen);
+    add_hex_payload(ip_addr, port, IPPROTO_UDP, hex_payload);
+    arena_release(mark);
+
+    /* Responses differ in every datagram (DNS IDs, NTP timestamps), so the
+     * banner cache is of no use here. */
+    state = get_match_state();
+    for (i = 0; i < up->count; i++) {
+        if (match_signature(state, up->sigs[i], payload, plen, 0, 0) >= 0) {
+            app = get_app_name(up->sigs[i], state->match_data);
+            update_asset(ip_addr, port, IPPROTO_UDP, up->sigs[i]->service, app);
+
+            /* MATCH! */
+            i_attempts = 0;
+            update_i_attempts(ip_addr, port, IPPROTO_UDP, 0);
+            break;
+        }
+    }
+
+    /* Print asset if this is the last time to identify it. */
+    if (i_attempts == 0) {
+        print_asset(ip_addr, port, IPPROTO_UDP);
+        return 2;
+    }
+
+    return 1;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION     : get_app_name
  * DESCRIPTION  : This function will take the results of a
  *              : pcre match and compile the application name
  *              : based off of the signature.
+ *              : A name with captured parts is only interned
+ *              : while they fit in the string pool's share of
+ *              : asset_max;  otherwise the signature's own
+ *              : application name is used.
  * INPUT        : 0 - Signature Pointer
- *              : 1 - payload
- *              : 2 - ovector
- *              : 3 - rc (return from pcre_exec)
- * RETURN       : processed app name
+ *              : 1 - Match Data (from pcre2_match)
+ * RETURN       : processed app name (string pool ID)
  * ---------------------------------------------------------- */
-bstring get_app_name (Signature *sig,
-            const char *payload,
-            int *ovector,
-            int rc)
+StrId get_app_name (Signature *sig,
+            pcre2_match_data *match_data)
 {
     char sub[100];
     char app[5000];
     char expr[100];
-    bstring retval;
+    PCRE2_SIZE len;
+    StrId id;
     int i = 0;
     int n = 0;
     int x = 0;
@@ -355,7 +900,9 @@ bstring get_app_name (Signature *sig,
             i++;
             n = atoi(&app[i]);
 
-            pcre_copy_substring(payload, ovector, rc, n, expr, sizeof(expr));
+            len = sizeof(expr);
+            if (pcre2_substring_copy_bynumber(match_data, n, (PCRE2_UCHAR *)expr, &len) < 0)
+                expr[0] = '\0';
             x = 0;
             while (expr[x] != '\0' && z < (sizeof(sub) - 1)) {
                 sub[z] = expr[x];
@@ -374,9 +921,82 @@ bstring get_app_name (Signature *sig,
     }
     sub[z] = '\0';
 
-    retval = bstrcpy(bfromcstr(sub));
-    return retval;
+    /* Names without captures come from the signature file alone. */
+    if (strchr(app, '$') == NULL)
+        return str_intern_blk(sub, z);
+    if ((id = str_intern_captured(sub, z)) != STR_NONE)
+        return id;
+    if (sig->title.app != NULL && strchr(bdata(sig->title.app), '$') == NULL)
+        return str_intern(sig->title.app);
+    return STR_UNKNOWN;
+
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : get_match_state
+ * DESCRIPTION  : This function will return the calling
+ *              : thread's match resources, creating them
+ *              : the first time it is called.
+ * INPUT        : None!
+ * RETURN       : Pointer to MatchState
+ * ---------------------------------------------------------- */
+MatchState *get_match_state (void)
+{
+    MatchState *state;
+
+    if (match_state != NULL)
+        return match_state;
+
+    if ((state = (MatchState *) calloc(1, sizeof(MatchState))) == NULL)
+        err_message("Unable to allocate match state");
+
+    state->context = pcre2_match_context_create(NULL);
+    state->match_data = pcre2_match_data_create(MATCH_PAIRS, NULL);
+    state->candidates = (u_int64_t *) calloc(prefilter_words() + 1, sizeof(u_int64_t));
+    if ((state->stream = (MatchStream *) calloc(1, stream_size())) != NULL)
+        stream_layout(state->stream);
+    if (state->context == NULL || state->match_data == NULL || state->candidates == NULL
+            || state->stream == NULL)
+        err_message("Unable to allocate match state");
+
+#ifndef DISABLE_PCRE_JIT
+    /* Without a stack of its own, JIT code is limited to 32K of stack. */
+    if (signature_jit > 0) {
+        if ((state->jit_stack = pcre2_jit_stack_create(JIT_STACK_MIN, JIT_STACK_MAX, NULL)) == NULL)
+            err_message("Unable to allocate JIT stack");
+        pcre2_jit_stack_assign(state->context, NULL, state->jit_stack);
+    }
+#endif /* DISABLE_PCRE_JIT */
+
+    match_state = state;
+    return state;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : end_match_state
+ * DESCRIPTION  : This function will free the calling
+ *              : thread's match resources.
+ * INPUT        : None!
+ * RETURN       : None!
+ * ---------------------------------------------------------- */
+void end_match_state (void)
+{
+    if (match_state == NULL)
+        return;
 
+    if (match_state->match_data != NULL)
+        pcre2_match_data_free(match_state->match_data);
+    if (match_state->jit_stack != NULL)
+        pcre2_jit_stack_free(match_state->jit_stack);
+    if (match_state->context != NULL)
+        pcre2_match_context_free(match_state->context);
+    if (match_state->candidates != NULL)
+        free(match_state->candidates);
+    if (match_state->stream != NULL)
+        free(match_state->stream);
+
+    free(match_state);
+    match_state = NULL;
 }
 
 /* ----------------------------------------------------------
@@ -395,21 +1015,32 @@ void end_identification()
         next = signature_list->next;
 
         /* Free bstring allocations. */
-        if (signature_list->service != NULL)
-            bdestroy(signature_list->service);
         if (signature_list->title.app != NULL)
             bdestroy(signature_list->title.app);
         if (signature_list->title.ver != NULL)
             bdestroy(signature_list->title.ver);
         if (signature_list->title.misc != NULL)
             bdestroy(signature_list->title.misc);
-
-        /* Free Record */
-        if (signature_list != NULL)
-            free (signature_list);
+        if (signature_list->regex != NULL)
+            pcre2_code_free(signature_list->regex);
 
         signature_list = next;
     }
+    slab_destroy(&signature_slab);
+
+    if (signature_index != NULL)
+        free(signature_index);
+    signature_index = NULL;
+    while (udp_port_count > 0)
+        free(udp_ports[--udp_port_count].sigs);
+    if (udp_ports != NULL)
+        free(udp_ports);
+    udp_ports = NULL;
+    signature_count = 0;
+    signature_jit = 0;
+    end_match_state();
+    end_prefilter();
+    end_banner_cache();
 }
 
 /* ----------------------------------------------------------
@@ -431,7 +1062,7 @@ void print_signature()
 
     while (list != NULL) {
         printf("[ %d ] ------------------\n", i);
-        printf("1:  %s\n", bdata(list->service));
+        printf("1:  %s\n", bdata(str_get(list->service)));
         printf("2a: %s\n", bdata(list->title.app));
         printf("2b: %s\n", bdata(list->title.ver));
         printf("2c: %s\n", bdata(list->title.misc));
@@ -26,13 +26,69 @@
  *
  **************************************************************************/
 
+/* DEFINES ----------------------------------------- */
+#define MATCH_PAIRS 10              /* Captured substrings ($0 - $9) */
+#define JIT_STACK_MIN (32 * 1024)   /* Initial JIT stack size */
+#define JIT_STACK_MAX (512 * 1024)  /* Largest JIT stack size */
+#define UDP_SIG_PORTS 16            /* Ports listed by one UDP signature */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * MatchStream:  How far the signatures got in a stream of server data that
+ * grows one segment at a time.  The arrays follow the structure in the same
+ * allocation.
+ * -------------------------------------------------------------------------- */
+typedef struct _MatchStream
+{
+    u_int32_t scanned;              /* Bytes seen by the prefilter */
+    u_int32_t pf_state;             /* Prefilter state after 'scanned' bytes */
+    u_int64_t *candidates;          /* Signatures whose literal has been seen */
+    u_int64_t *dead;                /* Signatures that can no longer match */
+    u_int32_t *resume;              /* Offset each signature resumes at */
+} MatchStream;
+
+/* --------------------------------------------------------------------------
+ * MatchState:  Resources used to run signatures.  Each thread that runs
+ * signatures has its own, so nothing is allocated per match.
+ * -------------------------------------------------------------------------- */
+typedef struct _MatchState
+{
+    pcre2_match_context *context;   /* Match Context (JIT stack) */
+    pcre2_jit_stack *jit_stack;     /* JIT Stack */
+    pcre2_match_data *match_data;   /* Captured Substrings */
+    u_int64_t *candidates;          /* Prefilter Candidate Set */
+    MatchStream *stream;            /* Stream of a flow's first segment */
+} MatchState;
+
+/* --------------------------------------------------------------------------
+ * UdpPort:  The UDP signatures registered for a port, in file order.
+ * -------------------------------------------------------------------------- */
+typedef struct _UdpPort
+{
+    u_int16_t port;                 /* Port (host order) */
+    unsigned int count;             /* Number of signatures */
+    Signature **sigs;               /* Signatures */
+} UdpPort;
+
+
 /* PROTOTYPES -------------------------------------- */
 int init_identification(void);
 int parse_raw_signature (bstring line, int lineno);
 int add_signature (Signature *sig);
-int tcp_identify (struct in_addr ip_addr, u_int16_t port, char *payload, int plen);
+int tcp_identify (struct in_addr ip_addr, u_int16_t port, char *payload, int plen, const char *data, int dlen, MatchStream *ms, int last);
 int pcre_identify (struct in_addr ip_addr, u_int16_t port, unsigned short proto, const char *payload, int plen);
-bstring get_app_name (Signature *sig, const char *payload, int *ovector, int rc);
+int stream_identify (struct in_addr ip_addr, u_int16_t port, const char *data, int dlen, MatchStream *ms, int last);
+size_t stream_size (void);
+MatchStream *stream_start (void);
+MatchStream *stream_keep (void *mem);
+int udp_identify (struct in_addr ip_addr, u_int16_t port, char *payload, int plen);
+int udp_port_known (u_int16_t port);
+UdpPort *get_udp_ports (unsigned int *count);
+StrId get_app_name (Signature *sig, pcre2_match_data *match_data);
+MatchState *get_match_state (void);
+void end_match_state (void);
 void end_identification (void);
 
 #ifdef DEBUG
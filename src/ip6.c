@@ -0,0 +1,563 @@
+/*************************************************************************
+ * ip6.c
+ *
+ * This module lets the rest of PADS handle IPv6 addresses as 32 bit keys.
+ * Storage, the pending filter, the flow table and identification are all
+ * keyed by a struct in_addr;  an IPv4 address is its own key and costs
+ * nothing extra.  An IPv6 address is interned the first time it is needed
+ * as an asset key and gets a handle from the class E range (240.0.0.0/5),
+ * which never shows up as a real source address.  The address itself can
+ * be found again from the handle when it is printed.
+ *
+ * Only servers (and the first client of each new asset) are interned.
+ * Other clients are folded into 248.0.0.0/5 by a hash, which is good
+ * enough to tell flows apart.
+ *
+ * Addresses are stored in fixed size chunks that are never moved, so a
+ * handle can be resolved without taking the lock.  The asset and ARP
+ * records count the keys they hold;  an address goes back on the free
+ * list with the last of them.  Once asset_max and arp_max are both set,
+ * the store is limited to what those records can hold.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "ip6.h"
+#include "util.h"
+
+/* Variable Declarations */
+Ip6Entry **ip6_store;                   /* Address chunks, by handle */
+u_int32_t *ip6_index;                   /* Hash index of handle + 1 (0 = empty) */
+u_int32_t ip6_mask;                     /* Number of index slots - 1 */
+u_int32_t ip6_count;                    /* Handles handed out so far */
+u_int32_t ip6_used;                     /* Handles in use (in the index) */
+u_int32_t ip6_limit;                    /* Handles in use at most */
+u_int32_t ip6_free_head = IP6_NIL;      /* Oldest free handle */
+u_int32_t ip6_free_tail = IP6_NIL;      /* Newest free handle */
+u_int32_t ip6_serial;                   /* New addresses seen (wraps) */
+u_int32_t ip6_swept;                    /* ip6_serial at the last sweep */
+u_int32_t ip6_grace;                    /* New addresses before an unused one may go */
+Ip6Stats ip6_stats;
+pthread_rwlock_t ip6_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_hash
+ * DESCRIPTION	: This function will hash an IPv6 address.
+ * INPUT	: 0 - IPv6 Address
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+static inline u_int32_t
+ip6_hash (const struct in6_addr *addr)
+{
+    u_int64_t h, l;
+
+    memcpy(&h, &addr->s6_addr[0], sizeof(h));
+    memcpy(&l, &addr->s6_addr[8], sizeof(l));
+    h ^= l * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return (u_int32_t)h;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_slot
+ * DESCRIPTION	: This function will return the entry stored
+ *		: under a handle number.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: Pointer to Ip6Entry
+ * ---------------------------------------------------------- */
+static inline Ip6Entry *
+ip6_slot (u_int32_t n)
+{
+    return &ip6_store[n / IP6_CHUNK][n % IP6_CHUNK];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_find
+ * DESCRIPTION	: This function will look an address up in the
+ *		: index.  The caller holds the lock.
+ * INPUT	: 0 - IPv6 Address
+ *		: 1 - Hash Value
+ * RETURN	: Handle Number + 1 (0 = not found)
+ * ---------------------------------------------------------- */
+static u_int32_t
+ip6_find (const struct in6_addr *addr, u_int32_t hash)
+{
+    u_int32_t i;
+
+    if (ip6_index == NULL)
+	return 0;
+
+    for (i = hash & ip6_mask; ip6_index[i] != 0; i = (i + 1) & ip6_mask) {
+	if (memcmp(&ip6_slot(ip6_index[i] - 1)->addr, addr, sizeof(*addr)) == 0)
+	    return ip6_index[i];
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_place
+ * DESCRIPTION	: This function will add a handle to the index.
+ *		: The caller holds the lock for writing.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+ip6_place (u_int32_t n)
+{
+    u_int32_t i;
+
+    for (i = ip6_hash(&ip6_slot(n)->addr) & ip6_mask; ip6_index[i] != 0; i = (i + 1) & ip6_mask)
+	;
+    ip6_index[i] = n + 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_grow
+ * DESCRIPTION	: This function will double the size of the
+ *		: index (or create it).  The caller holds the
+ *		: lock for writing.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+ip6_grow (void)
+{
+    u_int32_t size, n;
+
+    size = (ip6_index == NULL) ? IP6_INDEX_MIN : (ip6_mask + 1) * 2;
+    free(ip6_index);
+    if ((ip6_index = (u_int32_t *) calloc(size, sizeof(u_int32_t))) == NULL)
+	err_message("Unable to allocate IPv6 address index (%u slots)", size);
+    ip6_mask = size - 1;
+
+    /* Every address in use is in the store, so the index is simply rebuilt. */
+    for (n = 0; n < ip6_count; n++)
+	if (ip6_slot(n)->refs != IP6_FREE)
+	    ip6_place(n);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_free
+ * DESCRIPTION	: This function will take a handle out of the
+ *		: index and put it at the end of the free list,
+ *		: so that it is handed out again as late as
+ *		: possible.  The caller holds the lock for
+ *		: writing.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+ip6_free (u_int32_t n)
+{
+    u_int32_t i, j, k;
+
+    for (i = ip6_hash(&ip6_slot(n)->addr) & ip6_mask; ip6_index[i] != n + 1; i = (i + 1) & ip6_mask)
+	;
+
+    /* Shift the rest of the probe sequence back over the hole. */
+    for (j = (i + 1) & ip6_mask; ip6_index[j] != 0; j = (j + 1) & ip6_mask) {
+	k = ip6_hash(&ip6_slot(ip6_index[j] - 1)->addr) & ip6_mask;
+	if (((j - k) & ip6_mask) >= ((j - i) & ip6_mask)) {
+	    ip6_index[i] = ip6_index[j];
+	    i = j;
+	}
+    }
+    ip6_index[i] = 0;
+    ip6_used--;
+
+    ip6_slot(n)->refs = IP6_FREE;
+    ip6_slot(n)->next = IP6_NIL;
+    if (ip6_free_tail != IP6_NIL)
+	ip6_slot(ip6_free_tail)->next = n;
+    else
+	ip6_free_head = n;
+    ip6_free_tail = n;
+    ip6_stats.released++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_sweep
+ * DESCRIPTION	: This function will free the addresses that
+ *		: were interned but never stored by any record
+ *		: (the asset was not added after all).  Only
+ *		: addresses that have not been handed out while
+ *		: ip6_grace new addresses came along are taken,
+ *		: as a packet may still be on its way to storage
+ *		: with the key.
+ *		: The caller holds the lock for writing.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+ip6_sweep (void)
+{
+    Ip6Entry *e;
+    u_int32_t n;
+
+    if (ip6_serial - ip6_swept < ip6_grace)
+	return;
+    ip6_swept = ip6_serial;
+
+    for (n = 0; n < ip6_count; n++) {
+	e = ip6_slot(n);
+	if (e->refs == 0 && ip6_serial - e->born >= ip6_grace)
+	    ip6_free(n);
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_key
+ * DESCRIPTION	: This function will turn a handle number into
+ *		: a key.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: Key
+ * ---------------------------------------------------------- */
+static inline struct in_addr
+ip6_key (u_int32_t n)
+{
+    struct in_addr key;
+
+    key.s_addr = htonl(IP6_HANDLE_NET | n);
+    return key;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_lookup
+ * DESCRIPTION	: This function will find the key of an IPv6
+ *		: address that has already been interned.
+ * INPUT	: 0 - IPv6 Address
+ *		: 1 - Key (output)
+ * RETURN	: 0 - Not interned
+ *		: 1 - Found
+ * ---------------------------------------------------------- */
+int
+ip6_lookup (const struct in6_addr *addr, struct in_addr *key)
+{
+    u_int32_t n;
+
+    /* Nothing has been interned yet. */
+    if (__atomic_load_n(&ip6_count, __ATOMIC_ACQUIRE) == 0)
+	return 0;
+
+    pthread_rwlock_rdlock(&ip6_lock);
+    n = ip6_find(addr, ip6_hash(addr));
+    pthread_rwlock_unlock(&ip6_lock);
+
+    if (n == 0)
+	return 0;
+    *key = ip6_key(n - 1);
+    return 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_touch
+ * DESCRIPTION	: This function will keep an address that no
+ *		: record holds yet from being swept, as it has
+ *		: just been handed out again.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+ip6_touch (u_int32_t n)
+{
+    Ip6Entry *e = ip6_slot(n);
+
+    if (__atomic_load_n(&e->refs, __ATOMIC_RELAXED) == 0)
+	__atomic_store_n(&e->born, __atomic_load_n(&ip6_serial, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_intern
+ * DESCRIPTION	: This function will find the key of an IPv6
+ *		: address, interning the address if it is new.
+ *		: A new address gets a fresh handle while the
+ *		: store is below its limit, the oldest free
+ *		: handle otherwise.
+ * INPUT	: 0 - IPv6 Address
+ *		: 1 - Key (output)
+ * RETURN	: 0 - The store is full
+ *		: 1 - Success
+ * ---------------------------------------------------------- */
+int
+ip6_intern (const struct in6_addr *addr, struct in_addr *key)
+{
+    Ip6Entry *e;
+    u_int32_t hash, n;
+
+    hash = ip6_hash(addr);
+
+    /* Known addresses only need the read lock. */
+    if (__atomic_load_n(&ip6_count, __ATOMIC_ACQUIRE) > 0) {
+	pthread_rwlock_rdlock(&ip6_lock);
+	if ((n = ip6_find(addr, hash)) != 0)
+	    ip6_touch(n - 1);
+	pthread_rwlock_unlock(&ip6_lock);
+	if (n != 0) {
+	    *key = ip6_key(n - 1);
+	    return 1;
+	}
+    }
+
+    pthread_rwlock_wrlock(&ip6_lock);
+
+    /* Someone else may have been quicker. */
+    if ((n = ip6_find(addr, hash)) != 0) {
+	ip6_touch(n - 1);
+	goto found;
+    }
+
+    if (ip6_limit == 0) {
+	/* Each asset holds at most two addresses, each ARP entry one. */
+	ip6_limit = IP6_HANDLES;
+	if (gc.asset_max > 0 && gc.arp_max > 0
+		&& (u_int64_t) gc.asset_max * 2 + gc.arp_max + IP6_CHUNK < IP6_HANDLES)
+	    ip6_limit = gc.asset_max * 2 + gc.arp_max + IP6_CHUNK;
+	/* A small store is swept more often. */
+	ip6_grace = (ip6_limit / 4 < IP6_GRACE) ? ip6_limit / 4 : IP6_GRACE;
+    }
+    ip6_serial++;
+    if (ip6_used >= ip6_limit)
+	ip6_sweep();
+
+    if (ip6_count < ip6_limit) {
+	if (ip6_store == NULL
+		&& (ip6_store = (Ip6Entry **) calloc(IP6_HANDLES / IP6_CHUNK,
+			sizeof(Ip6Entry *))) == NULL)
+	    err_message("Unable to allocate IPv6 address store");
+	if (ip6_count % IP6_CHUNK == 0
+		&& (ip6_store[ip6_count / IP6_CHUNK] = (Ip6Entry *) malloc(IP6_CHUNK
+			* sizeof(Ip6Entry))) == NULL)
+	    err_message("Unable to allocate IPv6 address store");
+	n = ip6_count;
+    } else if (ip6_free_head != IP6_NIL) {
+	n = ip6_free_head;
+	if ((ip6_free_head = ip6_slot(n)->next) == IP6_NIL)
+	    ip6_free_tail = IP6_NIL;
+    } else {
+	ip6_stats.full++;
+	pthread_rwlock_unlock(&ip6_lock);
+	return 0;
+    }
+
+    /* Grow the index once it is 3/4 full. */
+    if (ip6_index == NULL || (ip6_used + 1) * 4 > (ip6_mask + 1) * 3)
+	ip6_grow();
+
+    e = ip6_slot(n);
+    memcpy(&e->addr, addr, sizeof(*addr));
+    e->refs = 0;
+    e->born = ip6_serial;
+    e->next = IP6_NIL;
+    ip6_place(n);
+    ip6_used++;
+    if (n == ip6_count)
+	__atomic_store_n(&ip6_count, n + 1, __ATOMIC_RELEASE);
+    ip6_stats.addresses++;
+    n++;
+
+found:
+    pthread_rwlock_unlock(&ip6_lock);
+    *key = ip6_key(n - 1);
+    return 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_hold
+ * DESCRIPTION	: This function will count a record that keeps
+ *		: a key.  Other keys are ignored.
+ * INPUT	: 0 - Key
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ip6_hold (struct in_addr key)
+{
+    Ip6Entry *e;
+    u_int32_t n;
+
+    if (!IP6_HANDLE(key))
+	return;
+
+    n = ntohl(key.s_addr) - IP6_HANDLE_NET;
+    pthread_rwlock_wrlock(&ip6_lock);
+    if (n < ip6_count && (e = ip6_slot(n))->refs != IP6_FREE)
+	e->refs++;
+    pthread_rwlock_unlock(&ip6_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_release
+ * DESCRIPTION	: This function will let go of a key held by
+ *		: ip6_hold().  The address is freed with the
+ *		: last record that held it.
+ * INPUT	: 0 - Key
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ip6_release (struct in_addr key)
+{
+    Ip6Entry *e;
+    u_int32_t n;
+
+    if (!IP6_HANDLE(key))
+	return;
+
+    n = ntohl(key.s_addr) - IP6_HANDLE_NET;
+    pthread_rwlock_wrlock(&ip6_lock);
+    if (n < ip6_count && (e = ip6_slot(n))->refs != IP6_FREE && e->refs > 0
+	    && --e->refs == 0)
+	ip6_free(n);
+    pthread_rwlock_unlock(&ip6_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_fold
+ * DESCRIPTION	: This function will fold an IPv6 address into
+ *		: a key, without interning it.  Folded keys
+ *		: cannot be turned back into addresses.
+ * INPUT	: 0 - IPv6 Address
+ * RETURN	: Key
+ * ---------------------------------------------------------- */
+struct in_addr
+ip6_fold (const struct in6_addr *addr)
+{
+    struct in_addr key;
+
+    key.s_addr = htonl(IP6_FOLD_NET | (ip6_hash(addr) & (IP6_HANDLES - 1)));
+    return key;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip6_address
+ * DESCRIPTION	: This function will return the IPv6 address
+ *		: that a key stands for.
+ * INPUT	: 0 - Key
+ * RETURN	: Pointer to Address (NULL = not an interned
+ *		: IPv6 address)
+ * ---------------------------------------------------------- */
+const struct in6_addr *
+ip6_address (struct in_addr key)
+{
+    u_int32_t n;
+
+    if (!IP6_HANDLE(key))
+	return NULL;
+
+    n = ntohl(key.s_addr) - IP6_HANDLE_NET;
+    if (n >= __atomic_load_n(&ip6_count, __ATOMIC_ACQUIRE))
+	return NULL;
+
+    return &ip6_slot(n)->addr;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip_ntop
+ * DESCRIPTION	: This function will print the address that a
+ *		: key stands for.
+ * INPUT	: 0 - Key
+ *		: 1 - Buffer (INET6_ADDRSTRLEN)
+ *		: 2 - Size of Buffer
+ * RETURN	: Buffer
+ * ---------------------------------------------------------- */
+const char *
+ip_ntop (struct in_addr key, char *dst, size_t size)
+{
+    const struct in6_addr *addr;
+
+    if (!IP6_KEY(key))
+	inet_ntop(AF_INET, &key, dst, size);
+    else if ((addr = ip6_address(key)) != NULL)
+	inet_ntop(AF_INET6, addr, dst, size);
+    else
+	strlcpy(dst, "::", size);
+
+    return dst;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ip_pton
+ * DESCRIPTION	: This function will parse an IPv4 or IPv6
+ *		: address into a key.
+ * INPUT	: 0 - Address String
+ *		: 1 - Key (output)
+ * RETURN	: 0 - Not a valid address
+ *		: 1 - Success
+ * ---------------------------------------------------------- */
+int
+ip_pton (const char *src, struct in_addr *key)
+{
+    struct in6_addr addr;
+
+    if (strchr(src, ':') == NULL)
+	return (inet_pton(AF_INET, src, key) == 1 && !IP6_KEY(*key));
+
+    if (inet_pton(AF_INET6, src, &addr) != 1)
+	return 0;
+    return ip6_intern(&addr, key);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_ip6_stats
+ * DESCRIPTION	: This function will return the address store
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to Ip6Stats
+ * ---------------------------------------------------------- */
+Ip6Stats *
+get_ip6_stats (void)
+{
+    return &ip6_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_ip6
+ * DESCRIPTION	: This function will free the address store.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_ip6 (void)
+{
+    u_int32_t i;
+
+    if (ip6_store != NULL) {
+	for (i = 0; i < IP6_HANDLES / IP6_CHUNK && ip6_store[i] != NULL; i++)
+	    free(ip6_store[i]);
+	free(ip6_store);
+	ip6_store = NULL;
+    }
+    free(ip6_index);
+    ip6_index = NULL;
+    ip6_count = 0;
+    ip6_used = 0;
+    ip6_limit = 0;
+    ip6_free_head = IP6_NIL;
+    ip6_free_tail = IP6_NIL;
+}
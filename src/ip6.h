@@ -0,0 +1,84 @@
+/*************************************************************************
+ * ip6.h
+ *
+ * This header file contains information relating to the ip6.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_IP6_H
+#define INCLUDED_IP6_H
+
+#include "global.h"
+
+#include <netinet/in.h>
+
+/* DEFINES ----------------------------------------- */
+#define IP6_HANDLE_NET 0xf0000000   /* 240.0.0.0/5:  interned addresses */
+#define IP6_FOLD_NET 0xf8000000     /* 248.0.0.0/5:  folded addresses */
+#define IP6_HANDLES 0x08000000      /* Size of each range */
+#define IP6_CHUNK 4096              /* Addresses per chunk of the store */
+#define IP6_INDEX_MIN 1024          /* Initial size of the address index */
+#define IP6_FREE 0xffffffff         /* Reference count of an unused handle */
+#define IP6_NIL 0xffffffff          /* End of the free handle list */
+#define IP6_GRACE 16384             /* Most new addresses before an unused one may go */
+
+/*
+ * Keys in 240.0.0.0/4 (class E) stand for IPv6 addresses.  Real packets
+ * from that range are dropped by the decoders.
+ */
+#define IP6_KEY(a)	((ntohl((a).s_addr) & 0xf0000000) == IP6_HANDLE_NET)
+#define IP6_HANDLE(a)	((ntohl((a).s_addr) & 0xf8000000) == IP6_HANDLE_NET)
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * Ip6Entry:  An interned address and the number of asset and ARP records
+ * that hold its key.  The handle goes back on the free list when the last
+ * record lets go of it.
+ * -------------------------------------------------------------------------- */
+typedef struct _Ip6Entry
+{
+    struct in6_addr addr;       /* IPv6 Address */
+    u_int32_t refs;             /* Records holding the key (IP6_FREE = unused) */
+    u_int32_t born;             /* Intern serial when last handed out */
+    u_int32_t next;             /* Next free handle */
+} Ip6Entry;
+
+/* --------------------------------------------------------------------------
+ * Ip6Stats:  IPv6 address store counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _Ip6Stats
+{
+    unsigned long addresses;    /* Addresses interned. */
+    unsigned long released;     /* Addresses no record held any more. */
+    unsigned long full;         /* Addresses refused because the store was full. */
+} Ip6Stats;
+
+
+/* PROTOTYPES -------------------------------------- */
+int ip6_intern (const struct in6_addr *addr, struct in_addr *key);
+int ip6_lookup (const struct in6_addr *addr, struct in_addr *key);
+struct in_addr ip6_fold (const struct in6_addr *addr);
+void ip6_hold (struct in_addr key);
+void ip6_release (struct in_addr key);
+const struct in6_addr *ip6_address (struct in_addr key);
+const char *ip_ntop (struct in_addr key, char *dst, size_t size);
+int ip_pton (const char *src, struct in_addr *key);
+Ip6Stats *get_ip6_stats (void);
+void end_ip6 (void);
+
+#endif /* INCLUDED_IP6_H */
@@ -35,11 +35,15 @@
 #include "global.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include "mac-resolution.h"
+#include "slab.h"
+#include "strpool.h"
 #include "util.h"
 
 Vendor *vendor_list = NULL;
+Slab vendor_slab = SLAB_INITIALIZER("Vendors", Vendor, 0);
 
 /* ----------------------------------------------------------
  * FUNCTION     : init_mac_resolution
@@ -106,7 +110,7 @@ int parse_raw_mac (bstring line)
     int m1, m2, m3;
 
     /* Parse out the contents of the line. */
-    if (sscanf(bdata(line), "%02X:%02X:%02X %80[^,\n],\n", &m1, &m2, &m3, vendor) != 4)
+    if (sscanf(bdata(line), "%02X:%02X:%02X %79[^,\n],\n", &m1, &m2, &m3, vendor) != 4)
         return -1;
 
     mac[0] = (char) (m1);
@@ -128,16 +132,16 @@ int parse_raw_mac (bstring line)
  * DESCRIPTION  : This function will add a MAC vendor to the
  *              : vendor data structure.
  * INPUT        : 0 - MAC Address (bstring)
- *              : 1 - Vendor (bstring)
+ *              : 1 - Vendor (interned in the string pool)
  * ---------------------------------------------------------- */
 int add_vendor (char *mac, char *vendor){
     Vendor *list;
     Vendor *rec;
 
     /* Assign data to temporary data structure. */
-    rec = (Vendor*) malloc (sizeof (Vendor));
+    rec = (Vendor *) slab_alloc(&vendor_slab);
     rec->mac = *(int *) mac;
-    rec->vendor = bfromcstr(vendor);
+    rec->vendor = str_intern_blk(vendor, strlen(vendor));
     rec->next = NULL;
 
     /* Place data structure in MAC address list. */
@@ -163,9 +167,9 @@ int add_vendor (char *mac, char *vendor){
  * DESCRIPTION  : This function will retrieve the vendor name
  *              : for a given MAC address.
  * INPUT        : 0 - MAC Address
- * RETURN       : Vendor Name
+ * RETURN       : Vendor Name (STR_NONE = not found)
  * ---------------------------------------------------------- */
-bstring get_vendor (char *m)
+StrId get_vendor (char *m)
 {
     Vendor *list;
     char mac[4];
@@ -186,7 +190,7 @@ bstring get_vendor (char *m)
     }
 
     /* Nothing Found */
-    return NULL;
+    return STR_NONE;
 }
 
 /* ----------------------------------------------------------
@@ -197,19 +201,8 @@ bstring get_vendor (char *m)
  * RETURN       : None
  * ---------------------------------------------------------- */
 void end_mac_resolution (void){
-
-    Vendor *list, *next;
-
-    list = vendor_list;
-
-    while (list != NULL) {
-        next = list->next;
-        if (list->vendor != NULL)
-            bdestroy(list->vendor);
-        if (list != NULL)
-            free (list);
-        list = next;
-    }
+    vendor_list = NULL;
+    slab_destroy(&vendor_slab);
 }
 
 #ifdef DEBUG
@@ -219,7 +212,7 @@ void show_vendor (void){
     list = vendor_list;
 
     while(list != NULL) {
-        printf("Mac: %s\nVendor: %s\n\n", list->mac, bdata(list->vendor));
+        printf("Mac: %06x\nVendor: %s\n\n", list->mac, bdata(str_get(list->vendor)));
         list = list->next;
     }
 }
@@ -38,7 +38,7 @@
 int init_mac_resolution (void);
 int parse_raw_mac (bstring line);
 int add_vendor (char *mac, char *vendor);
-bstring get_vendor (char *m);
+StrId get_vendor (char *m);
 void end_mac_resolution (void);
 
 #ifdef DEBUG
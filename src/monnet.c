@@ -34,12 +34,18 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <stdlib.h>
+#include <string.h>
 #include <arpa/inet.h>
 
 #include "monnet.h"
+#include "ip6.h"
+#include "slab.h"
 #include "util.h"
 
 struct mon_net *mn;
+struct mon_net6 *mn6;
+Slab monnet_slab = SLAB_INITIALIZER("Networks", struct mon_net, 0);
+Slab monnet6_slab = SLAB_INITIALIZER("IPv6 Networks", struct mon_net6, 0);
 
 /* ----------------------------------------------------------
  * FUNCTION	: parse_networks
@@ -47,14 +53,14 @@ struct mon_net *mn;
  *		: '-n' switch and place it into a data
  *		: structure.  This input will be formated in
  *		: the following format:
- *			192.168.0.0/24,10.10.10.0/16
+ *			192.168.0.0/24,10.10.10.0/16,2001:db8::/32
  * INPUT	: 0 - Raw Input
  * RETURN	: None!
 * ---------------------------------------------------------- */
 void parse_networks (char *cmdline)
 {
     int i = 0;
-    char network[16], netmask[3], tmp[16];
+    char network[INET6_ADDRSTRLEN], netmask[4], tmp[INET6_ADDRSTRLEN];
 
     /* Make sure something was defined. */
     if (cmdline == NULL)
@@ -85,7 +91,7 @@ void parse_networks (char *cmdline)
 	    /* Exit if it's the end of the string. */
 	    if (*cmdline =='\0')
 		break;
-	} else {
+	} else if (i < sizeof(tmp) - 1) {
 	    tmp[i] = *cmdline;
 	    i++;
 	}
@@ -158,6 +164,12 @@ void add_monnet(char *network, char *netmask)
 
     nmask = atoi(netmask);
 
+    /* IPv6 networks are kept apart. */
+    if (strchr(network, ':') != NULL) {
+	add_monnet6(network, nmask);
+	return;
+    }
+
     /* Ensure that the netmask is correct. */
     if (nmask < 1 && nmask > 32)
 	return;
@@ -167,7 +179,7 @@ void add_monnet(char *network, char *netmask)
 	return;
 
     /* Create structure array and assign data to it. */
-    rec = (struct mon_net*)malloc(sizeof(struct mon_net));
+    rec = (struct mon_net *) slab_alloc(&monnet_slab);
     rec->netmask = htonl(netmasks[nmask]);
     rec->network = ((unsigned long) net_addr.s_addr & rec->netmask);
     rec->next = NULL;
@@ -188,6 +200,40 @@ void add_monnet(char *network, char *netmask)
     }
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: add_monnet6
+ * DESCRIPTION	: This function will add a monitored IPv6
+ *		: network.
+ * INPUT	: 0 - (char *) Network
+ *		: 1 - Prefix Length
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void add_monnet6 (char *network, int prefix)
+{
+    struct mon_net6 *rec, **tail;
+    struct in6_addr net_addr;
+    int i;
+
+    if (prefix < 1 || prefix > 128)
+	return;
+    if (inet_pton(AF_INET6, network, &net_addr) != 1)
+	return;
+
+    rec = (struct mon_net6 *) slab_calloc(&monnet6_slab);
+    for (i = 0; i < 16; i++) {
+	if (prefix >= 8)
+	    rec->netmask.s6_addr[i] = 0xff;
+	else if (prefix > 0)
+	    rec->netmask.s6_addr[i] = (u_int8_t)(0xff << (8 - prefix));
+	prefix -= (prefix >= 8) ? 8 : prefix;
+	rec->network.s6_addr[i] = net_addr.s6_addr[i] & rec->netmask.s6_addr[i];
+    }
+
+    for (tail = &mn6; *tail != NULL; tail = &(*tail)->next)
+	;
+    *tail = rec;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION	: check_monnet
  * DESCRIPTION	: This function will check to see whether a
@@ -201,9 +247,13 @@ short check_monnet (const struct in_addr ip_addr)
 {
     struct mon_net *data;
 
+    /* Keys of IPv6 addresses are checked against the IPv6 networks. */
+    if (IP6_KEY(ip_addr))
+	return check_monnet6(ip6_address(ip_addr));
+
     if (mn == NULL) {
-	/* No monitored networks */
-	return 1;
+	/* No monitored networks (or only IPv6 ones) */
+	return (mn6 == NULL);
     } else {
 	/* Go through monitored networks. */
 	data = mn;
@@ -221,3 +271,76 @@ short check_monnet (const struct in_addr ip_addr)
     /* Asset does not fall within a monitored network. */
     return 0;
 }
+
+/* ----------------------------------------------------------
+ * FUNCTION	: check_monnet6
+ * DESCRIPTION	: This function will check to see whether an
+ *		: IPv6 address falls within the monitored
+ *		: networks.
+ * INPUT	: 0 - IPv6 Address
+ * RETURN	: 0 - No, skip asset
+ *		: 1 - Yes, process asset
+ * ---------------------------------------------------------- */
+short check_monnet6 (const struct in6_addr *ip_addr)
+{
+    struct mon_net6 *data;
+    int i;
+
+    if (ip_addr == NULL)
+	return 0;
+    if (mn6 == NULL)
+	return (mn == NULL);
+
+    for (data = mn6; data != NULL; data = data->next) {
+	for (i = 0; i < 16; i++) {
+	    if ((ip_addr->s6_addr[i] & data->netmask.s6_addr[i]) != data->network.s6_addr[i])
+		break;
+	}
+	if (i == 16)
+	    return 1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: monnet_filter
+ * DESCRIPTION	: This function will build a libpcap filter
+ *		: expression that matches packets sent from
+ *		: the monitored networks of one family.
+ * INPUT	: 0 - Address Family (AF_INET / AF_INET6)
+ * RETURN	: Filter expression (NULL = no monitored
+ *		: networks, everything is monitored;  empty =
+ *		: nothing of this family is monitored)
+ * ---------------------------------------------------------- */
+bstring monnet_filter (int af)
+{
+    struct mon_net *data;
+    struct mon_net6 *data6;
+    struct in_addr net;
+    char buf[INET6_ADDRSTRLEN];
+    bstring filter;
+    int bits, i;
+
+    if (mn == NULL && mn6 == NULL)
+	return NULL;
+
+    filter = bfromcstr("");
+    if (af == AF_INET6) {
+	for (data6 = mn6; data6 != NULL; data6 = data6->next) {
+	    for (bits = 0, i = 0; i < 16; i++)
+		bits += __builtin_popcount(data6->netmask.s6_addr[i]);
+	    bformata(filter, "%ssrc net %s/%d", (data6 == mn6) ? "" : " or ",
+		     inet_ntop(AF_INET6, &data6->network, buf, sizeof(buf)), bits);
+	}
+	return filter;
+    }
+
+    for (data = mn; data != NULL; data = data->next) {
+	net.s_addr = data->network;
+	bformata(filter, "%ssrc net %s/%d", (data == mn) ? "" : " or ",
+		 inet_ntoa(net), __builtin_popcountl(data->netmask));
+    }
+
+    return filter;
+}
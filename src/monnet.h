@@ -33,12 +33,23 @@ struct mon_net {
     struct mon_net *next;
 };
 
+struct mon_net6 {
+    struct in6_addr	network;
+    struct in6_addr	netmask;
+    struct mon_net6 *next;
+};
+
 
 /* PROTOTYPES -------------------------------------- */
 void parse_networks (char *cmdline);
 void init_netmasks (unsigned int nm[33]);
 void add_monnet(char *network, char *netmask);
+void add_monnet6 (char *network, int prefix);
 short check_monnet (const struct in_addr ip_addr);
+short check_monnet6 (const struct in6_addr *ip_addr);
+bstring monnet_filter (int af);
 
 
 /* GLOBALS ----------------------------------------- */
+extern struct mon_net *mn;         /* Monitored Networks */
+extern struct mon_net6 *mn6;       /* Monitored IPv6 Networks */
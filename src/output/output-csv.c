@@ -29,10 +29,13 @@
 #include "global.h"
  
 #include <stdio.h>
+#include <unistd.h>
 #include <arpa/inet.h>
  
 #include "output.h"
 #include "output-csv.h"
+#include "ip6.h"
+#include "strpool.h"
 #include "util.h"
 
 OutputCSVConf output_csv_conf;
@@ -57,6 +60,9 @@ setup_output_csv (void)
     plugin->print_asset = print_asset_csv;
     plugin->print_arp = print_arp_asset_csv;
     plugin->print_stat = NULL;
+    plugin->print_expired = NULL;
+    plugin->print_arp_expired = NULL;
+    plugin->rewrite = rewrite_output_csv;
     plugin->end = end_output_csv;
 
     /* Register plugin with input module. */
@@ -72,9 +78,9 @@ setup_output_csv (void)
 /* ----------------------------------------------------------
  * FUNCTION	: init_output_csv
  * DESCRIPTION	: This function will initialize the output
- *		: CSV file.  If the file already exists, it
- *		: will read in the file and add each asset
- *		: to the asset data structure.
+ *		: CSV file.  If the file already exists, its
+ *		: assets are read by reload_output_csv() once
+ *		: the configuration has been processed.
  * INPUT	: 0 - CSV filename
  * RETURN	: None!
  * --------------------------------------------------------- */
@@ -96,7 +102,7 @@ init_output_csv (bstring filename)
 
 	/* File does not exist, create new.. */
 	if ((output_csv_conf.file = fopen(bdata(output_csv_conf.filename), "w")) != NULL) {
-	    fprintf(output_csv_conf.file, "asset,port,proto,service,application,discovered\n");
+	    output_csv_conf.size = fprintf(output_csv_conf.file, CSV_HEADER);
 
 	} else {
 	    err_message("Cannot open file %s!", bdata(output_csv_conf.filename));
@@ -104,19 +110,38 @@ init_output_csv (bstring filename)
 
     } else {
 
-	/* File does exist, read it into data structure. */
+	/* File does exist, read it into data structure later. */
 	fclose(fp);
-	read_report_file();
+	output_csv_conf.reload = 1;
 
 	/* Open file and assign it to the global FILE pointer.  */
 	if ((output_csv_conf.file = fopen(bdata(output_csv_conf.filename), "a")) == NULL) {
 	    err_message("Cannot open file %s!", bdata(output_csv_conf.filename));
 	}
+	fseek(output_csv_conf.file, 0, SEEK_END);
+	output_csv_conf.size = ftell(output_csv_conf.file);
     }
 
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: reload_output_csv
+ * DESCRIPTION	: This function will read the existing report
+ *		: file, if there was one.
+ * INPUT	: None
+ * RETURN	: None
+ * ---------------------------------------------------------- */
+void
+reload_output_csv (void)
+{
+    if (!output_csv_conf.reload)
+	return;
+
+    output_csv_conf.reload = 0;
+    read_report_file();
+}
+
 /* ----------------------------------------------------------
  * FUNCTION	: read_report_file
  * DESCRIPTION	: This function will read in a specified
@@ -194,7 +219,7 @@ parse_raw_report (bstring line)
     }
 
     /* Place data from 'list' into temporary data storage. */
-    if ((inet_aton(bdata(list->entry[0]), &ip_addr)) == -1)
+    if ((ip_pton(bdata(list->entry[0]), &ip_addr)) != 1)
 	ret = -1;
 
     if ((port = htons(atoi(bdata(list->entry[1])))) == -1)
@@ -223,7 +248,7 @@ parse_raw_report (bstring line)
 	add_arp_asset(ip_addr, mac_addr, discovered);
     } else {
 	/* Everything Else */
-	add_asset_csv(ip_addr, port, proto, service, application, discovered);
+	add_asset_csv(ip_addr, port, proto, str_intern(service), str_intern(application), discovered);
     }
 
     // Clean Up
@@ -253,13 +278,16 @@ parse_raw_report (bstring line)
 int
 print_asset_csv (Asset *rec)
 {
+    char ip[INET6_ADDRSTRLEN];
+
     if (output_csv_conf.file != NULL) {
-	if (gc.hide_unknowns == 0 || ((biseqcstr(rec->service, "unknown") != 0) &&
-		    (biseqcstr(rec->application, "unknown") != 0))) {
-	    fprintf(output_csv_conf.file, "%s,%d,%d,%s,%s,%d\n",
-		    inet_ntoa(rec->ip_addr), ntohs(rec->port), rec->proto, bdata(rec->service),
-		    bdata(rec->application), (int)rec->discovered);
-	    fflush(output_csv_conf.file);
+	if (gc.hide_unknowns == 0 || rec->service != STR_UNKNOWN
+		|| rec->application != STR_UNKNOWN) {
+	    output_csv_conf.size += fprintf(output_csv_conf.file, "%s,%d,%d,%s,%s,%d\n",
+		    ip_ntop(rec->ip_addr, ip, sizeof(ip)), ntohs(rec->port), rec->proto, bdata(str_get(rec->service)),
+		    bdata(str_get(rec->application)), (int)rec->discovered);
+	    if (!output_csv_conf.rewriting)
+		fflush(output_csv_conf.file);
 	}
     } else {
 	fprintf(stderr, "[!] ERROR:  File handle not open!\n");
@@ -282,17 +310,21 @@ print_asset_csv (Asset *rec)
 int
 print_arp_asset_csv (ArpAsset *rec)
 {
+    char ip[INET6_ADDRSTRLEN];
+
     /* Print to File */
     if (output_csv_conf.file != NULL) {
-	if (rec->mac_resolved != NULL) {
-	    fprintf(output_csv_conf.file, "%s,0,0,ARP (%s),%s,%d\n", inet_ntoa(rec->ip_addr),
-		    bdata(rec->mac_resolved), hex2mac(rec->mac_addr), (int)rec->discovered);
-	} else {
-	    fprintf(output_csv_conf.file, "%s,0,0,ARP,%s,%d\n", inet_ntoa(rec->ip_addr),
+	if (rec->mac_resolved != STR_NONE) {
+	    output_csv_conf.size += fprintf(output_csv_conf.file, "%s,0,0,ARP (%s),%s,%d\n",
+		    ip_ntop(rec->ip_addr, ip, sizeof(ip)), bdata(str_get(rec->mac_resolved)),
 		    hex2mac(rec->mac_addr), (int)rec->discovered);
+	} else {
+	    output_csv_conf.size += fprintf(output_csv_conf.file, "%s,0,0,ARP,%s,%d\n",
+		    ip_ntop(rec->ip_addr, ip, sizeof(ip)), hex2mac(rec->mac_addr), (int)rec->discovered);
 	}
 
-	fflush(output_csv_conf.file);
+	if (!output_csv_conf.rewriting)
+	    fflush(output_csv_conf.file);
     } else {
 	fprintf(stderr, "[!] ERROR:  File handle not open!\n");
 	return -1;
@@ -301,6 +333,68 @@ print_arp_asset_csv (ArpAsset *rec)
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: rewrite_output_csv
+ * DESCRIPTION	: This function will replace the CSV file with
+ *		: one line per asset and ARP entry:  at the
+ *		: first snapshot, then whenever the file has
+ *		: grown to twice the size it had after the last
+ *		: rewrite.  Assets that have expired are left
+ *		: out.  New lines are appended to the new file.
+ * INPUT	: 0 - Dump of all records
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+rewrite_output_csv (OutputDump *dump)
+{
+    FILE *fp, *old;
+    bstring tmp_file;
+    unsigned long size;
+
+    if (output_csv_conf.file == NULL || output_csv_conf.size <= 2 * output_csv_conf.base)
+	return 0;
+
+    tmp_file = bstrcpy(output_csv_conf.filename);
+    bcatcstr(tmp_file, ".tmp");
+
+    if ((fp = fopen(bdata(tmp_file), "w")) == NULL) {
+	log_message("warning:  Unable to rewrite CSV file %s", bdata(tmp_file));
+	bdestroy(tmp_file);
+	return -1;
+    }
+
+    /* The printing functions write to the new file. */
+    old = output_csv_conf.file;
+    size = output_csv_conf.size;
+    output_csv_conf.file = fp;
+    output_csv_conf.size = fprintf(fp, CSV_HEADER);
+    output_csv_conf.rewriting = 1;
+    (*dump->walk)(dump, print_asset_csv, print_arp_asset_csv);
+    output_csv_conf.rewriting = 0;
+
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0
+	    || rename(bdata(tmp_file), bdata(output_csv_conf.filename)) != 0) {
+	log_message("warning:  Unable to rewrite CSV file %s", bdata(output_csv_conf.filename));
+	fclose(fp);
+	unlink(bdata(tmp_file));
+	output_csv_conf.file = old;
+	output_csv_conf.size = size;
+	bdestroy(tmp_file);
+	return -1;
+    }
+
+    verbose_message("Rewrote %s:  %lu bytes instead of %lu",
+		    bdata(output_csv_conf.filename), output_csv_conf.size, size);
+
+    /* Clean Up */
+    fclose(old);
+    output_csv_conf.base = output_csv_conf.size;
+    bdestroy(tmp_file);
+
+    return 0;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION	: end_output_csv
  * DESCRIPTION	: This function will free the memory declared
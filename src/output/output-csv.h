@@ -27,11 +27,19 @@
  **************************************************************************/
 
 
+/* DEFINES ----------------------------------------- */
+#define CSV_HEADER "asset,port,proto,service,application,discovered\n"
+
+
 /* TYPEDEFS ---------------------------------------- */
 typedef struct _OutputCSVConf
 {
     FILE *file;
     bstring filename;
+    int reload;			/* Existing file to be read - 0 = No, 1 = Yes */
+    int rewriting;		/* Writing a new file - 0 = No, 1 = Yes */
+    unsigned long size;		/* Bytes in the file */
+    unsigned long base;		/* Bytes in the file when it was rewritten */
 } OutputCSVConf;
 
 
@@ -42,8 +50,10 @@ typedef struct _OutputCSVConf
 /* PROTOTYPES -------------------------------------- */
 int setup_output_csv (void);
 int init_output_csv (bstring filename);
+void reload_output_csv (void);
 void read_report_file (void);
 int parse_raw_report (bstring line);
 int print_asset_csv (Asset *rec);
 int print_arp_asset_csv (ArpAsset *rec);
+int rewrite_output_csv (OutputDump *dump);
 int end_output_csv (void);
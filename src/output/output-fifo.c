@@ -35,6 +35,8 @@
  
 #include "output.h"
 #include "output-fifo.h"
+#include "ip6.h"
+#include "strpool.h"
 #include "util.h"
 
 /*
@@ -52,6 +54,8 @@
  * 01			TCP / ICMP Asset Discovered
  * 02			ARP Asset Discovered
  * 03			TCP / ICMP Statistic Information
+ * 04			TCP / UDP / ICMP Asset Expired
+ * 05			ARP Asset Expired
  *
  * The following lines contains an example of the data written to the
  * FIFO:
@@ -60,9 +64,15 @@
  * 01,10.10.10.83,168430163,22,6,ssh,OpenSSH 3.8.1 (Protocol 2.0),1100846817
  * 02,10.10.10.81,168430161,3Com 3CRWE73796B,00:50:da:5a:2d:ae,1100846817
  * 03,10.10.10.83,168430163,22,6,1100847309
+ * 04,10.10.10.83,168430163,22,6,1100850909
+ * 05,10.10.10.81,168430161,00:50:da:5a:2d:ae,1100850909
  *
+ * IPv6 addresses have no such number;  0 is written instead.
  */
 
+/* Decimal form of an address for Sguil (0 for IPv6). */
+#define FIFO_DECIMAL(a)	(IP6_KEY(a) ? 0 : ntohl((a).s_addr))
+
 OutputFIFOConf output_fifo_conf;
 
 /* ----------------------------------------------------------
@@ -85,6 +95,9 @@ setup_output_fifo (void)
     plugin->print_asset = print_asset_fifo;
     plugin->print_arp = print_arp_asset_fifo;
     plugin->print_stat = print_stat_fifo;
+    plugin->print_expired = print_expired_fifo;
+    plugin->print_arp_expired = print_arp_expired_fifo;
+    plugin->rewrite = NULL;
     plugin->end = end_output_fifo;
 
     /* Register plugin with input module. */
@@ -140,22 +153,22 @@ init_output_fifo (bstring fifo_file)
 int
 print_asset_fifo (Asset *rec)
 {
-    char sip[16];
-    char dip[16];
+    char sip[INET6_ADDRSTRLEN];
+    char dip[INET6_ADDRSTRLEN];
 
-     inet_ntop(AF_INET, &rec->c_ip_addr, sip, 17);
-     inet_ntop(AF_INET, &rec->ip_addr, dip, 17);
+    ip_ntop(rec->c_ip_addr, sip, sizeof(sip));
+    ip_ntop(rec->ip_addr, dip, sizeof(dip));
 
     if (output_fifo_conf.file != NULL) {
-	if (gc.hide_unknowns == 0 || ((biseq(rec->service, bfromcstr("unknown")) != 0) &&
-		    (biseq(rec->application, bfromcstr("unknown")) != 0))) {
+	if (gc.hide_unknowns == 0 || rec->service != STR_UNKNOWN
+		|| rec->application != STR_UNKNOWN) {
             if (rec->proto == IPPROTO_TCP) {
                 /* pads_agent.tcl process each line until it receivs a dot by itself */
 	        fprintf(output_fifo_conf.file, "01\n%s\n%u\n%s\n%u\n%d\n%d\n%d\n%s\n%s\n%d\n%s\n.\n",
-		        sip, ntohl(rec->c_ip_addr.s_addr), 
-		        dip, ntohl(rec->ip_addr.s_addr), 
+		        sip, FIFO_DECIMAL(rec->c_ip_addr),
+		        dip, FIFO_DECIMAL(rec->ip_addr),
                         ntohs(rec->c_port), ntohs(rec->port), rec->proto, 
-                        bdata(rec->service), bdata(rec->application), 
+                        bdata(str_get(rec->service)), bdata(str_get(rec->application)), 
                         (int)rec->discovered, bdata(rec->hex_payload));
 	        fflush(output_fifo_conf.file);
             }
@@ -180,19 +193,19 @@ print_asset_fifo (Asset *rec)
 int
 print_arp_asset_fifo (ArpAsset *rec)
 {
-    char ip[16];
+    char ip[INET6_ADDRSTRLEN];
     /* Print to File */
     if (output_fifo_conf.file != NULL) {
-    inet_ntop(AF_INET, &rec->ip_addr.s_addr, ip, 16);
-	if (rec->mac_resolved != NULL) {
+    ip_ntop(rec->ip_addr, ip, sizeof(ip));
+	if (rec->mac_resolved != STR_NONE) {
             /* pads_agent.tcl process each line until it receivs a dot by itself */
 	    fprintf(output_fifo_conf.file, "02\n%s\n%u\n%s\n%s\n%d\n.\n", ip,
-		    ntohl(rec->ip_addr.s_addr), bdata(rec->mac_resolved), 
+		    FIFO_DECIMAL(rec->ip_addr), bdata(str_get(rec->mac_resolved)), 
                     hex2mac(rec->mac_addr), (int)rec->discovered);
 	} else {
             /* pads_agent.tcl process each line until it receivs a dot by itself */
 	    fprintf(output_fifo_conf.file, "02\n%s\n%u\nunknown\n%s\n%d\n.\n", ip,
-		    ntohl(rec->ip_addr.s_addr), hex2mac(rec->mac_addr), (int)rec->discovered);
+		    FIFO_DECIMAL(rec->ip_addr), hex2mac(rec->mac_addr), (int)rec->discovered);
 	}
 
 	fflush(output_fifo_conf.file);
@@ -217,9 +230,9 @@ print_arp_asset_fifo (ArpAsset *rec)
 int
 print_stat_fifo (Asset *rec)
 {
-    char ip[16];
+    char ip[INET6_ADDRSTRLEN];
 
-    inet_ntop(AF_INET, &rec->ip_addr, ip, 17);
+    ip_ntop(rec->ip_addr, ip, sizeof(ip));
 
     if (output_fifo_conf.file != NULL) {
         /* pads_agent.tcl process each line until it receivs a dot by itself */
@@ -235,6 +248,67 @@ print_stat_fifo (Asset *rec)
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: print_expired_fifo
+ * DESCRIPTION	: This function will print an asset that has
+ *		: expired to the FIFO file, with the time it
+ *		: was last seen.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+print_expired_fifo (Asset *rec)
+{
+    char ip[INET6_ADDRSTRLEN];
+
+    ip_ntop(rec->ip_addr, ip, sizeof(ip));
+
+    if (output_fifo_conf.file != NULL) {
+        /* pads_agent.tcl process each line until it receivs a dot by itself */
+	fprintf(output_fifo_conf.file, "04\n%s\n%u\n%d\n%d\n%d\n.\n",
+		ip, FIFO_DECIMAL(rec->ip_addr), ntohs(rec->port), rec->proto,
+		(int)rec->last_seen);
+	fflush(output_fifo_conf.file);
+
+    } else {
+	fprintf(stderr, "[!] ERROR:  File handle not open!\n");
+	return -1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: print_arp_expired_fifo
+ * DESCRIPTION	: This function will print an ARP entry that
+ *		: has expired to the FIFO file.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+print_arp_expired_fifo (ArpAsset *rec)
+{
+    char ip[INET6_ADDRSTRLEN];
+
+    ip_ntop(rec->ip_addr, ip, sizeof(ip));
+
+    if (output_fifo_conf.file != NULL) {
+        /* pads_agent.tcl process each line until it receivs a dot by itself */
+	fprintf(output_fifo_conf.file, "05\n%s\n%u\n%s\n%d\n.\n",
+		ip, FIFO_DECIMAL(rec->ip_addr), hex2mac(rec->mac_addr),
+		(int)rec->last_seen);
+	fflush(output_fifo_conf.file);
+
+    } else {
+	fprintf(stderr, "[!] ERROR:  File handle not open!\n");
+	return -1;
+    }
+
+    return 0;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION	: end_output_fifo
  * DESCRIPTION	: This function will free the memory declared
@@ -44,6 +44,8 @@ int init_output_fifo (bstring fifo_file);
 int print_asset_fifo (Asset *rec);
 int print_arp_asset_fifo (ArpAsset *rec);
 int print_stat_fifo (Asset *rec);
+int print_expired_fifo (Asset *rec);
+int print_arp_expired_fifo (ArpAsset *rec);
 int end_output_fifo (void);
 const char *u_ntop(const struct in6_addr ip_addr, int af, char *dest);
 
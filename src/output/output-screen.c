@@ -33,6 +33,8 @@
 
 #include "output.h"
 #include "output-screen.h"
+#include "ip6.h"
+#include "strpool.h"
 #include "util.h"
 
 /* ----------------------------------------------------------
@@ -55,6 +57,9 @@ setup_output_screen (void)
     plugin->print_asset = print_asset_screen;
     plugin->print_arp = print_arp_asset_screen;
     plugin->print_stat = NULL;
+    plugin->print_expired = print_expired_screen;
+    plugin->print_arp_expired = print_arp_expired_screen;
+    plugin->rewrite = NULL;
     plugin->end = end_output_screen;
 
     /* Register plugin with input module. */
@@ -99,10 +104,12 @@ init_output_screen (bstring args)
 int
 print_asset_screen (Asset *rec)
 {
+    char ip[INET6_ADDRSTRLEN];
+
     /* Print to Screen */
     fprintf(stdout, "[*] Asset Found:  Port - %d / Host - %s / Service - %s / Application - %s\n",
-	    ntohs(rec->port), inet_ntoa(rec->ip_addr),
-	    bdata(rec->service), bdata(rec->application));
+	    ntohs(rec->port), ip_ntop(rec->ip_addr, ip, sizeof(ip)),
+	    bdata(str_get(rec->service)), bdata(str_get(rec->application)));
 
     return 0;
 }
@@ -120,18 +127,61 @@ print_asset_screen (Asset *rec)
 int
 print_arp_asset_screen (ArpAsset *rec)
 {
+    char ip[INET6_ADDRSTRLEN];
+
     /* Print to Screen */
-    if(rec->mac_resolved != NULL) {
+    if(rec->mac_resolved != STR_NONE) {
 	fprintf(stdout, "[*] Asset Found:  IP Address - %s / MAC Address - %s (%s)\n",
-		inet_ntoa(rec->ip_addr), hex2mac(rec->mac_addr), bdata(rec->mac_resolved));
+		ip_ntop(rec->ip_addr, ip, sizeof(ip)), hex2mac(rec->mac_addr), bdata(str_get(rec->mac_resolved)));
     } else {
 	fprintf(stdout, "[*] Asset Found:  IP Address - %s / MAC Address - %s\n",
-		inet_ntoa(rec->ip_addr), hex2mac(rec->mac_addr));
+		ip_ntop(rec->ip_addr, ip, sizeof(ip)), hex2mac(rec->mac_addr));
     }
 
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: print_expired_screen
+ * DESCRIPTION	: This function will print an asset that has
+ *		: expired to the screen.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+print_expired_screen (Asset *rec)
+{
+    char ip[INET6_ADDRSTRLEN];
+
+    /* Print to Screen */
+    fprintf(stdout, "[*] Asset Expired:  Port - %d / Host - %s / Service - %s / Application - %s\n",
+	    ntohs(rec->port), ip_ntop(rec->ip_addr, ip, sizeof(ip)),
+	    bdata(str_get(rec->service)), bdata(str_get(rec->application)));
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: print_arp_expired_screen
+ * DESCRIPTION	: This function will print an ARP entry that
+ *		: has expired to the screen.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+print_arp_expired_screen (ArpAsset *rec)
+{
+    char ip[INET6_ADDRSTRLEN];
+
+    /* Print to Screen */
+    fprintf(stdout, "[*] Asset Expired:  IP Address - %s / MAC Address - %s\n",
+	    ip_ntop(rec->ip_addr, ip, sizeof(ip)), hex2mac(rec->mac_addr));
+
+    return 0;
+}
+
 /* ----------------------------------------------------------
  * FUNCTION	: free_output_screen
  * DESCRIPTION	: This function will free the memory declared
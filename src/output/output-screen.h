@@ -32,4 +32,6 @@ int setup_output_screen (void);
 int init_output_screen (bstring args);
 int print_asset_screen (Asset *rec);
 int print_arp_asset_screen (ArpAsset *rec);
+int print_expired_screen (Asset *rec);
+int print_arp_expired_screen (ArpAsset *rec);
 int end_output_screen (void);
@@ -29,16 +29,38 @@
 /* INCLUDES ---------------------------------------- */
 #include "global.h"
 
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "output.h"
 #include "output-screen.h"
 #include "output-fifo.h"
 #include "output-csv.h"
+#include "slab.h"
 #include "storage.h"
+#include "util.h"
 
 /* Global Variables */
 OutputPluginList *output_plugin_list;
+Slab plugin_slab = SLAB_INITIALIZER("Output Plugins", OutputPluginList, 0);
+Slab event_slab = SLAB_INITIALIZER("Output Events", OutputEvent, 1);
+int output_stats;               /* Does an active plugin print statistics? */
+
+/*
+ * Output Writer:  With several workers, assets are printed by a single
+ * writer thread, so that the plugins never run concurrently and a slow
+ * FIFO reader does not hold up packet processing.  Workers queue a copy
+ * of the record.
+ */
+OutputEvent *output_head;
+OutputEvent *output_tail;
+pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t output_cond = PTHREAD_COND_INITIALIZER;
+pthread_t output_thread;
+int output_writer;              /* Is the writer thread running? */
+int output_closing;             /* No more events will be queued. */
 
 /* ----------------------------------------------------------
  * FUNCTION	: init_output()
@@ -80,7 +102,7 @@ int register_output_plugin (OutputPlugin *plugin)
 	return -1;
 
     /* Create OutputPluginList Record */
-    list = (OutputPluginList*)malloc(sizeof(OutputPluginList));
+    list = (OutputPluginList *) slab_alloc(&plugin_slab);
     list->plugin = plugin;
     list->active = 0;
     list->next = NULL;
@@ -128,6 +150,8 @@ int activate_output_plugin (bstring name, bstring args)
 	if ((biseq(plugin->name, name)) == 1) {
 	    /* MATCH! Set record to active and run 'init' function. */
 	    list->active = 1;
+	    if (plugin->print_stat != NULL)
+		output_stats = 1;
 	    if (plugin != NULL && plugin->init != NULL)
 		(*plugin->init)(args);
 	    break;
@@ -140,90 +164,231 @@ int activate_output_plugin (bstring name, bstring args)
 }
 
 /* ----------------------------------------------------------
- * FUNCTION	: print_asset
- * DESCRIPTION	: This function is an interface between the
- *		: output modules and the rest of the PADS
- *		: application.  It will print out a standard
- *		: asset.
- * INPUT	: 0 - IP Address
- *		: 1 - Port
- *		: 2 - Proto
- *              : 3 - Hex Payload
- * RETURN	: 0 - Success
- *		: -1 - Error
+ * FUNCTION	: reload_output
+ * DESCRIPTION	: This function will read the assets of the
+ *		: last run back from the report file of the
+ *		: CSV plugin (if it is active).
+ * INPUT	: None!
+ * RETURN	: None!
  * ---------------------------------------------------------- */
-int print_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+void
+reload_output (void)
 {
-    OutputPluginList *head;
-    Asset *rec;
-
-    rec = (Asset *)find_asset(ip_addr, port, proto);
+    reload_output_csv();
+}
 
-    /* Make sure that a record was found. */
-    if (rec == NULL)
-	return -1;
+/* ----------------------------------------------------------
+ * FUNCTION	: output_event
+ * DESCRIPTION	: This function will hand an event to each
+ *		: active output plugin and free it.
+ * INPUT	: 0 - Event
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+output_event (OutputEvent *ev)
+{
+    OutputPluginList *head;
 
     /* Cycle through output plugins and print to those that are active. */
     head = output_plugin_list;
     while (head != NULL) {
 	/* Only print to active plugins. */
 	if (head->active == 1) {
-	    if (head->plugin->print_asset)
-		(*head->plugin->print_asset)(rec);
+	    switch (ev->type) {
+		case OUTPUT_ASSET:
+		    if (head->plugin->print_asset)
+			(*head->plugin->print_asset)(&ev->asset);
+		    break;
+		case OUTPUT_ARP:
+		    if (head->plugin->print_arp)
+			(*head->plugin->print_arp)(&ev->arp);
+		    break;
+		case OUTPUT_STAT:
+		    if (head->plugin->print_stat)
+			(*head->plugin->print_stat)(&ev->asset);
+		    break;
+		case OUTPUT_EXPIRED:
+		    if (head->plugin->print_expired)
+			(*head->plugin->print_expired)(&ev->asset);
+		    break;
+		case OUTPUT_ARP_EXPIRED:
+		    if (head->plugin->print_arp_expired)
+			(*head->plugin->print_arp_expired)(&ev->arp);
+		    break;
+		case OUTPUT_REWRITE:
+		    if (head->plugin->rewrite)
+			(*head->plugin->rewrite)(ev->dump);
+		    break;
+	    }
 	}
 
 	head = head->next;
     }
 
-    return 0;
+    if (ev->type == OUTPUT_REWRITE)
+	(*ev->dump->release)(ev->dump);
+    else if (ev->type != OUTPUT_ARP && ev->type != OUTPUT_ARP_EXPIRED)
+	free_asset_copy(&ev->asset);
+    slab_free(&event_slab, ev);
 }
 
 /* ----------------------------------------------------------
- * FUNCTION     : print_arp_asset
- * DESCRIPTION  : This function is an interface between the
- *		: output modules and the rest of the PADS
- *		: application.  It will print out a standard
- *		: asset.
- * INPUT        : 0 - IP Address
- *              : 1 - MAC Address
+ * FUNCTION	: output_put
+ * DESCRIPTION	: This function will queue an event for the
+ *		: writer thread, or print it right away when
+ *		: there is no writer.
+ * INPUT	: 0 - Event
  * RETURN	: None!
  * ---------------------------------------------------------- */
-int print_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN])
+static void
+output_put (OutputEvent *ev)
 {
-    OutputPluginList *head;
+    if (!output_writer) {
+	output_event(ev);
+	return;
+    }
 
-    /* Find Asset */
-    ArpAsset *list;
-    ArpAsset *rec = NULL;
+    ev->next = NULL;
+    pthread_mutex_lock(&output_lock);
+    if (output_tail == NULL)
+	output_head = ev;
+    else
+	output_tail->next = ev;
+    output_tail = ev;
+    pthread_cond_signal(&output_cond);
+    pthread_mutex_unlock(&output_lock);
+}
 
-    list = (ArpAsset *)get_arp_pointer();
-    while (list != NULL) {
-	if (ip_addr.s_addr == list->ip_addr.s_addr
-               && (memcmp(mac_addr, list->mac_addr, MAC_LEN) == 0)) {
+/* ----------------------------------------------------------
+ * FUNCTION	: output_writer_thread
+ * DESCRIPTION	: This is the writer thread.  It prints events
+ *		: until the queue has been closed and drained.
+ * INPUT	: 0 - Not used
+ * RETURN	: NULL
+ * ---------------------------------------------------------- */
+static void *
+output_writer_thread (void *arg)
+{
+    OutputEvent *ev, *next;
 
-	    /* Found! */
-	    rec = list;
+    for (;;) {
+	pthread_mutex_lock(&output_lock);
+	while (output_head == NULL && !output_closing)
+	    pthread_cond_wait(&output_cond, &output_lock);
+	ev = output_head;
+	output_head = output_tail = NULL;
+	pthread_mutex_unlock(&output_lock);
+
+	if (ev == NULL)
 	    break;
-	} else {
-	    list = list->next;
+
+	for (; ev != NULL; ev = next) {
+	    next = ev->next;
+	    output_event(ev);
 	}
     }
 
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_output_writer
+ * DESCRIPTION	: This function will start the writer thread,
+ *		: unless it is running already.  From now on,
+ *		: events are printed in the order in which
+ *		: they were queued.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_output_writer (void)
+{
+    sigset_t all, old;
+
+    if (output_writer)
+	return;
+
+    /* Signals are handled by the main thread only. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&output_thread, NULL, output_writer_thread, NULL) != 0)
+	err_message("Unable to start output thread");
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    output_writer = 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_output_writer
+ * DESCRIPTION	: This function will wait for the writer thread
+ *		: to print what is left on the queue and stop
+ *		: it.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_output_writer (void)
+{
+    if (!output_writer)
+	return;
+
+    pthread_mutex_lock(&output_lock);
+    output_closing = 1;
+    pthread_cond_signal(&output_cond);
+    pthread_mutex_unlock(&output_lock);
+
+    pthread_join(output_thread, NULL);
+    output_writer = 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: print_asset
+ * DESCRIPTION	: This function is an interface between the
+ *		: output modules and the rest of the PADS
+ *		: application.  It will print out a standard
+ *		: asset.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Proto
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int print_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    OutputEvent *ev;
+
+    ev = (OutputEvent *) slab_calloc(&event_slab);
+
     /* Make sure that a record was found. */
-    if (rec == NULL)
+    if (copy_asset(ip_addr, port, proto, &ev->asset) == -1) {
+	slab_free(&event_slab, ev);
 	return -1;
+    }
 
-    /* Cycle through output plugins and print to those that are active. */
-    head = output_plugin_list;
-    while (head != NULL) {
-	/* Only print to active plugins. */
-	if (head->active == 1) {
-	    if (head->plugin->print_arp)
-		(*head->plugin->print_arp)(rec);
-	}
+    ev->type = OUTPUT_ASSET;
+    output_put(ev);
 
-	head = head->next;
-    }
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION     : print_arp_asset
+ * DESCRIPTION  : This function is an interface between the
+ *		: output modules and the rest of the PADS
+ *		: application.  It will print out a new ARP
+ *		: entry.
+ * INPUT        : 0 - Copy of the ArpAsset Record
+ *		:     (upsert_arp_asset)
+ * RETURN	: 0 - Success
+ * ---------------------------------------------------------- */
+int print_arp_asset (ArpAsset *rec)
+{
+    OutputEvent *ev;
+
+    ev = (OutputEvent *) slab_calloc(&event_slab);
+
+    ev->type = OUTPUT_ARP;
+    ev->arp = *rec;
+    output_put(ev);
 
     return 0;
 }
@@ -239,27 +404,90 @@ int print_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN])
  * ---------------------------------------------------------- */
 int print_stat(struct in_addr ip_addr, u_int16_t port, unsigned short proto)
 {
-    OutputPluginList *head;
-    Asset *rec;
+    OutputEvent *ev;
+
+    /* Don't copy the asset unless an active plugin prints connections. */
+    if (!output_stats)
+	return 0;
 
-    rec = (Asset *)find_asset(ip_addr, port, proto);
+    ev = (OutputEvent *) slab_calloc(&event_slab);
 
     /* Make sure that a record was found. */
-    if (rec == NULL)
+    if (copy_asset(ip_addr, port, proto, &ev->asset) == -1) {
+	slab_free(&event_slab, ev);
 	return -1;
+    }
 
-    /* Cycle through output plugins and print to those that are active. */
-    head = output_plugin_list;
+    ev->type = OUTPUT_STAT;
+    output_put(ev);
 
-    while (head != NULL) {
-	/* Only print to active plugins. */
-	if (head->active == 1) {
-	    if (head->plugin->print_stat)
-		(*head->plugin->print_stat)(rec);
-	}
+    return 0;
+}
 
-	head = head->next;
-    }
+/* ----------------------------------------------------------
+ * FUNCTION	: print_expired
+ * DESCRIPTION	: This function will print an asset that has
+ *		: been dropped from storage.  The event takes
+ *		: over the record's hex payload.  It is called
+ *		: with the storage lock held.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: 0 - Success
+ * ---------------------------------------------------------- */
+int print_expired (Asset *rec)
+{
+    OutputEvent *ev;
+
+    ev = (OutputEvent *) slab_calloc(&event_slab);
+
+    ev->type = OUTPUT_EXPIRED;
+    ev->asset = *rec;
+    output_put(ev);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: print_arp_expired
+ * DESCRIPTION	: This function will print an ARP entry that
+ *		: has been dropped from storage.  See
+ *		: print_expired.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: 0 - Success
+ * ---------------------------------------------------------- */
+int print_arp_expired (ArpAsset *rec)
+{
+    OutputEvent *ev;
+
+    ev = (OutputEvent *) slab_calloc(&event_slab);
+
+    ev->type = OUTPUT_ARP_EXPIRED;
+    ev->arp = *rec;
+    ev->arp.next = NULL;
+    ev->arp.prev = NULL;
+    output_put(ev);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: print_rewrite
+ * DESCRIPTION	: This function will hand every asset and ARP
+ *		: entry to the plugins that rewrite their
+ *		: report.  The caller queues it while holding
+ *		: the storage lock, so every change printed
+ *		: before it is in the dump.
+ * INPUT	: 0 - Dump (the event takes over a reference)
+ * RETURN	: 0 - Success
+ * ---------------------------------------------------------- */
+int print_rewrite (OutputDump *dump)
+{
+    OutputEvent *ev;
+
+    ev = (OutputEvent *) slab_calloc(&event_slab);
+
+    ev->type = OUTPUT_REWRITE;
+    ev->dump = dump;
+    output_put(ev);
 
     return 0;
 }
@@ -302,9 +530,10 @@ void end_output (void)
 	    free(tmp);
 
 	/* Free OutputPluginList Record */
-	free(output_plugin_list);
 	output_plugin_list = next;
     }
+    slab_destroy(&plugin_slab);
+    slab_destroy(&event_slab);
 }
 
 #ifdef DEBUG
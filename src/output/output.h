@@ -32,8 +32,32 @@
 #include <bstring/bstrlib.h>
 #include "storage.h"
 
+/* DEFINES ----------------------------------------- */
+#define OUTPUT_ASSET 1
+#define OUTPUT_ARP 2
+#define OUTPUT_STAT 3
+#define OUTPUT_EXPIRED 4
+#define OUTPUT_ARP_EXPIRED 5
+#define OUTPUT_REWRITE 6
+
+
 /* DATA STRUCTURES --------------------------------- */
 
+/* --------------------------------------------------------------------------
+ * OutputDump:  Every asset and ARP entry at one point in time, for plugins
+ * that rewrite their report.  walk() calls the functions for each record
+ * (the records only live during the call);  release() drops the reference
+ * held by the event.
+ * -------------------------------------------------------------------------- */
+typedef struct _OutputDump
+{
+    unsigned long assets;
+    unsigned long arp_entries;
+    void (*walk) (struct _OutputDump *dump, int (*asset) (Asset *rec),
+		  int (*arp) (ArpAsset *rec));
+    void (*release) (struct _OutputDump *dump);
+} OutputDump;
+
 /* --------------------------------------------------------------------------
  * OutputPlugin:  This data structure defines a single output processor.
  * -------------------------------------------------------------------------- */
@@ -44,6 +68,9 @@ typedef struct _OutputPlugin
     int (*print_asset) (Asset *rec);
     int (*print_arp) (ArpAsset *rec);
     int (*print_stat) (Asset *rec);
+    int (*print_expired) (Asset *rec);
+    int (*print_arp_expired) (ArpAsset *rec);
+    int (*rewrite) (OutputDump *dump);
     int (*end) (void);
 } OutputPlugin;
 
@@ -57,13 +84,31 @@ typedef struct _OutputPluginList
     struct _OutputPluginList *next;
 } OutputPluginList;
 
+/* --------------------------------------------------------------------------
+ * OutputEvent:  Something to be printed by the output plugins.
+ * -------------------------------------------------------------------------- */
+typedef struct _OutputEvent
+{
+    int type;				/* OUTPUT_* */
+    Asset asset;			/* Copy of the asset (copy_asset) */
+    ArpAsset arp;			/* Copy of the ARP entry (upsert_arp_asset) */
+    OutputDump *dump;			/* All records (OUTPUT_REWRITE) */
+    struct _OutputEvent *next;
+} OutputEvent;
+
 /* PROTOTYPES -------------------------------------- */
 void init_output();
 int register_output_plugin (OutputPlugin *plugin);
 int activate_output_plugin (bstring name, bstring args);
 int print_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
-int print_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN]);
+int print_arp_asset (ArpAsset *rec);
 int print_stat(struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+int print_expired (Asset *rec);
+int print_arp_expired (ArpAsset *rec);
+int print_rewrite (OutputDump *dump);
+void reload_output (void);
+void init_output_writer (void);
+void end_output_writer (void);
 void end_output (void);
 
 #endif /* INCLUDED_OUTPUT_H */
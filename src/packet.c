@@ -29,10 +29,13 @@
 /* INCLUDES ---------------------------------------- */
 #include "global.h"
 
+#include <pthread.h>
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
 #include <net/ethernet.h>
 
 /* DATA STRUCTURES --------------------------------- */
@@ -53,24 +56,600 @@ struct sll_header {
 };
 #endif /* DLT_LINUX_SLL */
 
+/* SLL2 puts the protocol first;  nothing else is needed. */
+#define SLL2_HDR_LEN	20
+
 /* 802.1Q VLAN tags are 4 bytes long.  */
 #define VLAN_HDRLEN (4 * sizeof(char))
  
 /* This is the decimal equivalent of the VLAN tag's ether frame type */
 #define VLAN_ETHERTYPE 33024
 
+/* Other ethertypes that are walked through. */
+#define QINQ_ETHERTYPE 0x88a8		/* 802.1ad */
+#define QINQ_OLD_ETHERTYPE 0x9100
+#define MPLS_ETHERTYPE 0x8847
+#define MPLS_MC_ETHERTYPE 0x8848
+#define TEB_ETHERTYPE 0x6558		/* Transparent Ethernet Bridging */
+#define ERSPAN2_ETHERTYPE 0x88be	/* ERSPAN type I / II */
+#define ERSPAN3_ETHERTYPE 0x22eb	/* ERSPAN type III */
+
+#define MPLS_HDRLEN 4
+#define MPLS_LABELS 8			/* Deepest label stack walked */
+#define GRE_HDRLEN 4
+#define GRE_CHECKSUM 0x8000
+#define GRE_KEY 0x2000
+#define GRE_SEQUENCE 0x1000
+#define GRE_VERSION 0x0007
+#define ERSPAN2_HDRLEN 8
+#define ERSPAN3_HDRLEN 12
+#define VXLAN_HDRLEN 8
+#define VXLAN_PORT 4789
+#define ENCAP_DEPTH 1			/* Tunnels opened per packet */
+#define IP6_EXTHDRS 8			/* IPv6 extension headers skipped */
+#define NA_HDRLEN 24			/* Neighbor advertisement + target */
+
 #include "packet.h"
 #include "storage.h"
 #include "identification.h"
 #include "output/output.h"
 #include "monnet.h"
+#include "ip6.h"
+#include "flow.h"
+#include "pending.h"
+#include "strpool.h"
+#include "util.h"
+
+/* Workers share the banner dump file. */
+pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Decoder chosen at startup (or by decode_probe) and its parameters. */
+static Decoder decoder;
+static u_int16_t encap_outer;		/* Outer tag of QinQ frames */
+static int encap_labels;		/* MPLS labels in front of IP */
+static int encap_proto;			/* IPPROTO_GRE / IPPROTO_UDP (VXLAN) */
+static const char *encap_names[] = { "auto", "eth", "vlan", "qinq", "mpls", "gre", "vxlan" };
+
+static void decode_gre (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len, Decoded *d, int depth);
+static void decode_vxlan (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len, Decoded *d, int depth);
 
 /* ----------------------------------------------------------
- * FUNCTION	: process_eth
- * DESCRIPTION	: This function will decode and process the
- *		: ethernet contents of a packet.
+ * FUNCTION	: packet_filter
+ * DESCRIPTION	: This function will build a libpcap filter
+ *		: expression that passes only the packets the
+ *		: decoders below act on:  ARP replies, and
+ *		: ICMP echo replies, TCP SYN-ACKs, FINs, RSTs
+ *		: and data segments sent from a monitored
+ *		: network, and UDP datagrams sent from the
+ *		: ports of the UDP signatures.  IPv6 TCP and
+ *		: ICMPv6 are passed
+ *		: whole (libpcap cannot look into IPv6 upper
+ *		: layers), neighbor advertisements even when
+ *		: only IPv4 networks are monitored.  On
+ *		: ethernet, the same is repeated
+ *		: for 802.1Q tagged frames, and QinQ, MPLS,
+ *		: GRE / ERSPAN and VXLAN packets are passed as
+ *		: a whole (they are decapsulated by decode_eth).
+ * INPUT	: 0 - Link Layer Type (DLT_*)
+ * RETURN	: Filter expression (caller frees)
+ * ---------------------------------------------------------- */
+bstring packet_filter (int datalink)
+{
+    bstring nets, ip, ip6, udp, l4, core, filter;
+    UdpPort *ports;
+    unsigned int count, i;
+
+    /* UDP servers answer from the ports of their signatures. */
+    ports = get_udp_ports(&count);
+    udp = bfromcstr("");
+    for (i = 0; i < count; i++)
+	bformata(udp, "%sudp src port %u", (i == 0) ? "" : " or ", ports[i].port);
+
+    ip = bfromcstr("(icmp and icmp[icmptype] = icmp-echoreply)"
+	" or (tcp and (tcp[tcpflags] = (tcp-syn|tcp-ack)"
+	" or tcp[tcpflags] & (tcp-fin|tcp-rst) != 0"
+	" or ((tcp[tcpflags] = tcp-ack or tcp[tcpflags] = (tcp-ack|tcp-push))"
+	" and ip[2:2] - ((ip[0] & 0x0f) << 2) - ((tcp[12] & 0xf0) >> 2) != 0)))");
+    if (count > 0)
+	bformata(ip, " or (ip and (%s))", bdata(udp));
+
+    /* IPv6 TCP is passed whole. */
+    l4 = bformat((count > 0) ? "tcp or %s" : "tcp%s", bdata(udp));
+
+    /* Only servers on the monitored networks are of interest. */
+    if ((nets = monnet_filter(AF_INET)) == NULL)
+	core = bformat("(arp and arp[6:2] = 2) or (%s)", bdata(ip));
+    else if (blength(nets) == 0)
+	core = bfromcstr("(arp and arp[6:2] = 2)");
+    else
+	core = bformat("(arp and arp[6:2] = 2) or ((%s) and (%s))", bdata(nets), bdata(ip));
+    bdestroy(nets);
+
+    /* Neighbor advertisements are the ARP replies of IPv6. */
+    if ((nets = monnet_filter(AF_INET6)) == NULL)
+	ip6 = bformat("(ip6 and (icmp6 or %s))", bdata(l4));
+    else if (blength(nets) == 0)
+	ip6 = bformat("(icmp6 and ip6[40] = %d)", ND_NEIGHBOR_ADVERT);
+    else
+	ip6 = bformat("(ip6 and (icmp6 or ((%s) and (%s))))", bdata(nets), bdata(l4));
+    bdestroy(nets);
+    bformata(core, " or %s", bdata(ip6));
+
+    /*
+     * 'vlan' moves the offsets of everything after it, so it goes last.
+     * ether[] is not moved, but 'mpls' would be:  the link layer
+     * encapsulations are matched by their ethertype.
+     */
+    if (datalink == DLT_EN10MB)
+	filter = bformat("ether[12:2] = 0x%x or ether[12:2] = 0x%x or ether[12:2] = 0x%x"
+	    " or (ether[12:2] = 0x%x and ether[16:2] = 0x%x)"
+	    " or (ip proto %d) or (udp dst port %d)"
+	    " or (%s) or (vlan and (%s))",
+	    MPLS_ETHERTYPE, QINQ_ETHERTYPE, QINQ_OLD_ETHERTYPE,
+	    VLAN_ETHERTYPE, VLAN_ETHERTYPE, IPPROTO_GRE, VXLAN_PORT,
+	    bdata(core), bdata(core));
+    else
+	filter = bstrcpy(core);
+
+    bdestroy(ip);
+    bdestroy(ip6);
+    bdestroy(udp);
+    bdestroy(l4);
+    bdestroy(core);
+    return filter;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pkt_u16
+ * DESCRIPTION	: This function will read a 16 bit field in
+ *		: network byte order from any alignment.
+ * INPUT	: 0 - Field
+ * RETURN	: Value (host order)
+ * ---------------------------------------------------------- */
+static inline u_int16_t
+pkt_u16 (const u_char *p)
+{
+    return (u_int16_t)((p[0] << 8) | p[1]);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_tcp
+ * DESCRIPTION	: This function will read the ports and flags
+ *		: of a TCP header.
+ * INPUT	: 0 - Packet
+ *		: 1 - Decoded Packet (TCP starting point)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+decode_tcp (const u_char* packet, Decoded *d)
+{
+    struct tcphdr *tcph;		/* netinet/tcp.h */
+
+    tcph = (struct tcphdr *)(packet + d->off);
+    d->sport = tcph->th_sport;
+    d->dport = tcph->th_dport;
+
+    /* The same cases as process_tcp(). */
+    switch (tcph->th_flags) {
+	case (TH_SYN + TH_ACK):
+	    d->action = PKT_SYNACK;
+	    break;
+	case (TH_ACK):
+	case (TH_ACK + TH_PUSH):
+	    d->action = PKT_DATA;
+	    break;
+	case (TH_FIN + TH_ACK):
+	case (TH_FIN + TH_ACK + TH_PUSH):
+	case (TH_RST):
+	case (TH_RST + TH_ACK):
+	    d->action = PKT_CLOSE;
+	    break;
+	default:
+	    break;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_udp
+ * DESCRIPTION	: This function will read a UDP header.  Only
+ *		: datagrams sent from a port that has UDP
+ *		: signatures are kept (VXLAN is decapsulated).
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Length of the IP Payload
+ *		: 3 - Decoded Packet (UDP starting point)
+ *		: 4 - Tunnels Already Opened
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+decode_udp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int ulen,
+	    Decoded *d, int depth)
+{
+    if (ulen < sizeof(struct udphdr) || d->off + sizeof(struct udphdr) > pkthdr->caplen)
+	return;
+
+    if (pkt_u16(packet + d->off + 2) == VXLAN_PORT) {
+	if (depth < ENCAP_DEPTH)
+	    decode_vxlan(pkthdr, packet, d->off, d, depth + 1);
+	return;
+    }
+
+    if (udp_port_known(pkt_u16(packet + d->off))) {
+	d->sport = htons(pkt_u16(packet + d->off));
+	d->dport = htons(pkt_u16(packet + d->off + 2));
+	d->seglen = ulen;
+	d->action = PKT_UDP;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_ip
+ * DESCRIPTION	: This function will read the IP and TCP / ICMP
+ *		: headers of a packet into a Decoded, without
+ *		: touching any of the asset tables.  GRE and
+ *		: VXLAN packets are decapsulated.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - IP Starting Point
+ *		: 3 - Decoded Packet
+ *		: 4 - Tunnels Already Opened
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_ip (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
+	   Decoded *d, int depth)
+{
+    struct ip *iph;			/* netinet/ip.h */
+    unsigned int hlen, iplen;
+
+    if (len + sizeof(struct ip) > pkthdr->caplen)
+	return;
+
+    /* The header length and the total length are both checked. */
+    iph = (struct ip *)(packet + len);
+    hlen = iph->ip_hl << 2;
+    iplen = ntohs(iph->ip_len);
+    if (iph->ip_v != 4 || hlen < sizeof(struct ip) || iplen < hlen)
+	return;
+
+    /* Class E sources would collide with the keys of IPv6 addresses. */
+    if (IP6_KEY(iph->ip_src))
+	return;
+
+    d->af = AF_INET;
+    d->l3 = len;
+    d->off = len + hlen;
+    d->ip_src = iph->ip_src;
+    d->ip_dst = iph->ip_dst;
+
+    switch (iph->ip_p) {
+	case IPPROTO_TCP:
+	    if (iplen < hlen + sizeof(struct tcphdr)
+		    || d->off + sizeof(struct tcphdr) > pkthdr->caplen)
+		return;
+	    d->seglen = iplen - hlen;
+	    decode_tcp(packet, d);
+	    break;
+
+	case IPPROTO_ICMP:
+	    if (d->off < pkthdr->caplen)
+		d->action = PKT_ICMP;
+	    break;
+
+	case IPPROTO_GRE:
+	    if (depth < ENCAP_DEPTH)
+		decode_gre(pkthdr, packet, d->off, d, depth + 1);
+	    break;
+
+	case IPPROTO_UDP:
+	    decode_udp(pkthdr, packet, iplen - hlen, d, depth);
+	    break;
+
+	default:
+	    break;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_ip6
+ * DESCRIPTION	: This function will read the IPv6 and TCP /
+ *		: ICMPv6 headers of a packet into a Decoded,
+ *		: skipping the extension headers.  Servers get
+ *		: the key of their address:  a SYN-ACK or an
+ *		: echo reply from a monitored network interns
+ *		: it, later segments only look it up.  Clients
+ *		: are folded.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - IPv6 Starting Point
+ *		: 3 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_ip6 (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
+	    Decoded *d)
+{
+    struct ip6_hdr *ip6h;		/* netinet/ip6.h */
+    struct in6_addr target;
+    unsigned int end, hlen;
+    u_int8_t nxt;
+    int ext, ret;
+
+    if (len + sizeof(struct ip6_hdr) > pkthdr->caplen)
+	return;
+
+    ip6h = (struct ip6_hdr *)(packet + len);
+    if ((ip6h->ip6_vfc >> 4) != 6)
+	return;
+
+    d->af = AF_INET6;
+    d->l3 = len;
+    d->off = len + sizeof(struct ip6_hdr);
+    end = d->off + ntohs(ip6h->ip6_plen);
+    nxt = ip6h->ip6_nxt;
+
+    for (ext = 0; nxt == IPPROTO_HOPOPTS || nxt == IPPROTO_ROUTING || nxt == IPPROTO_DSTOPTS
+	    || nxt == IPPROTO_FRAGMENT || nxt == IPPROTO_AH; ext++) {
+	if (ext == IP6_EXTHDRS || d->off + 8 > pkthdr->caplen || d->off + 8 > end)
+	    return;
+
+	if (nxt == IPPROTO_FRAGMENT) {
+	    /* Only the first fragment carries the upper layer header. */
+	    if (pkt_u16(packet + d->off + 2) & 0xfff8)
+		return;
+	    hlen = 8;
+	} else if (nxt == IPPROTO_AH) {
+	    hlen = (packet[d->off + 1] + 2) << 2;
+	} else {
+	    hlen = (packet[d->off + 1] + 1) << 3;
+	}
+	nxt = packet[d->off];
+	d->off += hlen;
+    }
+
+    switch (nxt) {
+	case IPPROTO_TCP:
+	    if (d->off + sizeof(struct tcphdr) > end
+		    || d->off + sizeof(struct tcphdr) > pkthdr->caplen)
+		return;
+	    d->seglen = end - d->off;
+	    decode_tcp(packet, d);
+	    break;
+
+	case IPPROTO_UDP:
+	    /* Tunnels are only opened in IPv4. */
+	    if (d->off <= end)
+		decode_udp(pkthdr, packet, end - d->off, d, ENCAP_DEPTH);
+	    break;
+
+	case IPPROTO_ICMPV6:
+	    if (d->off + sizeof(struct icmp6_hdr) > end
+		    || d->off + sizeof(struct icmp6_hdr) > pkthdr->caplen)
+		return;
+	    d->seglen = end - d->off;
+	    if (packet[d->off] == ICMP6_ECHO_REPLY)
+		d->action = PKT_ICMP;
+	    else if (packet[d->off] == ND_NEIGHBOR_ADVERT && d->seglen >= NA_HDRLEN
+		    && d->off + NA_HDRLEN <= pkthdr->caplen)
+		d->action = PKT_NDP;
+	    break;
+
+	default:
+	    break;
+    }
+
+    switch (d->action) {
+	case PKT_NDP:
+	    /* The target is the asset, whoever advertises it. */
+	    memcpy(&target, packet + d->off + 8, sizeof(target));
+	    ret = check_monnet6(&target) && ip6_intern(&target, &d->ip_src);
+	    break;
+
+	case PKT_ICMP:
+	case PKT_SYNACK:
+	case PKT_UDP:
+	    ret = check_monnet6(&ip6h->ip6_src) && ip6_intern(&ip6h->ip6_src, &d->ip_src);
+	    break;
+
+	case PKT_DATA:
+	case PKT_CLOSE:
+	    /* Servers that never got a key have nothing to follow. */
+	    ret = ip6_lookup(&ip6h->ip6_src, &d->ip_src);
+	    break;
+
+	default:
+	    return;
+    }
+
+    if (ret == 0)
+	d->action = PKT_NONE;
+    d->ip_dst = ip6_fold(&ip6h->ip6_dst);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_link
+ * DESCRIPTION	: This function will walk the link layer from
+ *		: an ethertype on:  802.1Q / 802.1ad tags and
+ *		: MPLS labels are skipped until IP or ARP is
+ *		: found.  This is the general (and slower) path
+ *		: that the specialized decoders fall back on.
  * INPUT	: 0 - PCAP Packet Header
  *		: 1 - Packet
+ *		: 2 - Offset Following The Ethertype
+ *		: 3 - Ethertype
+ *		: 4 - Decoded Packet
+ *		: 5 - Tunnels Already Opened
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_link (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
+	     u_int16_t type, Decoded *d, int depth)
+{
+    int labels;
+
+    for (;;) {
+	switch (type) {
+	    case ETHERTYPE_IP:
+		decode_ip(pkthdr, packet, len, d, depth);
+		return;
+
+	    case ETHERTYPE_IPV6:
+		decode_ip6(pkthdr, packet, len, d);
+		return;
+
+	    case ETHERTYPE_ARP:
+		if (len + sizeof(struct ether_arp) <= pkthdr->caplen) {
+		    d->action = PKT_ARP;
+		    d->off = len;
+		}
+		return;
+
+	    case VLAN_ETHERTYPE:
+	    case QINQ_ETHERTYPE:
+	    case QINQ_OLD_ETHERTYPE:
+		if (len + VLAN_HDRLEN > pkthdr->caplen)
+		    return;
+		type = pkt_u16(packet + len + 2);
+		len += VLAN_HDRLEN;
+		break;
+
+	    case MPLS_ETHERTYPE:
+	    case MPLS_MC_ETHERTYPE:
+		for (labels = 0; ; labels++) {
+		    if (labels == MPLS_LABELS || len + MPLS_HDRLEN >= pkthdr->caplen)
+			return;
+		    len += MPLS_HDRLEN;
+		    if (packet[len - 2] & 0x01)		/* Bottom of stack */
+			break;
+		}
+		/* MPLS does not say what it carries. */
+		if ((packet[len] >> 4) == 4)
+		    type = ETHERTYPE_IP;
+		else if ((packet[len] >> 4) == 6)
+		    type = ETHERTYPE_IPV6;
+		else
+		    return;
+		break;
+
+	    default:
+		return;
+	}
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_gre
+ * DESCRIPTION	: This function will decapsulate a GRE packet
+ *		: carrying IP, an ethernet frame, or an ERSPAN
+ *		: (type I, II or III) mirrored frame.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - GRE Starting Point
+ *		: 3 - Decoded Packet
+ *		: 4 - Tunnels Already Opened
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_gre (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
+	    Decoded *d, int depth)
+{
+    u_int16_t flags, type;
+
+    if (len + GRE_HDRLEN > pkthdr->caplen)
+	return;
+    flags = pkt_u16(packet + len);
+    type = pkt_u16(packet + len + 2);
+
+    /* Only version 0 carries frames. */
+    if (flags & GRE_VERSION)
+	return;
+    len += GRE_HDRLEN;
+    if (flags & GRE_CHECKSUM)
+	len += 4;
+    if (flags & GRE_KEY)
+	len += 4;
+    if (flags & GRE_SEQUENCE)
+	len += 4;
+
+    switch (type) {
+	case ETHERTYPE_IP:
+	    decode_ip(pkthdr, packet, len, d, depth);
+	    return;
+
+	case ERSPAN2_ETHERTYPE:
+	    /* Type I has no sequence number and no ERSPAN header. */
+	    if (flags & GRE_SEQUENCE)
+		len += ERSPAN2_HDRLEN;
+	    break;
+
+	case ERSPAN3_ETHERTYPE:
+	    if (len + ERSPAN3_HDRLEN > pkthdr->caplen)
+		return;
+	    /* The O flag announces an optional subheader. */
+	    if (packet[len + ERSPAN3_HDRLEN - 1] & 0x01)
+		len += 8;
+	    len += ERSPAN3_HDRLEN;
+	    break;
+
+	case TEB_ETHERTYPE:
+	    break;
+
+	default:
+	    return;
+    }
+
+    /* An ethernet frame follows. */
+    if (len + sizeof(struct ether_header) > pkthdr->caplen)
+	return;
+    decode_link(pkthdr, packet, len + sizeof(struct ether_header),
+		pkt_u16(packet + len + 12), d, depth);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_vxlan
+ * DESCRIPTION	: This function will decapsulate a VXLAN packet.
+ *		: Other UDP packets are left alone.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - UDP Starting Point
+ *		: 3 - Decoded Packet
+ *		: 4 - Tunnels Already Opened
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_vxlan (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
+	      Decoded *d, int depth)
+{
+    if (len + sizeof(struct udphdr) + VXLAN_HDRLEN + sizeof(struct ether_header) > pkthdr->caplen)
+	return;
+    if (pkt_u16(packet + len + 2) != VXLAN_PORT)
+	return;
+
+    /* The I flag says that the VNI is valid. */
+    len += sizeof(struct udphdr);
+    if ((packet[len] & 0x08) == 0)
+	return;
+    len += VXLAN_HDRLEN;
+
+    decode_link(pkthdr, packet, len + sizeof(struct ether_header),
+		pkt_u16(packet + len + 12), d, depth);
+}
+
+/*
+ * The decoders below are chosen once, by link type and (for ethernet) by
+ * encapsulation, so that the usual packet takes a straight walk through
+ * headers whose layout is known.  A packet that does not have the layout
+ * a decoder expects is handed to decode_eth(), which understands all of
+ * them.
+ */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_eth
+ * DESCRIPTION	: This function will decode an ethernet frame,
+ *		: whatever its encapsulation.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
  * RETURN	: None!
  * ---------------------------------------------------------- */
 
@@ -80,111 +659,413 @@ struct sll_header {
  * Otherwise the handler won't process the packet.  This is useful when,
  * for example, you are monitoring a VLAN trunk line.
  */
-void process_eth (const struct pcap_pkthdr* pkthdr, const u_char* packet)
+static void
+decode_eth (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    d->action = PKT_NONE;
+    if (pkthdr->caplen < sizeof(struct ether_header))
+	return;
+
+    decode_link(pkthdr, packet, sizeof(struct ether_header), pkt_u16(packet + 12), d, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_vlan
+ * DESCRIPTION	: This function will decode an ethernet frame
+ *		: with one 802.1Q tag.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_vlan (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
 {
-    struct ether_header *ethh;		/* net/ethernet.h */
-    u_char * my_packet;
+    const unsigned int len = sizeof(struct ether_header) + VLAN_HDRLEN;
 
-    my_packet = (u_char *)packet;
+    if (pkthdr->caplen < len || pkt_u16(packet + 12) != VLAN_ETHERTYPE
+	    || pkt_u16(packet + 16) != ETHERTYPE_IP) {
+	decode_eth(pkthdr, packet, d);
+	return;
+    }
+
+    d->action = PKT_NONE;
+    decode_ip(pkthdr, packet, len, d, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_qinq
+ * DESCRIPTION	: This function will decode an ethernet frame
+ *		: with two (802.1ad / QinQ) tags.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_qinq (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    const unsigned int len = sizeof(struct ether_header) + 2 * VLAN_HDRLEN;
 
-    /* Extract the ethernet header from the packet. */
-    ethh = (struct ether_header*) my_packet;
-    if(ntohs(ethh->ether_type) == VLAN_ETHERTYPE) { /* strip the vlan tags */
-      ethh = (struct ether_header*) (packet + VLAN_HDRLEN);
-      my_packet += VLAN_HDRLEN;
+    if (pkthdr->caplen < len || pkt_u16(packet + 12) != encap_outer
+	    || pkt_u16(packet + 16) != VLAN_ETHERTYPE
+	    || pkt_u16(packet + 20) != ETHERTYPE_IP) {
+	decode_eth(pkthdr, packet, d);
+	return;
     }
-    /* Determine what type of ethernet packet this is. */
-    switch (ntohs(ethh->ether_type)) {
-	/* IP */
-	case ETHERTYPE_IP:
-	  process_ip (pkthdr, my_packet, sizeof(struct ether_header));
-	  break;
 
-	/* ARP */
-	case ETHERTYPE_ARP:
-	    process_arp (pkthdr, my_packet, sizeof(struct ether_header));
-	    break;
- 
-	/* Unknown Type */
-	default:
-	    return;
+    d->action = PKT_NONE;
+    decode_ip(pkthdr, packet, len, d, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_mpls
+ * DESCRIPTION	: This function will decode an ethernet frame
+ *		: with the number of MPLS labels found by the
+ *		: probe (or one) in front of IP.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_mpls (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    const unsigned int len = sizeof(struct ether_header) + encap_labels * MPLS_HDRLEN;
+
+    /* The last label, and only that one, is the bottom of the stack. */
+    if (pkthdr->caplen <= len || pkt_u16(packet + 12) != MPLS_ETHERTYPE
+	    || (packet[len - 2] & 0x01) == 0 || (packet[len] >> 4) != 4
+	    || (encap_labels > 1 && (packet[len - MPLS_HDRLEN - 2] & 0x01))) {
+	decode_eth(pkthdr, packet, d);
+	return;
     }
 
-    return;
+    d->action = PKT_NONE;
+    decode_ip(pkthdr, packet, len, d, 0);
 }
 
 /* ----------------------------------------------------------
- * FUNCTION	: process_sll
- * DESCRIPTION	: This function will decode and process the
- *		: SLL contents of a packet.
+ * FUNCTION	: decode_tunnel
+ * DESCRIPTION	: This function will decode an ethernet frame
+ *		: that carries a GRE, ERSPAN or VXLAN tunnel,
+ *		: such as a remote mirror feed.  The outer IP
+ *		: packet is skipped without being looked at.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_tunnel (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    const unsigned int len = sizeof(struct ether_header);
+    struct ip *iph = (struct ip *)(packet + len);
+    unsigned int hlen;
+
+    if (pkthdr->caplen < len + sizeof(struct ip) || pkt_u16(packet + 12) != ETHERTYPE_IP
+	    || iph->ip_p != encap_proto || (hlen = iph->ip_hl << 2) < sizeof(struct ip)) {
+	decode_eth(pkthdr, packet, d);
+	return;
+    }
+
+    d->action = PKT_NONE;
+    if (encap_proto == IPPROTO_GRE)
+	decode_gre(pkthdr, packet, len + hlen, d, 1);
+    else
+	decode_vxlan(pkthdr, packet, len + hlen, d, 1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_raw
+ * DESCRIPTION	: This function will decode a raw IP packet.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_raw (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    d->action = PKT_NONE;
+    if (pkthdr->caplen > 0 && (packet[0] >> 4) == 6)
+	decode_ip6(pkthdr, packet, 0, d);
+    else
+	decode_ip(pkthdr, packet, 0, d, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_sll
+ * DESCRIPTION	: This function will decode an SLL frame.
  * INPUT	: 0 - PCAP Packet Header
  *		: 1 - Packet
+ *		: 2 - Decoded Packet
  * RETURN	: None!
  * ---------------------------------------------------------- */
 #ifdef DLT_LINUX_SLL
-void process_sll (const struct pcap_pkthdr* pkthdr, const u_char* packet)
+static void
+decode_sll (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
 {
     struct sll_header *sllh;
 
-    /* Extract the sll header from the packet. */
-    sllh = (struct sll_header*) packet;
+    d->action = PKT_NONE;
+    if (pkthdr->caplen < SLL_HDR_LEN)
+	return;
+
+    sllh = (struct sll_header *)packet;
+    decode_link(pkthdr, packet, SLL_HDR_LEN, ntohs(sllh->sll_protocol), d, 0);
+}
+#endif /* DLT_LINUX_SLL */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_sll2
+ * DESCRIPTION	: This function will decode an SLL2 frame.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+#ifdef DLT_LINUX_SLL2
+static void
+decode_sll2 (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    d->action = PKT_NONE;
+    if (pkthdr->caplen < SLL2_HDR_LEN)
+	return;
+
+    /* The protocol comes first in SLL2. */
+    decode_link(pkthdr, packet, SLL2_HDR_LEN, pkt_u16(packet), d, 0);
+}
+#endif /* DLT_LINUX_SLL2 */
 
-    /* Determine what type of sll packet this is. */
-    switch(ntohs(sllh->sll_protocol)) {
-	/* IP */
+/* ----------------------------------------------------------
+ * FUNCTION	: encap_select
+ * DESCRIPTION	: This function will switch to the decoder for
+ *		: an ethernet encapsulation.
+ * INPUT	: 0 - Encapsulation (ENCAP_*)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+encap_select (int encap)
+{
+    Decoder next;
+
+    switch (encap) {
+	case ENCAP_VLAN:
+	    next = decode_vlan;
+	    break;
+	case ENCAP_QINQ:
+	    next = decode_qinq;
+	    break;
+	case ENCAP_MPLS:
+	    next = decode_mpls;
+	    break;
+	case ENCAP_GRE:
+	case ENCAP_VXLAN:
+	    encap_proto = (encap == ENCAP_GRE) ? IPPROTO_GRE : IPPROTO_UDP;
+	    next = decode_tunnel;
+	    break;
+	default:
+	    next = decode_eth;
+	    break;
+    }
+
+    verbose_message("Encapsulation:  %s", encap_names[encap]);
+    __atomic_store_n(&decoder, next, __ATOMIC_RELEASE);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: decode_probe
+ * DESCRIPTION	: This function will decode an ethernet frame
+ *		: and look at how it is encapsulated.  Frames
+ *		: are probed until an IP packet has been seen;
+ *		: the matching decoder then takes over.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+decode_probe (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
+{
+    unsigned int len = sizeof(struct ether_header);
+    struct ip *iph;
+    int encap = ENCAP_AUTO;
+    u_int16_t type;
+
+    decode_eth(pkthdr, packet, d);
+    if (pkthdr->caplen < len + sizeof(struct ip))
+	return;
+
+    switch ((type = pkt_u16(packet + 12))) {
 	case ETHERTYPE_IP:
-	    process_ip (pkthdr, packet, sizeof(struct sll_header));
+	    iph = (struct ip *)(packet + len);
+	    if (iph->ip_p == IPPROTO_GRE)
+		encap = ENCAP_GRE;
+	    else if (iph->ip_p == IPPROTO_UDP
+		    && len + (iph->ip_hl << 2) + sizeof(struct udphdr) <= pkthdr->caplen
+		    && pkt_u16(packet + len + (iph->ip_hl << 2) + 2) == VXLAN_PORT)
+		encap = ENCAP_VXLAN;
+	    else
+		encap = ENCAP_ETH;
 	    break;
 
-	/* ARP */
-	case ETHERTYPE_ARP:
-	    process_arp (pkthdr, packet, sizeof(struct sll_header));
+	case ETHERTYPE_IPV6:
+	    encap = ENCAP_ETH;
+	    break;
+
+	case VLAN_ETHERTYPE:
+	case QINQ_ETHERTYPE:
+	case QINQ_OLD_ETHERTYPE:
+	    encap_outer = type;
+	    if (pkt_u16(packet + 16) == VLAN_ETHERTYPE)
+		encap = ENCAP_QINQ;
+	    else if (type == VLAN_ETHERTYPE)
+		encap = ENCAP_VLAN;
+	    break;
+
+	case MPLS_ETHERTYPE:
+	    for (encap_labels = 1; encap_labels < MPLS_LABELS
+		    && (packet[len + encap_labels * MPLS_HDRLEN - 2] & 0x01) == 0
+		    && len + (encap_labels + 1) * MPLS_HDRLEN < pkthdr->caplen; encap_labels++)
+		;
+	    encap = ENCAP_MPLS;
 	    break;
 
-	/* Unknown Protocol */
 	default:
+	    /* ARP and friends say nothing about the rest. */
 	    return;
     }
 
-    return;
+    if (encap != ENCAP_AUTO)
+	encap_select(encap);
 }
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_decoder
+ * DESCRIPTION	: This function will choose the decoder for a
+ *		: link layer type and, for ethernet, for the
+ *		: configured encapsulation.
+ * INPUT	: 0 - Link Layer Type (DLT_*)
+ * RETURN	: 0 - Link layer not supported
+ *		: 1 - Success
+ * ---------------------------------------------------------- */
+int init_decoder (int datalink)
+{
+    switch (datalink) {
+	/* Ethernet */
+	case DLT_EN10MB:
+	    if (gc.encap == ENCAP_AUTO) {
+		decoder = decode_probe;
+	    } else {
+		encap_outer = VLAN_ETHERTYPE;
+		encap_labels = 1;
+		encap_select(gc.encap);
+	    }
+	    break;
+
+	/* Raw IP */
+	case DLT_RAW:
+#ifdef DLT_IPV4
+	case DLT_IPV4:
+#endif /* DLT_IPV4 */
+#ifdef DLT_IPV6
+	case DLT_IPV6:
+#endif /* DLT_IPV6 */
+	    decoder = decode_raw;
+	    break;
+
+#ifdef DLT_LINUX_SLL
+	/* Linux Cooked Sockets */
+	case DLT_LINUX_SLL:
+	    decoder = decode_sll;
+	    break;
 #endif /* DLT_LINUX_SLL */
 
+#ifdef DLT_LINUX_SLL2
+	case DLT_LINUX_SLL2:
+	    decoder = decode_sll2;
+	    break;
+#endif /* DLT_LINUX_SLL2 */
+
+	default:
+	    return 0;
+    }
+
+    return 1;
+}
+
 /* ----------------------------------------------------------
- * FUNCTION	: process_ip
- * DESCRIPTION	: This function will decode and process the
- *		: IP contents of a packet.
+ * FUNCTION	: decode_packet
+ * DESCRIPTION	: This function will decode a packet with the
+ *		: decoder chosen by init_decoder().
  * INPUT	: 0 - PCAP Packet Header
  *		: 1 - Packet
- *		: 2 - IP Starting Point
+ *		: 2 - Decoded Packet
  * RETURN	: None!
  * ---------------------------------------------------------- */
-void process_ip (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len)
+void decode_packet (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d)
 {
-    struct ip *iph;			/* netinet/ip.h */
+    (*__atomic_load_n(&decoder, __ATOMIC_ACQUIRE))(pkthdr, packet, d);
+}
 
-    /* Extract the IP header from this packet. */
-      iph = (struct ip*)(packet + len);
-    /* Determine what type of IP packet this is. */
-    switch (iph->ip_p) {
-	case IPPROTO_TCP:
-	    /* TCP */
-	    process_tcp(pkthdr, packet, (len + sizeof(struct ip)), iph->ip_src, iph->ip_dst);
+/* ----------------------------------------------------------
+ * FUNCTION	: process_packet
+ * DESCRIPTION	: This function will decode and process a
+ *		: packet.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void process_packet (const struct pcap_pkthdr* pkthdr, const u_char* packet)
+{
+    Decoded d;
+
+    decode_packet(pkthdr, packet, &d);
+    process_decoded(pkthdr, packet, &d);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: process_decoded
+ * DESCRIPTION	: This function will process a packet that has
+ *		: already been decoded.  Its time moves the
+ *		: asset clock on.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void process_decoded (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d)
+{
+    storage_tick(pkthdr->ts.tv_sec);
+
+    switch (d->action) {
+	case PKT_ARP:
+	    process_arp(pkthdr, packet, d->off);
 	    break;
 
-	case IPPROTO_ICMP:
-	    /* ICMP */
-	    process_icmp(pkthdr, packet, (len + sizeof(struct ip)), iph->ip_src, iph->ip_dst);
+	case PKT_ICMP:
+	    process_icmp(pkthdr, packet, d);
+	    break;
+
+	case PKT_SYNACK:
+	case PKT_DATA:
+	case PKT_CLOSE:
+	    process_tcp(pkthdr, packet, d);
+	    break;
+
+	case PKT_NDP:
+	    process_ndp(pkthdr, packet, d);
+	    break;
+
+	case PKT_UDP:
+	    process_udp(pkthdr, packet, d);
 	    break;
 
 	default:
-	    /* Unsupported Protocol */
-	    return;
+	    break;
     }
-
-    return;
 }
-
 /* ----------------------------------------------------------
  * FUNCTION	: process_arp
  * DESCRIPTION	: This function will decode and process the
@@ -198,6 +1079,7 @@ void process_arp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsign
 {
     struct ether_arp *arph;
     struct in_addr ip_addr;
+    ArpAsset rec;
 
     arph = (struct ether_arp *)(packet + len);
 
@@ -206,11 +1088,12 @@ void process_arp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsign
 	/* ARP Reply */
 	case ARPOP_REPLY:
 	    memcpy(&ip_addr.s_addr, arph->arp_spa, sizeof(u_int8_t) * 4);
+	    if (IP6_KEY(ip_addr))
+		return;
 
-	    if (check_arp_asset(ip_addr, arph->arp_sha) == 1) {
-		add_arp_asset(ip_addr, arph->arp_sha, 0);
-		print_arp_asset (ip_addr, arph->arp_sha);
-	    }
+	    /* Record the asset and print it if it is new. */
+	    if (upsert_arp_asset(ip_addr, (char *)arph->arp_sha, 0, &rec))
+		print_arp_asset (&rec);
 
 	    break;
 
@@ -222,22 +1105,88 @@ void process_arp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsign
     return;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: process_ndp
+ * DESCRIPTION	: This function will process an ICMPv6
+ *		: neighbor advertisement:  the target and the
+ *		: link layer address in its option are recorded
+ *		: like an ARP reply.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet (key of the target)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void process_ndp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d)
+{
+    unsigned int opt, end;
+    ArpAsset rec;
+
+    end = d->off + d->seglen;
+    if (end > pkthdr->caplen)
+	end = pkthdr->caplen;
+
+    /* Options are counted in units of 8 bytes. */
+    for (opt = d->off + NA_HDRLEN; opt + 8 <= end && packet[opt + 1] != 0;
+	    opt += packet[opt + 1] << 3) {
+	if (packet[opt] == ND_OPT_TARGET_LINKADDR && packet[opt + 1] == 1) {
+	    if (upsert_arp_asset(d->ip_src, (char *)packet + opt + 2, 0, &rec))
+		print_arp_asset (&rec);
+	    return;
+	}
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: client_addr
+ * DESCRIPTION	: This function will return the key under
+ *		: which the client of a new asset is recorded.
+ *		: IPv6 clients were only folded by decode_ip6;
+ *		: they are interned here, once per asset.
+ * INPUT	: 0 - Packet
+ *		: 1 - Decoded Packet
+ * RETURN	: Client Address (0.0.0.0 when the IPv6 store
+ *		: is full)
+ * ---------------------------------------------------------- */
+static struct in_addr
+client_addr (const u_char* packet, const Decoded *d)
+{
+    struct in6_addr addr;
+    struct in_addr key;
+
+    if (d->af != AF_INET6)
+	return d->ip_dst;
+
+    memcpy(&addr, &((struct ip6_hdr *)(packet + d->l3))->ip6_dst, sizeof(addr));
+    if (ip6_intern(&addr, &key) == 0)
+	key.s_addr = 0;
+    return key;
+}
+
 /* ---------------------------------------------------------
  * FUNCTION	: process_tcp
  * DESCRIPTION	: This function will decode and process the
  *		: TCP contents of a packet.
  * INPUT	: 0 - PCAP Packet Header
  *		: 1 - Packet
- *		: 2 - TCP Starting Point
- *		: 3 - Source IP Address
- *		: 4 - Destination IP Address
+ *		: 2 - Decoded Packet (TCP starting point,
+ *		:     segment length and addresses)
  * RETURN	: None!
  * ---------------------------------------------------------- */
-void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
-		  const struct in_addr ip_src, const struct in_addr ip_dst)
+void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d)
 {
     struct tcphdr *tcph;		/* netinet/tcp.h */
-    char *payload;
+    const unsigned int len = d->off;
+    const unsigned int seglen = d->seglen;
+    const struct in_addr ip_src = d->ip_src;
+    const struct in_addr ip_dst = d->ip_dst;
+    Flow *flow;
+    MatchStream *ms;
+    char *payload, *data;
+    unsigned int thlen;
+    int plen, dlen;
+    u_int32_t seq;
+    int clipped, last;
+    int ret;
     tcph = (struct tcphdr *)(packet + len);
 
     /* Process packet according to it's TCP flags. */
@@ -258,33 +1207,122 @@ void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsign
 		/* Check to see if this is a known asset. */
 		if(check_tcp_asset(ip_src, tcph->th_sport)) {
 
-		    add_asset(ip_src, ip_dst, tcph->th_sport, tcph->th_dport,
-			    IPPROTO_TCP, bfromcstr("unknown"), bfromcstr("unknown"), 0);
+		    add_asset(ip_src, client_addr(packet, d), tcph->th_sport, tcph->th_dport,
+			    IPPROTO_TCP, STR_UNKNOWN, STR_UNKNOWN, 0);
 		} else {
 		    /* Record connection for statistical purposes. */
 		    print_stat(ip_src, tcph->th_sport, IPPROTO_TCP);
+
+		    /* Only follow this connection if the asset still needs
+		     * to be identified. */
+		    if (get_i_attempts(ip_src, tcph->th_sport, IPPROTO_TCP) == 0)
+			return;
 		}
 
+		/* Follow the server side of this connection.  The first
+		 * data byte comes right after the SYN. */
+		flow_add(ip_src, tcph->th_sport, ip_dst, tcph->th_dport,
+			 ntohl(tcph->th_seq) + 1, pkthdr->ts.tv_sec);
+
 	} break;
 
 	case (TH_ACK):
 	case (TH_ACK + TH_PUSH):{
 		/*
-		 * Check to see if this ACK packet needs to be
-		 * identified.
+		 * Only server to client segments of a tracked flow need
+		 * to be identified.  Everything else stops here.  The
+		 * pending filter turns away the bulk of the traffic
+		 * (identified servers and clients) before the flow table
+		 * is touched.
 		 */
-		payload = (u_char *)(packet + sizeof(struct tcphdr) + len);
+		if (!pending_check(ip_src, tcph->th_sport, IPPROTO_TCP))
+		    return;
+		thlen = tcph->th_off << 2;
+		plen = (int)seglen - (int)thlen;
+		if ((flow = flow_find(ip_src, tcph->th_sport, ip_dst, tcph->th_dport,
+				pkthdr->ts.tv_sec)) == NULL) {
+		    if (get_i_attempts(ip_src, tcph->th_sport, IPPROTO_TCP) == 0) {
+			pending_false_positive();
+			return;
+		    }
+
+		    /* The asset is still pending but the SYN-ACK of this
+		     * connection was never seen (it was already open at
+		     * startup, or its flow was dropped).  Pick the flow up
+		     * from the first data segment instead. */
+		    if (thlen < sizeof(struct tcphdr) || plen <= 0)
+			return;
+		    flow = flow_add(ip_src, tcph->th_sport, ip_dst, tcph->th_dport,
+				    ntohl(tcph->th_seq), pkthdr->ts.tv_sec);
+		}
+
+		/* Skip pure ACKs. */
+		if (thlen < sizeof(struct tcphdr) || plen <= 0) {
+		    get_flow_stats()->skipped++;
+		    return;
+		}
+
+		/* Only inspect what has been captured.  Nothing can be
+		 * appended after a segment that was cut short. */
+		clipped = (len + thlen + plen > pkthdr->caplen);
+		if (clipped)
+		    plen = (int)pkthdr->caplen - (int)(len + thlen);
+		if (plen <= 0)
+		    return;
+
+		/* Skip retransmissions.  Out of order segments resync. */
+		seq = ntohl(tcph->th_seq);
+		if (SEQ_LT(seq, flow->next_seq)) {
+		    get_flow_stats()->skipped++;
+		    return;
+		}
+		payload = (char *)(packet + len + thlen);
+
+		/* A gap ends the reassembly:  what was kept so far is
+		 * identified for the last time first. */
+		if (seq != flow->next_seq && flow_flush(flow) == 2) {
+		    flow_remove(flow);
+		    return;
+		}
+
+		/* Append in-order segments to the server data kept so far. */
+		dlen = plen;
+		data = flow_reassemble(flow, seq, payload, &dlen, clipped, &ms, &last);
+		flow->next_seq = seq + (seglen - thlen);
+		get_flow_stats()->inspected++;
 
 		/* Attempt to identify this asset.  */
-		if(tcp_identify(ip_src, tcph->th_sport, payload, 
-			    (pkthdr->caplen - sizeof(struct tcphdr) - len)) == 1)
+		if((ret = tcp_identify(ip_src, tcph->th_sport, payload, plen, data, dlen, ms, last)) > 0)
 		{
 		    /* Dump banner if option specified (-d). */
-		    if (gc.dump_file)
+		    if (gc.dump_file) {
+			pthread_mutex_lock(&dump_lock);
 			pcap_dump((u_char *)gc.dumper, pkthdr, packet);
+			pthread_mutex_unlock(&dump_lock);
+		    }
 		}
+
+		/* Stop following this flow once the asset is finished,
+		 * otherwise keep its data for the next segment. */
+		if (ret != 1)
+		    flow_remove(flow);
+		else
+		    flow_keep(flow, payload, plen, last);
 	} break;
 
+	/* FIN / RST:  Connection closed.  The server data kept so far is
+	 * identified for the last time. */
+	case (TH_FIN + TH_ACK):
+	case (TH_FIN + TH_ACK + TH_PUSH):
+	case (TH_RST):
+	case (TH_RST + TH_ACK):
+		if ((flow = flow_find(ip_src, tcph->th_sport, ip_dst, tcph->th_dport,
+				pkthdr->ts.tv_sec)) != NULL) {
+		    flow_flush(flow);
+		    flow_remove(flow);
+		}
+		break;
+
 	/* DEFAULT:  Return, pick up next packet. */
 	default:
 		return;
@@ -293,30 +1331,77 @@ void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsign
     return;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION	: process_udp
+ * DESCRIPTION	: This function will process a UDP datagram
+ *		: sent from a port that has UDP signatures.
+ *		: There is no handshake:  the first response
+ *		: from a monitored server records the asset,
+ *		: and each response is one identification
+ *		: attempt until it is identified.
+ * INPUT	: 0 - PCAP Packet Header
+ *		: 1 - Packet
+ *		: 2 - Decoded Packet (UDP starting point,
+ *		:     datagram length and addresses)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void process_udp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d)
+{
+    const struct in_addr ip_src = d->ip_src;
+    unsigned int len = d->off + sizeof(struct udphdr);
+    int plen;
+
+    /* Servers still being identified pass the pending filter;  anything
+     * else must be a new server on a monitored network. */
+    if (!pending_check(ip_src, d->sport, IPPROTO_UDP)) {
+	if (check_monnet(ip_src) == 0 || check_udp_asset(ip_src, d->sport) == 0)
+	    return;
+	add_asset(ip_src, client_addr(packet, d), d->sport, d->dport,
+		  IPPROTO_UDP, STR_UNKNOWN, STR_UNKNOWN, 0);
+    }
+
+    /* Only inspect what has been captured. */
+    plen = (int)d->seglen - (int)sizeof(struct udphdr);
+    if (len + plen > pkthdr->caplen)
+	plen = (int)pkthdr->caplen - (int)len;
+    if (plen <= 0)
+	return;
+
+    /* Attempt to identify this asset.  */
+    if (udp_identify(ip_src, d->sport, (char *)(packet + len), plen) > 0) {
+	/* Dump banner if option specified (-d). */
+	if (gc.dump_file) {
+	    pthread_mutex_lock(&dump_lock);
+	    pcap_dump((u_char *)gc.dumper, pkthdr, packet);
+	    pthread_mutex_unlock(&dump_lock);
+	}
+    }
+}
+
 /* ---------------------------------------------------------
  * FUNCTION	: process_icmp
  * DESCRIPTION	: This function will decode and process the
- *		: ICMP contents of a packet.
+ *		: ICMP (or ICMPv6) contents of a packet.
  * INPUT	: 0 - PCAP Packet Header
  *		: 1 - Packet
- *		: 2 - TCP Starting Point
- *		: 3 - Source IP Address
- *		: 4 - Destination IP Address
+ *		: 2 - Decoded Packet (ICMP starting point and
+ *		:     addresses)
  * RETURN	: None!
  * ---------------------------------------------------------- */
-void process_icmp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len,
-	const struct in_addr ip_src, const struct in_addr ip_dst)
+void process_icmp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d)
 {
+    const struct in_addr ip_src = d->ip_src;
     struct icmp *icmp;
-    icmp = (struct icmp *)(packet + len);
+    icmp = (struct icmp *)(packet + d->off);
 
     /* Check to see if this falls within our monitored networks. */
     if ((check_monnet(ip_src)) == 0)
 	return;
 
-    if (icmp->icmp_type == ICMP_ECHOREPLY) {
+    /* decode_ip6() only lets ICMPv6 echo replies through. */
+    if (d->af == AF_INET6 || icmp->icmp_type == ICMP_ECHOREPLY) {
 	if(check_icmp_asset(ip_src)) {
-	    add_asset(ip_src, ip_dst, 0, 0, IPPROTO_ICMP, bfromcstr("ICMP"), bfromcstr("ICMP"), 0);
+	    add_asset(ip_src, client_addr(packet, d), 0, 0, IPPROTO_ICMP, STR_ICMP, STR_ICMP, 0);
 	    print_asset(ip_src, 0, IPPROTO_ICMP);
 	}
     }
@@ -324,3 +1409,4 @@ void process_icmp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsig
     return;
 }
 
+
@@ -25,12 +25,57 @@
  * $Id: packet.h,v 1.1 2005/02/10 06:05:05 mattshelton Exp $
  *
  **************************************************************************/
+#ifndef INCLUDED_PACKET_H
+#define INCLUDED_PACKET_H
+
+/* DEFINES ----------------------------------------- */
+
+/* What a decoded packet will be used for. */
+#define PKT_NONE    0               /* Nothing, drop it */
+#define PKT_ARP     1               /* ARP reply */
+#define PKT_ICMP    2               /* ICMP packet */
+#define PKT_SYNACK  3               /* TCP SYN-ACK:  server connection */
+#define PKT_DATA    4               /* TCP ACK:  possible server banner */
+#define PKT_CLOSE   5               /* TCP FIN / RST */
+#define PKT_NDP     6               /* ICMPv6 neighbor advertisement */
+#define PKT_UDP     7               /* UDP response from a signature port */
+#define PKT_ACTIONS 8
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * Decoded:  The headers of a packet, as needed by process_decoded().
+ * -------------------------------------------------------------------------- */
+typedef struct _Decoded
+{
+    int action;                 /* PKT_* */
+    int af;                     /* AF_INET / AF_INET6 */
+    unsigned int l3;            /* Offset of the IP header */
+    unsigned int off;           /* Offset of the ARP / ICMP / TCP header */
+    unsigned int seglen;        /* TCP Segment Length (header + payload) */
+    struct in_addr ip_src;      /* Source IP Address (or IPv6 key) */
+    struct in_addr ip_dst;      /* Destination IP Address (or IPv6 key) */
+    u_int16_t sport;            /* Source Port (network order) */
+    u_int16_t dport;            /* Destination Port (network order) */
+} Decoded;
+
+/* --------------------------------------------------------------------------
+ * Decoder:  Fills in a Decoded from the link layer up.
+ * -------------------------------------------------------------------------- */
+typedef void (*Decoder)(const struct pcap_pkthdr *, const u_char *, Decoded *);
+
+
 /* PROTOTYPES -------------------------------------- */
-void process_eth (const struct pcap_pkthdr* pkthdr, const u_char* packet);
-#ifdef DLT_LINUX_SLL
-void process_sll (const struct pcap_pkthdr* pkthdr, const u_char* packet);
-#endif /* DLT_LINUX_SLL */
-void process_ip (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len);
+bstring packet_filter (int datalink);
+int init_decoder (int datalink);
+void decode_packet (const struct pcap_pkthdr* pkthdr, const u_char* packet, Decoded *d);
+void process_packet (const struct pcap_pkthdr* pkthdr, const u_char* packet);
 void process_arp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len);
-void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len, const struct in_addr ip_src, const struct in_addr ip_dst);
-void process_icmp (const struct pcap_pkthdr* pkthdr, const u_char* packet, unsigned int len, const struct in_addr ip_src, const struct in_addr ip_dst);
+void process_ndp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d);
+void process_tcp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d);
+void process_udp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d);
+void process_icmp (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d);
+void process_decoded (const struct pcap_pkthdr* pkthdr, const u_char* packet, const Decoded *d);
+
+#endif /* INCLUDED_PACKET_H */
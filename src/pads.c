@@ -48,6 +48,20 @@ typedef void (*proc_t)(const struct pcap_pkthdr *, const u_char *);
 #include "output/output.h"
 #include "storage.h"
 #include "monnet.h"
+#include "ip6.h"
+#include "strpool.h"
+#include "banner.h"
+#include "flow.h"
+#include "pending.h"
+#include "ring.h"
+#include "batch.h"
+#include "tpacket.h"
+#include "ebpf.h"
+#include "xsk.h"
+#include "worker.h"
+#include "slab.h"
+#include "snapshot.h"
+#include "wal.h"
 
 static int process_cmdline (int argc, char *argv[]);
 
@@ -57,22 +71,7 @@ char errbuf[PCAP_ERRBUF_SIZE];
 proc_t processor;
 char **prog_argv;
 int prog_argc;
-
-/* ----------------------------------------------------------
- * FUNCTION     : process_pkt
- * DESCRIPTION  : This function takes data from libpcap and
- *              : processes it based on what type of traffic
- *              : it is.
- * INPUT        : 0 - Not used
- *              : 1 - pcap packet header
- *              : 2 - pcap packet
- * ---------------------------------------------------------- */
-void
-process_pkt (u_char *args, const struct pcap_pkthdr* pkthdr, const u_char* packet)
-{
-    /* Call LLC Processor */
-    (*processor)(pkthdr, packet);
-}
+volatile sig_atomic_t pads_stopping;    /* Set by the signal handlers */
 
 /* ----------------------------------------------------------
  * FUNCTION     : set_processor
@@ -88,24 +87,10 @@ set_processor (pcap_t *this_handle)
     int datalink;
     datalink = pcap_datalink(this_handle);
 
-    switch (datalink) {
-        /* Ethernet */
-        case DLT_EN10MB:
-            processor = process_eth;
-            break;
-
-#ifdef DLT_LINUX_SLL
-        /* Linux Cooked Sockets */
-        case DLT_LINUX_SLL:
-            processor = process_sll;
-            break;
-#endif /* DLT_LINUX_SLL */
-
-    /* Default */
-        default:
-            err_message("LLC not supported!  Please contact the author!");
-            break;
-    }
+    /* The decoder is specialized for the link type (and encapsulation). */
+    if (!init_decoder(datalink))
+        err_message("LLC not supported!  Please contact the author!");
+    processor = process_packet;
 
     return;
 }
@@ -144,9 +129,11 @@ print_usage()
        "                 will be used if an interface isn't specified.\n"
        "-n <network>   : Reads in a comma seperated list of networks\n"
        "                 to be monitored.\n"
-       "                   ex.  -n \"192.168.0.0/24,10.0.0.0/16\"\n"
+       "                   ex.  -n \"192.168.0.0/24,10.0.0.0/16,2001:db8::/32\"\n"
        "-p <file>      : PID file used with daemon mode.\n"
        "-r <file>      : Read packets from a libpcap formatted file.\n"
+       "-t <workers>   : Process packets with <workers> threads (needs\n"
+       "                 'capture tpacket' or 'capture xdp').\n"
        "-u <user>      : Drop privileges to this user.\n"
        "-v             : Verbose\n"
        "-V             : Version\n"
@@ -175,7 +162,7 @@ print_version (void)
     printf("\n");
     printf("Libraries:\n");
     printf("libpcap     - %d.%d\n", PCAP_VERSION_MAJOR, PCAP_VERSION_MINOR);
-    printf("pcre        - %d.%d\n", PCRE_MAJOR, PCRE_MINOR);
+    printf("pcre2       - %d.%d\n", PCRE2_MAJOR, PCRE2_MINOR);
     printf("\n");
 }
 
@@ -186,12 +173,20 @@ print_version (void)
 void
 init_pads (void)
 {
+    struct sigaction act;
+
     /* Process the command line parameters. */
     process_cmdline(prog_argc, prog_argv);
 
+    /* Names are interned from the first signature on. */
+    init_strpool();
+
     /* Initialize Output Module */
     init_output();
 
+    /* The pending filter must exist before any asset is stored. */
+    init_pending();
+
     /* Process the configuration file. */
     if (gc.conf_file) {
         init_configuration(gc.conf_file);
@@ -209,8 +204,18 @@ init_pads (void)
     }
 
     /* Initialize Modules */
+    init_storage();
+
+    /* Restore the assets of the last run:  from the snapshot if there
+     * is one, from the CSV report otherwise.  Then apply the changes
+     * logged after the snapshot was saved. */
+    if (load_snapshot() != 0)
+        reload_output();
+    replay_wal();
+
     init_identification();
     init_mac_resolution();
+    init_flow();
 
     /* Daemon Mode:  fork child process */
     if (gc.daemon_mode) {
@@ -218,11 +223,18 @@ init_pads (void)
         init_pid_file(gc.pid_file, gc.priv_user, gc.priv_group);
     }
 
-    /* Signal Trapping */
-    (void) signal(SIGTERM, sig_term_handler);
-    (void) signal(SIGINT, sig_int_handler);
-    (void) signal(SIGQUIT, sig_quit_handler);
-    (void) signal(SIGHUP, sig_hup_handler);
+    /* Signal Trapping:  without SA_RESTART, so that a blocking read
+     * returns and the capture loop sees that it has to stop. */
+    memset(&act, 0, sizeof(act));
+    sigemptyset(&act.sa_mask);
+    act.sa_handler = sig_term_handler;
+    (void) sigaction(SIGTERM, &act, NULL);
+    act.sa_handler = sig_int_handler;
+    (void) sigaction(SIGINT, &act, NULL);
+    act.sa_handler = sig_quit_handler;
+    (void) sigaction(SIGQUIT, &act, NULL);
+    act.sa_handler = sig_hup_handler;
+    (void) sigaction(SIGHUP, &act, NULL);
 }
 
 /* ----------------------------------------------------------
@@ -232,7 +244,7 @@ init_pads (void)
 void
 main_pads (void)
 {
-    char pcap_filter[1044];
+    bstring pcap_filter;
     /* Initialize */
     init_pads();
 
@@ -245,6 +257,8 @@ main_pads (void)
 
         gc.mask = 0;
         gc.net = 0;
+        gc.capture = CAPTURE_PCAP;
+        gc.ebpf = 0;
 
     } else {
         /* Only root can access the interface. */
@@ -259,8 +273,59 @@ main_pads (void)
                 err_message("Unable to find a sniffing interface!  (%s)", errbuf);
         }
 
+        if (gc.workers > WORKERS_MAX)
+            gc.workers = WORKERS_MAX;
+
+        /*
+         * Set up the TPACKET_V3 ring.  libpcap is still used to build
+         * filters and write the dump file, so give it a dead handle.
+         */
+        if (gc.capture == CAPTURE_TPACKET) {
+            if (init_tpacket(gc.dev, (gc.workers > 1) ? gc.workers : 1) == 0) {
+                if (!(gc.handle = pcap_open_dead(DLT_EN10MB, tpacket_snaplen())))
+                    err_message("Unable to create pcap handle for interface %s!", gc.dev);
+            } else {
+                log_message("WARNING:  Falling back to libpcap capture\n");
+                gc.capture = CAPTURE_PCAP;
+            }
+        }
+
+        /* Same for AF_XDP:  one socket per receive queue, shared out
+         * over the workers. */
+        if (gc.capture == CAPTURE_XDP) {
+            if (init_xsk(gc.dev, (gc.workers > 1) ? gc.workers : 1) == 0) {
+                if (!(gc.handle = pcap_open_dead(DLT_EN10MB, xsk_snaplen())))
+                    err_message("Unable to create pcap handle for interface %s!", gc.dev);
+            } else {
+                log_message("WARNING:  Falling back to libpcap capture\n");
+                gc.capture = CAPTURE_PCAP;
+            }
+        }
+
+        /*
+         * Load the eBPF socket filter while we are still root.  Its map
+         * is updated for as long as PADS runs, which needs root as well.
+         */
+        if (gc.ebpf && gc.capture != CAPTURE_TPACKET) {
+            log_message("WARNING:  The eBPF filter needs 'capture tpacket'\n");
+            gc.ebpf = 0;
+        } else if (gc.ebpf && gc.priv_user != NULL && gc.priv_group != NULL) {
+            log_message("WARNING:  The eBPF filter cannot be used when dropping privileges\n");
+            gc.ebpf = 0;
+        } else if (gc.ebpf && init_ebpf(tpacket_snaplen()) == -1) {
+            gc.ebpf = 0;
+        } else if (gc.ebpf) {
+            sync_ebpf_map();
+        }
+
+        /* Workers need a socket each. */
+        if (gc.workers > 1 && gc.capture == CAPTURE_PCAP) {
+            log_message("WARNING:  Workers need 'capture tpacket' or 'capture xdp', using one\n");
+            gc.workers = 1;
+        }
+
         /* Set up libpcap connection. */
-        if (!(gc.handle = pcap_open_live(gc.dev, BUFSIZ, 1, 0, errbuf)))
+        if (gc.capture == CAPTURE_PCAP && !(gc.handle = pcap_open_live(gc.dev, BUFSIZ, 1, 0, errbuf)))
             err_message("Unable to open interface %s!  (%s)", gc.dev, errbuf);
 
         /* Drop Privileges */
@@ -282,19 +347,50 @@ main_pads (void)
     verbose_message("Determine LLC Type");
     set_processor(gc.handle);
 
-    /* Compile libpcap filter */
+    /* Decode packets in batches unless told not to. */
+    if (gc.batch_size != 1) {
+        init_batch();
+        processor = batch_add;
+    }
+
+    /*
+     * Compile libpcap filter.  Only the packets that PADS acts on are
+     * passed;  a user supplied filter narrows this down further.  The
+     * eBPF program does the first part itself, so only the user's
+     * filter is left (and run in userspace).
+     */
     if (prog_argc > 0) {
-      if(gc.pcap_filter) {
-	strcpy(pcap_filter, "");
-	strncat(pcap_filter, gc.pcap_filter, 1024);
-      } else {
-	strcpy(pcap_filter, "(arp or ip or vlan)");
-      }
-        log_message("Filter:  %s\n", pcap_filter);
-        if (pcap_compile(gc.handle, &gc.filter, pcap_filter, 0, gc.net) == -1) {
-            err_message("Unable to compile pcap filter!  %s", pcap_geterr(gc.handle));
+        if (gc.ebpf) {
+            pcap_filter = bfromcstr(gc.pcap_filter ? gc.pcap_filter : "");
+            log_message("Filter:  eBPF%s%s\n", gc.pcap_filter ? " and " : "", bdata(pcap_filter));
+        } else {
+            pcap_filter = packet_filter(pcap_datalink(gc.handle));
+            if (gc.pcap_filter) {
+                bstring synth = pcap_filter;
+                pcap_filter = bformat("(%s) and (%s)", bdata(synth), gc.pcap_filter);
+                bdestroy(synth);
+            }
+            log_message("Filter:  %s\n", bdata(pcap_filter));
         }
-        if (pcap_setfilter(gc.handle, &gc.filter)) {
+        if (pcap_compile(gc.handle, &gc.filter, bdata(pcap_filter), 1, gc.net) == -1) {
+            /* Fall back to the filter used before PADS built its own. */
+            log_message("WARNING:  Unable to compile filter (%s)\n", pcap_geterr(gc.handle));
+            bdestroy(pcap_filter);
+            pcap_filter = bfromcstr(gc.pcap_filter ? gc.pcap_filter : "(arp or ip or vlan)");
+            log_message("Filter:  %s\n", bdata(pcap_filter));
+            if (pcap_compile(gc.handle, &gc.filter, bdata(pcap_filter), 0, gc.net) == -1)
+                err_message("Unable to compile pcap filter!  %s", pcap_geterr(gc.handle));
+        }
+        bdestroy(pcap_filter);
+        if (gc.ebpf) {
+            if (tpacket_setebpf(ebpf_program(), gc.pcap_filter ? &gc.filter : NULL))
+                err_message("Unable to attach eBPF filter!");
+        } else if (gc.capture == CAPTURE_TPACKET) {
+            if (tpacket_setfilter(&gc.filter))
+                err_message("Unable to set socket filter!");
+        } else if (gc.capture == CAPTURE_XDP) {
+            xsk_setfilter(&gc.filter);
+        } else if (pcap_setfilter(gc.handle, &gc.filter)) {
             err_message("Unable to set pcap filter!  %s", pcap_geterr(gc.handle));
         }
         free(gc.pcap_filter);
@@ -307,13 +403,48 @@ main_pads (void)
             err_message("Cannot open dump file - %s\n", pcap_geterr(gc.handle));
     }
 
-    /* Sniff libpcap connection. */
     log_message("Listening on interface %s\n", gc.dev);
     log_message("\n");
-    verbose_message("Entering pcap_loop()");
-    while (pcap_loop(gc.handle, -1, process_pkt, NULL));
 
-    /* End */
+    /* Log asset changes and save snapshots while capturing. */
+    init_wal();
+    init_snapshot();
+
+    if (gc.capture == CAPTURE_TPACKET && gc.workers > 1) {
+        /* Hand each socket of the fanout group to a worker. */
+        init_output_writer();
+        init_workers(gc.workers, tpacket_loop, tpacket_breakloop, processor);
+        wait_workers();
+
+    } else if (gc.capture == CAPTURE_XDP && gc.workers > 1) {
+        /* Hand each receive queue to a worker. */
+        init_output_writer();
+        init_workers(gc.workers, xsk_loop, xsk_breakloop, processor);
+        wait_workers();
+
+    } else if (gc.capture == CAPTURE_TPACKET) {
+        /* Process packets in place in the kernel's ring. */
+        verbose_message("Entering tpacket_loop()");
+        tpacket_loop(0, processor);
+
+    } else if (gc.capture == CAPTURE_XDP) {
+        /* Process packets in place in the UMEM. */
+        verbose_message("Entering xsk_loop()");
+        xsk_loop(0, processor);
+
+    } else {
+        /*
+         * Start the analysis thread.  Packets read from a file are never
+         * dropped;  the capture thread waits for room on the ring instead.
+         */
+        init_ring(processor, gc.pcap_file != NULL);
+
+        /* Sniff libpcap connection. */
+        verbose_message("Entering pcap_loop()");
+        while (!pads_stopping && pcap_loop(gc.handle, -1, ring_put, NULL));
+    }
+
+    /* End:  the capture loops return on a signal as well. */
     end_pads();
 }
 
@@ -327,6 +458,22 @@ void
 end_pads(void)
 {
     struct pcap_stat pstat;
+    FlowStats *fstat;
+    PendingStats *pdstat;
+    EbpfStats *estat;
+    BannerStats *bstat;
+    StorageStats *sstat;
+    Ip6Stats *istat;
+    StrPoolStats *spstat;
+    RingStats *rstat;
+    TpacketStats *tstat;
+    XskStats *xstat;
+    ArenaStats *astat;
+    Slab *slab;
+    unsigned long packets, drops;
+    Worker *w;
+    sigset_t held;
+    int i;
     static int exit_status = 0;
 
     /* Make sure that this function is only called once. */
@@ -335,6 +482,18 @@ end_pads(void)
     else
         exit_status = 1;
 
+    /* Hold any further signals:  the last snapshot and the write-ahead
+     * log are written out now and must not be cut short. */
+    sigfillset(&held);
+    sigprocmask(SIG_BLOCK, &held, NULL);
+
+    /* Let the workers / analysis thread finish what has been captured. */
+    end_workers();
+    end_ring();
+    end_snapshot();
+    end_wal();
+    end_output_writer();
+
     /* Display PCAP Statistics */
     if (!pcap_stats(gc.handle, &pstat)) {
         log_message("\n");
@@ -344,12 +503,101 @@ end_pads(void)
         log_message("\n");
     }
 
+    /* Display Capture Ring Statistics */
+    if (gc.capture == CAPTURE_TPACKET) {
+        tstat = get_tpacket_stats(-1);
+        log_message("\n");
+        log_message("%lu Packets Received\n", tstat->packets);
+        log_message("%lu Packets Dropped by TPACKET Ring (%lu Freezes, %lu Blocks)\n",
+                    tstat->drops, tstat->freezes, tstat->blocks);
+        log_message("\n");
+    } else if (gc.capture == CAPTURE_XDP) {
+        xstat = get_xsk_stats(-1);
+        log_message("\n");
+        log_message("%lu Packets Received\n", xstat->packets);
+        log_message("%lu Packets Dropped by AF_XDP Sockets (%lu Times Out of Frames, %lu Batches)\n",
+                    xstat->drops, xstat->fill_empty, xstat->batches);
+        log_message("\n");
+    } else {
+        rstat = get_ring_stats();
+        log_message("%lu Packets Queued for Analysis\n", rstat->queued);
+        log_message("%lu Packets Dropped by Analysis Ring (Peak %u of %u Slots)\n",
+                    rstat->dropped, rstat->peak, rstat->slots);
+        log_message("\n");
+    }
+
+    /* Display Worker Statistics */
+    for (i = 0; i < get_worker_count(); i++) {
+        w = get_worker(i);
+        if (gc.capture == CAPTURE_XDP) {
+            xstat = get_xsk_stats(i);
+            packets = xstat->packets;
+            drops = xstat->drops;
+        } else {
+            tstat = get_tpacket_stats(i);
+            packets = tstat->packets;
+            drops = tstat->drops;
+        }
+        log_message("Worker %d:  %lu Packets (%lu Dropped), %lu Flows, %lu Segments Inspected, %lu Pending Filter Hits\n",
+                    i, packets, drops, w->flows.stats.created,
+                    w->flows.stats.inspected, w->pending.hits);
+    }
+    if (get_worker_count() > 0)
+        log_message("\n");
+
+    /* Display Flow Statistics */
+    fstat = get_flow_stats();
+    log_message("%lu Flows Tracked (%lu Expired, %lu Evicted)\n",
+                fstat->created, fstat->expired, fstat->evicted);
+    log_message("%lu Segments Inspected, %lu Skipped\n",
+                fstat->inspected, fstat->skipped);
+    log_message("%lu Segments Reassembled (%lu Gaps, %lu Full)\n",
+                fstat->reassembled, fstat->gaps, fstat->full);
+    pdstat = get_pending_stats();
+    log_message("%lu Pending Filter Hits (%lu False Positives), %lu Misses\n",
+                pdstat->hits, pdstat->false_pos, pdstat->misses);
+    if (gc.ebpf) {
+        estat = get_ebpf_stats();
+        log_message("%lu Endpoints Dropped by eBPF Filter (%lu Added, %lu Removed, %lu Errors)\n",
+                    estat->entries, estat->inserts, estat->deletes, estat->errors);
+    }
+    bstat = get_banner_stats();
+    log_message("%lu Banner Cache Hits, %lu Misses (%lu Evicted)\n",
+                bstat->hits, bstat->misses, bstat->evicted);
+    sstat = get_storage_stats();
+    log_message("%lu Assets Stored (%lu Expired, %lu Evicted), %lu ARP Entries (%lu Expired, %lu Evicted)\n",
+                sstat->assets, sstat->expired, sstat->evicted,
+                sstat->arp_entries, sstat->arp_expired, sstat->arp_evicted);
+    istat = get_ip6_stats();
+    if (istat->addresses > 0 || istat->full > 0)
+        log_message("%lu IPv6 Addresses Stored (%lu Released, %lu Refused)\n",
+                    istat->addresses, istat->released, istat->full);
+    spstat = get_strpool_stats();
+    log_message("%lu Names Interned (%lu Bytes, %lu From Packets, %lu Refused)\n",
+                spstat->strings, spstat->bytes, spstat->captured, spstat->full);
+    log_message("\n");
+
+    /* Display Memory Statistics */
+    for (slab = get_slabs(); slab != NULL; slab = slab->next)
+        log_message("%s:  %lu In Use (Peak %lu, %lu Chunks, %lu Allocated, %lu Freed)\n",
+                    slab->name, slab->stats.in_use, slab->stats.peak,
+                    slab->stats.chunks, slab->stats.allocs, slab->stats.frees);
+    astat = get_arena_stats();
+    log_message("%lu Scratch Allocations (Peak %lu Bytes, %lu Too Big)\n",
+                astat->allocs, astat->peak, astat->oversize);
+    log_message("\n");
+
     /* Close banner dump file if specifed (-d). */
     if (gc.dump_file) {
         verbose_message("Closing Banner Dump File");
         pcap_dump_close(gc.dumper);
     }
 
+    /* Close TPACKET / AF_XDP Sockets */
+    end_tpacket();
+    end_xsk();
+    end_ebpf();
+
     /* Kill PCAP Object */
     if (gc.handle) {
         log_message("Closing PCAP Connection");
@@ -365,10 +613,15 @@ end_pads(void)
     verbose_message("Cleaning Up Memory");
     end_output();
     end_storage();
+    end_flow();
+    end_pending();
+    end_ip6();
     end_identification();
 #ifndef DISABLE_VENDOR
     end_mac_resolution();
 #endif
+    end_strpool();
+    end_arena();
 
     /* Garbage Collect GC Variable */
     if (gc.conf_file != NULL)
@@ -385,6 +638,10 @@ end_pads(void)
         bdestroy(gc.sig_file);
     if (gc.mac_file != NULL)
         bdestroy(gc.mac_file);
+    if (gc.snapshot_file != NULL)
+        bdestroy(gc.snapshot_file);
+    if (gc.wal_file != NULL)
+        bdestroy(gc.wal_file);
     if (gc.pid_file != NULL)
         bdestroy(gc.pid_file);
     if (gc.priv_user != NULL)
@@ -411,7 +668,7 @@ process_cmdline (int argc, char *argv[])
     int ch;
 
     /* Process Command Line Arguments */
-    while ((ch = getopt(argc, argv, "c:d:Dg:hi:n:p:r:u:UvVw:")) != -1)  {
+    while ((ch = getopt(argc, argv, "c:d:Dg:hi:n:p:r:t:u:UvVw:")) != -1)  {
         switch (ch) {
             case 'c':
                 gc.conf_file = blk2bstr(optarg, strlen(optarg));
@@ -441,6 +698,9 @@ process_cmdline (int argc, char *argv[])
             case 'r':
                 gc.pcap_file = blk2bstr(optarg, strlen(optarg));
                 break;
+            case 't':
+                gc.workers = atoi(optarg);
+                break;
             case 'u':
                 gc.priv_user = blk2bstr(optarg, strlen(optarg));
                 break;
@@ -476,34 +736,54 @@ process_cmdline (int argc, char *argv[])
     return 0;
 }
 
+/* ----------------------------------------------------------
+ * FUNCTION     : stop_capture
+ * DESCRIPTION  : This function will make the capture loop
+ *              : (or the workers' loops) return, so that
+ *              : main_pads() can call end_pads().  It is
+ *              : called from the signal handlers, so it only
+ *              : sets flags.
+ * ---------------------------------------------------------- */
+static void
+stop_capture (void)
+{
+    pads_stopping = 1;
+    tpacket_breakloop();
+    xsk_breakloop();
+    if (gc.handle != NULL)
+        pcap_breakloop(gc.handle);
+}
+
 /* ----------------------------------------------------------
  * The following functions are signal handlers.  They are
  * initialized in 'init_pads' and will perform a function
- * based on the signal.
+ * based on the signal.  PADS is shut down by main_pads()
+ * once the capture has stopped;  end_pads() takes locks
+ * and joins threads, so it is never called from here.
  * ---------------------------------------------------------- */
 void
 sig_term_handler(int signal)
 {
-    end_pads();
+    stop_capture();
 }
 
 void
 sig_int_handler(int signal)
 {
-    end_pads();
+    stop_capture();
 }
 
 void
 sig_quit_handler(int signal)
 {
-    end_pads();
+    stop_capture();
 }
 
 void
 sig_hup_handler(int signal)
 {
     /* The HUP signal has not been implemented yet. */
-    end_pads();
+    stop_capture();
 }
 
 /* ----------------------------------------------------------
@@ -28,7 +28,6 @@
 
 
 /* PROTOTYPES -------------------------------------- */
-void process_pkt(u_char *args, const struct pcap_pkthdr* pkthdr, const u_char* packet);
 void set_processor (pcap_t *this_handle);
 void print_header(void);
 void print_usage(void);
@@ -43,8 +42,9 @@ void sig_quit_handler(int signal);
 void sig_hup_handler(int signal);
 
 /* packet.h LLC prototypes */
-void process_eth (const struct pcap_pkthdr* pkthdr, const u_char* packet);
-void process_sll (const struct pcap_pkthdr* pkthdr, const u_char* packet);
+int init_decoder (int datalink);
+void process_packet (const struct pcap_pkthdr* pkthdr, const u_char* packet);
+bstring packet_filter (int datalink);
 
 /* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
  */
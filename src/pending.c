@@ -0,0 +1,287 @@
+/*************************************************************************
+ * pending.c
+ *
+ * This module answers one question for every payload packet:  is the
+ * sender a server that we are still trying to identify?  The answer comes
+ * from a blocked counting Bloom filter that is kept in sync by the storage
+ * module.  All the counters for a key live in a single cache line, so a
+ * lookup touches one line of a table that fits in L2.  The filter never
+ * says no to a pending endpoint, but it may occasionally say yes to one
+ * that is not pending;  those false positives are caught further down the
+ * ACK path and counted here so the filter can be sized.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pending.h"
+#include "ebpf.h"
+#include "util.h"
+
+/* Variable Declarations */
+u_int8_t *pending_filter;       /* Counter Blocks */
+PendingStats pending_stats;
+__thread PendingStats *pending_local = &pending_stats;  /* Lookup counters for this thread */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_hash
+ * DESCRIPTION	: This function will hash an endpoint.  The
+ *		: low bits select the block and the high bits
+ *		: select the counters within it.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+static inline u_int64_t
+pending_hash (u_int32_t ip, u_int16_t port, unsigned short proto)
+{
+    u_int64_t h;
+
+    h = ((u_int64_t)ip << 32) | ((u_int32_t)port << 16) | (proto & 0xffff);
+    h ^= h >> 31;
+    h *= 0x7fb5d329728ea185ULL;
+    h ^= h >> 27;
+    h *= 0x81dadef4bc2dd44dULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_block
+ * DESCRIPTION	: This function will return the counter block
+ *		: that holds a key.
+ * INPUT	: 0 - Hash Value
+ * RETURN	: Pointer to Block
+ * ---------------------------------------------------------- */
+static inline u_int8_t *
+pending_block (u_int64_t h)
+{
+    return pending_filter + (h & (PENDING_BLOCKS - 1)) * PENDING_BLOCK_SIZE;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_pending
+ * DESCRIPTION	: This function will allocate the filter.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_pending (void)
+{
+    if (posix_memalign((void **)&pending_filter, PENDING_BLOCK_SIZE,
+		PENDING_BLOCKS * PENDING_BLOCK_SIZE) != 0)
+	err_message("Unable to allocate pending identification filter");
+
+    memset(pending_filter, 0, PENDING_BLOCKS * PENDING_BLOCK_SIZE);
+    memset(&pending_stats, 0, sizeof(PendingStats));
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_add
+ * DESCRIPTION	: This function will mark an endpoint as
+ *		: pending identification.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+pending_add (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    u_int64_t h;
+    u_int8_t *block, c;
+    int i;
+
+    /* Let the kernel pass its data segments again. */
+    ebpf_pending(ip_addr, port, proto);
+
+    if (pending_filter == NULL)
+	return;
+
+    h = pending_hash(ip_addr.s_addr, port, proto);
+    block = pending_block(h);
+    h >>= 32;
+
+    /*
+     * Updates are serialized by the storage lock;  workers may read the
+     * counters at any time, so they are stored atomically.
+     */
+    for (i = 0; i < PENDING_HASHES; i++, h >>= 6) {
+	c = block[h & (PENDING_BLOCK_SIZE - 1)];
+	/* Saturated counters are never touched again. */
+	if (c == 0xff)
+	    continue;
+	__atomic_store_n(&block[h & (PENDING_BLOCK_SIZE - 1)], ++c, __ATOMIC_RELAXED);
+	if (c == 0xff)
+	    pending_stats.saturated++;
+    }
+
+    pending_stats.keys++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_del
+ * DESCRIPTION	: This function will remove an endpoint from
+ *		: the filter.  It must only be called for
+ *		: endpoints that were added.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+pending_del (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    u_int64_t h;
+    u_int8_t *block, c;
+    int i;
+
+    /* From now on the kernel drops its data segments. */
+    ebpf_identified(ip_addr, port, proto);
+
+    if (pending_filter == NULL)
+	return;
+
+    h = pending_hash(ip_addr.s_addr, port, proto);
+    block = pending_block(h);
+    h >>= 32;
+
+    for (i = 0; i < PENDING_HASHES; i++, h >>= 6) {
+	c = block[h & (PENDING_BLOCK_SIZE - 1)];
+	if (c != 0xff && c != 0)
+	    __atomic_store_n(&block[h & (PENDING_BLOCK_SIZE - 1)], c - 1, __ATOMIC_RELAXED);
+    }
+
+    if (pending_stats.keys > 0)
+	pending_stats.keys--;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_check
+ * DESCRIPTION	: This function will check whether an endpoint
+ *		: might be pending identification.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: 0 - Not pending
+ *		: 1 - Possibly pending
+ * ---------------------------------------------------------- */
+int
+pending_check (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    u_int64_t h;
+    u_int8_t *block;
+    int i;
+
+    /* Without a filter, everything might be pending. */
+    if (pending_filter == NULL)
+	return 1;
+
+    h = pending_hash(ip_addr.s_addr, port, proto);
+    block = pending_block(h);
+    h >>= 32;
+
+    for (i = 0; i < PENDING_HASHES; i++, h >>= 6) {
+	if (__atomic_load_n(&block[h & (PENDING_BLOCK_SIZE - 1)], __ATOMIC_RELAXED) == 0) {
+	    pending_local->misses++;
+	    return 0;
+	}
+    }
+
+    pending_local->hits++;
+    return 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_prefetch
+ * DESCRIPTION	: This function will start loading the counter
+ *		: block of an endpoint, ahead of pending_check().
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+pending_prefetch (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    if (pending_filter != NULL)
+	__builtin_prefetch(pending_block(pending_hash(ip_addr.s_addr, port, proto)), 0, 1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_false_positive
+ * DESCRIPTION	: This function is called when an endpoint
+ *		: that passed the filter turned out not to be
+ *		: pending.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+pending_false_positive (void)
+{
+    pending_local->false_pos++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: pending_thread_stats
+ * DESCRIPTION	: This function will make the calling thread
+ *		: count its lookups in its own counters, so
+ *		: that workers do not share a cache line.
+ * INPUT	: 0 - Counters (NULL = shared counters)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+pending_thread_stats (PendingStats *stats)
+{
+    pending_local = (stats != NULL) ? stats : &pending_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_pending_stats
+ * DESCRIPTION	: This function will return the filter
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to PendingStats
+ * ---------------------------------------------------------- */
+PendingStats *
+get_pending_stats (void)
+{
+    return &pending_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_pending
+ * DESCRIPTION	: This function will free the filter.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_pending (void)
+{
+    if (pending_filter != NULL)
+	free(pending_filter);
+    pending_filter = NULL;
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
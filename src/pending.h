@@ -0,0 +1,59 @@
+/*************************************************************************
+ * pending.h
+ *
+ * This header file contains information relating to the pending.c
+ * module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_PENDING_H
+#define INCLUDED_PENDING_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define PENDING_BLOCK_SIZE 64       /* Counters per block (one cache line). */
+#define PENDING_BLOCKS 4096         /* Blocks in the filter (256 KB). */
+#define PENDING_HASHES 4            /* Counters set per key. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * PendingStats:  Pending identification filter counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _PendingStats
+{
+    unsigned long keys;         /* Endpoints currently pending. */
+    unsigned long hits;         /* Lookups that passed the filter. */
+    unsigned long misses;       /* Lookups rejected by the filter. */
+    unsigned long false_pos;    /* Hits that were not actually pending. */
+    unsigned long saturated;    /* Counters stuck at their maximum. */
+} PendingStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_pending (void);
+void pending_add (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+void pending_del (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+int pending_check (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+void pending_prefetch (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+void pending_false_positive (void);
+void pending_thread_stats (PendingStats *stats);
+PendingStats *get_pending_stats (void);
+void end_pending (void);
+
+#endif /* INCLUDED_PENDING_H */
@@ -0,0 +1,524 @@
+/*************************************************************************
+ * prefilter.c
+ *
+ * This module narrows down the signatures that have to be run against a
+ * payload.  When a signature is loaded, the longest literal string that
+ * every match must contain (i.e. "SSH-" or "Server: Apache") is taken from
+ * its regular expression.  All of these literals are compiled into a
+ * single Aho-Corasick automaton, so one pass over the payload tells us
+ * which signatures could possibly match.  Signatures without a usable
+ * literal are always candidates.
+ *
+ * Literals are matched without regard to case, which keeps signatures
+ * using (?i) correct at the cost of the odd extra candidate.  Bytes that
+ * do not appear in any literal share one character class, which keeps
+ * the transition table small.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prefilter.h"
+#include "util.h"
+
+/* Variable Declarations */
+u_char **pf_lit;                /* Literals (case folded) */
+int *pf_lit_len;                /* Literal Lengths */
+unsigned int *pf_lit_id;        /* Signature ID for each literal */
+u_int32_t *pf_lit_next;         /* Next literal ending in the same state */
+unsigned int pf_nlit;           /* Number of literals */
+unsigned int pf_lit_size;       /* Allocated literal slots */
+
+unsigned int pf_nsig;           /* Number of signatures (highest ID + 1) */
+unsigned int pf_words;          /* 64 bit words in a candidate set */
+u_int64_t *pf_always;           /* Signatures without a literal */
+
+u_char pf_class[256];           /* Byte -> Character Class */
+unsigned int pf_nclasses;       /* Number of Character Classes */
+u_int32_t *pf_delta;            /* Transitions (state * classes + class) */
+u_int32_t *pf_out;              /* First literal ending in each state */
+u_int32_t *pf_dict;             /* Next state with output on the fail chain */
+unsigned int pf_nstates;        /* Number of States */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: set_candidate
+ * DESCRIPTION	: This function will mark a signature as a
+ *		: candidate.
+ * INPUT	: 0 - Candidate Set
+ *		: 1 - Signature ID
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+set_candidate (u_int64_t *cand, unsigned int id)
+{
+    cand[id >> 6] |= (u_int64_t)1 << (id & 63);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: extract_literal
+ * DESCRIPTION	: This function will find the longest literal
+ *		: that every match of a regular expression
+ *		: must contain.  Only the top level of the
+ *		: expression is considered;  groups, classes
+ *		: and escapes such as \d end a literal.  Top
+ *		: level alternation means there is no such
+ *		: literal.
+ * INPUT	: 0 - Regular Expression
+ *		: 1 - Buffer for the literal (case folded)
+ * RETURN	: Length of the literal (0 if none)
+ * ---------------------------------------------------------- */
+static int
+extract_literal (const char *re, u_char *best)
+{
+    u_char run[PREFILTER_MAX_LITERAL];
+    const char *p;
+    int rlen = 0;               /* Length of the current literal */
+    int blen = 0;               /* Length of the best literal */
+    int last_lit = 0;           /* Did the last token extend 'run'? */
+    int depth = 0;              /* Group nesting */
+    int c, min;
+
+#define COMMIT_RUN() do { \
+	if (rlen > blen) { memcpy(best, run, rlen); blen = rlen; } \
+	rlen = 0; last_lit = 0; \
+    } while (0)
+
+    for (p = re; *p != '\0'; p++) {
+	c = -1;
+
+	switch (*p) {
+	case '\\':
+	    p++;
+	    if (*p == '\0')
+		return 0;
+	    switch (*p) {
+	    case 'n': c = '\n'; break;
+	    case 'r': c = '\r'; break;
+	    case 't': c = '\t'; break;
+	    case 'f': c = '\f'; break;
+	    case 'a': c = '\a'; break;
+	    case 'e': c = 0x1b; break;
+	    case 'x':
+		/* \xhh:  up to two hex digits. */
+		if (p[1] == '{')
+		    return 0;
+		for (c = 0, min = 0; min < 2 && isxdigit((u_char)p[1]); min++, p++)
+		    c = (c << 4) | (isdigit((u_char)p[1]) ? p[1] - '0' : (tolower((u_char)p[1]) - 'a' + 10));
+		break;
+	    case 'c':
+		if (p[1] == '\0')
+		    return 0;
+		p++;
+		c = toupper((u_char)*p) ^ 0x40;
+		break;
+	    case 'Q': case 'p': case 'P': case 'g': case 'k': case 'N': case 'o':
+		/* Too much syntax to follow here. */
+		return 0;
+	    default:
+		if (isdigit((u_char)*p)) {
+		    /* Back reference or octal escape. */
+		    while (isdigit((u_char)p[1]))
+			p++;
+		} else if (!isalnum((u_char)*p)) {
+		    c = (u_char)*p;
+		}
+		/* \d, \S, \b, ... */
+		break;
+	    }
+	    break;
+
+	case '[':
+	    /* Skip over the character class. */
+	    p++;
+	    if (*p == '^')
+		p++;
+	    if (*p == ']')
+		p++;
+	    while (*p != '\0' && *p != ']') {
+		if (*p == '\\' && p[1] != '\0')
+		    p++;
+		else if (*p == '[' && p[1] == ':') {
+		    p += 2;
+		    while (*p != '\0' && !(*p == ':' && p[1] == ']'))
+			p++;
+		    if (*p != '\0')
+			p++;
+		}
+		if (*p != '\0')
+		    p++;
+	    }
+	    if (*p == '\0')
+		return 0;
+	    break;
+
+	case '(':
+	    if (p[1] == '?' && p[2] == '#') {
+		/* Comment */
+		while (*p != '\0' && *p != ')')
+		    p++;
+		if (*p == '\0')
+		    return 0;
+		break;
+	    }
+	    if (p[1] == '?') {
+		/* Inline options:  extended mode changes what is literal. */
+		for (min = 2; isalpha((u_char)p[min]) || p[min] == '-'; min++)
+		    if (p[min] == 'x')
+			return 0;
+	    }
+	    depth++;
+	    break;
+
+	case ')':
+	    depth--;
+	    break;
+
+	case '|':
+	    if (depth == 0)
+		return 0;
+	    break;
+
+	case '*':
+	case '?':
+	case '+':
+	case '{':
+	    if (*p == '{') {
+		/* Only {n}, {n,} and {n,m} are quantifiers. */
+		if (!isdigit((u_char)p[1])) {
+		    c = '{';
+		    break;
+		}
+		min = atoi(p + 1);
+		while (*p != '\0' && *p != '}')
+		    p++;
+		if (*p == '\0')
+		    return 0;
+	    } else {
+		min = (*p == '+') ? 1 : 0;
+	    }
+
+	    /*
+	     * The quantifier applies to the last character of the run.
+	     * If it may be absent, the run ends before it;  if it may
+	     * repeat, the run ends with it.
+	     */
+	    if (last_lit) {
+		if (min == 0)
+		    rlen--;
+		COMMIT_RUN();
+	    }
+
+	    /* Lazy and possessive modifiers. */
+	    if (p[1] == '?' || p[1] == '+')
+		p++;
+	    continue;
+
+	case '.':
+	case '^':
+	case '$':
+	    break;
+
+	default:
+	    c = (u_char)*p;
+	    break;
+	}
+
+	if (c < 0 || depth > 0) {
+	    COMMIT_RUN();
+	    continue;
+	}
+
+	if (rlen == PREFILTER_MAX_LITERAL)
+	    COMMIT_RUN();
+	run[rlen++] = (u_char)tolower(c);
+	last_lit = 1;
+    }
+
+    COMMIT_RUN();
+#undef COMMIT_RUN
+
+    return (blen >= PREFILTER_MIN_LITERAL) ? blen : 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: prefilter_add
+ * DESCRIPTION	: This function will register a signature with
+ *		: the prefilter.  Signature IDs must be handed
+ *		: out in file order, starting at 0.
+ * INPUT	: 0 - Regular Expression
+ *		: 1 - Signature ID
+ * RETURN	: 0 - Signature is always a candidate
+ *		: 1 - Signature has a literal
+ * ---------------------------------------------------------- */
+int
+prefilter_add (const char *regex, unsigned int id)
+{
+    u_char lit[PREFILTER_MAX_LITERAL];
+    int len;
+
+    if (id >= pf_nsig)
+	pf_nsig = id + 1;
+
+    /* Signatures without a literal are kept with an empty one. */
+    len = extract_literal(regex, lit);
+
+    if (pf_nlit == pf_lit_size) {
+	pf_lit_size = (pf_lit_size == 0) ? 256 : pf_lit_size * 2;
+	pf_lit = (u_char **) realloc(pf_lit, pf_lit_size * sizeof(u_char *));
+	pf_lit_len = (int *) realloc(pf_lit_len, pf_lit_size * sizeof(int));
+	pf_lit_id = (unsigned int *) realloc(pf_lit_id, pf_lit_size * sizeof(unsigned int));
+	if (pf_lit == NULL || pf_lit_len == NULL || pf_lit_id == NULL)
+	    err_message("Unable to allocate prefilter literals");
+    }
+
+    pf_lit[pf_nlit] = NULL;
+    if (len > 0) {
+	if ((pf_lit[pf_nlit] = (u_char *) malloc(len)) == NULL)
+	    err_message("Unable to allocate prefilter literals");
+	memcpy(pf_lit[pf_nlit], lit, len);
+    }
+    pf_lit_len[pf_nlit] = len;
+    pf_lit_id[pf_nlit] = id;
+    pf_nlit++;
+
+    return (len > 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: prefilter_build
+ * DESCRIPTION	: This function will compile the literals that
+ *		: have been added into the automaton.  It is
+ *		: called once all signatures have been read.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+prefilter_build (void)
+{
+    int used[256];
+    u_int32_t *fail, *queue;
+    unsigned int max_states, nliterals = 0;
+    unsigned int i, j, head, tail, s, t, cls;
+    int b;
+
+    pf_words = (pf_nsig + 63) / 64;
+    if ((pf_always = (u_int64_t *) calloc(pf_words + 1, sizeof(u_int64_t))) == NULL)
+	err_message("Unable to allocate prefilter");
+
+    /* Character classes:  one per folded byte used in a literal. */
+    memset(used, 0, sizeof(used));
+    max_states = 1;
+    for (i = 0; i < pf_nlit; i++) {
+	if (pf_lit_len[i] == 0) {
+	    set_candidate(pf_always, pf_lit_id[i]);
+	    continue;
+	}
+	for (j = 0; j < pf_lit_len[i]; j++)
+	    used[pf_lit[i][j]] = 1;
+	max_states += pf_lit_len[i];
+	nliterals++;
+    }
+    pf_nclasses = 1;
+    for (b = 0; b < 256; b++)
+	if (used[b])
+	    used[b] = pf_nclasses++;
+    for (b = 0; b < 256; b++)
+	pf_class[b] = used[tolower(b)];
+
+    pf_delta = (u_int32_t *) calloc(max_states * pf_nclasses, sizeof(u_int32_t));
+    pf_out = (u_int32_t *) malloc(max_states * sizeof(u_int32_t));
+    pf_dict = (u_int32_t *) malloc(max_states * sizeof(u_int32_t));
+    pf_lit_next = (u_int32_t *) malloc((pf_nlit + 1) * sizeof(u_int32_t));
+    fail = (u_int32_t *) calloc(max_states, sizeof(u_int32_t));
+    queue = (u_int32_t *) malloc(max_states * sizeof(u_int32_t));
+    if (pf_delta == NULL || pf_out == NULL || pf_dict == NULL
+	    || pf_lit_next == NULL || fail == NULL || queue == NULL)
+	err_message("Unable to allocate prefilter");
+
+    memset(pf_out, 0xff, max_states * sizeof(u_int32_t));
+    memset(pf_dict, 0xff, max_states * sizeof(u_int32_t));
+
+    /*
+     * Build the trie.  While building, a transition of 0 means that
+     * there is no edge (nothing ever points back at the root).  Literals
+     * are inserted in reverse so that each output list ends up in file
+     * order.
+     */
+    pf_nstates = 1;
+    for (i = pf_nlit; i-- > 0; ) {
+	if (pf_lit_len[i] == 0)
+	    continue;
+	s = 0;
+	for (j = 0; j < pf_lit_len[i]; j++) {
+	    cls = pf_class[pf_lit[i][j]];
+	    if (pf_delta[s * pf_nclasses + cls] == 0)
+		pf_delta[s * pf_nclasses + cls] = pf_nstates++;
+	    s = pf_delta[s * pf_nclasses + cls];
+	}
+	pf_lit_next[i] = pf_out[s];
+	pf_out[s] = i;
+    }
+
+    /*
+     * Breadth first:  compute the failure links and fill in every
+     * missing transition, turning the trie into a DFA.
+     */
+    head = tail = 0;
+    for (cls = 0; cls < pf_nclasses; cls++) {
+	if ((t = pf_delta[cls]) != 0) {
+	    fail[t] = 0;
+	    queue[tail++] = t;
+	}
+    }
+    while (head < tail) {
+	s = queue[head++];
+	for (cls = 0; cls < pf_nclasses; cls++) {
+	    t = pf_delta[s * pf_nclasses + cls];
+	    if (t != 0) {
+		fail[t] = pf_delta[fail[s] * pf_nclasses + cls];
+		pf_dict[t] = (pf_out[fail[t]] != PREFILTER_NIL) ? fail[t] : pf_dict[fail[t]];
+		queue[tail++] = t;
+	    } else {
+		pf_delta[s * pf_nclasses + cls] = pf_delta[fail[s] * pf_nclasses + cls];
+	    }
+	}
+    }
+
+    /*
+     * Store transitions as row offsets so a scan step is a single load,
+     * and flag the ones that lead to a state with output.
+     */
+    for (i = 0; i < pf_nstates * pf_nclasses; i++) {
+	t = pf_delta[i];
+	pf_delta[i] = t * pf_nclasses;
+	if (pf_out[t] != PREFILTER_NIL || pf_dict[t] != PREFILTER_NIL)
+	    pf_delta[i] |= PREFILTER_MATCH;
+    }
+
+    free(fail);
+    free(queue);
+
+    verbose_message("Prefilter:  %u of %u signatures have a literal (%u states, %u classes)",
+		    nliterals, pf_nsig, pf_nstates, pf_nclasses);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: prefilter_words
+ * DESCRIPTION	: This function will return the size of a
+ *		: candidate set in 64 bit words.
+ * INPUT	: None!
+ * RETURN	: Number of words
+ * ---------------------------------------------------------- */
+unsigned int
+prefilter_words (void)
+{
+    return pf_words;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: prefilter_scan
+ * DESCRIPTION	: This function will scan a payload and return
+ *		: the set of signatures that could match it.
+ * INPUT	: 0 - Payload
+ *		: 1 - Payload Length
+ *		: 2 - Candidate Set (prefilter_words() words)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+prefilter_scan (const u_char *data, int len, u_int64_t *cand)
+{
+    u_int32_t s = 0;
+
+    memcpy(cand, pf_always, pf_words * sizeof(u_int64_t));
+    prefilter_resume(data, len, &s, cand);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: prefilter_resume
+ * DESCRIPTION	: This function will continue a scan with the
+ *		: next bytes of a stream.  The signatures
+ *		: found are added to the candidate set, so
+ *		: only new bytes need to be scanned.
+ * INPUT	: 0 - Data
+ *		: 1 - Data Length
+ *		: 2 - Automaton State (0 at the start)
+ *		: 3 - Candidate Set (prefilter_words() words)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+prefilter_resume (const u_char *data, int len, u_int32_t *state, u_int64_t *cand)
+{
+    u_int32_t s = *state, o, l;
+    int i;
+
+    if (pf_delta == NULL)
+	return;
+
+    for (i = 0; i < len; i++) {
+	s = pf_delta[s + pf_class[data[i]]];
+	if (s & PREFILTER_MATCH) {
+	    s &= ~PREFILTER_MATCH;
+	    for (o = s / pf_nclasses; o != PREFILTER_NIL; o = pf_dict[o])
+		for (l = pf_out[o]; l != PREFILTER_NIL; l = pf_lit_next[l])
+		    set_candidate(cand, pf_lit_id[l]);
+	}
+    }
+    *state = s;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_prefilter
+ * DESCRIPTION	: This function will free the prefilter.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_prefilter (void)
+{
+    unsigned int i;
+
+    for (i = 0; i < pf_nlit; i++)
+	if (pf_lit[i] != NULL)
+	    free(pf_lit[i]);
+
+    free(pf_lit);
+    free(pf_lit_len);
+    free(pf_lit_id);
+    free(pf_lit_next);
+    free(pf_always);
+    free(pf_delta);
+    free(pf_out);
+    free(pf_dict);
+
+    pf_lit = NULL;
+    pf_lit_len = NULL;
+    pf_lit_id = NULL;
+    pf_lit_next = NULL;
+    pf_always = NULL;
+    pf_delta = NULL;
+    pf_out = NULL;
+    pf_dict = NULL;
+    pf_nlit = pf_lit_size = pf_nsig = pf_words = pf_nstates = 0;
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
@@ -0,0 +1,42 @@
+/*************************************************************************
+ * prefilter.h
+ *
+ * This header file contains information relating to the prefilter.c
+ * module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_PREFILTER_H
+#define INCLUDED_PREFILTER_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define PREFILTER_MIN_LITERAL 2     /* Shorter literals are not worth it. */
+#define PREFILTER_MAX_LITERAL 64    /* Longest literal taken from a signature. */
+#define PREFILTER_NIL 0xffffffff    /* Empty state / literal index. */
+#define PREFILTER_MATCH 0x80000000  /* Transition flag:  target has output. */
+
+
+/* PROTOTYPES -------------------------------------- */
+int prefilter_add (const char *regex, unsigned int id);
+void prefilter_build (void);
+unsigned int prefilter_words (void);
+void prefilter_scan (const u_char *data, int len, u_int64_t *cand);
+void prefilter_resume (const u_char *data, int len, u_int32_t *state, u_int64_t *cand);
+void end_prefilter (void);
+
+#endif /* INCLUDED_PREFILTER_H */
@@ -0,0 +1,279 @@
+/*************************************************************************
+ * ring.c
+ *
+ * This module separates packet capture from packet analysis.  The capture
+ * thread (the one running pcap_loop) copies the part of each packet that
+ * we need into a preallocated single producer / single consumer ring and
+ * goes straight back to the kernel.  A dedicated analysis thread takes
+ * packets off of the ring and runs the decoders, identification and
+ * output.  A slow signature or a blocked FIFO reader now fills the ring
+ * instead of the kernel buffer.
+ *
+ * The ring needs no locks:  only the capture thread moves the head and
+ * only the analysis thread moves the tail.  Each side keeps a cached copy
+ * of the other side's index and only rereads it when the ring looks full
+ * (or empty), so the two threads rarely touch the same cache line.
+ *
+ * When reading from a file nothing may be lost, so the capture thread
+ * waits for room instead of dropping packets.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "batch.h"
+#include "flow.h"
+#include "identification.h"
+#include "ring.h"
+#include "slab.h"
+#include "util.h"
+
+/* --------------------------------------------------------------------------
+ * Ring:  Ring state.  Fields written by the capture thread and fields
+ * written by the analysis thread live on separate cache lines.
+ * -------------------------------------------------------------------------- */
+typedef struct _Ring
+{
+    u_char *slots;              /* Slot Memory */
+    size_t stride;              /* Bytes per slot */
+    u_int32_t mask;             /* Number of slots - 1 */
+    u_int32_t snaplen;          /* Bytes kept per packet */
+    int blocking;               /* Wait for room instead of dropping. */
+    RingHandler handler;        /* Packet Processor */
+    pthread_t thread;           /* Analysis Thread */
+    int running;                /* Has the analysis thread been started? */
+
+    /* Capture Thread */
+    u_int32_t head __attribute__ ((aligned (RING_CACHE_LINE)));
+    u_int32_t tail_cache;       /* Last tail seen by the capture thread. */
+    int closed;                 /* No more packets will be queued. */
+    unsigned long queued;
+    unsigned long dropped;
+
+    /* Analysis Thread */
+    u_int32_t tail __attribute__ ((aligned (RING_CACHE_LINE)));
+    u_int32_t head_cache;       /* Last head seen by the analysis thread. */
+    unsigned int peak;
+} Ring;
+
+/* Variable Declarations */
+Ring ring;
+RingStats ring_stats;
+
+#define RING_SLOT(i) ((RingSlot *)(ring.slots + (size_t)((i) & ring.mask) * ring.stride))
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ring_backoff
+ * DESCRIPTION	: This function is called while a thread waits
+ *		: on the other side of the ring.  It yields at
+ *		: first and then sleeps for short periods.
+ * INPUT	: 0 - Number of times we have waited so far
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+ring_backoff (unsigned int *idle)
+{
+    struct timespec ts;
+
+    if ((*idle)++ < 64) {
+	sched_yield();
+    } else {
+	ts.tv_sec = 0;
+	ts.tv_nsec = 100000;
+	nanosleep(&ts, NULL);
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ring_thread
+ * DESCRIPTION	: This is the analysis thread.  It processes
+ *		: packets until the ring has been closed and
+ *		: drained.
+ * INPUT	: 0 - Not used
+ * RETURN	: NULL
+ * ---------------------------------------------------------- */
+static void *
+ring_thread (void *arg)
+{
+    RingSlot *slot;
+    u_int32_t tail = ring.tail;
+    unsigned int idle = 0;
+
+    for (;;) {
+	if (tail == ring.head_cache) {
+	    ring.head_cache = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	    if (tail == ring.head_cache) {
+		if (__atomic_load_n(&ring.closed, __ATOMIC_ACQUIRE)) {
+		    /* Pick up anything queued before the ring was closed. */
+		    ring.head_cache = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+		    if (tail == ring.head_cache)
+			break;
+		    continue;
+		}
+		ring_backoff(&idle);
+		continue;
+	    }
+	    if (ring.head_cache - tail > ring.peak)
+		ring.peak = ring.head_cache - tail;
+	    idle = 0;
+	}
+
+	slot = RING_SLOT(tail);
+	(*ring.handler)(&slot->hdr, slot->data);
+
+	/* Slots still waiting in a batch must not be handed back. */
+	if (++tail == ring.head_cache || (tail & (BATCH_SIZE - 1)) == 0) {
+	    batch_flush();
+	    __atomic_store_n(&ring.tail, tail, __ATOMIC_RELEASE);
+	}
+    }
+
+    /* Capture has ended:  identify what the open flows have kept. */
+    flow_flush_all();
+    end_match_state();
+    end_arena();
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_ring
+ * DESCRIPTION	: This function will allocate the ring and
+ *		: start the analysis thread.
+ * INPUT	: 0 - Packet Processor
+ *		: 1 - Wait for room instead of dropping (0/1)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_ring (RingHandler handler, int blocking)
+{
+    sigset_t all, old;
+    u_int32_t slots, i;
+
+    slots = (gc.ring_slots > 0) ? gc.ring_slots : RING_SLOTS;
+    for (i = 1; i < slots; i <<= 1);
+    ring.mask = i - 1;
+    ring.snaplen = (gc.ring_snaplen > 0) ? gc.ring_snaplen : RING_SNAPLEN;
+    ring.stride = (sizeof(RingSlot) + ring.snaplen + RING_CACHE_LINE - 1)
+	& ~(size_t)(RING_CACHE_LINE - 1);
+    ring.blocking = blocking;
+    ring.handler = handler;
+
+    if (posix_memalign((void **)&ring.slots, RING_CACHE_LINE,
+		(size_t)(ring.mask + 1) * ring.stride) != 0)
+	err_message("Unable to allocate capture ring (%u slots)", ring.mask + 1);
+
+    /* Signals are handled by the capture thread only. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&ring.thread, NULL, ring_thread, NULL) != 0)
+	err_message("Unable to start analysis thread");
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    ring.running = 1;
+
+    verbose_message("Capture ring:  %u slots, %u bytes per packet",
+		    ring.mask + 1, ring.snaplen);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: ring_put
+ * DESCRIPTION	: This is the capture thread's pcap callback.
+ *		: It copies a packet onto the ring.
+ * INPUT	: 0 - Not used
+ *		: 1 - pcap packet header
+ *		: 2 - pcap packet
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+ring_put (u_char *args, const struct pcap_pkthdr *pkthdr, const u_char *packet)
+{
+    RingSlot *slot;
+    u_int32_t head = ring.head;
+    unsigned int idle = 0;
+
+    if (head - ring.tail_cache > ring.mask) {
+	ring.tail_cache = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+	while (head - ring.tail_cache > ring.mask) {
+	    if (!ring.blocking) {
+		ring.dropped++;
+		return;
+	    }
+	    ring_backoff(&idle);
+	    ring.tail_cache = __atomic_load_n(&ring.tail, __ATOMIC_ACQUIRE);
+	}
+    }
+
+    slot = RING_SLOT(head);
+    slot->hdr.ts = pkthdr->ts;
+    slot->hdr.len = pkthdr->len;
+    slot->hdr.caplen = (pkthdr->caplen < ring.snaplen) ? pkthdr->caplen : ring.snaplen;
+    memcpy(slot->data, packet, slot->hdr.caplen);
+
+    __atomic_store_n(&ring.head, head + 1, __ATOMIC_RELEASE);
+    ring.queued++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_ring_stats
+ * DESCRIPTION	: This function will return the capture ring
+ *		: counters.  They are only exact once the ring
+ *		: has been shut down.
+ * INPUT	: None!
+ * RETURN	: Pointer to RingStats
+ * ---------------------------------------------------------- */
+RingStats *
+get_ring_stats (void)
+{
+    ring_stats.queued = ring.queued;
+    ring_stats.dropped = ring.dropped;
+    ring_stats.peak = ring.peak;
+    ring_stats.slots = ring.mask + 1;
+
+    return &ring_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_ring
+ * DESCRIPTION	: This function will close the ring, wait for
+ *		: the analysis thread to process what is left
+ *		: on it and free the ring.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_ring (void)
+{
+    if (!ring.running)
+	return;
+
+    __atomic_store_n(&ring.closed, 1, __ATOMIC_RELEASE);
+    pthread_join(ring.thread, NULL);
+    ring.running = 0;
+
+    free(ring.slots);
+    ring.slots = NULL;
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
@@ -0,0 +1,66 @@
+/*************************************************************************
+ * ring.h
+ *
+ * This header file contains information relating to the ring.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_RING_H
+#define INCLUDED_RING_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define RING_SLOTS 8192             /* Default number of packets queued. */
+#define RING_SNAPLEN 2048           /* Default bytes kept from each packet. */
+#define RING_CACHE_LINE 64
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * RingHandler:  Function the analysis thread hands each packet to.
+ * -------------------------------------------------------------------------- */
+typedef void (*RingHandler)(const struct pcap_pkthdr *, const u_char *);
+
+/* --------------------------------------------------------------------------
+ * RingSlot:  One queued packet.  Slots are RING_CACHE_LINE aligned.
+ * -------------------------------------------------------------------------- */
+typedef struct _RingSlot
+{
+    struct pcap_pkthdr hdr;     /* Packet Header (caplen is what was kept) */
+    u_char data[];              /* Packet Data */
+} RingSlot;
+
+/* --------------------------------------------------------------------------
+ * RingStats:  Capture ring counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _RingStats
+{
+    unsigned long queued;       /* Packets handed to the analysis thread. */
+    unsigned long dropped;      /* Packets dropped because the ring was full. */
+    unsigned int peak;          /* Highest number of packets waiting. */
+    unsigned int slots;         /* Size of the ring. */
+} RingStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_ring (RingHandler handler, int blocking);
+void ring_put (u_char *args, const struct pcap_pkthdr *pkthdr, const u_char *packet);
+RingStats *get_ring_stats (void);
+void end_ring (void);
+
+#endif /* INCLUDED_RING_H */
@@ -0,0 +1,364 @@
+/*************************************************************************
+ * slab.c
+ *
+ * This module contains the memory allocators used while capturing.
+ *
+ * Records that are created one at a time (assets, ARP entries, signatures,
+ * output events, reassembly buffers) come from typed slab pools:  objects
+ * of one size, carved out of larger chunks and recycled through a free
+ * list.  Once a pool has grown to its working size, allocating and freeing
+ * a record no longer goes through malloc().
+ *
+ * Scratch memory that only lives while one packet is processed comes from
+ * a bump arena of the calling thread.  The caller takes a mark before and
+ * releases everything allocated since when it is done.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "slab.h"
+#include "util.h"
+
+/*
+ * ArenaBlock:  An allocation that did not fit in the arena.  It is taken
+ * from malloc() and freed when the arena is released past 'mark'.
+ */
+typedef struct _ArenaBlock
+{
+    struct _ArenaBlock *next;
+    size_t mark;                /* Arena offset when it was allocated */
+} ArenaBlock;
+
+/*
+ * Variable Declarations:  Slabs that have a name are listed for the
+ * statistics when their first chunk is allocated.
+ */
+Slab *slab_list;
+pthread_mutex_t slab_list_lock = PTHREAD_MUTEX_INITIALIZER;
+ArenaStats arena_stats;
+static __thread char *arena_base;
+static __thread size_t arena_used;
+static __thread ArenaBlock *arena_big;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_init
+ * DESCRIPTION	: This function will set up an empty slab
+ *		: pool at run time (see SLAB_INITIALIZER).
+ *		: Nothing is allocated until the first object
+ *		: is needed.
+ * INPUT	: 0 - Slab
+ *		: 1 - Name (NULL = not shown in the statistics)
+ *		: 2 - Object Size
+ *		: 3 - Objects per Chunk (0 = SLAB_CHUNK)
+ *		: 4 - Used by several threads - 0 = No, 1 = Yes
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+slab_init (Slab *slab, const char *name, size_t size, unsigned int per_chunk, int locked)
+{
+    memset(slab, 0, sizeof(Slab));
+    slab->name = name;
+    slab->size = SLAB_SIZE(size);
+    slab->per_chunk = (per_chunk > 0) ? per_chunk : SLAB_CHUNK;
+    slab->locked = locked;
+    pthread_mutex_init(&slab->lock, NULL);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_list_add
+ * DESCRIPTION	: This function will put a named slab on the
+ *		: statistics list, once.
+ * INPUT	: 0 - Slab
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+slab_list_add (Slab *slab)
+{
+    if (slab->name == NULL || slab->listed)
+	return;
+
+    pthread_mutex_lock(&slab_list_lock);
+    slab->next = slab_list;
+    slab_list = slab;
+    slab->listed = 1;
+    pthread_mutex_unlock(&slab_list_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_grow
+ * DESCRIPTION	: This function will allocate a new chunk and
+ *		: put its objects on the free list.
+ * INPUT	: 0 - Slab
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+slab_grow (Slab *slab)
+{
+    char *chunk, *obj;
+    unsigned int i;
+
+    if ((chunk = (char *) malloc(SLAB_ALIGN + slab->size * slab->per_chunk)) == NULL)
+	err_message("Unable to allocate %s slab", slab->name ? slab->name : "");
+
+    *(void **)chunk = slab->chunks;
+    slab->chunks = chunk;
+    slab->stats.chunks++;
+
+    slab_list_add(slab);
+
+    /* Chain the objects, first one on top. */
+    obj = chunk + SLAB_ALIGN + slab->size * (slab->per_chunk - 1);
+    for (i = 0; i < slab->per_chunk; i++, obj -= slab->size) {
+	*(void **)obj = slab->free_list;
+	slab->free_list = obj;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_alloc
+ * DESCRIPTION	: This function will take an object from a
+ *		: slab pool.  Its contents are undefined.
+ * INPUT	: 0 - Slab
+ * RETURN	: Pointer to the object
+ * ---------------------------------------------------------- */
+void *
+slab_alloc (Slab *slab)
+{
+    void *obj;
+
+    if (slab->locked)
+	pthread_mutex_lock(&slab->lock);
+
+    if (slab->free_list == NULL)
+	slab_grow(slab);
+    obj = slab->free_list;
+    slab->free_list = *(void **)obj;
+
+    slab->stats.allocs++;
+    if (++slab->stats.in_use > slab->stats.peak)
+	slab->stats.peak = slab->stats.in_use;
+
+    if (slab->locked)
+	pthread_mutex_unlock(&slab->lock);
+
+    return obj;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_calloc
+ * DESCRIPTION	: This function will take an object from a
+ *		: slab pool and clear it.
+ * INPUT	: 0 - Slab
+ * RETURN	: Pointer to the object
+ * ---------------------------------------------------------- */
+void *
+slab_calloc (Slab *slab)
+{
+    void *obj = slab_alloc(slab);
+
+    memset(obj, 0, slab->size);
+    return obj;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_free
+ * DESCRIPTION	: This function will return an object to its
+ *		: slab pool.
+ * INPUT	: 0 - Slab
+ *		: 1 - Object (may be NULL)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+slab_free (Slab *slab, void *obj)
+{
+    if (obj == NULL)
+	return;
+
+    if (slab->locked)
+	pthread_mutex_lock(&slab->lock);
+
+    *(void **)obj = slab->free_list;
+    slab->free_list = obj;
+    slab->stats.in_use--;
+    slab->stats.frees++;
+
+    if (slab->locked)
+	pthread_mutex_unlock(&slab->lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_merge
+ * DESCRIPTION	: This function will add the counters of one
+ *		: slab to another (for the statistics of the
+ *		: workers' private pools).
+ * INPUT	: 0 - Slab to add to
+ *		: 1 - Slab to add
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+slab_merge (Slab *into, Slab *from)
+{
+    into->stats.in_use += from->stats.in_use;
+    into->stats.peak += from->stats.peak;
+    into->stats.chunks += from->stats.chunks;
+    into->stats.allocs += from->stats.allocs;
+    into->stats.frees += from->stats.frees;
+    if (from->stats.chunks > 0)
+	slab_list_add(into);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slab_destroy
+ * DESCRIPTION	: This function will free every chunk of a
+ *		: slab pool, and with it every object.  The
+ *		: counters are kept.
+ * INPUT	: 0 - Slab
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+slab_destroy (Slab *slab)
+{
+    void *next;
+
+    while (slab->chunks != NULL) {
+	next = *(void **)slab->chunks;
+	free(slab->chunks);
+	slab->chunks = next;
+    }
+    slab->free_list = NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_slabs
+ * DESCRIPTION	: This function will return the slab pools
+ *		: shown in the statistics.
+ * INPUT	: None!
+ * RETURN	: First Slab (chained through 'next')
+ * ---------------------------------------------------------- */
+Slab *
+get_slabs (void)
+{
+    return slab_list;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arena_mark
+ * DESCRIPTION	: This function will return the calling
+ *		: thread's arena position, to be handed to
+ *		: arena_release() later.
+ * INPUT	: None!
+ * RETURN	: Mark
+ * ---------------------------------------------------------- */
+size_t
+arena_mark (void)
+{
+    return arena_used;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arena_alloc
+ * DESCRIPTION	: This function will allocate scratch memory
+ *		: from the calling thread's arena.  It stays
+ *		: valid until the arena is released past it.
+ * INPUT	: 0 - Size
+ * RETURN	: Pointer to the memory
+ * ---------------------------------------------------------- */
+void *
+arena_alloc (size_t size)
+{
+    ArenaBlock *big;
+    void *p;
+
+    if (arena_base == NULL
+	    && (arena_base = (char *) malloc(ARENA_SIZE)) == NULL)
+	err_message("Unable to allocate scratch arena");
+
+    __atomic_fetch_add(&arena_stats.allocs, 1, __ATOMIC_RELAXED);
+    size = (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+
+    /* Too big for what is left:  fall back to malloc(). */
+    if (size > ARENA_SIZE - arena_used) {
+	__atomic_fetch_add(&arena_stats.oversize, 1, __ATOMIC_RELAXED);
+	if ((big = (ArenaBlock *) malloc(SLAB_ALIGN + size)) == NULL)
+	    err_message("Unable to allocate %lu bytes of scratch memory", (unsigned long)size);
+	big->next = arena_big;
+	big->mark = arena_used;
+	arena_big = big;
+	return (char *)big + SLAB_ALIGN;
+    }
+
+    p = arena_base + arena_used;
+    arena_used += size;
+    if (arena_used > arena_stats.peak)
+	arena_stats.peak = arena_used;
+
+    return p;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arena_release
+ * DESCRIPTION	: This function will free everything allocated
+ *		: from the calling thread's arena since a mark.
+ * INPUT	: 0 - Mark (from arena_mark())
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+arena_release (size_t mark)
+{
+    ArenaBlock *big;
+
+    while (arena_big != NULL && arena_big->mark >= mark) {
+	big = arena_big;
+	arena_big = big->next;
+	free(big);
+    }
+    arena_used = mark;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_arena_stats
+ * DESCRIPTION	: This function will return the scratch arena
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to ArenaStats
+ * ---------------------------------------------------------- */
+ArenaStats *
+get_arena_stats (void)
+{
+    return &arena_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_arena
+ * DESCRIPTION	: This function will free the calling thread's
+ *		: arena.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_arena (void)
+{
+    arena_release(0);
+    if (arena_base != NULL)
+	free(arena_base);
+    arena_base = NULL;
+}
@@ -0,0 +1,98 @@
+/*************************************************************************
+ * slab.h
+ *
+ * This header file contains information relating to the slab.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_SLAB_H
+#define INCLUDED_SLAB_H
+
+#include <pthread.h>
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define SLAB_CHUNK 64               /* Default objects per chunk. */
+#define SLAB_ALIGN 16               /* Object alignment (bytes). */
+#define ARENA_SIZE (256 * 1024)     /* Scratch memory per thread. */
+
+/* A slab pool of 'type' records, shown in the statistics as 'name'. */
+#define SLAB_SIZE(size) (((size) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+#define SLAB_INITIALIZER(name, type, locked) \
+    { name, SLAB_SIZE(sizeof(type)), SLAB_CHUNK, locked, PTHREAD_MUTEX_INITIALIZER }
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * SlabStats:  Slab pool counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _SlabStats
+{
+    unsigned long in_use;       /* Objects handed out. */
+    unsigned long peak;         /* Most objects handed out at once. */
+    unsigned long chunks;       /* Chunks taken from malloc(). */
+    unsigned long allocs;       /* Objects allocated. */
+    unsigned long frees;        /* Objects returned. */
+} SlabStats;
+
+/* --------------------------------------------------------------------------
+ * Slab:  A pool of fixed size objects.  Memory is taken from malloc() one
+ * chunk of objects at a time;  freed objects go on a free list and are
+ * handed out again before a new chunk is allocated.  Chunks are only
+ * released by slab_destroy().
+ * -------------------------------------------------------------------------- */
+typedef struct _Slab
+{
+    const char *name;           /* Name shown in the statistics (or NULL) */
+    size_t size;                /* Object size (rounded up to SLAB_ALIGN) */
+    unsigned int per_chunk;     /* Objects per chunk */
+    int locked;                 /* Take 'lock' - 0 = No, 1 = Yes */
+    pthread_mutex_t lock;
+    void *free_list;            /* Free objects (chained through 1st word) */
+    void *chunks;               /* Chunks (chained through 1st word) */
+    int listed;                 /* On the statistics list - 0 = No, 1 = Yes */
+    SlabStats stats;
+    struct _Slab *next;         /* Next slab shown in the statistics */
+} Slab;
+
+/* --------------------------------------------------------------------------
+ * ArenaStats:  Scratch arena counters (all threads).
+ * -------------------------------------------------------------------------- */
+typedef struct _ArenaStats
+{
+    unsigned long allocs;       /* Scratch allocations. */
+    unsigned long peak;         /* Most bytes in use by one thread. */
+    unsigned long oversize;     /* Allocations that did not fit. */
+} ArenaStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+void slab_init (Slab *slab, const char *name, size_t size, unsigned int per_chunk, int locked);
+void *slab_alloc (Slab *slab);
+void *slab_calloc (Slab *slab);
+void slab_free (Slab *slab, void *obj);
+void slab_merge (Slab *into, Slab *from);
+void slab_destroy (Slab *slab);
+Slab *get_slabs (void);
+size_t arena_mark (void);
+void *arena_alloc (size_t size);
+void arena_release (size_t mark);
+ArenaStats *get_arena_stats (void);
+void end_arena (void);
+
+#endif /* INCLUDED_SLAB_H */
@@ -0,0 +1,750 @@
+/*************************************************************************
+ * snapshot.c
+ *
+ * This module saves the asset, ARP and pending identification state to a
+ * binary snapshot file and loads it again on startup.
+ *
+ * The file is a header followed by fixed size records and the strings they
+ * refer to.  It is loaded with mmap() into indexes that are sized up front,
+ * so a restart costs about as much as reading the file.  The snapshot is
+ * written every snapshot_interval seconds by a thread of its own and when
+ * PADS exits;  a new file replaces the old one only once it is complete.
+ *
+ * Each snapshot also compacts what has piled up since the last one:  the
+ * write-ahead log starts a new generation and the older ones are deleted,
+ * and the output plugins get the snapshot to rewrite their report from.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ip6.h"
+#include "output/output.h"
+#include "snapshot.h"
+#include "storage.h"
+#include "strpool.h"
+#include "util.h"
+#include "wal.h"
+
+/*
+ * Snapshot Writer:  Wakes up every snapshot_interval seconds, or early
+ * when wake_snapshot() is called, until end_snapshot() stops it.
+ */
+pthread_t snapshot_thread;
+pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t snapshot_cond = PTHREAD_COND_INITIALIZER;
+int snapshot_running;
+int snapshot_closing;
+int snapshot_now;               /* Save without waiting - 0 = No, 1 = Yes */
+
+/* Write-ahead log generation of the snapshot that was loaded. */
+u_int64_t snapshot_generation = SNAPSHOT_NONE;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_layout
+ * DESCRIPTION	: This function will compute where the sections
+ *		: of a snapshot start.
+ * INPUT	: 0 - Header
+ *		: 1 - Offset of the assets (output)
+ *		: 2 - Offset of the ARP entries (output)
+ *		: 3 - Offset of the strings (output)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+snap_layout (const SnapshotHeader *hdr, u_int64_t *off_assets,
+	     u_int64_t *off_arp, u_int64_t *off_strings)
+{
+    *off_assets = SNAPSHOT_ALIGN(sizeof(SnapshotHeader) + (u_int64_t) hdr->ip6_count * sizeof(struct in6_addr));
+    *off_arp = SNAPSHOT_ALIGN(*off_assets + (u_int64_t) hdr->asset_count * sizeof(SnapAsset));
+    *off_strings = SNAPSHOT_ALIGN(*off_arp + (u_int64_t) hdr->arp_count * sizeof(SnapArp));
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_ip6_key
+ * DESCRIPTION	: This function will return the key of the
+ *		: n-th interned IPv6 address.
+ * INPUT	: 0 - Handle Number
+ * RETURN	: Key
+ * ---------------------------------------------------------- */
+static inline struct in_addr
+snap_ip6_key (u_int32_t n)
+{
+    struct in_addr key;
+
+    key.s_addr = htonl(IP6_HANDLE_NET | n);
+    return key;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_put_string
+ * DESCRIPTION	: This function will append a string and a NUL
+ *		: byte to the string section.
+ * INPUT	: 0 - String Section
+ *		: 1 - Bytes used so far (updated)
+ *		: 2 - String (may be NULL)
+ * RETURN	: Reference to the string
+ * ---------------------------------------------------------- */
+static SnapString
+snap_put_string (char *strings, u_int64_t *used, bstring str)
+{
+    SnapString ref;
+
+    if (str == NULL) {
+	ref.offset = SNAPSHOT_NONE;
+	ref.length = 0;
+	return ref;
+    }
+
+    ref.offset = *used;
+    ref.length = str->slen;
+    memcpy(strings + *used, str->data, str->slen);
+    strings[*used + str->slen] = '\0';
+    *used += str->slen + 1;
+    return ref;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_put_id
+ * DESCRIPTION	: This function will place a pooled string in
+ *		: the string section, the first time that it
+ *		: is used.  Later uses refer to the same bytes.
+ * INPUT	: 0 - References, by ID (updated)
+ *		: 1 - Number of References
+ *		: 2 - Bytes used so far (updated)
+ *		: 3 - ID
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+snap_put_id (SnapString *refs, u_int32_t count, u_int64_t *used, StrId id)
+{
+    bstring str;
+
+    if (id >= count || refs[id].offset != SNAPSHOT_NONE || (str = str_get(id)) == NULL)
+	return;
+
+    refs[id].offset = *used;
+    refs[id].length = str->slen;
+    *used += str->slen + 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_get_string
+ * DESCRIPTION	: This function will copy a string out of the
+ *		: string section of a loaded snapshot.
+ * INPUT	: 0 - String Section
+ *		: 1 - Size of the String Section
+ *		: 2 - Reference to the string
+ *		: 3 - String (output, NULL for a NULL string)
+ * RETURN	: 0 - Success
+ *		: -1 - The reference is out of bounds
+ * ---------------------------------------------------------- */
+static int
+snap_get_string (const char *strings, u_int64_t size, SnapString ref, bstring *str)
+{
+    *str = NULL;
+    if (ref.offset == SNAPSHOT_NONE)
+	return 0;
+    if (ref.offset > size || ref.length > size - ref.offset || ref.length > 0x7fffffff)
+	return -1;
+
+    *str = blk2bstr(strings + ref.offset, (int)ref.length);
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_get_id
+ * DESCRIPTION	: This function will intern a string of a
+ *		: loaded snapshot.
+ * INPUT	: 0 - String Section
+ *		: 1 - Size of the String Section
+ *		: 2 - Reference to the string
+ *		: 3 - ID (output, STR_NONE for a NULL string)
+ * RETURN	: 0 - Success
+ *		: -1 - The reference is out of bounds
+ * ---------------------------------------------------------- */
+static int
+snap_get_id (const char *strings, u_int64_t size, SnapString ref, StrId *id)
+{
+    *id = STR_NONE;
+    if (ref.offset == SNAPSHOT_NONE)
+	return 0;
+    if (ref.offset > size || ref.length > size - ref.offset || ref.length > 0x7fffffff)
+	return -1;
+
+    *id = str_intern_blk(strings + ref.offset, (int)ref.length);
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_get_key
+ * DESCRIPTION	: This function will turn an address of a
+ *		: loaded snapshot into a key of this run.  Only
+ *		: the keys of interned IPv6 addresses change;
+ *		: each address is interned again when a record
+ *		: first uses it.
+ * INPUT	: 0 - Address (updated)
+ *		: 1 - The snapshot's IPv6 addresses
+ *		: 2 - Their keys in this run (0 = not yet)
+ *		: 3 - Number of IPv6 addresses
+ * RETURN	: 0 - Success
+ *		: -1 - Unknown IPv6 address
+ * ---------------------------------------------------------- */
+static int
+snap_get_key (struct in_addr *addr, const struct in6_addr *addrs,
+	      struct in_addr *keys, u_int32_t count)
+{
+    u_int32_t n;
+
+    if (!IP6_HANDLE(*addr))
+	return 0;
+
+    n = ntohl(addr->s_addr) - IP6_HANDLE_NET;
+    if (n >= count)
+	return -1;
+    if (keys[n].s_addr == 0 && !ip6_intern(&addrs[n], &keys[n]))
+	keys[n] = ip6_fold(&addrs[n]);
+    *addr = keys[n];
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: load_snapshot
+ * DESCRIPTION	: This function will restore the assets and ARP
+ *		: entries saved in the snapshot file.  Assets
+ *		: keep their identification attempts, so those
+ *		: still being identified go back on the pending
+ *		: filter.
+ * INPUT	: None!
+ * RETURN	: 0 - Success
+ *		: -1 - No snapshot (or not a valid one)
+ * ---------------------------------------------------------- */
+int
+load_snapshot (void)
+{
+    SnapshotHeader *hdr;
+    SnapAsset *sa;
+    SnapArp *sp;
+    Asset asset;
+    ArpAsset arp;
+    struct in_addr *keys = NULL;
+    const struct in6_addr *addrs;
+    const char *strings;
+    struct stat st;
+    char *map;
+    u_int64_t off_assets, off_arp, off_strings;
+    u_int32_t i;
+    unsigned long assets = 0, arp_entries = 0, skipped = 0;
+    int fd;
+
+    if (gc.snapshot_file == NULL)
+	return -1;
+
+    if ((fd = open(bdata(gc.snapshot_file), O_RDONLY)) < 0) {
+	if (errno != ENOENT)
+	    log_message("warning:  Unable to open snapshot %s", bdata(gc.snapshot_file));
+	return -1;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(SnapshotHeader)) {
+	log_message("warning:  Snapshot %s is too short, ignored", bdata(gc.snapshot_file));
+	close(fd);
+	return -1;
+    }
+
+    if ((map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+	log_message("warning:  Unable to map snapshot %s", bdata(gc.snapshot_file));
+	close(fd);
+	return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    /* Make sure that this run understands the file. */
+    hdr = (SnapshotHeader *) map;
+    snap_layout(hdr, &off_assets, &off_arp, &off_strings);
+
+    if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->version != SNAPSHOT_VERSION
+	    || hdr->byte_order != SNAPSHOT_BYTE_ORDER
+	    || hdr->header_size != sizeof(SnapshotHeader)
+	    || hdr->asset_size != sizeof(SnapAsset)
+	    || hdr->arp_size != sizeof(SnapArp)
+	    || hdr->file_size != (u_int64_t) st.st_size
+	    || off_strings + hdr->strings_size != hdr->file_size) {
+	log_message("warning:  %s is not a snapshot of this version, ignored", bdata(gc.snapshot_file));
+	munmap(map, st.st_size);
+	close(fd);
+	return -1;
+    }
+
+    addrs = (const struct in6_addr *) (map + sizeof(SnapshotHeader));
+    sa = (SnapAsset *) (map + off_assets);
+    sp = (SnapArp *) (map + off_arp);
+    strings = map + off_strings;
+
+    /* The IPv6 addresses are interned again;  their keys may differ. */
+    if (hdr->ip6_count > 0
+	    && (keys = (struct in_addr *) calloc(hdr->ip6_count, sizeof(struct in_addr))) == NULL)
+	err_message("Unable to allocate snapshot keys");
+
+    reserve_storage(hdr->asset_count, hdr->arp_count);
+
+    for (i = 0; i < hdr->asset_count; i++, sa++) {
+	memset(&asset, 0, sizeof(Asset));
+	asset.ip_addr.s_addr = sa->ip_addr;
+	asset.c_ip_addr.s_addr = sa->c_ip_addr;
+	asset.port = sa->port;
+	asset.c_port = sa->c_port;
+	asset.proto = sa->proto;
+	asset.i_attempts = sa->i_attempts;
+	asset.discovered = (time_t) sa->discovered;
+	asset.last_seen = (time_t) sa->last_seen;
+
+	if (snap_get_key(&asset.ip_addr, addrs, keys, hdr->ip6_count) != 0
+		|| snap_get_key(&asset.c_ip_addr, addrs, keys, hdr->ip6_count) != 0
+		|| snap_get_id(strings, hdr->strings_size, sa->service, &asset.service) != 0
+		|| snap_get_id(strings, hdr->strings_size, sa->application, &asset.application) != 0
+		|| snap_get_string(strings, hdr->strings_size, sa->hex_payload, &asset.hex_payload) != 0) {
+	    free_asset_copy(&asset);
+	    skipped++;
+	    continue;
+	}
+
+	if (restore_asset(&asset) == 0)
+	    assets++;
+    }
+
+    for (i = 0; i < hdr->arp_count; i++, sp++) {
+	memset(&arp, 0, sizeof(ArpAsset));
+	arp.ip_addr.s_addr = sp->ip_addr;
+	memcpy(arp.mac_addr, sp->mac_addr, MAC_LEN);
+	arp.discovered = (time_t) sp->discovered;
+	arp.last_seen = (time_t) sp->last_seen;
+
+	if (snap_get_key(&arp.ip_addr, addrs, keys, hdr->ip6_count) != 0
+		|| snap_get_id(strings, hdr->strings_size, sp->mac_resolved, &arp.mac_resolved) != 0) {
+	    skipped++;
+	    continue;
+	}
+
+	if (restore_arp_asset(&arp) == 0)
+	    arp_entries++;
+    }
+
+    log_message("Restored %lu Assets and %lu ARP Entries from %s (%lu Skipped)\n",
+		assets, arp_entries, bdata(gc.snapshot_file), skipped);
+    snapshot_generation = hdr->wal_generation;
+
+    /* Clean Up */
+    if (keys != NULL)
+	free(keys);
+    munmap(map, st.st_size);
+    close(fd);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_walk
+ * DESCRIPTION	: This function will call the output functions
+ *		: for each asset and ARP entry of a snapshot in
+ *		: memory.  Its strings are all in the pool.
+ * INPUT	: 0 - Dump (a SnapshotDump)
+ *		: 1 - Asset Function
+ *		: 2 - ARP Function
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+snap_walk (OutputDump *dump, int (*print_asset) (Asset *rec), int (*print_arp) (ArpAsset *rec))
+{
+    SnapshotDump *snap = (SnapshotDump *) dump;
+    SnapshotHeader *hdr;
+    SnapAsset *sa;
+    SnapArp *sp;
+    Asset asset;
+    ArpAsset arp;
+    char *strings;
+    u_int64_t off_assets, off_arp, off_strings;
+    u_int32_t i;
+
+    hdr = (SnapshotHeader *) snap->buf;
+    snap_layout(hdr, &off_assets, &off_arp, &off_strings);
+    strings = snap->buf + off_strings;
+
+    sa = (SnapAsset *) (snap->buf + off_assets);
+    for (i = 0; i < hdr->asset_count; i++, sa++) {
+	memset(&asset, 0, sizeof(Asset));
+	asset.ip_addr.s_addr = sa->ip_addr;
+	asset.c_ip_addr.s_addr = sa->c_ip_addr;
+	asset.port = sa->port;
+	asset.c_port = sa->c_port;
+	asset.proto = sa->proto;
+	asset.i_attempts = sa->i_attempts;
+	asset.discovered = (time_t) sa->discovered;
+	asset.last_seen = (time_t) sa->last_seen;
+	snap_get_id(strings, hdr->strings_size, sa->service, &asset.service);
+	snap_get_id(strings, hdr->strings_size, sa->application, &asset.application);
+	(*print_asset)(&asset);
+    }
+
+    sp = (SnapArp *) (snap->buf + off_arp);
+    for (i = 0; i < hdr->arp_count; i++, sp++) {
+	memset(&arp, 0, sizeof(ArpAsset));
+	arp.ip_addr.s_addr = sp->ip_addr;
+	memcpy(arp.mac_addr, sp->mac_addr, MAC_LEN);
+	arp.discovered = (time_t) sp->discovered;
+	arp.last_seen = (time_t) sp->last_seen;
+	snap_get_id(strings, hdr->strings_size, sp->mac_resolved, &arp.mac_resolved);
+	(*print_arp)(&arp);
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snap_release
+ * DESCRIPTION	: This function will drop a reference to a
+ *		: snapshot in memory and free it after the
+ *		: last one.
+ * INPUT	: 0 - Dump (a SnapshotDump)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+snap_release (OutputDump *dump)
+{
+    SnapshotDump *snap = (SnapshotDump *) dump;
+
+    if (__atomic_sub_fetch(&snap->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+	free(snap->buf);
+	free(snap);
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: save_snapshot
+ * DESCRIPTION	: This function will write the assets and ARP
+ *		: entries to the snapshot file.  The records
+ *		: are copied into a buffer while the storage
+ *		: lock is held and written out after it has
+ *		: been released.  While the lock is held, the
+ *		: write-ahead log moves on to a new generation
+ *		: and the output plugins are handed the buffer;
+ *		: once the file is in place, the older log
+ *		: generations are deleted.
+ * INPUT	: None!
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+save_snapshot (void)
+{
+    SnapshotDump *snap;
+    SnapshotHeader *hdr, layout;
+    SnapAsset *sa;
+    SnapArp *sp;
+    AssetRecord *rec;
+    Asset asset;
+    ArpAsset *arp;
+    const struct in6_addr *addr;
+    SnapString *refs;
+    bstring tmp_file;
+    char *buf, *strings;
+    u_int64_t off_assets, off_arp, off_strings, strings_size, used = 0;
+    u_int32_t ip6_count, asset_count = 0, arp_count = 0, str_ids, n;
+    int fd;
+
+    if (gc.snapshot_file == NULL)
+	return -1;
+
+    lock_storage();
+
+    /* Size the sections.  IPv6 addresses and strings interned from now
+     * on are not used by any of the records.  The strings of the pool
+     * are placed first, once each;  the hex payloads follow. */
+    for (ip6_count = 0; ip6_address(snap_ip6_key(ip6_count)) != NULL; ip6_count++);
+    str_ids = str_count();
+    if ((refs = (SnapString *) malloc((str_ids + 1) * sizeof(SnapString))) == NULL) {
+	unlock_storage();
+	log_message("warning:  Unable to allocate the snapshot strings");
+	return -1;
+    }
+    for (n = 0; n <= str_ids; n++) {
+	refs[n].offset = SNAPSHOT_NONE;
+	refs[n].length = 0;
+    }
+
+    for (rec = get_asset_pointer(); rec != NULL; rec = rec->next) {
+	asset_count++;
+	snap_put_id(refs, str_ids, &used, rec->service);
+	snap_put_id(refs, str_ids, &used, rec->application);
+    }
+    for (arp = get_arp_pointer(); arp != NULL; arp = arp->next) {
+	arp_count++;
+	snap_put_id(refs, str_ids, &used, arp->mac_resolved);
+    }
+    strings_size = used;
+    for (rec = get_asset_pointer(); rec != NULL; rec = rec->next)
+	strings_size += (rec->hex_payload ? rec->hex_payload->slen + 1 : 0);
+
+    memset(&layout, 0, sizeof(SnapshotHeader));
+    layout.ip6_count = ip6_count;
+    layout.asset_count = asset_count;
+    layout.arp_count = arp_count;
+    snap_layout(&layout, &off_assets, &off_arp, &off_strings);
+
+    if ((snap = (SnapshotDump *) calloc(1, sizeof(SnapshotDump))) == NULL
+	    || (buf = (char *) calloc(1, off_strings + strings_size)) == NULL) {
+	unlock_storage();
+	log_message("warning:  Unable to allocate %lu bytes for the snapshot",
+		    (unsigned long)(off_strings + strings_size));
+	free(snap);
+	free(refs);
+	return -1;
+    }
+
+    hdr = (SnapshotHeader *) buf;
+    memcpy(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic));
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr->header_size = sizeof(SnapshotHeader);
+    hdr->asset_size = sizeof(SnapAsset);
+    hdr->arp_size = sizeof(SnapArp);
+    hdr->ip6_count = ip6_count;
+    hdr->asset_count = asset_count;
+    hdr->arp_count = arp_count;
+    hdr->strings_size = strings_size;
+    hdr->file_size = off_strings + strings_size;
+    hdr->saved = (u_int64_t) time(NULL);
+
+    for (n = 0; n < ip6_count; n++) {
+	addr = ip6_address(snap_ip6_key(n));
+	memcpy(buf + sizeof(SnapshotHeader) + n * sizeof(struct in6_addr), addr, sizeof(struct in6_addr));
+    }
+
+    strings = buf + off_strings;
+    for (n = 0; n < str_ids; n++)
+	if (refs[n].offset != SNAPSHOT_NONE)
+	    memcpy(strings + refs[n].offset, str_get(n)->data, refs[n].length);
+
+    sa = (SnapAsset *) (buf + off_assets);
+    for (rec = get_asset_pointer(); rec != NULL; rec = rec->next, sa++) {
+	peek_asset(rec, &asset);
+	sa->discovered = (u_int64_t) asset.discovered;
+	sa->last_seen = (u_int64_t) asset.last_seen;
+	sa->ip_addr = asset.ip_addr.s_addr;
+	sa->c_ip_addr = asset.c_ip_addr.s_addr;
+	sa->port = asset.port;
+	sa->c_port = asset.c_port;
+	sa->proto = asset.proto;
+	sa->i_attempts = asset.i_attempts;
+	sa->service = refs[(asset.service < str_ids) ? asset.service : STR_NONE];
+	sa->application = refs[(asset.application < str_ids) ? asset.application : STR_NONE];
+	sa->hex_payload = snap_put_string(strings, &used, asset.hex_payload);
+    }
+
+    sp = (SnapArp *) (buf + off_arp);
+    for (arp = get_arp_pointer(); arp != NULL; arp = arp->next, sp++) {
+	sp->discovered = (u_int64_t) arp->discovered;
+	sp->last_seen = (u_int64_t) arp->last_seen;
+	sp->ip_addr = arp->ip_addr.s_addr;
+	memcpy(sp->mac_addr, arp->mac_addr, MAC_LEN);
+	sp->mac_resolved = refs[(arp->mac_resolved < str_ids) ? arp->mac_resolved : STR_NONE];
+    }
+    free(refs);
+
+    /* Compact:  later changes go to a new log, and the plugins rewrite
+     * their report before any of them is printed. */
+    hdr->wal_generation = rotate_wal();
+
+    snap->buf = buf;
+    snap->refs = 2;
+    snap->dump.assets = asset_count;
+    snap->dump.arp_entries = arp_count;
+    snap->dump.walk = snap_walk;
+    snap->dump.release = snap_release;
+    print_rewrite(&snap->dump);
+
+    unlock_storage();
+
+    /* Write a new file and put it in place of the old one. */
+    tmp_file = bstrcpy(gc.snapshot_file);
+    bcatcstr(tmp_file, ".tmp");
+
+    if ((fd = open(bdata(tmp_file), O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0
+	    || write_full(fd, buf, hdr->file_size) != 0
+	    || fsync(fd) != 0) {
+	log_message("warning:  Unable to write snapshot %s", bdata(tmp_file));
+	if (fd >= 0) {
+	    close(fd);
+	    unlink(bdata(tmp_file));
+	}
+	bdestroy(tmp_file);
+	snap_release(&snap->dump);
+	return -1;
+    }
+    close(fd);
+
+    if (rename(bdata(tmp_file), bdata(gc.snapshot_file)) != 0) {
+	log_message("warning:  Unable to replace snapshot %s", bdata(gc.snapshot_file));
+	unlink(bdata(tmp_file));
+	bdestroy(tmp_file);
+	snap_release(&snap->dump);
+	return -1;
+    }
+
+    /* The snapshot holds everything logged before this generation. */
+    compact_wal(hdr->wal_generation);
+
+    verbose_message("Saved %u assets and %u ARP entries to %s",
+		    asset_count, arp_count, bdata(gc.snapshot_file));
+
+    /* Clean Up */
+    bdestroy(tmp_file);
+    snap_release(&snap->dump);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_snapshot_generation
+ * DESCRIPTION	: This function will return the write-ahead
+ *		: log generation that follows the snapshot
+ *		: that was loaded.
+ * INPUT	: None!
+ * RETURN	: Generation (0 = saved without a log)
+ *		: SNAPSHOT_NONE - No snapshot was loaded
+ * ---------------------------------------------------------- */
+u_int64_t
+get_snapshot_generation (void)
+{
+    return snapshot_generation;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wake_snapshot
+ * DESCRIPTION	: This function will have the snapshot thread
+ *		: save a snapshot now rather than at the end of
+ *		: the interval.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wake_snapshot (void)
+{
+    pthread_mutex_lock(&snapshot_lock);
+    snapshot_now = 1;
+    pthread_cond_signal(&snapshot_cond);
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: snapshot_writer
+ * DESCRIPTION	: This is the snapshot thread.  It saves a
+ *		: snapshot every snapshot_interval seconds, or
+ *		: when it is woken up.
+ * INPUT	: 0 - Not used
+ * RETURN	: NULL
+ * ---------------------------------------------------------- */
+static void *
+snapshot_writer (void *arg)
+{
+    struct timespec due;
+    int interval;
+
+    interval = (gc.snapshot_interval > 0) ? gc.snapshot_interval : SNAPSHOT_INTERVAL;
+
+    pthread_mutex_lock(&snapshot_lock);
+    while (!snapshot_closing) {
+	clock_gettime(CLOCK_REALTIME, &due);
+	due.tv_sec += interval;
+	while (!snapshot_closing && !snapshot_now
+		&& pthread_cond_timedwait(&snapshot_cond, &snapshot_lock, &due) != ETIMEDOUT);
+	if (snapshot_closing)
+	    break;
+	snapshot_now = 0;
+
+	pthread_mutex_unlock(&snapshot_lock);
+	save_snapshot();
+	pthread_mutex_lock(&snapshot_lock);
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_snapshot
+ * DESCRIPTION	: This function will start the snapshot thread
+ *		: when a snapshot file has been configured.
+ *		: The plugins rewrite their report from this
+ *		: thread's snapshots, so from now on output
+ *		: goes through the writer thread.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_snapshot (void)
+{
+    sigset_t all, old;
+
+    if (gc.snapshot_file == NULL)
+	return;
+
+    init_output_writer();
+
+    /* Signals are handled by the main thread only. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&snapshot_thread, NULL, snapshot_writer, NULL) != 0)
+	err_message("Unable to start snapshot thread");
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    snapshot_running = 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_snapshot
+ * DESCRIPTION	: This function will stop the snapshot thread
+ *		: and save a last snapshot.  Nothing may add
+ *		: assets any more.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_snapshot (void)
+{
+    if (snapshot_running) {
+	pthread_mutex_lock(&snapshot_lock);
+	snapshot_closing = 1;
+	pthread_cond_signal(&snapshot_cond);
+	pthread_mutex_unlock(&snapshot_lock);
+
+	pthread_join(snapshot_thread, NULL);
+	snapshot_running = 0;
+    }
+
+    if (gc.snapshot_file != NULL)
+	save_snapshot();
+}
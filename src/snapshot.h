@@ -0,0 +1,126 @@
+/*************************************************************************
+ * snapshot.h
+ *
+ * This header file contains information relating to the snapshot.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_SNAPSHOT_H
+#define INCLUDED_SNAPSHOT_H
+
+#include "global.h"
+#include "output/output.h"
+
+/* DEFINES ----------------------------------------- */
+#define SNAPSHOT_MAGIC "PADSSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_BYTE_ORDER 0x01020304  /* Written in host byte order. */
+#define SNAPSHOT_INTERVAL 300       /* Default seconds between snapshots. */
+#define SNAPSHOT_NONE (~(u_int64_t)0)  /* Offset of a NULL string. */
+
+/* Sections start on 8 byte boundaries. */
+#define SNAPSHOT_ALIGN(n) (((n) + 7) & ~(u_int64_t)7)
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * SnapshotHeader:  Start of a snapshot file.  It is followed by the IPv6
+ * addresses (16 bytes each, in key order), the assets, the ARP entries and
+ * the strings they refer to (each followed by a NUL byte).  Records with the
+ * same service, application or vendor refer to the same string.
+ * -------------------------------------------------------------------------- */
+typedef struct _SnapshotHeader
+{
+    char magic[8];              /* SNAPSHOT_MAGIC */
+    u_int32_t version;          /* SNAPSHOT_VERSION */
+    u_int32_t byte_order;       /* SNAPSHOT_BYTE_ORDER */
+    u_int32_t header_size;      /* sizeof(SnapshotHeader) */
+    u_int32_t asset_size;       /* sizeof(SnapAsset) */
+    u_int32_t arp_size;         /* sizeof(SnapArp) */
+    u_int32_t ip6_count;        /* IPv6 addresses */
+    u_int32_t asset_count;      /* Assets */
+    u_int32_t arp_count;        /* ARP entries */
+    u_int64_t strings_size;     /* Bytes of strings */
+    u_int64_t file_size;        /* Size of the whole file */
+    u_int64_t saved;            /* Time the snapshot was written */
+    u_int64_t wal_generation;   /* First write-ahead log that follows (0 = none) */
+} SnapshotHeader;
+
+/* --------------------------------------------------------------------------
+ * SnapString:  A string in the string section (offset SNAPSHOT_NONE = NULL).
+ * The length does not count the NUL byte.
+ * -------------------------------------------------------------------------- */
+typedef struct _SnapString
+{
+    u_int64_t offset;
+    u_int64_t length;
+} SnapString;
+
+/* --------------------------------------------------------------------------
+ * SnapAsset:  An asset.  Addresses and ports are in network byte order;
+ * IPv6 keys refer to the addresses of the snapshot.
+ * -------------------------------------------------------------------------- */
+typedef struct _SnapAsset
+{
+    u_int64_t discovered;
+    u_int64_t last_seen;
+    u_int32_t ip_addr;
+    u_int32_t c_ip_addr;
+    u_int16_t port;
+    u_int16_t c_port;
+    u_int16_t proto;
+    u_int16_t i_attempts;
+    SnapString service;
+    SnapString application;
+    SnapString hex_payload;
+} SnapAsset;
+
+/* --------------------------------------------------------------------------
+ * SnapArp:  An ARP entry.
+ * -------------------------------------------------------------------------- */
+typedef struct _SnapArp
+{
+    u_int64_t discovered;
+    u_int64_t last_seen;
+    u_int32_t ip_addr;
+    u_int8_t mac_addr[MAC_LEN];
+    u_int16_t pad;
+    SnapString mac_resolved;
+} SnapArp;
+
+/* --------------------------------------------------------------------------
+ * SnapshotDump:  A snapshot in memory.  It is handed to the output plugins
+ * so that they can rewrite their report, and freed by whoever is done with
+ * it last.
+ * -------------------------------------------------------------------------- */
+typedef struct _SnapshotDump
+{
+    OutputDump dump;            /* Must be first */
+    char *buf;                  /* Contents of the snapshot file */
+    int refs;                   /* References (atomic) */
+} SnapshotDump;
+
+
+/* PROTOTYPES -------------------------------------- */
+int load_snapshot (void);
+int save_snapshot (void);
+u_int64_t get_snapshot_generation (void);
+void wake_snapshot (void);
+void init_snapshot (void);
+void end_snapshot (void);
+
+#endif /* INCLUDED_SNAPSHOT_H */
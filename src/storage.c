@@ -26,11 +26,1123 @@
  **************************************************************************/
 #include "global.h"
 
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ebpf.h"
+#include "ip6.h"
 #include "mac-resolution.h"
+#include "output/output.h"
+#include "pending.h"
+#include "slab.h"
 #include "storage.h"
+#include "strpool.h"
+#include "util.h"
+#include "wal.h"
+#include "wheel.h"
+
+/* Records that the wheel entries are part of. */
+#define ASSET_OF(e) ((AssetRecord *)((char *)(e) - offsetof(AssetRecord, timer)))
+#define ARP_OF(e) ((ArpAsset *)((char *)(e) - offsetof(ArpAsset, timer)))
+
+AssetRecord *asset_list;
+AssetRecord *asset_tail;
+ArpAsset *arp_asset_list;
+ArpAsset *arp_asset_tail;
+
+/* ARP records are taken from a slab pool (under the storage lock). */
+Slab arp_slab = SLAB_INITIALIZER("ARP Entries", ArpAsset, 0);
+
+/*
+ * Storage Lock:  Worker threads share the asset and ARP data structures.
+ * Lookups take the lock for reading;  anything that adds, changes or
+ * removes a record takes it for writing.  Records may be freed as soon
+ * as the lock is released, so output works on copies (copy_asset).
+ */
+pthread_rwlock_t storage_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * Asset Index:  The asset records are kept on 'asset_list' in the order they
+ * were discovered.  Lookups go through an open-addressing hash table keyed by
+ * (ip, port, proto).  When the table grows, a second, larger table is
+ * allocated and the old one is migrated a few slots at a time on each
+ * insert, so that a resize never stalls packet capture.
+ *
+ * The slots of the index carry the identification attempts and the time an
+ * asset was last seen, which is all that a packet of a known server reads or
+ * changes.  A migrated slot is copied with them;  the copy left behind in the
+ * old table is never found again, as the current table is searched first.
+ */
+static int asset_slot_live (const void *slot);
+static void *asset_table_put (SlotTable *table, const void *from);
+
+SlotIndex asset_index = {
+    { NULL, 0, 0, 0 }, { NULL, 0, 0, 0 }, 0,
+    ASSET_INDEX_MIN, sizeof(AssetSlot), "asset", asset_slot_live, asset_table_put
+};
+
+/*
+ * Asset Store:  The asset records, in chunks of ASSET_CHUNK that are never
+ * moved.  Records that are removed go on a free list and their IDs are
+ * handed out again.
+ */
+AssetRecord **asset_store;      /* Record chunks, by ID */
+u_int32_t asset_chunks;         /* Size of the chunk array */
+u_int32_t asset_ids;            /* IDs handed out (ASSET_NONE included) */
+AssetRecord *asset_free;        /* Records that were removed */
+
+/* ARP Index:  The same scheme, keyed by (ip, mac). */
+static int arp_slot_live (const void *slot);
+static void *arp_table_put (SlotTable *table, const void *from);
+
+SlotIndex arp_index = {
+    { NULL, 0, 0, 0 }, { NULL, 0, 0, 0 }, 0,
+    ARP_INDEX_MIN, sizeof(ArpSlot), "ARP", arp_slot_live, arp_table_put
+};
+
+/*
+ * Asset Aging:  Records that have a time to live (or have to be ordered
+ * for eviction) sit on a timing wheel.  The clock is the newest packet
+ * time seen, so a capture file ages its assets like live traffic.
+ * Seeing a known record only stores the clock in 'last_seen' (under the
+ * read lock);  the wheel finds out when the record's slot comes up.
+ * For assets, 'last_seen' is in the index slot.
+ */
+Wheel asset_wheel;
+Wheel arp_wheel;
+time_t storage_clock;           /* 0 = no packet seen yet */
+int storage_aging;              /* Aging or a limit set - 0 = No, 1 = Yes */
+time_t ttl_tcp, ttl_udp, ttl_icmp, ttl_arp;
+StorageStats storage_stats;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_storage
+ * DESCRIPTION	: This function will set up asset aging from
+ *		: the configuration.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_storage (void)
+{
+    time_t ttl = (gc.asset_ttl > 0) ? gc.asset_ttl : 0;
+
+    ttl_tcp = (gc.asset_ttl_tcp > 0) ? gc.asset_ttl_tcp : ttl;
+    ttl_udp = (gc.asset_ttl_udp > 0) ? gc.asset_ttl_udp : ttl;
+    ttl_icmp = (gc.asset_ttl_icmp > 0) ? gc.asset_ttl_icmp : ttl;
+    ttl_arp = (gc.arp_ttl > 0) ? gc.arp_ttl : ttl;
+
+    storage_aging = (ttl_tcp > 0 || ttl_udp > 0 || ttl_icmp > 0 || ttl_arp > 0
+		     || gc.asset_max > 0 || gc.arp_max > 0);
+    if (storage_aging)
+	verbose_message("Asset aging:  TCP %ds, UDP %ds, ICMP %ds, ARP %ds (0 = never), at most %u assets / %u ARP entries (0 = no limit)",
+			(int)ttl_tcp, (int)ttl_udp, (int)ttl_icmp, (int)ttl_arp,
+			gc.asset_max, gc.arp_max);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_ttl
+ * DESCRIPTION	: This function will return the time to live
+ *		: of an asset's protocol.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: Seconds (0 = never expires)
+ * ---------------------------------------------------------- */
+static inline time_t
+asset_ttl (AssetRecord *rec)
+{
+    switch (rec->proto) {
+	case IPPROTO_TCP:
+	    return ttl_tcp;
+	case IPPROTO_UDP:
+	    return ttl_udp;
+	default:
+	    return ttl_icmp;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_age
+ * DESCRIPTION	: This function will return how long an asset
+ *		: stays on the wheel after it was last seen:
+ *		: its time to live or, when it only has to be
+ *		: ordered for eviction, the wheel's span.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: Seconds (0 = not on the wheel)
+ * ---------------------------------------------------------- */
+static inline time_t
+asset_age (AssetRecord *rec)
+{
+    time_t ttl = asset_ttl(rec);
+
+    if (ttl > 0)
+	return ttl;
+    return (gc.asset_max > 0) ? WHEEL_SPAN - 1 : 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_age
+ * DESCRIPTION	: See asset_age.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: Seconds (0 = not on the wheel)
+ * ---------------------------------------------------------- */
+static inline time_t
+arp_age (ArpAsset *rec)
+{
+    if (ttl_arp > 0)
+	return ttl_arp;
+    return (gc.arp_max > 0) ? WHEEL_SPAN - 1 : 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_due
+ * DESCRIPTION	: See asset_due.
+ * INPUT	: 0 - Wheel Entry
+ * RETURN	: Time
+ * ---------------------------------------------------------- */
+static time_t
+arp_due (WheelEntry *entry)
+{
+    ArpAsset *rec = ARP_OF(entry);
+
+    return rec->last_seen + arp_age(rec);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_seen
+ * DESCRIPTION	: This function will note that an asset has
+ *		: been seen.  The caller holds the storage lock
+ *		: (for reading at least).
+ * INPUT	: 0 - Asset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+asset_seen (AssetSlot *slot)
+{
+    u_int32_t now = (u_int32_t) __atomic_load_n(&storage_clock, __ATOMIC_RELAXED);
+
+    if (slot->last_seen < now)
+	__atomic_store_n(&slot->last_seen, now, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_seen
+ * DESCRIPTION	: See asset_seen.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static inline void
+arp_seen (ArpAsset *rec)
+{
+    time_t now = __atomic_load_n(&storage_clock, __ATOMIC_RELAXED);
+
+    if (rec->last_seen < now)
+	__atomic_store_n(&rec->last_seen, now, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_hash
+ * DESCRIPTION	: This function will hash an asset key.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+static inline u_int32_t
+asset_hash (u_int32_t ip, u_int16_t port, unsigned short proto)
+{
+    u_int64_t h;
+
+    h = ((u_int64_t)ip << 32) | ((u_int32_t)port << 16) | (proto & 0xffff);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return (u_int32_t)h;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: slot_table_init
+ * DESCRIPTION	: This function will allocate an empty hash
+ *		: table for an index, aligned to a cache line.
+ * INPUT	: 0 - Slot Index
+ *		: 1 - Slot Table
+ *		: 2 - Number of slots (power of 2)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+slot_table_init (SlotIndex *index, SlotTable *table, u_int32_t size)
+{
+    if (posix_memalign(&table->slots, ASSET_CACHE_LINE,
+		       (size_t) size * index->slot_size) != 0)
+	err_message("Unable to allocate %s index (%u slots)", index->name, size);
+    memset(table->slots, 0, (size_t) size * index->slot_size);
+    table->mask = size - 1;
+    table->used = 0;
+    table->deleted = 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: index_migrate
+ * DESCRIPTION	: This function will move up to 'count' slots
+ *		: from the old table of an index into the
+ *		: current one.  The old table is freed once it
+ *		: has been drained.  Migrated slots are left in
+ *		: place so that the probe sequences of the
+ *		: remaining entries stay intact.
+ * INPUT	: 0 - Slot Index
+ *		: 1 - Number of slots to migrate
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+index_migrate (SlotIndex *index, u_int32_t count)
+{
+    const char *slot;
+
+    if (index->old.slots == NULL)
+	return;
+
+    while (count-- > 0 && index->migrate_pos <= index->old.mask) {
+	slot = (const char *) index->old.slots + (size_t) index->migrate_pos++ * index->slot_size;
+	if (index->live(slot))
+	    index->put(&index->cur, slot);
+    }
+
+    if (index->migrate_pos > index->old.mask) {
+	free(index->old.slots);
+	memset(&index->old, 0, sizeof(SlotTable));
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: index_make_room
+ * DESCRIPTION	: This function will make sure that the current
+ *		: table of an index can take one more record.
+ *		: It is created on first use and replaced by a
+ *		: larger one once it is 3/4 full;  a table that
+ *		: is mostly deleted slots is rebuilt at the
+ *		: same size instead.
+ * INPUT	: 0 - Slot Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+index_make_room (SlotIndex *index)
+{
+    u_int32_t size;
+
+    if (index->cur.slots == NULL)
+	slot_table_init(index, &index->cur, index->min_size);
+
+    if ((index->cur.used + 1) * 4 <= (index->cur.mask + 1) * 3)
+	return;
+
+    /* Finish any resize that is still in progress. */
+    index_migrate(index, index->old.mask + 1);
+
+    size = index->cur.mask + 1;
+    if ((index->cur.used - index->cur.deleted + 1) * 2 > size)
+	size *= 2;
+
+    index->old = index->cur;
+    index->migrate_pos = 0;
+    slot_table_init(index, &index->cur, size);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: index_reserve
+ * DESCRIPTION	: This function will size an empty index for a
+ *		: number of records.
+ * INPUT	: 0 - Slot Index
+ *		: 1 - Number of records
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+index_reserve (SlotIndex *index, unsigned long records)
+{
+    u_int32_t size;
+
+    if (index->cur.slots != NULL)
+	return;
+
+    for (size = index->min_size; size < 0x80000000 && (records + 1) * 4 > (unsigned long) size * 3; size *= 2);
+    slot_table_init(index, &index->cur, size);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: index_free
+ * DESCRIPTION	: This function will free the tables of an
+ *		: index.
+ * INPUT	: 0 - Slot Index
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+index_free (SlotIndex *index)
+{
+    free(index->cur.slots);
+    free(index->old.slots);
+    memset(&index->cur, 0, sizeof(SlotTable));
+    memset(&index->old, 0, sizeof(SlotTable));
+    index->migrate_pos = 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_slot_live
+ * DESCRIPTION	: This function will tell whether an asset
+ *		: slot holds a record.
+ * INPUT	: 0 - Asset Slot
+ * RETURN	: 0 - No, 1 - Yes
+ * ---------------------------------------------------------- */
+static int
+asset_slot_live (const void *slot)
+{
+    u_int32_t id = ((const AssetSlot *) slot)->id;
+
+    return (id != ASSET_NONE && id != ASSET_DELETED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_table_find
+ * DESCRIPTION	: This function will probe a single asset
+ *		: hash table for a key.
+ * INPUT	: 0 - Asset Table
+ *		: 1 - Hash Value
+ *		: 2 - IP Address
+ *		: 3 - Port
+ *		: 4 - Protocol
+ * RETURN	: Pointer to AssetSlot or NULL
+ * ---------------------------------------------------------- */
+static inline AssetSlot *
+asset_table_find (SlotTable *table, u_int32_t hash, u_int32_t ip,
+		  u_int16_t port, unsigned short proto)
+{
+    AssetSlot *slot;
+    u_int32_t i;
+
+    if (table->slots == NULL)
+	return NULL;
+
+    for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+	slot = (AssetSlot *) table->slots + i;
+	if (slot->id == ASSET_NONE)
+	    return NULL;
+	if (slot->ip == ip && slot->port == port && slot->proto == proto
+		&& slot->id != ASSET_DELETED)
+	    return slot;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_table_slot
+ * DESCRIPTION	: This function will probe a single asset
+ *		: hash table for the slot of a record.
+ * INPUT	: 0 - Asset Table
+ *		: 1 - Hash Value
+ *		: 2 - Record ID
+ * RETURN	: Pointer to AssetSlot or NULL
+ * ---------------------------------------------------------- */
+static inline AssetSlot *
+asset_table_slot (SlotTable *table, u_int32_t hash, u_int32_t id)
+{
+    AssetSlot *slot;
+    u_int32_t i;
+
+    if (table->slots == NULL)
+	return NULL;
+
+    for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+	slot = (AssetSlot *) table->slots + i;
+	if (slot->id == ASSET_NONE)
+	    return NULL;
+	if (slot->id == id)
+	    return slot;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_table_put
+ * DESCRIPTION	: This function will copy a slot into the first
+ *		: free (or deleted) slot of its probe sequence.
+ *		: The caller makes sure that the key is not
+ *		: already present.
+ * INPUT	: 0 - Asset Table
+ *		: 1 - AssetSlot
+ * RETURN	: Pointer to the new AssetSlot
+ * ---------------------------------------------------------- */
+static void *
+asset_table_put (SlotTable *table, const void *from)
+{
+    const AssetSlot *key = (const AssetSlot *) from;
+    AssetSlot *slots = (AssetSlot *) table->slots;
+    u_int32_t i;
+
+    i = asset_hash(key->ip, key->port, key->proto) & table->mask;
+    while (asset_slot_live(&slots[i]))
+	i = (i + 1) & table->mask;
+
+    if (slots[i].id == ASSET_DELETED)
+	table->deleted--;
+    else
+	table->used++;
+    slots[i] = *key;
+
+    return &slots[i];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_table_del
+ * DESCRIPTION	: This function will remove an asset record
+ *		: from a single asset hash table.  Its slot
+ *		: is marked ASSET_DELETED, so that the probe
+ *		: sequences running through it stay intact.
+ * INPUT	: 0 - Asset Table
+ *		: 1 - Hash Value
+ *		: 2 - Record ID
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+asset_table_del (SlotTable *table, u_int32_t hash, u_int32_t id)
+{
+    AssetSlot *slot;
+
+    if ((slot = asset_table_slot(table, hash, id)) != NULL) {
+	slot->id = ASSET_DELETED;
+	table->deleted++;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_rec
+ * DESCRIPTION	: This function will return the record stored
+ *		: under an ID.
+ * INPUT	: 0 - Record ID
+ * RETURN	: Pointer to AssetRecord
+ * ---------------------------------------------------------- */
+static inline AssetRecord *
+asset_rec (u_int32_t id)
+{
+    return &asset_store[id / ASSET_CHUNK][id % ASSET_CHUNK];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_slot
+ * DESCRIPTION	: This function will find the index slot of a
+ *		: stored record.  The caller must hold the
+ *		: storage lock.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: Pointer to AssetSlot
+ * ---------------------------------------------------------- */
+static AssetSlot *
+asset_slot (AssetRecord *rec)
+{
+    AssetSlot *slot;
+    u_int32_t hash;
+
+    hash = asset_hash(rec->ip_addr.s_addr, rec->port, rec->proto);
+    if ((slot = asset_table_slot(&asset_index.cur, hash, rec->id)) != NULL)
+	return slot;
+
+    return asset_table_slot(&asset_index.old, hash, rec->id);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_due
+ * DESCRIPTION	: This function will return the time an asset
+ *		: on the wheel is really due (WheelDue).
+ * INPUT	: 0 - Wheel Entry
+ * RETURN	: Time
+ * ---------------------------------------------------------- */
+static time_t
+asset_due (WheelEntry *entry)
+{
+    AssetRecord *rec = ASSET_OF(entry);
+
+    return (time_t) asset_slot(rec)->last_seen + asset_age(rec);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_fill
+ * DESCRIPTION	: This function will put the two halves of a
+ *		: stored asset together.  The copy shares the
+ *		: record's hex payload.
+ * INPUT	: 0 - Asset Slot
+ *		: 1 - Asset Record
+ *		: 2 - Copy
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+asset_fill (AssetSlot *slot, AssetRecord *rec, Asset *copy)
+{
+    copy->ip_addr = rec->ip_addr;
+    copy->c_ip_addr = rec->c_ip_addr;
+    copy->port = rec->port;
+    copy->c_port = rec->c_port;
+    copy->proto = rec->proto;
+    copy->i_attempts = slot->i_attempts;
+    copy->service = rec->service;
+    copy->application = rec->application;
+    copy->hex_payload = rec->hex_payload;
+    copy->discovered = rec->discovered;
+    copy->last_seen = (time_t) slot->last_seen;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: log_asset
+ * DESCRIPTION	: This function will log a change to a stored
+ *		: asset (see wal_asset).
+ * INPUT	: 0 - Asset Slot
+ *		: 1 - WAL_NEW, WAL_UPDATED or WAL_EXPIRED
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+log_asset (AssetSlot *slot, int type)
+{
+    Asset copy;
+
+    asset_fill(slot, asset_rec(slot->id), &copy);
+    wal_asset(&copy, type);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_alloc
+ * DESCRIPTION	: This function will take an empty record from
+ *		: the asset store.
+ * INPUT	: None!
+ * RETURN	: Pointer to AssetRecord
+ * ---------------------------------------------------------- */
+static AssetRecord *
+asset_alloc (void)
+{
+    AssetRecord *rec;
+    u_int32_t id;
+
+    if ((rec = asset_free) != NULL) {
+	asset_free = rec->next;
+	id = rec->id;
+	memset(rec, 0, sizeof(AssetRecord));
+	rec->id = id;
+	return rec;
+    }
+
+    /* ID 0 stands for an empty slot. */
+    if (asset_ids == ASSET_NONE)
+	asset_ids++;
+    if (asset_ids == ASSET_DELETED)
+	err_message("Unable to allocate asset record (store is full)");
+
+    if (asset_ids % ASSET_CHUNK == 0 || asset_store == NULL) {
+	if (asset_ids / ASSET_CHUNK >= asset_chunks) {
+	    asset_chunks = (asset_chunks == 0) ? 16 : asset_chunks * 2;
+	    if ((asset_store = (AssetRecord **) realloc(asset_store,
+			    asset_chunks * sizeof(AssetRecord *))) == NULL)
+		err_message("Unable to allocate asset store");
+	}
+	if ((asset_store[asset_ids / ASSET_CHUNK] = (AssetRecord *) calloc(ASSET_CHUNK,
+			sizeof(AssetRecord))) == NULL)
+	    err_message("Unable to allocate asset store");
+    }
+
+    rec = asset_rec(asset_ids);
+    rec->id = asset_ids++;
+
+    return rec;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: asset_release
+ * DESCRIPTION	: This function will return a record to the
+ *		: asset store, along with the IPv6 addresses
+ *		: it holds.  Its hex payload is not freed.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+asset_release (AssetRecord *rec)
+{
+    ip6_release(rec->ip_addr);
+    ip6_release(rec->c_ip_addr);
+    rec->next = asset_free;
+    asset_free = rec;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: unlink_asset
+ * DESCRIPTION	: This function will take an asset record out
+ *		: of the index and the asset list;  the server
+ *		: is no longer followed.  The caller holds the
+ *		: storage lock and has taken the record off the
+ *		: wheel.
+ * INPUT	: 0 - Asset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+unlink_asset (AssetRecord *rec)
+{
+    u_int32_t hash;
+
+    /* Forget about it in the pending filter and in the kernel. */
+    if (asset_slot(rec)->i_attempts > 0)
+	pending_del(rec->ip_addr, rec->port, rec->proto);
+    ebpf_pending(rec->ip_addr, rec->port, rec->proto);
+
+    hash = asset_hash(rec->ip_addr.s_addr, rec->port, rec->proto);
+    asset_table_del(&asset_index.cur, hash, rec->id);
+    asset_table_del(&asset_index.old, hash, rec->id);
+
+    if (rec->prev != NULL)
+	rec->prev->next = rec->next;
+    else
+	asset_list = rec->next;
+    if (rec->next != NULL)
+	rec->next->prev = rec->prev;
+    else
+	asset_tail = rec->prev;
+
+    storage_stats.assets--;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: remove_asset
+ * DESCRIPTION	: This function will drop an asset record.  An
+ *		: expiry event is printed, which takes over the
+ *		: record's hex payload.  See unlink_asset.
+ * INPUT	: 0 - Asset Record
+ *		: 1 - Evicted - 0 = No (expired), 1 = Yes
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+remove_asset (AssetRecord *rec, int evicted)
+{
+    Asset copy;
+
+    asset_fill(asset_slot(rec), rec, &copy);
+    unlink_asset(rec);
+
+    if (evicted)
+	storage_stats.evicted++;
+    else
+	storage_stats.expired++;
+
+    wal_asset(&copy, WAL_EXPIRED);
+    print_expired(&copy);
+    asset_release(rec);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: evict_assets
+ * DESCRIPTION	: This function will drop the assets that are
+ *		: due first on the wheel (the least recently
+ *		: seen) until no more than 'keep' are left.
+ * INPUT	: 0 - Number of assets to keep
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+evict_assets (unsigned long keep)
+{
+    WheelEntry *entry;
+
+    while (storage_stats.assets > keep
+	    && (entry = wheel_first(&asset_wheel, asset_due)) != NULL)
+	remove_asset(ASSET_OF(entry), 1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: insert_asset
+ * DESCRIPTION	: This function will index a new asset record,
+ *		: append it to the ordered asset list and put
+ *		: it on the wheel.  With asset_max set, the
+ *		: least recently seen assets make room for it.
+ * INPUT	: 0 - Asset Record
+ *		: 1 - Identification attempts
+ * RETURN	: Pointer to the AssetSlot
+ * ---------------------------------------------------------- */
+static AssetSlot *
+insert_asset (AssetRecord *rec, unsigned short i_attempts)
+{
+    AssetSlot from, *slot;
+
+    if (gc.asset_max > 0 && storage_clock != 0)
+	evict_assets(gc.asset_max - 1);
+
+    index_make_room(&asset_index);
+    from.ip = rec->ip_addr.s_addr;
+    from.port = rec->port;
+    from.proto = rec->proto;
+    from.i_attempts = i_attempts;
+    from.id = rec->id;
+    from.last_seen = (u_int32_t) storage_clock;
+    slot = asset_table_put(&asset_index.cur, &from);
+    index_migrate(&asset_index, ASSET_MIGRATE_STEP);
+
+    /* Append to the ordered asset list. */
+    rec->next = NULL;
+    rec->prev = asset_tail;
+    if (asset_list == NULL)
+	asset_list = rec;
+    else
+	asset_tail->next = rec;
+    asset_tail = rec;
+
+    if (storage_clock != 0 && asset_age(rec) > 0)
+	wheel_add(&asset_wheel, &rec->timer, storage_clock + asset_age(rec));
+    storage_stats.assets++;
+    ip6_hold(rec->ip_addr);
+    ip6_hold(rec->c_ip_addr);
+
+    log_asset(slot, WAL_NEW);
+    return slot;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_hash
+ * DESCRIPTION	: This function will hash an ARP asset key.
+ * INPUT	: 0 - IP Address
+ *		: 1 - MAC Address
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+static inline u_int32_t
+arp_hash (u_int32_t ip, const char mac_addr[MAC_LEN])
+{
+    const u_char *mac = (const u_char *)mac_addr;
+    u_int16_t lo;
+
+    /* Fold the two bytes of the MAC that are not covered by the port. */
+    lo = (mac[4] << 8) | mac[5];
+    return asset_hash(ip ^ ((mac[0] << 24) | (mac[1] << 16) | (mac[2] << 8) | mac[3]),
+		      lo, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_slot_live
+ * DESCRIPTION	: This function will tell whether an ARP slot
+ *		: holds a record.
+ * INPUT	: 0 - ARP Slot
+ * RETURN	: 0 - No, 1 - Yes
+ * ---------------------------------------------------------- */
+static int
+arp_slot_live (const void *slot)
+{
+    ArpAsset *rec = ((const ArpSlot *) slot)->rec;
+
+    return (rec != NULL && rec != SLOT_DELETED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_table_find
+ * DESCRIPTION	: This function will probe a single ARP hash
+ *		: table for a key.
+ * INPUT	: 0 - ARP Table
+ *		: 1 - Hash Value
+ *		: 2 - IP Address
+ *		: 3 - MAC Address
+ * RETURN	: Pointer to ArpAsset or NULL
+ * ---------------------------------------------------------- */
+static inline ArpAsset *
+arp_table_find (SlotTable *table, u_int32_t hash, u_int32_t ip,
+		const char mac_addr[MAC_LEN])
+{
+    ArpSlot *slot;
+    u_int32_t i;
+
+    if (table->slots == NULL)
+	return NULL;
+
+    for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+	slot = (ArpSlot *) table->slots + i;
+	if (slot->rec == NULL)
+	    return NULL;
+	if (slot->ip == ip && memcmp(slot->mac_addr, mac_addr, MAC_LEN) == 0
+		&& slot->rec != SLOT_DELETED)
+	    return slot->rec;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_table_put
+ * DESCRIPTION	: This function will copy a slot into the first
+ *		: free (or deleted) slot of its probe sequence.
+ *		: See asset_table_put.
+ * INPUT	: 0 - ARP Table
+ *		: 1 - ArpSlot
+ * RETURN	: Pointer to the new ArpSlot
+ * ---------------------------------------------------------- */
+static void *
+arp_table_put (SlotTable *table, const void *from)
+{
+    const ArpSlot *key = (const ArpSlot *) from;
+    ArpSlot *slots = (ArpSlot *) table->slots;
+    u_int32_t i;
+
+    i = arp_hash(key->ip, key->mac_addr) & table->mask;
+    while (arp_slot_live(&slots[i]))
+	i = (i + 1) & table->mask;
+
+    if (slots[i].rec == SLOT_DELETED)
+	table->deleted--;
+    else
+	table->used++;
+    slots[i] = *key;
+
+    return &slots[i];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: arp_table_del
+ * DESCRIPTION	: This function will remove an ARP record from
+ *		: a single ARP hash table.  See asset_table_del.
+ * INPUT	: 0 - ARP Table
+ *		: 1 - Hash Value
+ *		: 2 - ArpAsset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+arp_table_del (SlotTable *table, u_int32_t hash, ArpAsset *rec)
+{
+    ArpSlot *slot;
+    u_int32_t i;
+
+    if (table->slots == NULL)
+	return;
+
+    for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+	slot = (ArpSlot *) table->slots + i;
+	if (slot->rec == NULL)
+	    return;
+	if (slot->rec == rec) {
+	    slot->rec = SLOT_DELETED;
+	    table->deleted++;
+	    return;
+	}
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: find_arp_asset
+ * DESCRIPTION	: This function will find an ARP asset's
+ *		: record and return it.
+ * INPUT	: 0 - IP Address
+ *		: 1 - MAC Address
+ * RETURN	: Pointer to ArpAsset or NULL
+ * ---------------------------------------------------------- */
+static inline ArpAsset *
+find_arp_asset (struct in_addr ip_addr, const char mac_addr[MAC_LEN])
+{
+    ArpAsset *rec;
+    u_int32_t hash;
+
+    hash = arp_hash(ip_addr.s_addr, mac_addr);
+
+    if ((rec = arp_table_find(&arp_index.cur, hash, ip_addr.s_addr, mac_addr)) != NULL)
+	return rec;
+
+    return arp_table_find(&arp_index.old, hash, ip_addr.s_addr, mac_addr);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: unlink_arp_asset
+ * DESCRIPTION	: This function will take an ARP record out of
+ *		: the index and the ARP list.  See unlink_asset.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+unlink_arp_asset (ArpAsset *rec)
+{
+    u_int32_t hash;
+
+    hash = arp_hash(rec->ip_addr.s_addr, rec->mac_addr);
+    arp_table_del(&arp_index.cur, hash, rec);
+    arp_table_del(&arp_index.old, hash, rec);
+
+    if (rec->prev != NULL)
+	rec->prev->next = rec->next;
+    else
+	arp_asset_list = rec->next;
+    if (rec->next != NULL)
+	rec->next->prev = rec->prev;
+    else
+	arp_asset_tail = rec->prev;
+
+    storage_stats.arp_entries--;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: remove_arp_asset
+ * DESCRIPTION	: This function will drop an ARP record.  See
+ *		: remove_asset.
+ * INPUT	: 0 - ArpAsset Record
+ *		: 1 - Evicted - 0 = No (expired), 1 = Yes
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+remove_arp_asset (ArpAsset *rec, int evicted)
+{
+    unlink_arp_asset(rec);
 
-Asset *asset_list;
-ArpAsset *arp_asset_list;
+    if (evicted)
+	storage_stats.arp_evicted++;
+    else
+	storage_stats.arp_expired++;
+
+    wal_arp_asset(rec, WAL_ARP_EXPIRED);
+    print_arp_expired(rec);
+    ip6_release(rec->ip_addr);
+    slab_free(&arp_slab, rec);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: evict_arp_assets
+ * DESCRIPTION	: This function will drop the ARP entries that
+ *		: are due first on the wheel until no more than
+ *		: 'keep' are left.
+ * INPUT	: 0 - Number of ARP entries to keep
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+evict_arp_assets (unsigned long keep)
+{
+    WheelEntry *entry;
+
+    while (storage_stats.arp_entries > keep
+	    && (entry = wheel_first(&arp_wheel, arp_due)) != NULL)
+	remove_arp_asset(ARP_OF(entry), 1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: insert_arp_asset
+ * DESCRIPTION	: This function will index a new ARP record,
+ *		: append it to the ordered ARP list and put it
+ *		: on the wheel.  See insert_asset.
+ * INPUT	: 0 - ArpAsset Record
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+insert_arp_asset (ArpAsset *rec)
+{
+    ArpSlot from;
+
+    if (gc.arp_max > 0 && storage_clock != 0)
+	evict_arp_assets(gc.arp_max - 1);
+
+    /* Index the record. */
+    index_make_room(&arp_index);
+    from.ip = rec->ip_addr.s_addr;
+    memcpy(from.mac_addr, rec->mac_addr, MAC_LEN);
+    from.rec = rec;
+    arp_table_put(&arp_index.cur, &from);
+    index_migrate(&arp_index, ASSET_MIGRATE_STEP);
+
+    /* Append to the ordered ARP list. */
+    rec->next = NULL;
+    rec->prev = arp_asset_tail;
+    if (arp_asset_list == NULL)
+	arp_asset_list = rec;
+    else
+	arp_asset_tail->next = rec;
+    arp_asset_tail = rec;
+
+    rec->last_seen = storage_clock;
+    if (storage_clock != 0 && arp_age(rec) > 0)
+	wheel_add(&arp_wheel, &rec->timer, rec->last_seen + arp_age(rec));
+    storage_stats.arp_entries++;
+    ip6_hold(rec->ip_addr);
+
+    wal_arp_asset(rec, WAL_ARP_NEW);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: storage_start
+ * DESCRIPTION	: This function will start the asset clock on
+ *		: the first packet.  Records loaded from the
+ *		: report file count as seen now.
+ * INPUT	: 0 - Packet Time
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+storage_start (time_t now)
+{
+    AssetRecord *rec;
+    AssetSlot *slot;
+    ArpAsset *arp;
+
+    __atomic_store_n(&storage_clock, now, __ATOMIC_RELAXED);
+    wheel_start(&asset_wheel, now);
+    wheel_start(&arp_wheel, now);
+
+    for (rec = asset_list; rec != NULL; rec = rec->next) {
+	slot = asset_slot(rec);
+	if (slot->last_seen == 0)
+	    slot->last_seen = (u_int32_t) now;
+	if (asset_age(rec) > 0)
+	    wheel_add(&asset_wheel, &rec->timer, (time_t) slot->last_seen + asset_age(rec));
+    }
+    for (arp = arp_asset_list; arp != NULL; arp = arp->next) {
+	if (arp->last_seen == 0)
+	    arp->last_seen = now;
+	if (arp_age(arp) > 0)
+	    wheel_add(&arp_wheel, &arp->timer, arp->last_seen + arp_age(arp));
+    }
+
+    if (gc.asset_max > 0)
+	evict_assets(gc.asset_max);
+    if (gc.arp_max > 0)
+	evict_arp_assets(gc.arp_max);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: storage_tick
+ * DESCRIPTION	: This function will move the asset clock on
+ *		: to a packet's time and drop the records that
+ *		: have not been seen for their time to live.
+ *		: The clock never goes back.  Most packets do
+ *		: not move it and return without a lock.
+ * INPUT	: 0 - Packet Time
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+storage_tick (time_t now)
+{
+    WheelEntry *list, *entry;
+
+    if (!storage_aging || now <= __atomic_load_n(&storage_clock, __ATOMIC_RELAXED))
+	return;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if (now <= storage_clock) {
+	pthread_rwlock_unlock(&storage_lock);
+	return;
+    }
+
+    if (storage_clock == 0) {
+	storage_start(now);
+	pthread_rwlock_unlock(&storage_lock);
+	return;
+    }
+    __atomic_store_n(&storage_clock, now, __ATOMIC_RELAXED);
+
+    /* Records that only sit on the wheel for eviction come round once
+     * per span;  they are put back. */
+    list = wheel_advance(&asset_wheel, now, asset_due);
+    while ((entry = list) != NULL) {
+	list = entry->next;
+	if (asset_ttl(ASSET_OF(entry)) > 0)
+	    remove_asset(ASSET_OF(entry), 0);
+	else
+	    wheel_add(&asset_wheel, entry, now + WHEEL_SPAN - 1);
+    }
+
+    list = wheel_advance(&arp_wheel, now, arp_due);
+    while ((entry = list) != NULL) {
+	list = entry->next;
+	if (ttl_arp > 0)
+	    remove_arp_asset(ARP_OF(entry), 0);
+	else
+	    wheel_add(&arp_wheel, entry, now + WHEEL_SPAN - 1);
+    }
+    pthread_rwlock_unlock(&storage_lock);
+}
 
 /* ----------------------------------------------------------
  * FUNCTION	: check_tcp_asset
@@ -43,23 +1155,39 @@ ArpAsset *arp_asset_list;
  * ---------------------------------------------------------- */
 int check_tcp_asset (struct in_addr ip_addr, u_int16_t port)
 {
-    Asset *rec;
+    AssetSlot *slot;
 
     /* Check the Asset data structure for an existing entry. */
-    rec = asset_list;
-    while (rec != NULL) {
-	if (rec->ip_addr.s_addr == ip_addr.s_addr
-		&& rec->port == port
-		&& rec->proto == IPPROTO_TCP) {
-	    return 0;
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, IPPROTO_TCP)) != NULL)
+	asset_seen(slot);
+    pthread_rwlock_unlock(&storage_lock);
 
-	} else {
-	    rec = rec->next;
-	}
-    }
+    /* Return 1 if the asset was not found. */
+    return (slot == NULL);
+}
 
-    /* Asset not found, return 1 */
-    return 1;
+/* ----------------------------------------------------------
+ * FUNCTION	: check_udp_asset
+ * DESCRIPTION	: This function determines whether an asset
+ *		: has already been recorded.
+ * INPUT	: 0 - IP Address
+ *		: 1 - UDP port
+ * RETURN	: 0 - Asset Exists
+ *		: 1 - New Asset
+ * ---------------------------------------------------------- */
+int check_udp_asset (struct in_addr ip_addr, u_int16_t port)
+{
+    AssetSlot *slot;
+
+    /* Check the Asset data structure for an existing entry. */
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, IPPROTO_UDP)) != NULL)
+	asset_seen(slot);
+    pthread_rwlock_unlock(&storage_lock);
+
+    /* Return 1 if the asset was not found. */
+    return (slot == NULL);
 }
 
 /* ----------------------------------------------------------
@@ -72,22 +1200,17 @@ int check_tcp_asset (struct in_addr ip_addr, u_int16_t port)
  * ---------------------------------------------------------- */
 int check_icmp_asset (struct in_addr ip_addr)
 {
-    Asset *rec;
-
-    /* Check the Asset data stucture for an existing entry. */
-    rec = asset_list;
-    while (rec != NULL) {
-	if (rec->ip_addr.s_addr == ip_addr.s_addr
-		&& rec->proto == IPPROTO_ICMP) {
-	    return 0;
+    AssetSlot *slot;
 
-	} else {
-	    rec = rec->next;
-	}
-    }
+    /* Check the Asset data stucture for an existing entry.  ICMP assets
+     * are always recorded with a port of 0. */
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, 0, IPPROTO_ICMP)) != NULL)
+	asset_seen(slot);
+    pthread_rwlock_unlock(&storage_lock);
 
-    /* Asset not found, return 1 */
-    return 1;
+    /* Return 1 if the asset was not found. */
+    return (slot == NULL);
 }
 
 /* ----------------------------------------------------------
@@ -105,19 +1228,13 @@ int check_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN])
     ArpAsset *rec;
 
     /* Check the ARP data structure for an existing entry. */
-    rec = arp_asset_list;
-    while (rec != NULL) {
-	if (rec->ip_addr.s_addr == ip_addr.s_addr
-               && (memcmp(rec->mac_addr, mac_addr, MAC_LEN) == 0)) {
-	    return 0;
-
-	} else {
-	    rec = rec->next;
-	}
-    }
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((rec = find_arp_asset(ip_addr, mac_addr)) != NULL)
+	arp_seen(rec);
+    pthread_rwlock_unlock(&storage_lock);
 
-    /* Asset not found return 1 */
-    return 1;
+    /* Return 1 if the asset was not found. */
+    return (rec == NULL);
 }
 
 /* ----------------------------------------------------------
@@ -137,23 +1254,29 @@ void add_asset (struct in_addr ip_addr,
 		u_int16_t port,
 		u_int16_t c_port,
 		unsigned short proto,
-		bstring service,
-		bstring application,
+		StrId service,
+		StrId application,
 		time_t discovered)
 {
-    Asset *rec;
-    Asset *list;
+    AssetRecord *rec;
+    unsigned short i_attempts;
+
+    /* Make sure that this asset has not already been recorded. */
+    pthread_rwlock_wrlock(&storage_lock);
+    if (find_asset(ip_addr, port, proto) != NULL) {
+	pthread_rwlock_unlock(&storage_lock);
+	return;
+    }
 
     /* Assign list to temp structure.  */
-    rec = (Asset*)malloc(sizeof(Asset));
+    rec = asset_alloc();
     rec->ip_addr.s_addr = ip_addr.s_addr;
     rec->c_ip_addr.s_addr = c_ip_addr.s_addr;
     rec->port = port;
     rec->c_port = c_port;
     rec->proto = proto;
-    rec->service = bstrcpy(service);
-    rec->application = bstrcpy(application);
-    rec->next = NULL;
+    rec->service = service;
+    rec->application = application;
 
     /*
      * If this device has been read from a report file, set
@@ -163,10 +1286,10 @@ void add_asset (struct in_addr ip_addr,
      */
     if (!discovered) {
 	rec->discovered = time(NULL);
-	rec->i_attempts = I_ATTEMPTS;
+	i_attempts = I_ATTEMPTS;
     } else {
 	rec->discovered = discovered;
-	rec->i_attempts = 0;
+	i_attempts = 0;
     }
 
     /*
@@ -174,23 +1297,16 @@ void add_asset (struct in_addr ip_addr,
      * to zero.
      */
     if (proto == IPPROTO_ICMP) {
-	rec->i_attempts = 0;
+	i_attempts = 0;
     }
 
-    /* Find this record's location within linked list.  */
-    if (asset_list == NULL) {
-	asset_list = rec;
-    } else {
-	list = asset_list;
-	while (list != NULL) {
-	    if (list->next == NULL) {
-		list->next = rec;
-		break;
-	    } else {
-		list = list->next;
-	    }
-	}
-    }
+    /* Index the record and append it to the asset list. */
+    insert_asset(rec, i_attempts);
+    if (i_attempts > 0)
+	pending_add(ip_addr, port, proto);
+    else
+	ebpf_identified(ip_addr, port, proto);
+    pthread_rwlock_unlock(&storage_lock);
 
     return;
 }
@@ -207,27 +1323,57 @@ void add_asset (struct in_addr ip_addr,
 void add_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN],
 		    time_t discovered)
 {
-    ArpAsset *list;
+    upsert_arp_asset(ip_addr, mac_addr, discovered, NULL);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: upsert_arp_asset
+ * DESCRIPTION	: This function will look up an ARP entry and
+ *		: add it to the ARP data structure if it does
+ *		: not exist yet.  Both steps share a single
+ *		: probe of the ARP index.
+ * INPUT	: 0 - IP Address
+ *		: 1 - MAC Address
+ *		: 2 - Discovered
+ *		: 3 - Copy of the new record, made under the
+ *		:     storage lock (may be NULL;  only filled
+ *		:     in when the entry was added)
+ * RETURN	: 1 - Added
+ *		: 0 - Already existed
+ * ---------------------------------------------------------- */
+int upsert_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN],
+		      time_t discovered, ArpAsset *copy)
+{
     ArpAsset *rec;
-    bstring mac_resolved;
 
-    rec = (ArpAsset*) calloc(1, sizeof(ArpAsset));
+    /* Is the record there already? */
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((rec = find_arp_asset(ip_addr, mac_addr)) != NULL)
+	arp_seen(rec);
+    pthread_rwlock_unlock(&storage_lock);
+    if (rec != NULL)
+	return 0;
+
+    /* Another worker may have added it in the meantime. */
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((rec = find_arp_asset(ip_addr, mac_addr)) != NULL) {
+	arp_seen(rec);
+	pthread_rwlock_unlock(&storage_lock);
+	return 0;
+    }
+
+    rec = (ArpAsset *) slab_calloc(&arp_slab);
     rec->ip_addr.s_addr = ip_addr.s_addr;
     memcpy(&rec->mac_addr, mac_addr, MAC_LEN);
-    /*rec->next = NULL; */
-    /*rec->mac_resolved = NULL;*/
 
     /* Attempt to resolve the vendor name of the MAC address. */
 #ifndef DISABLE_VENDOR
-    mac_resolved = (bstring) get_vendor(mac_addr);
-    rec->mac_resolved = bstrcpy(mac_resolved);
+    rec->mac_resolved = get_vendor(mac_addr);
 #endif
 
     /*
      * If this device has been read from a report file, set
      * the discovered time to whatever is in the report.
-     * Also, we don't want to try to identify this service
-     * anymore (i_attempts = 0);
      */
     if (!discovered) {
 	rec->discovered = time(NULL);
@@ -235,21 +1381,16 @@ void add_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN],
 	rec->discovered = discovered;
     }
 
-    /* Find this record's location within linked list.  */
-    if (arp_asset_list == NULL) {
-	arp_asset_list = rec;
-    } else {
-	list = arp_asset_list;
-
-	while (list != NULL) {
-	    if (list->next == NULL) {
-		list->next = rec;
-		break;
-	    } else {
-		list = list->next;
-	    }
-	}
+    /* Index the record and append it to the ARP list. */
+    insert_arp_asset(rec);
+    if (copy != NULL) {
+	*copy = *rec;
+	copy->next = NULL;
+	copy->prev = NULL;
     }
+    pthread_rwlock_unlock(&storage_lock);
+
+    return 1;
 }
 
 /* ----------------------------------------------------------
@@ -264,23 +1405,48 @@ unsigned short get_i_attempts (struct in_addr ip_addr,
 			       u_int16_t port,
 			       unsigned short proto)
 {
-    Asset *rec;
+    AssetSlot *slot;
+    unsigned short i_attempts = 0;
 
-    /* Find asset within linked list.  */
-    rec = asset_list;
-    while (rec != NULL) {
-	if (ip_addr.s_addr == rec->ip_addr.s_addr
-		&& port == rec->port
-		&& proto == rec->proto) {
-	    /* Found! */
-	    return rec->i_attempts;
-
-	} else {
-	    rec = rec->next;
+    /* Find asset within the asset index.  */
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL)
+	i_attempts = slot->i_attempts;
+    pthread_rwlock_unlock(&storage_lock);
+
+    return i_attempts;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: take_i_attempt
+ * DESCRIPTION	: This function will use up one of an asset's
+ *		: identification attempts.  Workers that see
+ *		: the same server on different connections
+ *		: each get an attempt of their own.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Proto
+ * RETURN	: i_attempts before this attempt (0 = none left)
+ * ---------------------------------------------------------- */
+unsigned short take_i_attempt (struct in_addr ip_addr,
+			       u_int16_t port,
+			       unsigned short proto)
+{
+    AssetSlot *slot;
+    unsigned short i_attempts = 0;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL && slot->i_attempts > 0) {
+	asset_seen(slot);
+	i_attempts = slot->i_attempts--;
+	if (slot->i_attempts == 0) {
+	    pending_del(ip_addr, port, proto);
+	    log_asset(slot, WAL_UPDATED);
 	}
     }
+    pthread_rwlock_unlock(&storage_lock);
 
-    return 0;
+    return i_attempts;
 }
 
 /* ----------------------------------------------------------
@@ -299,22 +1465,25 @@ short update_i_attempts (struct in_addr ip_addr,
 			 unsigned short proto,
 			 unsigned short i_attempts)
 {
-    Asset *rec;
-
-    /* Find asset within linked list.  */
-    rec = asset_list;
-    while (rec != NULL) {
-	if (ip_addr.s_addr == rec->ip_addr.s_addr
-		&& port == rec->port
-		&& proto == rec->proto) {
-	    /* Found! */
-	    rec->i_attempts = i_attempts;
-	    return 0;
-
-	} else {
-	    rec = rec->next;
+    AssetSlot *slot;
+
+    /* Find asset within the asset index.  */
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL) {
+	/* Keep the pending identification filter in sync. */
+	if (slot->i_attempts > 0 && i_attempts == 0)
+	    pending_del(ip_addr, port, proto);
+	else if (slot->i_attempts == 0 && i_attempts > 0)
+	    pending_add(ip_addr, port, proto);
+
+	if (slot->i_attempts != i_attempts) {
+	    slot->i_attempts = i_attempts;
+	    log_asset(slot, WAL_UPDATED);
 	}
+	pthread_rwlock_unlock(&storage_lock);
+	return 0;
     }
+    pthread_rwlock_unlock(&storage_lock);
 
     return 1;
 }
@@ -334,26 +1503,23 @@ short update_i_attempts (struct in_addr ip_addr,
 short update_asset (struct in_addr ip_addr,
 		    u_int16_t port,
 		    unsigned short proto,
-		    bstring service,
-		    bstring application)
-{
-    Asset *list;
-
-    /* Find asset within linked list.  */
-    list = asset_list;
-    while (list != NULL) {
-	if (ip_addr.s_addr == list->ip_addr.s_addr
-		&& port == list->port
-		&& proto == list->proto) {
-	    /* Found! */
-	    list->service = bstrcpy(service);
-	    list->application = bstrcpy(application);
-	    return 0;
-
-	} else {
-	    list = list->next;
-	}
+		    StrId service,
+		    StrId application)
+{
+    AssetSlot *slot;
+    AssetRecord *rec;
+
+    /* Find asset within the asset index.  */
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL) {
+	rec = asset_rec(slot->id);
+	rec->service = service;
+	rec->application = application;
+	log_asset(slot, WAL_UPDATED);
+	pthread_rwlock_unlock(&storage_lock);
+	return 0;
     }
+    pthread_rwlock_unlock(&storage_lock);
 
     return 1;
 }
@@ -363,32 +1529,28 @@ short add_hex_payload (struct in_addr ip_addr,
                        unsigned short proto,
                        char *hex_payload)
 {
-    Asset *list;
+    AssetSlot *slot;
+    AssetRecord *rec;
 
-    /* Find asset within linked list.  */
-    list = asset_list;
-    while (list != NULL) {
-        if (ip_addr.s_addr == list->ip_addr.s_addr
-                && port == list->port
-                && proto == list->proto) {
-            /* Found! */
-            if ( list->i_attempts == I_ATTEMPTS - 1 ) {
+    /* Find asset within the asset index.  */
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL) {
+        rec = asset_rec(slot->id);
+        if (rec->hex_payload == NULL) {
 
-                /* First payload */
-                list->hex_payload = bstrcpy(bfromcstr(hex_payload));
+            /* First payload */
+            rec->hex_payload = bfromcstr(hex_payload);
 
-            } else {
-                
-                /* Append payload */
-                bcatcstr(list->hex_payload, hex_payload);
+        } else {
 
-            }
-            return 0;
+            /* Append payload */
+            bcatcstr(rec->hex_payload, hex_payload);
 
-        } else {
-            list = list->next;
         }
+        pthread_rwlock_unlock(&storage_lock);
+        return 0;
     }
+    pthread_rwlock_unlock(&storage_lock);
 
     return 1;
 }
@@ -402,70 +1564,142 @@ short add_hex_payload (struct in_addr ip_addr,
  * ---------------------------------------------------------- */
 void end_storage ()
 {
-    Asset *next1;
-    ArpAsset *next2;
-
-    /* Free records in asset_list (Asset). */
-    while (asset_list != NULL) {
-	next1 = asset_list->next;
-	if (asset_list->service != NULL)
-	    bdestroy(asset_list->service);
-	if (asset_list->application != NULL)
-	    bdestroy(asset_list->application);
-        /*if (asset_list->hex_payload != NULL)
-	    bdestroy(asset_list->hex_payload);*/
-	if (asset_list != NULL)
-	    free (asset_list);
-	asset_list = next1;
+    AssetRecord *rec;
+    u_int32_t i;
+
+    /* The wheels only point into the records. */
+    wheel_clear(&asset_wheel);
+    wheel_clear(&arp_wheel);
+
+    /* The live records own their hex payload;  removed ones gave it
+     * away with their last copy. */
+    for (rec = asset_list; rec != NULL; rec = rec->next) {
+	if (rec->hex_payload != NULL)
+	    bdestroy(rec->hex_payload);
     }
 
-    /* Free records in arp_asset_list (Arasset_list). */
-    while (arp_asset_list != NULL) {
-	next2 = arp_asset_list->next;
-	if (arp_asset_list->mac_resolved != NULL)
-	    bdestroy(arp_asset_list->mac_resolved);
-	if (arp_asset_list != NULL)
-	    free (arp_asset_list);
-	arp_asset_list = next2;
-    }
+    /* Free the asset store (Asset records). */
+    asset_list = NULL;
+    asset_tail = NULL;
+    for (i = 0; i < asset_ids; i += ASSET_CHUNK)
+	free(asset_store[i / ASSET_CHUNK]);
+    free(asset_store);
+    asset_store = NULL;
+    asset_chunks = 0;
+    asset_ids = ASSET_NONE;
+    asset_free = NULL;
+
+    /* Free the asset index. */
+    index_free(&asset_index);
+
+    /* Free the ARP records. */
+    arp_asset_list = NULL;
+    arp_asset_tail = NULL;
+    slab_destroy(&arp_slab);
+
+    /* Free the ARP index. */
+    index_free(&arp_index);
 }
 
 /* ----------------------------------------------------------
  * FUNCTION	: find_asset
  * DESCRIPTION	: This function will find an asset's record
- *		: and return it.
+ *		: and return it.  The caller must hold the
+ *		: storage lock.
  * INPUT	: 0 - IP Address
  *		: 1 - Port
  *		: 2 - Protocol
- * RETURN	: Pointer to Asset
+ * RETURN	: Pointer to the AssetSlot
  * ---------------------------------------------------------- */
-inline Asset *
+AssetSlot *
 find_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
 {
-    Asset *list;
-    Asset *rec = NULL;
+    AssetSlot *slot;
+    u_int32_t hash;
 
-    list = asset_list;
+    hash = asset_hash(ip_addr.s_addr, port, proto);
 
-    while (list != NULL) {
-	if (ip_addr.s_addr == list->ip_addr.s_addr
-		&& port == list->port
-		&& proto == list->proto) {
+    /* Check the current index, then the one being migrated (if any). */
+    if ((slot = asset_table_find(&asset_index.cur, hash, ip_addr.s_addr, port, proto)) != NULL)
+	return slot;
 
-	    /* Found! */
-	    rec = list;
-	    break;
+    return asset_table_find(&asset_index.old, hash, ip_addr.s_addr, port, proto);
+}
 
-	} else {
-	    list = list->next;
-	}
+/* ----------------------------------------------------------
+ * FUNCTION	: copy_asset
+ * DESCRIPTION	: This function will copy an asset's record,
+ *		: so that it can be used without holding the
+ *		: storage lock.  The copy's hex payload must
+ *		: be freed with free_asset_copy().
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Protocol
+ *		: 3 - Copy
+ * RETURN	: 0 - Success
+ *		: -1 - Not Found
+ * ---------------------------------------------------------- */
+int
+copy_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto, Asset *copy)
+{
+    AssetSlot *slot;
+
+    pthread_rwlock_rdlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) == NULL) {
+	pthread_rwlock_unlock(&storage_lock);
+	return -1;
     }
 
-    /* Make sure that a record was found. */
-    if (rec == NULL)
-	return NULL;
-    else
-	return rec;
+    asset_fill(slot, asset_rec(slot->id), copy);
+    if (copy->hex_payload != NULL)
+	copy->hex_payload = bstrcpy(copy->hex_payload);
+    pthread_rwlock_unlock(&storage_lock);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: peek_asset
+ * DESCRIPTION	: This function will copy a record of the asset
+ *		: list.  The copy shares the record's hex
+ *		: payload, so it is only good while the caller
+ *		: holds the storage lock (lock_storage()).
+ * INPUT	: 0 - Asset Record
+ *		: 1 - Copy
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+peek_asset (AssetRecord *rec, Asset *copy)
+{
+    asset_fill(asset_slot(rec), rec, copy);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: free_asset_copy
+ * DESCRIPTION	: This function will free the hex payload of a
+ *		: copy made by copy_asset().  The service and
+ *		: application are in the string pool.
+ * INPUT	: 0 - Copy
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+free_asset_copy (Asset *copy)
+{
+    if (copy->hex_payload != NULL)
+	bdestroy(copy->hex_payload);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_storage_stats
+ * DESCRIPTION	: This function will return the asset storage
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to StorageStats
+ * ---------------------------------------------------------- */
+StorageStats *
+get_storage_stats (void)
+{
+    return &storage_stats;
 }
 
 /* ----------------------------------------------------------
@@ -475,7 +1709,7 @@ find_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
  * INPUT	: None!
  * RETURN	: 0 - Asset Data Structure
  * ---------------------------------------------------------- */
-Asset *get_asset_pointer ()
+AssetRecord *get_asset_pointer ()
 {
     return asset_list;
 }
@@ -503,18 +1737,19 @@ ArpAsset *get_arp_pointer ()
 #ifdef DEBUG
 void print_database ()
 {
-    Asset *rec;
+    AssetRecord *rec;
     ArpAsset *arp;
+    char ip[INET6_ADDRSTRLEN];
     int id = 0;
 
     printf("-- Begin Asset Database --\n");
     rec = asset_list;
     while (rec != NULL) {
 	printf("%d:  %s,%d,%d,%d,%s,%s,%d\n",
-		id, inet_ntoa(rec->ip_addr), ntohs(rec->port),
+		id, ip_ntop(rec->ip_addr, ip, sizeof(ip)), ntohs(rec->port),
 		rec->proto, (int)rec->discovered,
-		bdata(rec->service), bdata(rec->application),
-		rec->i_attempts);
+		bdata(str_get(rec->service)), bdata(str_get(rec->application)),
+		asset_slot(rec)->i_attempts);
 	rec = rec->next;
 	id++;
     }
@@ -524,8 +1759,8 @@ void print_database ()
     id = 0;
     arp = arp_asset_list;
     while (arp != NULL) {
-	printf("%d:  %s,%s,%d\n", id, inet_ntoa(arp->ip_addr),
-		ether_ntoa(&arp->mac_addr), (int)arp->discovered);
+	printf("%d:  %s,%s,%d\n", id, ip_ntop(arp->ip_addr, ip, sizeof(ip)),
+		ether_ntoa((struct ether_addr *)arp->mac_addr), (int)arp->discovered);
 	arp = arp->next;
 	id++;
     }
@@ -548,21 +1783,34 @@ void print_database ()
 void add_asset_csv (struct in_addr ip_addr,
 		u_int16_t port,
 		unsigned short proto,
-		bstring service,
-		bstring application,
+		StrId service,
+		StrId application,
 		time_t discovered)
 {
-    Asset *rec;
-    Asset *list;
+    AssetSlot *slot;
+    AssetRecord *rec;
+    unsigned short i_attempts;
+
+    /*
+     * The report file contains a new line every time an asset is
+     * updated.  Later lines supersede earlier ones for the same asset.
+     */
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL) {
+	rec = asset_rec(slot->id);
+	rec->service = service;
+	rec->application = application;
+	pthread_rwlock_unlock(&storage_lock);
+	return;
+    }
 
     /* Assign list to temp structure.  */
-    rec = (Asset*)malloc(sizeof(Asset));
+    rec = asset_alloc();
     rec->ip_addr.s_addr = ip_addr.s_addr;
     rec->port = port;
     rec->proto = proto;
-    rec->service = bstrcpy(service);
-    rec->application = bstrcpy(application);
-    rec->next = NULL;
+    rec->service = service;
+    rec->application = application;
 
     /*
      * If this device has been read from a report file, set
@@ -572,10 +1820,10 @@ void add_asset_csv (struct in_addr ip_addr,
      */
     if (!discovered) {
 	rec->discovered = time(NULL);
-	rec->i_attempts = I_ATTEMPTS;
+	i_attempts = I_ATTEMPTS;
     } else {
 	rec->discovered = discovered;
-	rec->i_attempts = 0;
+	i_attempts = 0;
     }
 
     /*
@@ -583,24 +1831,247 @@ void add_asset_csv (struct in_addr ip_addr,
      * to zero.
      */
     if (proto == IPPROTO_ICMP) {
-	rec->i_attempts = 0;
+	i_attempts = 0;
     }
 
-    /* Find this record's location within linked list.  */
-    if (asset_list == NULL) {
-	asset_list = rec;
-    } else {
-	list = asset_list;
-	while (list != NULL) {
-	    if (list->next == NULL) {
-		list->next = rec;
-		break;
-	    } else {
-		list = list->next;
-	    }
-	}
-    }
+    /* Index the record and append it to the asset list. */
+    insert_asset(rec, i_attempts);
+    if (i_attempts > 0)
+	pending_add(ip_addr, port, proto);
+    else
+	ebpf_identified(ip_addr, port, proto);
+    pthread_rwlock_unlock(&storage_lock);
 
     return;
 }
 
+
+/* ----------------------------------------------------------
+ * FUNCTION	: reserve_storage
+ * DESCRIPTION	: This function will size the empty asset and
+ *		: ARP indexes for a number of records, so that
+ *		: loading them does not resize the indexes.
+ * INPUT	: 0 - Number of assets
+ *		: 1 - Number of ARP entries
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+reserve_storage (unsigned long assets, unsigned long arp_entries)
+{
+    pthread_rwlock_wrlock(&storage_lock);
+    index_reserve(&asset_index, assets);
+    index_reserve(&arp_index, arp_entries);
+    pthread_rwlock_unlock(&storage_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: restore_asset
+ * DESCRIPTION	: This function will add an asset that was
+ *		: saved by an earlier run, with all of its
+ *		: state.  The record takes over the hex payload
+ *		: of the copy.
+ * INPUT	: 0 - Copy of the Asset
+ * RETURN	: 0 - Success
+ *		: -1 - Already stored (the payload is freed)
+ * ---------------------------------------------------------- */
+int
+restore_asset (Asset *copy)
+{
+    AssetRecord *rec;
+    unsigned short i_attempts;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if (find_asset(copy->ip_addr, copy->port, copy->proto) != NULL) {
+	pthread_rwlock_unlock(&storage_lock);
+	free_asset_copy(copy);
+	return -1;
+    }
+
+    rec = asset_alloc();
+    rec->ip_addr = copy->ip_addr;
+    rec->c_ip_addr = copy->c_ip_addr;
+    rec->port = copy->port;
+    rec->c_port = copy->c_port;
+    rec->proto = copy->proto;
+    rec->service = copy->service;
+    rec->application = copy->application;
+    rec->hex_payload = copy->hex_payload;
+    rec->discovered = copy->discovered;
+    i_attempts = (rec->proto == IPPROTO_ICMP) ? 0 : copy->i_attempts;
+
+    insert_asset(rec, i_attempts);
+    if (i_attempts > 0)
+	pending_add(rec->ip_addr, rec->port, rec->proto);
+    else
+	ebpf_identified(rec->ip_addr, rec->port, rec->proto);
+    pthread_rwlock_unlock(&storage_lock);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: restore_arp_asset
+ * DESCRIPTION	: This function will add an ARP entry that was
+ *		: saved by an earlier run.  See restore_asset.
+ * INPUT	: 0 - Copy of the ArpAsset
+ * RETURN	: 0 - Success
+ *		: -1 - Already stored
+ * ---------------------------------------------------------- */
+int
+restore_arp_asset (ArpAsset *copy)
+{
+    ArpAsset *rec;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if (find_arp_asset(copy->ip_addr, copy->mac_addr) != NULL) {
+	pthread_rwlock_unlock(&storage_lock);
+	return -1;
+    }
+
+    rec = (ArpAsset *) slab_alloc(&arp_slab);
+    *rec = *copy;
+    insert_arp_asset(rec);
+    pthread_rwlock_unlock(&storage_lock);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: replay_asset
+ * DESCRIPTION	: This function will apply a logged change to
+ *		: an asset:  a new asset is restored, a stored
+ *		: one takes over the service, application and
+ *		: identification attempts of the copy.  The
+ *		: copy's hex payload is taken over or freed.
+ * INPUT	: 0 - Copy of the Asset
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+replay_asset (Asset *copy)
+{
+    AssetSlot *slot;
+    AssetRecord *rec;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(copy->ip_addr, copy->port, copy->proto)) == NULL) {
+	pthread_rwlock_unlock(&storage_lock);
+	restore_asset(copy);
+	return;
+    }
+
+    rec = asset_rec(slot->id);
+    rec->service = copy->service;
+    rec->application = copy->application;
+
+    if (rec->proto != IPPROTO_ICMP) {
+	if (slot->i_attempts > 0 && copy->i_attempts == 0)
+	    pending_del(rec->ip_addr, rec->port, rec->proto);
+	else if (slot->i_attempts == 0 && copy->i_attempts > 0)
+	    pending_add(rec->ip_addr, rec->port, rec->proto);
+	slot->i_attempts = copy->i_attempts;
+    }
+    pthread_rwlock_unlock(&storage_lock);
+
+    free_asset_copy(copy);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: forget_asset
+ * DESCRIPTION	: This function will drop an asset that a
+ *		: logged change says has expired.  Nothing is
+ *		: printed.  It is only used before the first
+ *		: packet, while no record is on the wheel.
+ * INPUT	: 0 - IP Address
+ *		: 1 - Port
+ *		: 2 - Proto
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+forget_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto)
+{
+    AssetSlot *slot;
+    AssetRecord *rec;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((slot = find_asset(ip_addr, port, proto)) != NULL) {
+	rec = asset_rec(slot->id);
+	unlink_asset(rec);
+	if (rec->hex_payload != NULL)
+	    bdestroy(rec->hex_payload);
+	asset_release(rec);
+    }
+    pthread_rwlock_unlock(&storage_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: forget_arp_asset
+ * DESCRIPTION	: This function will drop an ARP entry that a
+ *		: logged change says has expired.  See
+ *		: forget_asset.
+ * INPUT	: 0 - IP Address
+ *		: 1 - MAC Address
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+forget_arp_asset (struct in_addr ip_addr, const char mac_addr[MAC_LEN])
+{
+    ArpAsset *rec;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    if ((rec = find_arp_asset(ip_addr, mac_addr)) != NULL) {
+	unlink_arp_asset(rec);
+	ip6_release(rec->ip_addr);
+	slab_free(&arp_slab, rec);
+    }
+    pthread_rwlock_unlock(&storage_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: sync_ebpf_map
+ * DESCRIPTION	: This function will add the identified assets
+ *		: to the eBPF endpoint map.  The map is created
+ *		: after the assets of the last run have been
+ *		: restored, so they would otherwise be missing.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+sync_ebpf_map (void)
+{
+    AssetRecord *rec;
+
+    pthread_rwlock_wrlock(&storage_lock);
+    for (rec = asset_list; rec != NULL; rec = rec->next) {
+	if (asset_slot(rec)->i_attempts == 0)
+	    ebpf_identified(rec->ip_addr, rec->port, rec->proto);
+    }
+    pthread_rwlock_unlock(&storage_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: lock_storage
+ * DESCRIPTION	: This function will hold the storage lock for
+ *		: reading, so that the asset and ARP lists can
+ *		: be walked (get_asset_pointer()) while the
+ *		: records are in use elsewhere.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+lock_storage (void)
+{
+    pthread_rwlock_rdlock(&storage_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: unlock_storage
+ * DESCRIPTION	: This function will release the lock taken by
+ *		: lock_storage().
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+unlock_storage (void)
+{
+    pthread_rwlock_unlock(&storage_lock);
+}
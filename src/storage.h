@@ -26,6 +26,9 @@
  *
  **************************************************************************/
 
+#ifndef INCLUDED_STORAGE_H
+#define INCLUDED_STORAGE_H
+
 /* INCLUDES ---------------------------------------- */
 #include <unistd.h>
 #include <stdio.h>
@@ -47,21 +50,147 @@
 #ifndef _BSD_SOURCE
 #define _BSD_SOURCE
 #endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#define ASSET_INDEX_MIN 1024        /* Initial size of the asset index. */
+#define ASSET_MIGRATE_STEP 64       /* Slots migrated per insert while resizing. */
+#define ASSET_CHUNK 4096            /* Records per chunk of the asset store. */
+#define ASSET_CACHE_LINE 64         /* The asset index is aligned to this. */
+#define ASSET_NONE 0                /* ID of an empty slot. */
+#define ASSET_DELETED 0xffffffffU   /* ID of a slot whose asset was removed. */
+#define ARP_INDEX_MIN 256           /* Initial size of the ARP index. */
+#define SLOT_DELETED ((void *) 1)   /* Slot of a record that was removed. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * AssetSlot:  A single slot within the asset index.  Besides the key, the
+ * slot holds the part of the asset that changes while packets are seen, so
+ * that finding a known asset and noting that it was seen touch one cache
+ * line (four slots).  The rest of the asset is in the asset store, under
+ * the slot's ID.
+ * -------------------------------------------------------------------------- */
+typedef struct _AssetSlot
+{
+    u_int32_t ip;               /* Asset IP Address */
+    u_int16_t port;             /* Asset Port */
+    u_int8_t proto;             /* Asset Protocol */
+    u_int8_t i_attempts;        /* Attempts at identifying the asset. */
+    u_int32_t id;               /* Asset Record (ASSET_NONE = empty) */
+    u_int32_t last_seen;        /* Time at which asset was last seen. */
+} AssetSlot;
+
+/* --------------------------------------------------------------------------
+ * AssetRecord:  The part of a stored asset that is only needed once it has
+ * been found.  Records live in chunks of the asset store that are never
+ * moved, so the ID of a record (and a pointer to it) stays valid until the
+ * asset is removed.
+ * -------------------------------------------------------------------------- */
+typedef struct _AssetRecord
+{
+    struct in_addr ip_addr;     /* Asset IP Address */
+    struct in_addr c_ip_addr;   /* Clients IP Address */
+    u_int16_t port;             /* Asset Port */
+    u_int16_t c_port;           /* Clients Port */
+    unsigned short proto;       /* Asset Protocol */
+    u_int32_t id;               /* ID of the record */
+    StrId service;              /* Asset Service (i.e. SSH, WWW, etc.) */
+    StrId application;          /* Asset Application (i.e. Apache, etc.) */
+    bstring hex_payload;        /* Hex data for detected banner */
+    time_t discovered;          /* Time at which asset was first seen. */
+    WheelEntry timer;           /* Expiry (asset aging) */
+    struct _AssetRecord *prev;  /* Previous Asset Record */
+    struct _AssetRecord *next;  /* Next Asset Record (or next free one) */
+} AssetRecord;
+
+/* --------------------------------------------------------------------------
+ * SlotTable:  Open-addressing (linear probing) hash table.  The slots are
+ * AssetSlots or ArpSlots.
+ * -------------------------------------------------------------------------- */
+typedef struct _SlotTable
+{
+    void *slots;                /* Slot Array */
+    u_int32_t mask;             /* Number of slots - 1 */
+    u_int32_t used;             /* Number of occupied slots (deleted included) */
+    u_int32_t deleted;          /* Number of deleted slots */
+} SlotTable;
+
+/* --------------------------------------------------------------------------
+ * SlotIndex:  A hash table that grows a few slots at a time.  When it is
+ * resized, the old table is kept until all of its records have been moved
+ * over, and lookups search both.  The asset and ARP indexes share the
+ * resizing and differ in their slots.
+ * -------------------------------------------------------------------------- */
+typedef struct _SlotIndex
+{
+    SlotTable cur;              /* Current table */
+    SlotTable old;              /* Table being migrated (slots NULL = none) */
+    u_int32_t migrate_pos;      /* Next slot of 'old' to migrate */
+    u_int32_t min_size;         /* Initial number of slots */
+    size_t slot_size;           /* Size of a slot */
+    const char *name;           /* Name used in error messages */
+    int (*live) (const void *slot);                     /* Slot holds a record */
+    void *(*put) (SlotTable *table, const void *slot);  /* Copy a slot in */
+} SlotIndex;
+
+/* --------------------------------------------------------------------------
+ * ArpSlot:  A single slot within the ARP index.
+ * -------------------------------------------------------------------------- */
+typedef struct _ArpSlot
+{
+    u_int32_t ip;               /* Asset IP Address */
+    char mac_addr[MAC_LEN];     /* Asset MAC Address */
+    ArpAsset *rec;              /* ARP Record (NULL = empty) */
+} ArpSlot;
+
+/* --------------------------------------------------------------------------
+ * StorageStats:  Asset storage counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _StorageStats
+{
+    unsigned long assets;       /* Assets currently stored. */
+    unsigned long expired;      /* Assets dropped after their time to live. */
+    unsigned long evicted;      /* Assets dropped to stay under asset_max. */
+    unsigned long arp_entries;  /* ARP entries currently stored. */
+    unsigned long arp_expired;  /* ARP entries dropped after their time to live. */
+    unsigned long arp_evicted;  /* ARP entries dropped to stay under arp_max. */
+} StorageStats;
 
 
 /* PROTOTYPES -------------------------------------- */
+void init_storage (void);
+void storage_tick (time_t now);
 int check_tcp_asset (struct in_addr ip_addr, u_int16_t port);
+int check_udp_asset (struct in_addr ip_addr, u_int16_t port);
 int check_icmp_asset (struct in_addr ip_addr);
 int check_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN]);
-void add_asset (struct in_addr ip_addr, struct in_addr c_ip_addr, u_int16_t port, u_int16_t c_port, unsigned short proto, bstring service, bstring application, time_t discovered);
-void add_asset_csv (struct in_addr ip_addr, u_int16_t port, unsigned short proto, bstring service, bstring application, time_t discovered);
+void add_asset (struct in_addr ip_addr, struct in_addr c_ip_addr, u_int16_t port, u_int16_t c_port, unsigned short proto, StrId service, StrId application, time_t discovered);
+void add_asset_csv (struct in_addr ip_addr, u_int16_t port, unsigned short proto, StrId service, StrId application, time_t discovered);
 void add_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN], time_t discovered);
+int upsert_arp_asset (struct in_addr ip_addr, char mac_addr[MAC_LEN], time_t discovered, ArpAsset *copy);
 unsigned short get_i_attempts (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+unsigned short take_i_attempt (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
 short update_i_attempts (struct in_addr ip_addr, u_int16_t port, unsigned short proto, unsigned short i_attempts);
 short add_hex_payload (struct in_addr ip_addr, u_int16_t port, unsigned short proto, char *hex_payload);
-short update_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto, bstring service, bstring application);
-inline Asset *find_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
-Asset *get_asset_pointer (void);
+short update_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto, StrId service, StrId application);
+AssetSlot *find_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+int copy_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto, Asset *copy);
+void peek_asset (AssetRecord *rec, Asset *copy);
+void free_asset_copy (Asset *copy);
+StorageStats *get_storage_stats (void);
+void reserve_storage (unsigned long assets, unsigned long arp_entries);
+int restore_asset (Asset *copy);
+int restore_arp_asset (ArpAsset *copy);
+void replay_asset (Asset *copy);
+void forget_asset (struct in_addr ip_addr, u_int16_t port, unsigned short proto);
+void forget_arp_asset (struct in_addr ip_addr, const char mac_addr[MAC_LEN]);
+void sync_ebpf_map (void);
+void lock_storage (void);
+void unlock_storage (void);
+AssetRecord *get_asset_pointer (void);
 ArpAsset *get_arp_pointer (void);
 void end_storage (void);
 
@@ -71,3 +200,5 @@ void print_database ();
 
 
 /* GLOBALS ----------------------------------------- */
+
+#endif /* INCLUDED_STORAGE_H */
@@ -0,0 +1,411 @@
+/*************************************************************************
+ * strpool.c
+ *
+ * This module keeps a single copy of the strings that assets share:  the
+ * service and application names and the MAC vendors.  Most assets are
+ * "unknown", "ssh" or "www", so each record holds a 4 byte ID into the pool
+ * instead of strings of its own, and two names are the same exactly when
+ * their IDs are.
+ *
+ * A string never changes or goes away once it has been interned, and the
+ * strings are stored in fixed size chunks that are never moved, so an ID
+ * can be resolved without taking the lock.  Interning takes the lock;  it
+ * is done once per identification, not per packet.
+ *
+ * Names built from what a signature captured (versions, mostly) are not
+ * bounded by the signature file.  When asset_max is set, they may take up
+ * STRPOOL_ASSET_BYTES for each asset;  beyond that they are refused.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "strpool.h"
+#include "util.h"
+
+/* Variable Declarations */
+struct tagbstring **str_store;          /* String chunks, by ID */
+u_int32_t *str_index;                   /* Hash index of IDs (0 = empty) */
+u_int32_t str_mask;                     /* Number of index slots - 1 */
+u_int32_t str_used;                     /* IDs handed out (STR_NONE included) */
+StrBlock *str_blocks;                   /* String data, newest block first */
+StrPoolStats str_stats;
+pthread_rwlock_t str_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_hash
+ * DESCRIPTION	: This function will hash a string (FNV-1a).
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ * RETURN	: Hash Value
+ * ---------------------------------------------------------- */
+static inline u_int32_t
+str_hash (const u_char *data, int len)
+{
+    u_int32_t h = 2166136261U;
+    int i;
+
+    for (i = 0; i < len; i++) {
+	h ^= data[i];
+	h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_slot
+ * DESCRIPTION	: This function will return the string stored
+ *		: under an ID.
+ * INPUT	: 0 - ID
+ * RETURN	: Pointer to String
+ * ---------------------------------------------------------- */
+static inline struct tagbstring *
+str_slot (u_int32_t id)
+{
+    return &str_store[id / STRPOOL_CHUNK][id % STRPOOL_CHUNK];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_find
+ * DESCRIPTION	: This function will look a string up in the
+ *		: index.  The caller holds the lock.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ *		: 2 - Hash Value
+ * RETURN	: ID (STR_NONE = not found)
+ * ---------------------------------------------------------- */
+static u_int32_t
+str_find (const void *data, int len, u_int32_t hash)
+{
+    struct tagbstring *str;
+    u_int32_t i;
+
+    if (str_index == NULL)
+	return STR_NONE;
+
+    for (i = hash & str_mask; str_index[i] != 0; i = (i + 1) & str_mask) {
+	str = str_slot(str_index[i]);
+	if (str->slen == len && memcmp(str->data, data, len) == 0)
+	    return str_index[i];
+    }
+
+    return STR_NONE;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_grow
+ * DESCRIPTION	: This function will double the size of the
+ *		: index (or create it).  The caller holds the
+ *		: lock for writing.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+str_grow (void)
+{
+    struct tagbstring *str;
+    u_int32_t size, id, i;
+
+    size = (str_index == NULL) ? STRPOOL_INDEX_MIN : (str_mask + 1) * 2;
+    free(str_index);
+    if ((str_index = (u_int32_t *) calloc(size, sizeof(u_int32_t))) == NULL)
+	err_message("Unable to allocate string index (%u slots)", size);
+    str_mask = size - 1;
+
+    /* Every string is in the store, so the index is simply rebuilt. */
+    for (id = STR_NONE + 1; id < str_used; id++) {
+	str = str_slot(id);
+	for (i = str_hash(str->data, str->slen) & str_mask; str_index[i] != 0; i = (i + 1) & str_mask)
+	    ;
+	str_index[i] = id;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_copy
+ * DESCRIPTION	: This function will copy string data and a NUL
+ *		: byte into the current block, starting a new
+ *		: block when it is full.  The caller holds the
+ *		: lock for writing.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ * RETURN	: Pointer to the copy
+ * ---------------------------------------------------------- */
+static u_char *
+str_copy (const void *data, int len)
+{
+    StrBlock *block = str_blocks;
+    size_t size;
+    u_char *copy;
+
+    if (block == NULL || block->size - block->used < (size_t) len + 1) {
+	size = ((size_t) len + 1 > STRPOOL_BLOCK) ? (size_t) len + 1 : STRPOOL_BLOCK;
+	if ((block = (StrBlock *) malloc(sizeof(StrBlock) + size)) == NULL)
+	    err_message("Unable to allocate string pool");
+	block->next = str_blocks;
+	block->used = 0;
+	block->size = size;
+	str_blocks = block;
+    }
+
+    copy = (u_char *) (block + 1) + block->used;
+    memcpy(copy, data, len);
+    copy[len] = '\0';
+    block->used += len + 1;
+
+    return copy;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_insert
+ * DESCRIPTION	: This function will add a string to the pool.
+ *		: The caller holds the lock for writing and has
+ *		: made sure that the string is not there yet.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ *		: 2 - Hash Value
+ * RETURN	: ID (STR_NONE = the pool is full)
+ * ---------------------------------------------------------- */
+static u_int32_t
+str_insert (const void *data, int len, u_int32_t hash)
+{
+    struct tagbstring *str;
+    u_int32_t id, i;
+
+    if (str_used == STRPOOL_MAX) {
+	str_stats.full++;
+	return STR_NONE;
+    }
+
+    if (str_store == NULL
+	    && (str_store = (struct tagbstring **) calloc(STRPOOL_MAX / STRPOOL_CHUNK,
+		    sizeof(struct tagbstring *))) == NULL)
+	err_message("Unable to allocate string pool");
+    if (str_used % STRPOOL_CHUNK == 0
+	    && (str_store[str_used / STRPOOL_CHUNK] = (struct tagbstring *) calloc(STRPOOL_CHUNK,
+		    sizeof(struct tagbstring))) == NULL)
+	err_message("Unable to allocate string pool");
+
+    /* STR_NONE has a slot, but no string. */
+    if (str_used == STR_NONE)
+	str_used++;
+
+    /* Grow the index once it is 3/4 full. */
+    if (str_index == NULL || (str_used + 1) * 4 > (str_mask + 1) * 3)
+	str_grow();
+
+    /* Strings in the pool are read-only (mlen < 0). */
+    id = str_used;
+    str = str_slot(id);
+    str->data = str_copy(data, len);
+    str->slen = len;
+    str->mlen = -1;
+
+    for (i = hash & str_mask; str_index[i] != 0; i = (i + 1) & str_mask)
+	;
+    str_index[i] = id;
+    __atomic_store_n(&str_used, id + 1, __ATOMIC_RELEASE);
+    str_stats.strings++;
+    str_stats.bytes += len + 1;
+
+    return id;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_strpool
+ * DESCRIPTION	: This function will set up the string pool
+ *		: with the strings that have fixed IDs.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_strpool (void)
+{
+    if (str_used != STR_NONE)
+	return;
+
+    pthread_rwlock_wrlock(&str_lock);
+    str_insert("unknown", 7, str_hash((const u_char *) "unknown", 7));
+    str_insert("ICMP", 4, str_hash((const u_char *) "ICMP", 4));
+    pthread_rwlock_unlock(&str_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_add
+ * DESCRIPTION	: This function will find the ID of a string,
+ *		: interning the string if it is new and fits
+ *		: within a number of bytes.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ *		: 2 - Bytes new captured strings may take up
+ *		:     (0 = the string is not captured)
+ * RETURN	: ID (STR_NONE = the pool is full)
+ * ---------------------------------------------------------- */
+static StrId
+str_add (const void *data, int len, u_int64_t limit)
+{
+    u_int32_t hash, id;
+
+    hash = str_hash((const u_char *) data, len);
+
+    pthread_rwlock_rdlock(&str_lock);
+    id = str_find(data, len, hash);
+    pthread_rwlock_unlock(&str_lock);
+    if (id != STR_NONE)
+	return id;
+
+    pthread_rwlock_wrlock(&str_lock);
+
+    /* Someone else may have been quicker. */
+    if ((id = str_find(data, len, hash)) != STR_NONE) {
+	pthread_rwlock_unlock(&str_lock);
+	return id;
+    }
+
+    if (limit > 0 && str_stats.captured + len + 1 > limit) {
+	str_stats.full++;
+	id = STR_NONE;
+    } else if ((id = str_insert(data, len, hash)) != STR_NONE && limit > 0) {
+	str_stats.captured += len + 1;
+    }
+
+    pthread_rwlock_unlock(&str_lock);
+    return id;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_intern_blk
+ * DESCRIPTION	: This function will find the ID of a string,
+ *		: interning the string if it is new.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ * RETURN	: ID (STR_NONE = the pool is full)
+ * ---------------------------------------------------------- */
+StrId
+str_intern_blk (const void *data, int len)
+{
+    return str_add(data, len, 0);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_intern_captured
+ * DESCRIPTION	: This function will find the ID of a string
+ *		: built from a packet, interning the string if
+ *		: it is new and the captured strings have not
+ *		: used up their share of asset_max.
+ * INPUT	: 0 - Data
+ *		: 1 - Length
+ * RETURN	: ID (STR_NONE = the pool is full)
+ * ---------------------------------------------------------- */
+StrId
+str_intern_captured (const void *data, int len)
+{
+    return str_add(data, len, (u_int64_t) gc.asset_max * STRPOOL_ASSET_BYTES);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_intern
+ * DESCRIPTION	: This function will find the ID of a bstring,
+ *		: interning the string if it is new.
+ * INPUT	: 0 - String (may be NULL)
+ * RETURN	: ID (STR_NONE for NULL)
+ * ---------------------------------------------------------- */
+StrId
+str_intern (bstring str)
+{
+    if (str == NULL || str->data == NULL || str->slen < 0)
+	return STR_NONE;
+
+    return str_intern_blk(str->data, str->slen);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_get
+ * DESCRIPTION	: This function will return the string that an
+ *		: ID stands for.  The string belongs to the
+ *		: pool and must not be changed or freed.
+ * INPUT	: 0 - ID
+ * RETURN	: String (NULL for STR_NONE or an unknown ID)
+ * ---------------------------------------------------------- */
+bstring
+str_get (StrId id)
+{
+    if (id == STR_NONE || id >= __atomic_load_n(&str_used, __ATOMIC_ACQUIRE))
+	return NULL;
+
+    return str_slot(id);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: str_count
+ * DESCRIPTION	: This function will return the number of IDs
+ *		: handed out so far.  Every ID in use is below
+ *		: it.
+ * INPUT	: None!
+ * RETURN	: Number of IDs
+ * ---------------------------------------------------------- */
+u_int32_t
+str_count (void)
+{
+    return __atomic_load_n(&str_used, __ATOMIC_ACQUIRE);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_strpool_stats
+ * DESCRIPTION	: This function will return the string pool
+ *		: counters.
+ * INPUT	: None!
+ * RETURN	: Pointer to StrPoolStats
+ * ---------------------------------------------------------- */
+StrPoolStats *
+get_strpool_stats (void)
+{
+    return &str_stats;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_strpool
+ * DESCRIPTION	: This function will free the string pool.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_strpool (void)
+{
+    StrBlock *block;
+    u_int32_t i;
+
+    if (str_store != NULL) {
+	for (i = 0; i < STRPOOL_MAX / STRPOOL_CHUNK && str_store[i] != NULL; i++)
+	    free(str_store[i]);
+	free(str_store);
+	str_store = NULL;
+    }
+    while ((block = str_blocks) != NULL) {
+	str_blocks = block->next;
+	free(block);
+    }
+    free(str_index);
+    str_index = NULL;
+    str_used = STR_NONE;
+}
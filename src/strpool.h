@@ -0,0 +1,73 @@
+/*************************************************************************
+ * strpool.h
+ *
+ * This header file contains information relating to the strpool.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_STRPOOL_H
+#define INCLUDED_STRPOOL_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define STRPOOL_CHUNK 4096          /* Strings per chunk of the store */
+#define STRPOOL_MAX 0x01000000      /* Strings stored at most */
+#define STRPOOL_BLOCK 65536         /* Bytes per block of string data */
+#define STRPOOL_INDEX_MIN 1024      /* Initial size of the string index */
+#define STRPOOL_ASSET_BYTES 64      /* Bytes of captured names per asset (asset_max) */
+
+/* Strings every run has, under fixed IDs. */
+#define STR_NONE 0                  /* No string (NULL) */
+#define STR_UNKNOWN 1               /* "unknown" */
+#define STR_ICMP 2                  /* "ICMP" */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * StrBlock:  A block of string data.  The bytes follow the structure.
+ * -------------------------------------------------------------------------- */
+typedef struct _StrBlock
+{
+    struct _StrBlock *next;     /* Previous block */
+    size_t used;                /* Bytes handed out */
+    size_t size;                /* Bytes in the block */
+} StrBlock;
+
+/* --------------------------------------------------------------------------
+ * StrPoolStats:  String pool counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _StrPoolStats
+{
+    unsigned long strings;      /* Strings interned. */
+    unsigned long bytes;        /* Bytes of string data. */
+    unsigned long captured;     /* Bytes of it taken from packets. */
+    unsigned long full;         /* Strings refused because the pool was full. */
+} StrPoolStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_strpool (void);
+StrId str_intern_blk (const void *data, int len);
+StrId str_intern_captured (const void *data, int len);
+StrId str_intern (bstring str);
+bstring str_get (StrId id);
+u_int32_t str_count (void);
+StrPoolStats *get_strpool_stats (void);
+void end_strpool (void);
+
+#endif /* INCLUDED_STRPOOL_H */
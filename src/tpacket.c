@@ -0,0 +1,499 @@
+/*************************************************************************
+ * tpacket.c
+ *
+ * This module is a native Linux capture backend built on an AF_PACKET
+ * socket with a TPACKET_V3 receive ring.  The kernel fills large blocks
+ * of packets in memory that is shared with us;  we walk each block in
+ * place, hand the packets to the decoders and give the block back.
+ * There is no copy and no system call per packet, and the size of the
+ * ring is under our control instead of libpcap's.
+ *
+ * The kernel ring already decouples capture from analysis, so packets
+ * are processed straight out of the blocks.  The capture snaplen is
+ * enforced by the socket filter, which is built with libpcap just like
+ * the filter used with the libpcap backend.
+ *
+ * To spread the work over several cores, one socket is opened per worker
+ * and the sockets are joined into a PACKET_FANOUT_HASH group.  The kernel
+ * picks the socket from a symmetric hash of the flow, so both directions
+ * of a connection always reach the same worker.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_TPACKET_V3
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/ethernet.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#endif /* HAVE_TPACKET_V3 */
+
+#include "tpacket.h"
+#include "batch.h"
+#include "util.h"
+
+#ifdef HAVE_TPACKET_V3
+
+/* --------------------------------------------------------------------------
+ * TpacketSocket:  One AF_PACKET socket and its ring.
+ * -------------------------------------------------------------------------- */
+typedef struct _TpacketSocket
+{
+    int fd;                     /* AF_PACKET Socket */
+    u_char *map;                /* Mapped Ring */
+    unsigned int cur;           /* Next block to be processed */
+    TpacketStats stats;
+} TpacketSocket;
+
+/* Variable Declarations */
+TpacketSocket *tp_socks;        /* One socket per worker */
+int tp_count;                   /* Number of sockets */
+struct tpacket_req3 tp_req;     /* Ring Layout (same for every socket) */
+int tp_snaplen;                 /* Bytes kept per packet */
+int tp_timeout;                 /* Block retire timeout (ms) */
+int tp_break;                   /* Set to leave tpacket_loop() */
+struct bpf_program *tp_filter;  /* Filter run in userspace (eBPF only) */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_read_stats
+ * DESCRIPTION	: This function will add the kernel's ring
+ *		: counters (which reset when read) to ours.
+ * INPUT	: 0 - Socket
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+tpacket_read_stats (TpacketSocket *sock)
+{
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if (sock->fd < 0)
+	return;
+
+    if (getsockopt(sock->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+	sock->stats.packets += st.tp_packets;
+	sock->stats.drops += st.tp_drops;
+	sock->stats.freezes += st.tp_freeze_q_cnt;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_attach
+ * DESCRIPTION	: This function will attach a compiled filter
+ *		: to a socket.
+ * INPUT	: 0 - Socket
+ *		: 1 - Compiled Filter
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+tpacket_attach (int fd, struct bpf_program *filter)
+{
+    struct sock_fprog fprog;
+
+    fprog.len = filter->bf_len;
+    fprog.filter = (struct sock_filter *)filter->bf_insns;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0) {
+	log_message("WARNING:  tpacket:  SO_ATTACH_FILTER (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_open
+ * DESCRIPTION	: This function will open one AF_PACKET socket
+ *		: on an interface, map its ring and join the
+ *		: fanout group (if any).
+ * INPUT	: 0 - Socket
+ *		: 1 - Interface
+ *		: 2 - Interface Index
+ *		: 3 - Fanout Group (-1 = none)
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+tpacket_open (TpacketSocket *sock, const char *dev, int ifindex, int group)
+{
+    struct sockaddr_ll sll;
+    struct packet_mreq mreq;
+    struct ifreq ifr;
+    struct bpf_program prog;
+    pcap_t *dead;
+    int version = TPACKET_V3;
+    int fanout;
+
+    if ((sock->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL))) < 0) {
+	log_message("WARNING:  tpacket:  socket (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    /* Packets are handed to the decoders as Ethernet frames. */
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    if (ioctl(sock->fd, SIOCGIFHWADDR, &ifr) < 0
+	    || (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER
+		&& ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK)) {
+	log_message("WARNING:  tpacket:  %s is not an Ethernet interface\n", dev);
+	return -1;
+    }
+
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+	log_message("WARNING:  tpacket:  TPACKET_V3 not supported (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    /* Enforce the snaplen before the ring is filled. */
+    if ((dead = pcap_open_dead(DLT_EN10MB, tp_snaplen)) == NULL
+	    || pcap_compile(dead, &prog, "", 1, 0) == -1) {
+	log_message("WARNING:  tpacket:  unable to build socket filter\n");
+	return -1;
+    }
+    pcap_close(dead);
+    if (tpacket_attach(sock->fd, &prog) == -1) {
+	pcap_freecode(&prog);
+	return -1;
+    }
+    pcap_freecode(&prog);
+
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_RX_RING, &tp_req, sizeof(tp_req)) < 0) {
+	log_message("WARNING:  tpacket:  PACKET_RX_RING (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    sock->map = mmap(NULL, (size_t)tp_req.tp_block_size * tp_req.tp_block_nr,
+		     PROT_READ | PROT_WRITE, MAP_SHARED, sock->fd, 0);
+    if (sock->map == MAP_FAILED) {
+	sock->map = NULL;
+	log_message("WARNING:  tpacket:  mmap (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(sock->fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+	log_message("WARNING:  tpacket:  bind to %s (%s)\n", dev, strerror(errno));
+	return -1;
+    }
+
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(sock->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+	log_message("WARNING:  tpacket:  unable to enable promiscuous mode (%s)\n", strerror(errno));
+
+    /* Split the traffic by flow.  Fragments are reassembled first, so
+     * that they hash like the rest of their flow. */
+    if (group >= 0) {
+	fanout = group | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+	if (setsockopt(sock->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+	    log_message("WARNING:  tpacket:  PACKET_FANOUT (%s)\n", strerror(errno));
+	    return -1;
+	}
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_tpacket
+ * DESCRIPTION	: This function will open AF_PACKET sockets on
+ *		: an interface and map a TPACKET_V3 ring for
+ *		: each.  More than one socket are joined into
+ *		: a fanout group.  On failure the caller is
+ *		: expected to fall back to libpcap.
+ * INPUT	: 0 - Interface
+ *		: 1 - Number of sockets
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+init_tpacket (const char *dev, int count)
+{
+    unsigned int block, frame;
+    int ifindex, i;
+
+    if ((ifindex = if_nametoindex(dev)) == 0) {
+	log_message("WARNING:  tpacket:  unknown interface %s\n", dev);
+	return -1;
+    }
+
+    /* Block size:  a power of two, at least one page. */
+    for (block = getpagesize();
+	 block < ((gc.tpacket_block_size > 0) ? gc.tpacket_block_size : TPACKET_BLOCK_SIZE);
+	 block <<= 1);
+    tp_snaplen = (gc.tpacket_snaplen > 0) ? gc.tpacket_snaplen : TPACKET_SNAPLEN;
+    tp_timeout = (gc.tpacket_timeout > 0) ? gc.tpacket_timeout : TPACKET_TIMEOUT;
+
+    /* Frame size only matters to the kernel's sanity checks in V3. */
+    for (frame = TPACKET_ALIGNMENT; frame < TPACKET_ALIGN(TPACKET3_HDRLEN) + tp_snaplen; frame <<= 1);
+    if (frame > block)
+	block = frame;
+
+    memset(&tp_req, 0, sizeof(tp_req));
+    tp_req.tp_block_size = block;
+    tp_req.tp_block_nr = (gc.tpacket_block_count > 0) ? gc.tpacket_block_count : TPACKET_BLOCK_COUNT;
+    tp_req.tp_frame_size = frame;
+    tp_req.tp_frame_nr = (block / frame) * tp_req.tp_block_nr;
+    tp_req.tp_retire_blk_tov = tp_timeout;
+
+    if (count < 1)
+	count = 1;
+    if ((tp_socks = (TpacketSocket *) calloc(count, sizeof(TpacketSocket))) == NULL)
+	err_message("Unable to allocate tpacket sockets (%d)", count);
+    for (i = 0; i < count; i++)
+	tp_socks[i].fd = -1;
+    tp_count = count;
+
+    for (i = 0; i < count; i++) {
+	if (tpacket_open(&tp_socks[i], dev, ifindex,
+			 (count > 1) ? (getpid() & 0xffff) : -1) == -1) {
+	    end_tpacket();
+	    return -1;
+	}
+    }
+
+    verbose_message("tpacket:  %d x %u blocks of %u bytes, snaplen %d, %d ms timeout",
+		    count, tp_req.tp_block_nr, tp_req.tp_block_size, tp_snaplen, tp_timeout);
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_setfilter
+ * DESCRIPTION	: This function will attach a compiled filter
+ *		: to every socket.
+ * INPUT	: 0 - Compiled Filter
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+tpacket_setfilter (struct bpf_program *filter)
+{
+    int i;
+
+    for (i = 0; i < tp_count; i++)
+	if (tpacket_attach(tp_socks[i].fd, filter) == -1)
+	    return -1;
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_setebpf
+ * DESCRIPTION	: This function will attach an eBPF program to
+ *		: every socket.  It takes the place of the
+ *		: classic filter, so a user supplied filter is
+ *		: run on the packets it passes instead.
+ * INPUT	: 0 - eBPF Program
+ *		: 1 - Compiled User Filter (NULL = none)
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+tpacket_setebpf (int prog, struct bpf_program *filter)
+{
+    int i;
+
+    for (i = 0; i < tp_count; i++) {
+	if (setsockopt(tp_socks[i].fd, SOL_SOCKET, SO_ATTACH_BPF, &prog, sizeof(prog)) < 0) {
+	    log_message("WARNING:  tpacket:  SO_ATTACH_BPF (%s)\n", strerror(errno));
+	    return -1;
+	}
+    }
+
+    tp_filter = filter;
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_snaplen
+ * DESCRIPTION	: This function will return the snaplen.
+ * INPUT	: None!
+ * RETURN	: Snaplen
+ * ---------------------------------------------------------- */
+int
+tpacket_snaplen (void)
+{
+    return tp_snaplen;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_loop
+ * DESCRIPTION	: This function will process the packets of
+ *		: one socket until tpacket_breakloop() is
+ *		: called or the socket fails.  Each block is
+ *		: walked in place and returned to the kernel.
+ * INPUT	: 0 - Socket Number
+ *		: 1 - Packet Processor
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+tpacket_loop (int index, RingHandler handler)
+{
+    TpacketSocket *sock = &tp_socks[index];
+    struct tpacket_block_desc *block;
+    struct tpacket3_hdr *ppd;
+    struct pcap_pkthdr hdr;
+    struct pollfd pfd;
+    unsigned int i;
+
+    pfd.fd = sock->fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    while (!__atomic_load_n(&tp_break, __ATOMIC_RELAXED)) {
+	block = (struct tpacket_block_desc *)(sock->map + (size_t)sock->cur * tp_req.tp_block_size);
+
+	/* Wait for the kernel to hand us this block. */
+	if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+	    if (poll(&pfd, 1, tp_timeout) < 0 && errno != EINTR) {
+		log_message("WARNING:  tpacket:  poll (%s)\n", strerror(errno));
+		return;
+	    }
+	    continue;
+	}
+
+	ppd = (struct tpacket3_hdr *)((u_char *)block + block->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < block->hdr.bh1.num_pkts; i++) {
+	    hdr.ts.tv_sec = ppd->tp_sec;
+	    hdr.ts.tv_usec = ppd->tp_nsec / 1000;
+	    hdr.caplen = ppd->tp_snaplen;
+	    hdr.len = ppd->tp_len;
+
+	    if (tp_filter == NULL
+		    || pcap_offline_filter(tp_filter, &hdr, (u_char *)ppd + ppd->tp_mac))
+		(*handler)(&hdr, (u_char *)ppd + ppd->tp_mac);
+
+	    ppd = (struct tpacket3_hdr *)((u_char *)ppd + ppd->tp_next_offset);
+	}
+
+	/* Give the block back. */
+	batch_flush();
+	__atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	sock->stats.blocks++;
+	sock->cur = (sock->cur + 1) % tp_req.tp_block_nr;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: tpacket_breakloop
+ * DESCRIPTION	: This function will make every tpacket_loop()
+ *		: return once it is done with its current
+ *		: block.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+tpacket_breakloop (void)
+{
+    __atomic_store_n(&tp_break, 1, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_tpacket_stats
+ * DESCRIPTION	: This function will return the counters of
+ *		: one socket, or the sum over all sockets.
+ * INPUT	: 0 - Socket Number (-1 = all sockets)
+ * RETURN	: Pointer to TpacketStats
+ * ---------------------------------------------------------- */
+TpacketStats *
+get_tpacket_stats (int index)
+{
+    static TpacketStats total;
+    int i;
+
+    if (index >= 0) {
+	tpacket_read_stats(&tp_socks[index]);
+	return &tp_socks[index].stats;
+    }
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < tp_count; i++) {
+	tpacket_read_stats(&tp_socks[i]);
+	total.packets += tp_socks[i].stats.packets;
+	total.drops += tp_socks[i].stats.drops;
+	total.freezes += tp_socks[i].stats.freezes;
+	total.blocks += tp_socks[i].stats.blocks;
+    }
+
+    return &total;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_tpacket
+ * DESCRIPTION	: This function will unmap the rings and close
+ *		: the sockets.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_tpacket (void)
+{
+    int i;
+
+    for (i = 0; i < tp_count; i++) {
+	if (tp_socks[i].map != NULL)
+	    munmap(tp_socks[i].map, (size_t)tp_req.tp_block_size * tp_req.tp_block_nr);
+	if (tp_socks[i].fd >= 0)
+	    close(tp_socks[i].fd);
+    }
+
+    if (tp_socks != NULL)
+	free(tp_socks);
+    tp_socks = NULL;
+    tp_count = 0;
+}
+
+#else /* HAVE_TPACKET_V3 */
+
+TpacketStats tpacket_stats;
+
+int
+init_tpacket (const char *dev, int count)
+{
+    log_message("WARNING:  tpacket:  not supported on this system\n");
+    return -1;
+}
+
+int tpacket_setfilter (struct bpf_program *filter) { return -1; }
+int tpacket_setebpf (int prog, struct bpf_program *filter) { return -1; }
+int tpacket_snaplen (void) { return 0; }
+void tpacket_loop (int index, RingHandler handler) { }
+void tpacket_breakloop (void) { }
+TpacketStats *get_tpacket_stats (int index) { return &tpacket_stats; }
+void end_tpacket (void) { }
+
+#endif /* HAVE_TPACKET_V3 */
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
@@ -0,0 +1,59 @@
+/*************************************************************************
+ * tpacket.h
+ *
+ * This header file contains information relating to the tpacket.c
+ * module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_TPACKET_H
+#define INCLUDED_TPACKET_H
+
+#include "global.h"
+#include "ring.h"
+
+/* DEFINES ----------------------------------------- */
+#define TPACKET_BLOCK_SIZE (1 << 20)    /* Default bytes per block. */
+#define TPACKET_BLOCK_COUNT 64          /* Default number of blocks. */
+#define TPACKET_SNAPLEN 2048            /* Default bytes kept per packet. */
+#define TPACKET_TIMEOUT 64              /* Default block retire timeout (ms). */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * TpacketStats:  AF_PACKET ring counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _TpacketStats
+{
+    unsigned long packets;      /* Packets seen by the kernel. */
+    unsigned long drops;        /* Packets dropped because the ring was full. */
+    unsigned long freezes;      /* Times the ring filled up. */
+    unsigned long blocks;       /* Blocks processed. */
+} TpacketStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+int init_tpacket (const char *dev, int count);
+int tpacket_setfilter (struct bpf_program *filter);
+int tpacket_setebpf (int prog, struct bpf_program *filter);
+int tpacket_snaplen (void);
+void tpacket_loop (int index, RingHandler handler);
+void tpacket_breakloop (void);
+TpacketStats *get_tpacket_stats (int index);
+void end_tpacket (void);
+
+#endif /* INCLUDED_TPACKET_H */
@@ -29,6 +29,7 @@
 /* INCLUDES ---------------------------------------- */
 #include "global.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <sys/types.h>
@@ -41,6 +42,7 @@
 
 #include "util.h"
 #include "pads.h"
+#include "slab.h"
 
 /* ----------------------------------------------------------
  * FUNCTION     : strip_comment
@@ -486,6 +488,16 @@ hex2mac(unsigned const char *mac)
 /* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
  */
 
+/* ----------------------------------------------------------
+ * FUNCTION     : fasthex
+ * DESCRIPTION  : This function will convert a payload into a
+ *              : string of hex digits.  The string is taken
+ *              : from the calling thread's scratch arena and
+ *              : is valid until the arena is released.
+ * INPUT        : 0 - Payload
+ *              : 1 - Payload Length
+ * RETURN       : Hex String
+ * ---------------------------------------------------------- */
 char *fasthex(u_char *xdata, int length)
 {
     char conv[] = "0123456789ABCDEF";
@@ -496,7 +508,7 @@ char *fasthex(u_char *xdata, int length)
 
     index = xdata;
     end = xdata + length;
-    retbuf = (char *) calloc((length*2)+1, sizeof(char));
+    retbuf = (char *) arena_alloc((length*2)+1);
     ridx = retbuf;
 
     while(index < end)
@@ -505,7 +517,36 @@ char *fasthex(u_char *xdata, int length)
         *ridx++ = conv[((*index & 0xFF)&0x0F)];
         index++;
     }
+    *ridx = '\0';
 
     return retbuf;
 }
 
+
+/* ----------------------------------------------------------
+ * FUNCTION     : write_full
+ * DESCRIPTION  : This function will write a whole buffer to
+ *              : a file descriptor, retrying short writes.
+ * INPUT        : 0 - File Descriptor
+ *              : 1 - Buffer
+ *              : 2 - Size
+ * RETURN       : 0 - Success
+ *              : -1 - Error
+ * ---------------------------------------------------------- */
+int
+write_full (int fd, const char *buf, u_int64_t size)
+{
+    ssize_t n;
+
+    while (size > 0) {
+        if ((n = write(fd, buf, (size > 0x40000000) ? 0x40000000 : size)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += n;
+        size -= n;
+    }
+
+    return 0;
+}
@@ -46,5 +46,6 @@ void drop_privs (bstring newuser, bstring newgroup);
 void mac2hex(const char *mac, char *dst, int len);
 char *hex2mac(unsigned const char *mac);
 char *fasthex(u_char *, int);
+int write_full (int fd, const char *buf, u_int64_t size);
 
 /* GLOBALS ----------------------------------------- */
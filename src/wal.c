@@ -0,0 +1,800 @@
+/*************************************************************************
+ * wal.c
+ *
+ * This module keeps a write-ahead log of the changes to the assets and
+ * ARP entries made between two snapshots, so that a crash does not lose
+ * what was discovered since the last one.
+ *
+ * Changes are appended to a buffer in memory.  A thread of its own writes
+ * the buffer out and syncs the file every wal_sync milliseconds, so one
+ * fdatasync() covers all the changes of the interval.  Every snapshot
+ * starts a new log file (a "generation") and records its number;  once
+ * the snapshot is on disk, the older files are deleted.  When the log
+ * grows past wal_max megabytes, a snapshot is taken early.  On startup,
+ * the files from the snapshot's generation on are replayed over it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ip6.h"
+#include "snapshot.h"
+#include "storage.h"
+#include "strpool.h"
+#include "util.h"
+#include "wal.h"
+
+#define WAL_BUFFER 65536            /* Initial size of the log buffer. */
+
+/*
+ * Log Buffer:  Records are appended under 'wal_lock' by the thread that
+ * changes the record (it holds the storage lock for writing).  The sync
+ * thread swaps the buffer for the spare one, writes it out and syncs the
+ * file while holding 'wal_io_lock'.
+ */
+char *wal_buf;
+char *wal_spare;
+size_t wal_used;
+size_t wal_size;
+size_t wal_spare_size;
+pthread_mutex_t wal_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t wal_io_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wal_cond = PTHREAD_COND_INITIALIZER;
+pthread_t wal_thread;
+int wal_running;
+int wal_closing;
+int wal_failed;                 /* A write failed (reported once). */
+int wal_fd = -1;
+
+/* Log Files:  <wal_file>.<generation> */
+u_int64_t wal_generation;       /* Generation being written */
+u_int64_t wal_oldest;           /* Oldest generation still on disk */
+u_int64_t wal_bytes;            /* Bytes logged to this generation */
+int wal_full;                   /* Early snapshot asked for - 0 = No, 1 = Yes */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_name
+ * DESCRIPTION	: This function will return the name of the
+ *		: file of a generation.
+ * INPUT	: 0 - Generation
+ * RETURN	: File Name (to be freed by the caller)
+ * ---------------------------------------------------------- */
+static bstring
+wal_name (u_int64_t generation)
+{
+    return bformat("%s.%lu", bdata(gc.wal_file), (unsigned long) generation);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_check
+ * DESCRIPTION	: This function will compute the checksum of
+ *		: a record (FNV-1a over everything after the
+ *		: 'check' field).  A record that was only
+ *		: partly written before a crash fails it.
+ * INPUT	: 0 - Record (its size must be valid)
+ * RETURN	: Checksum
+ * ---------------------------------------------------------- */
+static u_int32_t
+wal_check (const WalRecord *rec)
+{
+    const unsigned char *p;
+    u_int32_t hash = 2166136261U;
+    u_int32_t n;
+
+    p = (const unsigned char *) rec + offsetof(WalRecord, type);
+    for (n = rec->size - offsetof(WalRecord, type); n > 0; n--, p++) {
+	hash ^= *p;
+	hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_put_addr
+ * DESCRIPTION	: This function will log an address.  For an
+ *		: interned IPv6 key, the address goes with it;
+ *		: the key may differ in the next run.
+ * INPUT	: 0 - Address
+ *		: 1 - Key (output)
+ *		: 2 - IPv6 Address (output)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wal_put_addr (struct in_addr addr, u_int32_t *key, struct in6_addr *ip6)
+{
+    const struct in6_addr *a;
+
+    *key = addr.s_addr;
+    if (IP6_HANDLE(addr) && (a = ip6_address(addr)) != NULL)
+	memcpy(ip6, a, sizeof(struct in6_addr));
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_get_addr
+ * DESCRIPTION	: This function will turn a logged address into
+ *		: a key of this run.
+ * INPUT	: 0 - Key
+ *		: 1 - IPv6 Address
+ * RETURN	: Key
+ * ---------------------------------------------------------- */
+static struct in_addr
+wal_get_addr (u_int32_t key, const struct in6_addr *ip6)
+{
+    struct in_addr addr;
+
+    addr.s_addr = key;
+    if (IP6_HANDLE(addr) && !ip6_intern(ip6, &addr))
+	addr = ip6_fold(ip6);
+
+    return addr;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_append
+ * DESCRIPTION	: This function will append a record and its
+ *		: strings to the log buffer.  When the current
+ *		: generation has grown too big, the snapshot
+ *		: thread is woken up.
+ * INPUT	: 0 - Record (size, lengths and check are set)
+ *		: 1 - First String (may be NULL)
+ *		: 2 - Second String (may be NULL)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wal_append (WalRecord *rec, bstring first, bstring second)
+{
+    WalRecord *out;
+    char *p, *buf;
+    size_t size, off;
+    int wake = 0;
+
+    rec->length[0] = (first != NULL) ? (u_int32_t) first->slen : WAL_NONE;
+    rec->length[1] = (second != NULL) ? (u_int32_t) second->slen : WAL_NONE;
+    off = sizeof(WalRecord) + (first ? first->slen : 0) + (second ? second->slen : 0);
+    rec->size = WAL_ALIGN(off);
+
+    pthread_mutex_lock(&wal_lock);
+    if (wal_used + rec->size > wal_size) {
+	for (size = (wal_size > 0) ? wal_size : WAL_BUFFER; size < wal_used + rec->size; size *= 2);
+	if ((buf = (char *) realloc(wal_buf, size)) == NULL)
+	    err_message("Unable to grow the write-ahead log buffer");
+	wal_buf = buf;
+	wal_size = size;
+    }
+
+    p = wal_buf + wal_used;
+    memcpy(p, rec, sizeof(WalRecord));
+    off = sizeof(WalRecord);
+    if (first != NULL) {
+	memcpy(p + off, first->data, first->slen);
+	off += first->slen;
+    }
+    if (second != NULL) {
+	memcpy(p + off, second->data, second->slen);
+	off += second->slen;
+    }
+    memset(p + off, 0, rec->size - off);
+
+    out = (WalRecord *) p;
+    out->check = wal_check(out);
+    wal_used += rec->size;
+
+    wal_bytes += rec->size;
+    if (!wal_full && wal_bytes > (u_int64_t)((gc.wal_max > 0) ? gc.wal_max : WAL_MAX) << 20) {
+	wal_full = 1;
+	wake = 1;
+    }
+    pthread_mutex_unlock(&wal_lock);
+
+    if (wake)
+	wake_snapshot();
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_asset
+ * DESCRIPTION	: This function will log a change to an asset.
+ *		: It is called with the storage lock held for
+ *		: writing.
+ * INPUT	: 0 - Asset Record
+ *		: 1 - WAL_NEW, WAL_UPDATED or WAL_EXPIRED
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wal_asset (Asset *rec, int type)
+{
+    WalRecord w;
+
+    if (!wal_running)
+	return;
+
+    memset(&w, 0, sizeof(WalRecord));
+    w.type = type;
+    w.proto = rec->proto;
+    w.i_attempts = rec->i_attempts;
+    w.port = rec->port;
+    w.c_port = rec->c_port;
+    w.discovered = (u_int64_t) rec->discovered;
+    wal_put_addr(rec->ip_addr, &w.ip_addr, &w.ip6);
+    wal_put_addr(rec->c_ip_addr, &w.c_ip_addr, &w.c_ip6);
+
+    if (type == WAL_EXPIRED)
+	wal_append(&w, NULL, NULL);
+    else
+	wal_append(&w, str_get(rec->service), str_get(rec->application));
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_arp_asset
+ * DESCRIPTION	: This function will log a change to an ARP
+ *		: entry.  See wal_asset.
+ * INPUT	: 0 - ArpAsset Record
+ *		: 1 - WAL_ARP_NEW or WAL_ARP_EXPIRED
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wal_arp_asset (ArpAsset *rec, int type)
+{
+    WalRecord w;
+
+    if (!wal_running)
+	return;
+
+    memset(&w, 0, sizeof(WalRecord));
+    w.type = type;
+    w.discovered = (u_int64_t) rec->discovered;
+    wal_put_addr(rec->ip_addr, &w.ip_addr, &w.ip6);
+    memcpy(w.mac_addr, rec->mac_addr, MAC_LEN);
+
+    if (type == WAL_ARP_EXPIRED)
+	wal_append(&w, NULL, NULL);
+    else
+	wal_append(&w, str_get(rec->mac_resolved), NULL);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_open
+ * DESCRIPTION	: This function will create the file of a new
+ *		: generation and write its header.
+ * INPUT	: 0 - Generation
+ * RETURN	: File Descriptor
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+wal_open (u_int64_t generation)
+{
+    WalHeader hdr;
+    bstring name;
+    int fd;
+
+    name = wal_name(generation);
+
+    memset(&hdr, 0, sizeof(WalHeader));
+    memcpy(hdr.magic, WAL_MAGIC, sizeof(WAL_MAGIC));
+    hdr.version = WAL_VERSION;
+    hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+    hdr.header_size = sizeof(WalHeader);
+    hdr.record_size = sizeof(WalRecord);
+    hdr.generation = generation;
+
+    if ((fd = open(bdata(name), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644)) < 0
+	    || write_full(fd, (const char *) &hdr, sizeof(WalHeader)) != 0) {
+	log_message("warning:  Unable to create write-ahead log %s", bdata(name));
+	if (fd >= 0) {
+	    close(fd);
+	    unlink(bdata(name));
+	}
+	bdestroy(name);
+	return -1;
+    }
+
+    bdestroy(name);
+    return fd;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_sync
+ * DESCRIPTION	: This function will sync a generation, again
+ *		: if a signal interrupted it.
+ * INPUT	: 0 - File Descriptor
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+wal_sync (int fd)
+{
+    while (fdatasync(fd) != 0) {
+	if (errno != EINTR)
+	    return -1;
+    }
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_flush
+ * DESCRIPTION	: This function will write the log buffer to
+ *		: the current generation and sync it.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wal_flush (void)
+{
+    char *buf;
+    size_t used, size;
+
+    pthread_mutex_lock(&wal_io_lock);
+
+    pthread_mutex_lock(&wal_lock);
+    buf = wal_buf;
+    used = wal_used;
+    size = wal_size;
+    wal_buf = wal_spare;
+    wal_size = wal_spare_size;
+    wal_used = 0;
+    wal_spare = buf;
+    wal_spare_size = size;
+    pthread_mutex_unlock(&wal_lock);
+
+    if (used > 0 && wal_fd >= 0
+	    && (write_full(wal_fd, buf, used) != 0 || wal_sync(wal_fd) != 0)
+	    && !wal_failed) {
+	log_message("warning:  Unable to write the write-ahead log (generation %lu)",
+		    (unsigned long) wal_generation);
+	wal_failed = 1;
+    }
+
+    pthread_mutex_unlock(&wal_io_lock);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_syncer
+ * DESCRIPTION	: This is the sync thread.  It writes the log
+ *		: out every wal_sync milliseconds.
+ * INPUT	: 0 - Not used
+ * RETURN	: NULL
+ * ---------------------------------------------------------- */
+static void *
+wal_syncer (void *arg)
+{
+    struct timespec due;
+    int interval;
+
+    interval = (gc.wal_sync > 0) ? gc.wal_sync : WAL_SYNC;
+
+    pthread_mutex_lock(&wal_lock);
+    while (!wal_closing) {
+	clock_gettime(CLOCK_REALTIME, &due);
+	due.tv_sec += interval / 1000;
+	due.tv_nsec += (long)(interval % 1000) * 1000000L;
+	if (due.tv_nsec >= 1000000000L) {
+	    due.tv_sec++;
+	    due.tv_nsec -= 1000000000L;
+	}
+	while (!wal_closing
+		&& pthread_cond_timedwait(&wal_cond, &wal_lock, &due) != ETIMEDOUT);
+	if (wal_closing)
+	    break;
+
+	pthread_mutex_unlock(&wal_lock);
+	wal_flush();
+	pthread_mutex_lock(&wal_lock);
+    }
+    pthread_mutex_unlock(&wal_lock);
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_redo
+ * DESCRIPTION	: This function will apply a logged change to
+ *		: the assets.
+ * INPUT	: 0 - Record (checked)
+ * RETURN	: 0 - Success
+ *		: -1 - Bad record
+ * ---------------------------------------------------------- */
+static int
+wal_redo (const WalRecord *rec)
+{
+    Asset asset;
+    ArpAsset arp;
+    StrId str[2];
+    const char *p;
+    u_int32_t room;
+    int i;
+
+    /* The strings must fit in the record. */
+    p = (const char *) (rec + 1);
+    room = rec->size - sizeof(WalRecord);
+    for (i = 0; i < 2; i++) {
+	str[i] = STR_NONE;
+	if (rec->length[i] == WAL_NONE)
+	    continue;
+	if (rec->length[i] > room)
+	    return -1;
+	str[i] = str_intern_blk(p, rec->length[i]);
+	p += rec->length[i];
+	room -= rec->length[i];
+    }
+
+    switch (rec->type) {
+	case WAL_NEW:
+	case WAL_UPDATED:
+	    memset(&asset, 0, sizeof(Asset));
+	    asset.ip_addr = wal_get_addr(rec->ip_addr, &rec->ip6);
+	    asset.c_ip_addr = wal_get_addr(rec->c_ip_addr, &rec->c_ip6);
+	    asset.port = rec->port;
+	    asset.c_port = rec->c_port;
+	    asset.proto = rec->proto;
+	    asset.i_attempts = rec->i_attempts;
+	    asset.discovered = (time_t) rec->discovered;
+	    asset.service = str[0];
+	    asset.application = str[1];
+	    replay_asset(&asset);
+	    return 0;
+
+	case WAL_EXPIRED:
+	    forget_asset(wal_get_addr(rec->ip_addr, &rec->ip6), rec->port, rec->proto);
+	    return 0;
+
+	case WAL_ARP_NEW:
+	    memset(&arp, 0, sizeof(ArpAsset));
+	    arp.ip_addr = wal_get_addr(rec->ip_addr, &rec->ip6);
+	    memcpy(arp.mac_addr, rec->mac_addr, MAC_LEN);
+	    arp.discovered = (time_t) rec->discovered;
+	    arp.mac_resolved = str[0];
+	    restore_arp_asset(&arp);
+	    return 0;
+
+	case WAL_ARP_EXPIRED:
+	    forget_arp_asset(wal_get_addr(rec->ip_addr, &rec->ip6), (const char *) rec->mac_addr);
+	    return 0;
+    }
+
+    return -1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_replay_file
+ * DESCRIPTION	: This function will replay the records of one
+ *		: generation, up to the first one that was not
+ *		: completely written.
+ * INPUT	: 0 - Generation
+ *		: 1 - Number of changes (updated)
+ * RETURN	: 0 - Success
+ *		: -1 - There is no such file
+ * ---------------------------------------------------------- */
+static int
+wal_replay_file (u_int64_t generation, unsigned long *changes)
+{
+    WalHeader *hdr;
+    WalRecord *rec;
+    struct stat st;
+    bstring name;
+    char *map;
+    size_t off;
+    int fd;
+
+    name = wal_name(generation);
+    if ((fd = open(bdata(name), O_RDONLY)) < 0) {
+	if (errno != ENOENT)
+	    log_message("warning:  Unable to open write-ahead log %s", bdata(name));
+	bdestroy(name);
+	return -1;
+    }
+
+    /* A file without a complete header holds no changes. */
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(WalHeader)) {
+	close(fd);
+	bdestroy(name);
+	return 0;
+    }
+
+    if ((map = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+	log_message("warning:  Unable to map write-ahead log %s", bdata(name));
+	close(fd);
+	bdestroy(name);
+	return 0;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    hdr = (WalHeader *) map;
+    if (memcmp(hdr->magic, WAL_MAGIC, sizeof(WAL_MAGIC)) != 0
+	    || hdr->version != WAL_VERSION
+	    || hdr->byte_order != SNAPSHOT_BYTE_ORDER
+	    || hdr->header_size != sizeof(WalHeader)
+	    || hdr->record_size != sizeof(WalRecord)
+	    || hdr->generation != generation) {
+	log_message("warning:  %s is not a write-ahead log of this version, ignored", bdata(name));
+	munmap(map, st.st_size);
+	close(fd);
+	bdestroy(name);
+	return 0;
+    }
+
+    for (off = sizeof(WalHeader); off + sizeof(WalRecord) <= (size_t) st.st_size; off += rec->size) {
+	rec = (WalRecord *) (map + off);
+	if (rec->size < sizeof(WalRecord) || (rec->size & 7) != 0
+		|| rec->size > (size_t) st.st_size - off
+		|| rec->check != wal_check(rec))
+	    break;
+	if (wal_redo(rec) == 0)
+	    (*changes)++;
+    }
+
+    if (off < (size_t) st.st_size)
+	log_message("warning:  Write-ahead log %s ends with %lu bytes of an incomplete change",
+		    bdata(name), (unsigned long)(st.st_size - off));
+
+    /* Clean Up */
+    munmap(map, st.st_size);
+    close(fd);
+    bdestroy(name);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_remove
+ * DESCRIPTION	: This function will delete the file of a
+ *		: generation.
+ * INPUT	: 0 - Generation
+ * RETURN	: 0 - Success
+ *		: -1 - There is no such file
+ * ---------------------------------------------------------- */
+static int
+wal_remove (u_int64_t generation)
+{
+    bstring name;
+    int ret;
+
+    name = wal_name(generation);
+    ret = unlink(bdata(name));
+    bdestroy(name);
+
+    return (ret == 0) ? 0 : -1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wal_remove_all
+ * DESCRIPTION	: This function will delete the files of all
+ *		: generations, whatever their number.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wal_remove_all (void)
+{
+    DIR *dir;
+    struct dirent *ent;
+    bstring path, file, prefix, name;
+    char *dir_name, *end;
+
+    /* dirname() and basename() may change their argument. */
+    path = bstrcpy(gc.wal_file);
+    file = bstrcpy(gc.wal_file);
+    dir_name = dirname(bdata(path));
+    prefix = bformat("%s.", basename(bdata(file)));
+
+    if ((dir = opendir(dir_name)) != NULL) {
+	while ((ent = readdir(dir)) != NULL) {
+	    if (strncmp(ent->d_name, bdata(prefix), prefix->slen) != 0)
+		continue;
+	    strtoul(ent->d_name + prefix->slen, &end, 10);
+	    if (end == ent->d_name + prefix->slen || *end != '\0')
+		continue;
+	    name = bformat("%s/%s", dir_name, ent->d_name);
+	    unlink(bdata(name));
+	    bdestroy(name);
+	}
+	closedir(dir);
+    }
+
+    /* Clean Up */
+    bdestroy(path);
+    bdestroy(file);
+    bdestroy(prefix);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: replay_wal
+ * DESCRIPTION	: This function will apply the changes logged
+ *		: since the snapshot that was loaded.  Logs
+ *		: that the snapshot already contains are
+ *		: deleted;  so are all logs if the snapshot was
+ *		: saved by a run without one.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+replay_wal (void)
+{
+    u_int64_t first, gen;
+    unsigned long changes = 0, files = 0;
+
+    if (gc.wal_file == NULL)
+	return;
+
+    if (gc.snapshot_file == NULL) {
+	log_message("warning:  wal_file needs a snapshot_file, write-ahead log disabled");
+	return;
+    }
+
+    first = get_snapshot_generation();
+    if (first == 0) {
+	/* Any log is older than the snapshot. */
+	wal_remove_all();
+	wal_generation = wal_oldest = 1;
+	return;
+    }
+    if (first == SNAPSHOT_NONE)
+	first = 1;
+
+    /* Logs left behind by a crash right after the snapshot was saved. */
+    for (gen = first - 1; gen > 0 && wal_remove(gen) == 0; gen--);
+
+    for (gen = first; wal_replay_file(gen, &changes) == 0; gen++)
+	files++;
+
+    if (files > 0)
+	log_message("Replayed %lu Changes from %lu Write-Ahead Logs\n", changes, files);
+
+    /* Start a new generation;  the ones replayed go with the next snapshot. */
+    wal_generation = gen;
+    wal_oldest = first;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_wal
+ * DESCRIPTION	: This function will start logging changes when
+ *		: a write-ahead log has been configured.  It
+ *		: is called after replay_wal().
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_wal (void)
+{
+    sigset_t all, old;
+
+    if (gc.wal_file == NULL || gc.snapshot_file == NULL)
+	return;
+
+    if ((wal_fd = wal_open(wal_generation)) < 0) {
+	log_message("warning:  Write-ahead log disabled");
+	return;
+    }
+
+    /* Signals are handled by the main thread only. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&wal_thread, NULL, wal_syncer, NULL) != 0)
+	err_message("Unable to start write-ahead log thread");
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    wal_running = 1;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: rotate_wal
+ * DESCRIPTION	: This function will start a new generation.
+ *		: It is called by save_snapshot() while the
+ *		: storage lock is held, so the snapshot holds
+ *		: every change logged to the older ones.  It
+ *		: takes locks and syncs, so it must never run
+ *		: in a signal handler.
+ * INPUT	: None!
+ * RETURN	: Generation that follows the snapshot
+ *		: 0 - There is no write-ahead log
+ * ---------------------------------------------------------- */
+u_int64_t
+rotate_wal (void)
+{
+    u_int64_t generation;
+    int fd;
+
+    if (!wal_running)
+	return 0;
+
+    wal_flush();
+
+    pthread_mutex_lock(&wal_io_lock);
+
+    /* If no new file can be made, the changes in this one are replayed
+     * over the snapshot;  that does no harm. */
+    if ((fd = wal_open(wal_generation + 1)) >= 0) {
+	close(wal_fd);
+	wal_fd = fd;
+	wal_generation++;
+
+	pthread_mutex_lock(&wal_lock);
+	wal_bytes = 0;
+	wal_full = 0;
+	pthread_mutex_unlock(&wal_lock);
+    }
+    generation = wal_generation;
+
+    pthread_mutex_unlock(&wal_io_lock);
+
+    return generation;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: compact_wal
+ * DESCRIPTION	: This function will delete the generations
+ *		: older than the one a snapshot that has just
+ *		: been saved follows.
+ * INPUT	: 0 - Generation (from rotate_wal())
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+compact_wal (u_int64_t generation)
+{
+    if (!wal_running)
+	return;
+
+    for (; wal_oldest < generation; wal_oldest++)
+	wal_remove(wal_oldest);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_wal
+ * DESCRIPTION	: This function will stop the sync thread and
+ *		: write out what is left.  It is called after
+ *		: end_snapshot(), from main_pads() once the
+ *		: capture has stopped, with signals held.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_wal (void)
+{
+    if (!wal_running)
+	return;
+
+    pthread_mutex_lock(&wal_lock);
+    wal_closing = 1;
+    pthread_cond_signal(&wal_cond);
+    pthread_mutex_unlock(&wal_lock);
+    pthread_join(wal_thread, NULL);
+
+    wal_flush();
+    close(wal_fd);
+    wal_fd = -1;
+    wal_running = 0;
+
+    /* Clean Up */
+    free(wal_buf);
+    free(wal_spare);
+    wal_buf = wal_spare = NULL;
+    wal_size = wal_spare_size = 0;
+}
@@ -0,0 +1,94 @@
+/*************************************************************************
+ * wal.h
+ *
+ * This header file contains information relating to the wal.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_WAL_H
+#define INCLUDED_WAL_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define WAL_MAGIC "PADSWAL"
+#define WAL_VERSION 1
+#define WAL_SYNC 1000               /* Default milliseconds between syncs. */
+#define WAL_MAX 64                  /* Default megabytes before a snapshot. */
+#define WAL_NONE 0xffffffff         /* Length of a NULL string. */
+
+/* Records start on 8 byte boundaries. */
+#define WAL_ALIGN(n) (((n) + 7) & ~(u_int32_t)7)
+
+/* Record Types */
+#define WAL_NEW 1                   /* Asset discovered */
+#define WAL_UPDATED 2               /* Asset identified */
+#define WAL_EXPIRED 3               /* Asset dropped */
+#define WAL_ARP_NEW 4               /* ARP entry discovered */
+#define WAL_ARP_EXPIRED 5           /* ARP entry dropped */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * WalHeader:  Start of a log file.  Each snapshot starts a new file (a
+ * "generation");  the records of the older ones are in the snapshot.
+ * -------------------------------------------------------------------------- */
+typedef struct _WalHeader
+{
+    char magic[8];              /* WAL_MAGIC */
+    u_int32_t version;          /* WAL_VERSION */
+    u_int32_t byte_order;       /* SNAPSHOT_BYTE_ORDER */
+    u_int32_t header_size;      /* sizeof(WalHeader) */
+    u_int32_t record_size;      /* sizeof(WalRecord) */
+    u_int64_t generation;       /* Number of this file */
+} WalHeader;
+
+/* --------------------------------------------------------------------------
+ * WalRecord:  A change to an asset or ARP entry, followed by its strings
+ * (service and application, or the vendor).  Addresses and ports are in
+ * network byte order;  the address of an IPv6 key is logged with it.
+ * -------------------------------------------------------------------------- */
+typedef struct _WalRecord
+{
+    u_int32_t size;             /* Bytes, strings and padding included */
+    u_int32_t check;            /* Checksum of the bytes after this field */
+    u_int8_t type;              /* WAL_* */
+    u_int8_t proto;
+    u_int16_t i_attempts;
+    u_int16_t port;
+    u_int16_t c_port;
+    u_int64_t discovered;
+    u_int32_t ip_addr;
+    u_int32_t c_ip_addr;
+    struct in6_addr ip6;
+    struct in6_addr c_ip6;
+    u_int8_t mac_addr[MAC_LEN];
+    u_int16_t pad;
+    u_int32_t length[2];        /* Strings (WAL_NONE = NULL) */
+} WalRecord;
+
+
+/* PROTOTYPES -------------------------------------- */
+void replay_wal (void);
+void init_wal (void);
+void wal_asset (Asset *rec, int type);
+void wal_arp_asset (ArpAsset *rec, int type);
+u_int64_t rotate_wal (void);
+void compact_wal (u_int64_t generation);
+void end_wal (void);
+
+#endif /* INCLUDED_WAL_H */
@@ -0,0 +1,301 @@
+/*************************************************************************
+ * wheel.c
+ *
+ * This module contains a hierarchical timing wheel.  It tells the storage
+ * module which records have been idle for too long.
+ *
+ * Level 0 has one slot per second for the next minute, level 1 one slot
+ * per minute for the next hour, and so on.  Entries further away sit in
+ * the coarse slots and are moved down a level ("cascaded") when their slot
+ * comes up, so every tick only has to look at one slot.  Records that are
+ * seen again are not moved:  when their slot fires, the wheel asks for the
+ * time they are really due and puts them back further on.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <string.h>
+
+#include "wheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_start
+ * DESCRIPTION	: This function will set up an empty wheel.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Current Time
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wheel_start (Wheel *wheel, time_t now)
+{
+    memset(wheel, 0, sizeof(Wheel));
+    wheel->now = now;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_add
+ * DESCRIPTION	: This function will schedule an entry.  It
+ *		: goes into the finest level whose slots still
+ *		: reach that far.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Entry
+ *		: 2 - Time it is due (at least the next tick)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wheel_add (Wheel *wheel, WheelEntry *entry, time_t when)
+{
+    time_t delta, place;
+    int level, slot;
+
+    if (when <= wheel->now)
+	when = wheel->now + 1;
+    entry->when = when;
+
+    /* Entries beyond the last level wait in its farthest slot. */
+    delta = when - wheel->now;
+    place = when;
+    if (delta >= WHEEL_SPAN) {
+	delta = WHEEL_SPAN - 1;
+	place = wheel->now + delta;
+    }
+
+    for (level = 0; level < WHEEL_LEVELS - 1
+	    && (delta >> (WHEEL_BITS * (level + 1))) != 0; level++);
+    slot = (place >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    entry->next = wheel->slots[level][slot];
+    wheel->slots[level][slot] = entry;
+    wheel->count++;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_readd
+ * DESCRIPTION	: This function will schedule a list of entries
+ *		: again, each for its 'when'.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Entries (chained through next)
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wheel_readd (Wheel *wheel, WheelEntry *list)
+{
+    WheelEntry *entry;
+
+    while (list != NULL) {
+	entry = list;
+	list = entry->next;
+	wheel_add(wheel, entry, entry->when);
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_check
+ * DESCRIPTION	: This function will take the entries of a
+ *		: slot that has come up.  Those that are not
+ *		: due yet are scheduled again;  the others are
+ *		: added to the list of due entries.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Entries of the slot
+ *		: 2 - Due Time Function
+ *		: 3 - List of due entries
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wheel_check (Wheel *wheel, WheelEntry *list, WheelDue due, WheelEntry **expired)
+{
+    WheelEntry *entry;
+    time_t when;
+
+    while (list != NULL) {
+	entry = list;
+	list = entry->next;
+	wheel->count--;
+
+	when = (*due)(entry);
+	if (when > wheel->now) {
+	    wheel_add(wheel, entry, when);
+	} else {
+	    entry->next = *expired;
+	    *expired = entry;
+	}
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_tick
+ * DESCRIPTION	: This function will move the wheel on by one
+ *		: second.  Higher level slots that start now
+ *		: are cascaded down first (coarsest first), then
+ *		: the level 0 slot fires.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Due Time Function
+ *		: 2 - List of due entries
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+wheel_tick (Wheel *wheel, WheelDue due, WheelEntry **expired)
+{
+    WheelEntry *list, *entry;
+    time_t t;
+    int level, top, slot;
+
+    t = ++wheel->now;
+
+    for (top = 0; top < WHEEL_LEVELS - 1
+	    && (t & (((time_t)1 << (WHEEL_BITS * (top + 1))) - 1)) == 0; top++);
+
+    for (level = top; level > 0; level--) {
+	slot = (t >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	list = wheel->slots[level][slot];
+	wheel->slots[level][slot] = NULL;
+	for (entry = list; entry != NULL; entry = entry->next)
+	    wheel->count--;
+	wheel_readd(wheel, list);
+    }
+
+    slot = t & WHEEL_MASK;
+    list = wheel->slots[0][slot];
+    wheel->slots[0][slot] = NULL;
+    wheel_check(wheel, list, due, expired);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_advance
+ * DESCRIPTION	: This function will move the wheel on to the
+ *		: current time, one tick at a time.  After a
+ *		: jump of more than the wheel's span, every
+ *		: entry is checked once instead.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Current Time
+ *		: 2 - Due Time Function
+ * RETURN	: Entries that are due (chained through next)
+ * ---------------------------------------------------------- */
+WheelEntry *
+wheel_advance (Wheel *wheel, time_t now, WheelDue due)
+{
+    WheelEntry *expired = NULL;
+    WheelEntry *all = NULL, *list, *last;
+    int level, slot;
+
+    if (wheel->now == 0 || now <= wheel->now)
+	return NULL;
+
+    if (wheel->count == 0) {
+	wheel->now = now;
+	return NULL;
+    }
+
+    if (now - wheel->now >= WHEEL_SPAN) {
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+	    for (slot = 0; slot < WHEEL_SLOTS; slot++) {
+		if ((list = wheel->slots[level][slot]) == NULL)
+		    continue;
+		for (last = list; last->next != NULL; last = last->next);
+		last->next = all;
+		all = list;
+		wheel->slots[level][slot] = NULL;
+	    }
+	}
+	wheel->now = now;
+	wheel_check(wheel, all, due, &expired);
+	return expired;
+    }
+
+    while (wheel->now < now)
+	wheel_tick(wheel, due, &expired);
+
+    return expired;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_first
+ * DESCRIPTION	: This function will take the entry that is
+ *		: due first off the wheel, without moving the
+ *		: wheel on.  Slots are searched in the order
+ *		: they come up;  entries that were seen again
+ *		: on the way are scheduled again first.  The
+ *		: order is exact to within the slot size.
+ * INPUT	: 0 - Wheel
+ *		: 1 - Due Time Function
+ * RETURN	: Entry or NULL (wheel empty)
+ * ---------------------------------------------------------- */
+WheelEntry *
+wheel_first (Wheel *wheel, WheelDue due)
+{
+    WheelEntry **pp, **best, *entry, *moved;
+    time_t base, when;
+    int level, i, slot;
+
+    while (wheel->count > 0) {
+	moved = NULL;
+
+	for (level = 0; level < WHEEL_LEVELS && moved == NULL; level++) {
+	    base = wheel->now >> (WHEEL_BITS * level);
+	    for (i = 1; i <= WHEEL_SLOTS && moved == NULL; i++) {
+		slot = (base + i) & WHEEL_MASK;
+		best = NULL;
+
+		for (pp = &wheel->slots[level][slot]; (entry = *pp) != NULL; ) {
+		    when = (*due)(entry);
+		    if (when > entry->when) {
+			/* Seen again:  put back once the slot is done. */
+			*pp = entry->next;
+			wheel->count--;
+			entry->when = when;
+			entry->next = moved;
+			moved = entry;
+			continue;
+		    }
+		    if (best == NULL || entry->when < (*best)->when)
+			best = pp;
+		    pp = &entry->next;
+		}
+
+		if (best != NULL) {
+		    entry = *best;
+		    *best = entry->next;
+		    wheel->count--;
+		    wheel_readd(wheel, moved);
+		    return entry;
+		}
+	    }
+	}
+
+	/* Only entries that had to be moved:  search again. */
+	wheel_readd(wheel, moved);
+    }
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wheel_clear
+ * DESCRIPTION	: This function will empty the wheel.  The
+ *		: entries belong to the caller.
+ * INPUT	: 0 - Wheel
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wheel_clear (Wheel *wheel)
+{
+    memset(wheel, 0, sizeof(Wheel));
+}
@@ -0,0 +1,60 @@
+/*************************************************************************
+ * wheel.h
+ *
+ * This header file contains information relating to the wheel.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_WHEEL_H
+#define INCLUDED_WHEEL_H
+
+#include "global.h"
+
+/* DEFINES ----------------------------------------- */
+#define WHEEL_BITS 6                /* Slots per level (log2). */
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4              /* 1 s, 64 s, 68 min and 3 day slots. */
+#define WHEEL_SPAN ((time_t)1 << (WHEEL_BITS * WHEEL_LEVELS))  /* ~194 days */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * WheelDue:  Returns the time an entry is really due.  Entries are not
+ * moved when their record is seen again;  the wheel asks when their slot
+ * comes up.
+ * -------------------------------------------------------------------------- */
+typedef time_t (*WheelDue) (WheelEntry *entry);
+
+/* --------------------------------------------------------------------------
+ * Wheel:  A hierarchical timing wheel with one second ticks.
+ * -------------------------------------------------------------------------- */
+typedef struct _Wheel
+{
+    WheelEntry *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    time_t now;                 /* Last tick processed (0 = not started) */
+    unsigned long count;        /* Entries on the wheel */
+} Wheel;
+
+
+/* PROTOTYPES -------------------------------------- */
+void wheel_start (Wheel *wheel, time_t now);
+void wheel_add (Wheel *wheel, WheelEntry *entry, time_t when);
+WheelEntry *wheel_advance (Wheel *wheel, time_t now, WheelDue due);
+WheelEntry *wheel_first (Wheel *wheel, WheelDue due);
+void wheel_clear (Wheel *wheel);
+
+#endif /* INCLUDED_WHEEL_H */
@@ -0,0 +1,197 @@
+/*************************************************************************
+ * worker.c
+ *
+ * This module runs packet processing on several cores.  Each worker
+ * thread owns one of the capture sockets (tpacket sockets in a fanout
+ * group, or AF_XDP sockets on the receive queues) and processes that
+ * socket's packets from start to finish.  The kernel sends a connection
+ * to the same socket every time, so a worker tracks its flows in a table
+ * of its own.  The asset store, the banner cache and
+ * the pending filter are shared;  output goes through a single writer
+ * thread.
+ *
+ * The main thread only waits, and handles signals.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "identification.h"
+#include "slab.h"
+#include "worker.h"
+#include "util.h"
+
+/* Variable Declarations */
+Worker *workers;
+int worker_count;
+int workers_running;            /* Workers that have not returned yet. */
+CaptureLoop worker_loop;        /* Capture backend */
+CaptureBreak worker_break;
+
+/* ----------------------------------------------------------
+ * FUNCTION	: worker_thread
+ * DESCRIPTION	: This is a worker thread.  It processes the
+ *		: packets of its socket until it is stopped.
+ * INPUT	: 0 - Worker
+ * RETURN	: NULL
+ * ---------------------------------------------------------- */
+static void *
+worker_thread (void *arg)
+{
+    Worker *w = (Worker *)arg;
+
+    flow_thread_table(&w->flows);
+    pending_thread_stats(&w->pending);
+    init_flow();
+
+    (*worker_loop)(w->id, w->handler);
+
+    flow_flush_all();
+    end_flow();
+    end_match_state();
+    end_arena();
+    __atomic_fetch_sub(&workers_running, 1, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_workers
+ * DESCRIPTION	: This function will start one worker for each
+ *		: capture socket.
+ * INPUT	: 0 - Number of workers (= capture sockets)
+ *		: 1 - Capture Loop (tpacket_loop / xsk_loop)
+ *		: 2 - Function that stops the loops
+ *		: 3 - Packet Processor
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+init_workers (int count, CaptureLoop loop, CaptureBreak stop, RingHandler handler)
+{
+    sigset_t all, old;
+    int i;
+
+    if ((workers = (Worker *) calloc(count, sizeof(Worker))) == NULL)
+	err_message("Unable to allocate workers (%d)", count);
+    worker_loop = loop;
+    worker_break = stop;
+
+    /* Signals are handled by the main thread only. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (i = 0; i < count; i++) {
+	workers[i].id = i;
+	workers[i].handler = handler;
+	if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0)
+	    err_message("Unable to start worker %d", i);
+	worker_count++;
+	__atomic_fetch_add(&workers_running, 1, __ATOMIC_RELEASE);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    verbose_message("Started %d workers", count);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: wait_workers
+ * DESCRIPTION	: This function will return once every worker
+ *		: has stopped, because its socket failed or a
+ *		: signal broke the capture loops.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+wait_workers (void)
+{
+    while (__atomic_load_n(&workers_running, __ATOMIC_ACQUIRE) > 0)
+	sleep(1);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_worker_count
+ * DESCRIPTION	: This function will return the number of
+ *		: workers.
+ * INPUT	: None!
+ * RETURN	: Number of workers (0 = not running)
+ * ---------------------------------------------------------- */
+int
+get_worker_count (void)
+{
+    return worker_count;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_worker
+ * DESCRIPTION	: This function will return a worker.  Its
+ *		: counters are only exact once the workers
+ *		: have been stopped.
+ * INPUT	: 0 - Worker Number
+ * RETURN	: Pointer to Worker
+ * ---------------------------------------------------------- */
+Worker *
+get_worker (int id)
+{
+    return &workers[id];
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_workers
+ * DESCRIPTION	: This function will stop the workers and add
+ *		: their counters to the shared ones.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_workers (void)
+{
+    FlowStats *fstat;
+    PendingStats *pdstat;
+    int i;
+
+    if (worker_count == 0)
+	return;
+
+    (*worker_break)();
+    for (i = 0; i < worker_count; i++)
+	pthread_join(workers[i].thread, NULL);
+
+    fstat = get_flow_stats();
+    pdstat = get_pending_stats();
+    for (i = 0; i < worker_count; i++) {
+	fstat->created += workers[i].flows.stats.created;
+	fstat->removed += workers[i].flows.stats.removed;
+	fstat->expired += workers[i].flows.stats.expired;
+	fstat->evicted += workers[i].flows.stats.evicted;
+	fstat->inspected += workers[i].flows.stats.inspected;
+	fstat->skipped += workers[i].flows.stats.skipped;
+	fstat->reassembled += workers[i].flows.stats.reassembled;
+	fstat->gaps += workers[i].flows.stats.gaps;
+	fstat->full += workers[i].flows.stats.full;
+	pdstat->hits += workers[i].pending.hits;
+	pdstat->misses += workers[i].pending.misses;
+	pdstat->false_pos += workers[i].pending.false_pos;
+	slab_merge(get_flow_slab(), &workers[i].flows.data);
+    }
+}
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
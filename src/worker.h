@@ -0,0 +1,66 @@
+/*************************************************************************
+ * worker.h
+ *
+ * This header file contains information relating to the worker.c
+ * module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_WORKER_H
+#define INCLUDED_WORKER_H
+
+#include <pthread.h>
+
+#include "global.h"
+#include "flow.h"
+#include "pending.h"
+#include "ring.h"
+
+/* DEFINES ----------------------------------------- */
+#define WORKERS_MAX 64              /* Upper limit on the number of workers. */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * CaptureLoop:  Processes the packets of one capture socket until stopped.
+ * CaptureBreak:  Stops every CaptureLoop of a backend.
+ * -------------------------------------------------------------------------- */
+typedef void (*CaptureLoop)(int, RingHandler);
+typedef void (*CaptureBreak)(void);
+
+/* --------------------------------------------------------------------------
+ * Worker:  A thread that processes the packets of one capture socket.  Its
+ * flow table and counters are its own.
+ * -------------------------------------------------------------------------- */
+typedef struct _Worker
+{
+    int id;                     /* Capture socket number */
+    pthread_t thread;
+    RingHandler handler;        /* Packet Processor */
+    FlowTable flows;            /* Flows seen by this worker */
+    PendingStats pending;       /* Pending filter lookups */
+} Worker;
+
+
+/* PROTOTYPES -------------------------------------- */
+void init_workers (int count, CaptureLoop loop, CaptureBreak stop, RingHandler handler);
+void wait_workers (void);
+int get_worker_count (void);
+Worker *get_worker (int id);
+void end_workers (void);
+
+#endif /* INCLUDED_WORKER_H */
@@ -0,0 +1,563 @@
+/*************************************************************************
+ * xsk.c
+ *
+ * This module is a Linux capture backend built on AF_XDP sockets.  An
+ * XDP program (see ebpf.c) hands the packets of each receive queue to
+ * one socket before the kernel allocates anything for them.  The packets
+ * land in a UMEM, an area of our own memory split into frames:  we give
+ * the kernel free frames on the fill ring, it gives them back filled on
+ * the RX ring.  The descriptors are handled in batches, the packets are
+ * processed in place and the frames go straight back on the fill ring.
+ *
+ * The program is attached in native (driver) mode where the driver
+ * supports it, and the sockets then ask for zero-copy.  Everywhere else,
+ * veth included, generic (SKB) mode is used, which still skips most of
+ * the stack.  Note that the packets are taken away from the kernel, so
+ * this is meant for a dedicated capture interface such as a tap port.
+ *
+ * AF_XDP sockets do not run socket filters, so a filter is applied to
+ * the packets here.  One socket is opened per receive queue of the
+ * interface, as the packets of a queue without a socket would go past
+ * us;  the NIC spreads the flows over the queues.  Worker N reads queues
+ * N, N + workers, N + 2 * workers and so on.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+
+/* INCLUDES ---------------------------------------- */
+#include "global.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_AF_XDP) && defined(HAVE_EBPF)
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/ethtool.h>
+#include <linux/if_xdp.h>
+#include <linux/sockios.h>
+#endif
+
+#include "xsk.h"
+#include "batch.h"
+#include "ebpf.h"
+#include "util.h"
+
+#if defined(HAVE_AF_XDP) && defined(HAVE_EBPF)
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* --------------------------------------------------------------------------
+ * XskRing:  One of the rings shared with the kernel.
+ * -------------------------------------------------------------------------- */
+typedef struct _XskRing
+{
+    u_int32_t *producer;
+    u_int32_t *consumer;
+    void *desc;                 /* u_int64_t (fill) or struct xdp_desc (RX) */
+    u_int32_t mask;
+    void *map;
+    size_t map_len;
+} XskRing;
+
+/* --------------------------------------------------------------------------
+ * XskSocket:  One AF_XDP socket, its UMEM and its rings.
+ * -------------------------------------------------------------------------- */
+typedef struct _XskSocket
+{
+    int fd;                     /* AF_XDP Socket */
+    u_char *umem;               /* Packet Buffers */
+    XskRing fill;               /* Free frames for the kernel */
+    XskRing comp;               /* Completion ring (unused, but required) */
+    XskRing rx;                 /* Received packets */
+    XskStats stats;
+} XskSocket;
+
+/* Variable Declarations */
+XskSocket *xsk_socks;           /* One socket per receive queue */
+int xsk_count;                  /* Number of sockets */
+int xsk_workers;                /* Number of workers reading them */
+unsigned int xsk_frames;        /* UMEM frames per socket */
+struct bpf_program *xsk_filter; /* Filter run on the packets */
+int xsk_break;                  /* Set to leave xsk_loop() */
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_map_ring
+ * DESCRIPTION	: This function will map one of the rings of a
+ *		: socket.
+ * INPUT	: 0 - Socket
+ *		: 1 - Ring
+ *		: 2 - Ring Offsets
+ *		: 3 - Descriptor Size
+ *		: 4 - Number of Descriptors
+ *		: 5 - Page Offset
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+xsk_map_ring (int fd, XskRing *ring, struct xdp_ring_offset *off,
+	      size_t size, unsigned int count, off_t pgoff)
+{
+    ring->map_len = off->desc + size * count;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+	ring->map = NULL;
+	log_message("WARNING:  xsk:  mmap (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    ring->producer = (u_int32_t *)((u_char *)ring->map + off->producer);
+    ring->consumer = (u_int32_t *)((u_char *)ring->map + off->consumer);
+    ring->desc = (u_char *)ring->map + off->desc;
+    ring->mask = count - 1;
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_open
+ * DESCRIPTION	: This function will open one AF_XDP socket,
+ *		: register its UMEM, map its rings and bind it
+ *		: to a receive queue.  Every frame starts out
+ *		: on the fill ring.
+ * INPUT	: 0 - Socket
+ *		: 1 - Interface Index
+ *		: 2 - Queue
+ *		: 3 - Ask for zero-copy
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+static int
+xsk_open (XskSocket *sock, int ifindex, int queue, int zerocopy)
+{
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t len;
+    u_int64_t *addr;
+    unsigned int i;
+
+    if ((sock->fd = socket(AF_XDP, SOCK_RAW, 0)) < 0) {
+	log_message("WARNING:  xsk:  socket (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    sock->umem = mmap(NULL, (size_t)xsk_frames * XSK_FRAME_SIZE, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (sock->umem == MAP_FAILED) {
+	sock->umem = NULL;
+	log_message("WARNING:  xsk:  unable to allocate UMEM (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (unsigned long) sock->umem;
+    reg.len = (u_int64_t)xsk_frames * XSK_FRAME_SIZE;
+    reg.chunk_size = XSK_FRAME_SIZE;
+    if (setsockopt(sock->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0) {
+	log_message("WARNING:  xsk:  XDP_UMEM_REG (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    /* Fill and RX rings can each hold every frame, so they never overflow. */
+    if (setsockopt(sock->fd, SOL_XDP, XDP_UMEM_FILL_RING, &xsk_frames, sizeof(xsk_frames)) < 0
+	    || setsockopt(sock->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &xsk_frames, sizeof(xsk_frames)) < 0
+	    || setsockopt(sock->fd, SOL_XDP, XDP_RX_RING, &xsk_frames, sizeof(xsk_frames)) < 0) {
+	log_message("WARNING:  xsk:  unable to size rings (%s)\n", strerror(errno));
+	return -1;
+    }
+
+    len = sizeof(off);
+    if (getsockopt(sock->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &len) < 0) {
+	log_message("WARNING:  xsk:  XDP_MMAP_OFFSETS (%s)\n", strerror(errno));
+	return -1;
+    }
+    if (xsk_map_ring(sock->fd, &sock->fill, &off.fr, sizeof(u_int64_t),
+		     xsk_frames, XDP_UMEM_PGOFF_FILL_RING) == -1
+	    || xsk_map_ring(sock->fd, &sock->comp, &off.cr, sizeof(u_int64_t),
+			    xsk_frames, XDP_UMEM_PGOFF_COMPLETION_RING) == -1
+	    || xsk_map_ring(sock->fd, &sock->rx, &off.rx, sizeof(struct xdp_desc),
+			    xsk_frames, XDP_PGOFF_RX_RING) == -1)
+	return -1;
+
+    /* Hand every frame to the kernel. */
+    addr = (u_int64_t *)sock->fill.desc;
+    for (i = 0; i < xsk_frames; i++)
+	addr[i] = (u_int64_t)i * XSK_FRAME_SIZE;
+    __atomic_store_n(sock->fill.producer, xsk_frames, __ATOMIC_RELEASE);
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = queue;
+    sxdp.sxdp_flags = XDP_ZEROCOPY;
+    if (!zerocopy || bind(sock->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+	sxdp.sxdp_flags = XDP_COPY;
+	if (bind(sock->fd, (struct sockaddr *)&sxdp, sizeof(sxdp)) < 0) {
+	    log_message("WARNING:  xsk:  bind to queue %d (%s)\n", queue, strerror(errno));
+	    return -1;
+	}
+    }
+
+    verbose_message("xsk:  queue %d, %s", queue,
+		    (sxdp.sxdp_flags == XDP_ZEROCOPY) ? "zero-copy" : "copy mode");
+    return ebpf_xsk_add(queue, sock->fd);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_read_stats
+ * DESCRIPTION	: This function will copy the kernel's socket
+ *		: counters to ours.
+ * INPUT	: 0 - Socket
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+static void
+xsk_read_stats (XskSocket *sock)
+{
+    struct xdp_statistics st;
+    socklen_t len = sizeof(st);
+
+    if (sock->fd < 0)
+	return;
+
+    memset(&st, 0, sizeof(st));
+    if (getsockopt(sock->fd, SOL_XDP, XDP_STATISTICS, &st, &len) == 0) {
+	sock->stats.drops = st.rx_dropped + st.rx_ring_full;
+	sock->stats.fill_empty = st.rx_fill_ring_empty_descs;
+    }
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_rx_queues
+ * DESCRIPTION	: This function will ask the driver how many
+ *		: receive queues an interface has.
+ * INPUT	: 0 - Interface
+ * RETURN	: Number of queues (-1 = unknown)
+ * ---------------------------------------------------------- */
+static int
+xsk_rx_queues (const char *dev)
+{
+    struct ethtool_channels ch;
+    struct ifreq ifr;
+    int fd, queues = -1;
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	return -1;
+
+    memset(&ch, 0, sizeof(ch));
+    ch.cmd = ETHTOOL_GCHANNELS;
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    ifr.ifr_data = (char *) &ch;
+    if (ioctl(fd, SIOCETHTOOL, &ifr) == 0)
+	queues = ch.rx_count + ch.combined_count;
+
+    close(fd);
+    return queues;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: init_xsk
+ * DESCRIPTION	: This function will attach the XDP program to
+ *		: an interface and open an AF_XDP socket on
+ *		: each of its receive queues.  When the driver
+ *		: cannot tell how many there are, one queue per
+ *		: worker is assumed.  On failure the caller is
+ *		: expected to fall back to libpcap.
+ * INPUT	: 0 - Interface
+ *		: 1 - Number of workers
+ * RETURN	: 0 - Success
+ *		: -1 - Error
+ * ---------------------------------------------------------- */
+int
+init_xsk (const char *dev, int workers)
+{
+    int ifindex, native, count, i;
+
+    if ((ifindex = if_nametoindex(dev)) == 0) {
+	log_message("WARNING:  xsk:  unknown interface %s\n", dev);
+	return -1;
+    }
+
+    if (workers < 1)
+	workers = 1;
+    if ((count = xsk_rx_queues(dev)) < 1) {
+	log_message("WARNING:  xsk:  unable to count the receive queues of %s, using %d\n",
+		    dev, workers);
+	count = workers;
+    } else if (count < workers) {
+	log_message("WARNING:  xsk:  %s has %d receive queues, %d workers will be idle\n",
+		    dev, count, workers - count);
+    }
+
+    /* Frames:  a power of two, so that the rings can be indexed with a mask. */
+    for (xsk_frames = 64;
+	 xsk_frames < ((gc.xdp_frames > 0) ? gc.xdp_frames : XSK_FRAMES);
+	 xsk_frames <<= 1);
+
+    if ((native = ebpf_xsk_attach(ifindex, count)) == -1)
+	return -1;
+
+    if ((xsk_socks = (XskSocket *) calloc(count, sizeof(XskSocket))) == NULL)
+	err_message("Unable to allocate AF_XDP sockets (%d)", count);
+    for (i = 0; i < count; i++)
+	xsk_socks[i].fd = -1;
+    xsk_count = count;
+    xsk_workers = workers;
+
+    for (i = 0; i < count; i++) {
+	if (xsk_open(&xsk_socks[i], ifindex, i, native) == -1) {
+	    end_xsk();
+	    return -1;
+	}
+    }
+
+    verbose_message("xsk:  %d x %u frames of %d bytes, %s mode", count, xsk_frames,
+		    XSK_FRAME_SIZE, native ? "native" : "generic");
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_setfilter
+ * DESCRIPTION	: This function will set the filter the packets
+ *		: are run through before processing.
+ * INPUT	: 0 - Compiled Filter
+ * RETURN	: 0 - Success
+ * ---------------------------------------------------------- */
+int
+xsk_setfilter (struct bpf_program *filter)
+{
+    xsk_filter = filter;
+    return 0;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_snaplen
+ * DESCRIPTION	: This function will return the largest packet
+ *		: that fits in a frame.
+ * INPUT	: None!
+ * RETURN	: Snaplen
+ * ---------------------------------------------------------- */
+int
+xsk_snaplen (void)
+{
+    return XSK_FRAME_SIZE;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_batch
+ * DESCRIPTION	: This function will process the packets waiting
+ *		: on one socket.  Up to XSK_BATCH packets are
+ *		: taken off the RX ring;  their frames are put
+ *		: back on the fill ring together.
+ * INPUT	: 0 - Socket
+ *		: 1 - Packet Processor
+ * RETURN	: Number of packets processed
+ * ---------------------------------------------------------- */
+static u_int32_t
+xsk_batch (XskSocket *sock, RingHandler handler)
+{
+    struct xdp_desc *desc, *rx = (struct xdp_desc *)sock->rx.desc;
+    u_int64_t *fill = (u_int64_t *)sock->fill.desc;
+    u_int32_t cons, fprod, n, i;
+    struct pcap_pkthdr hdr;
+    struct timeval now;
+    u_char *packet;
+
+    cons = *sock->rx.consumer;
+    if ((n = __atomic_load_n(sock->rx.producer, __ATOMIC_ACQUIRE) - cons) == 0)
+	return 0;
+    if (n > XSK_BATCH)
+	n = XSK_BATCH;
+
+    /* XDP has no timestamps;  one clock read per batch is enough. */
+    gettimeofday(&now, NULL);
+    hdr.ts = now;
+
+    fprod = *sock->fill.producer;
+    for (i = 0; i < n; i++) {
+	desc = &rx[(cons + i) & sock->rx.mask];
+	packet = sock->umem + desc->addr;
+	hdr.caplen = hdr.len = desc->len;
+
+	if (xsk_filter == NULL || pcap_offline_filter(xsk_filter, &hdr, packet))
+	    (*handler)(&hdr, packet);
+
+	/* Recycle the frame. */
+	fill[(fprod + i) & sock->fill.mask] = desc->addr & ~((u_int64_t)XSK_FRAME_SIZE - 1);
+    }
+
+    batch_flush();
+    __atomic_store_n(sock->fill.producer, fprod + n, __ATOMIC_RELEASE);
+    __atomic_store_n(sock->rx.consumer, cons + n, __ATOMIC_RELEASE);
+    sock->stats.packets += n;
+    sock->stats.batches++;
+
+    return n;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_loop
+ * DESCRIPTION	: This function will process the packets of
+ *		: the sockets of one worker until
+ *		: xsk_breakloop() is called or a socket fails.
+ *		: The sockets take turns, one batch each;  the
+ *		: worker sleeps in poll() once all of them are
+ *		: empty.
+ * INPUT	: 0 - Worker Number
+ *		: 1 - Packet Processor
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+xsk_loop (int index, RingHandler handler)
+{
+    struct pollfd *pfd;
+    u_int32_t busy;
+    int n, i;
+
+    /* This worker reads queues index, index + xsk_workers, ... */
+    n = (xsk_count > index) ? (xsk_count - index + xsk_workers - 1) / xsk_workers : 0;
+    if ((pfd = (struct pollfd *) calloc(n + 1, sizeof(struct pollfd))) == NULL)
+	err_message("Unable to allocate AF_XDP poll set (%d)", n);
+    for (i = 0; i < n; i++) {
+	pfd[i].fd = xsk_socks[index + i * xsk_workers].fd;
+	pfd[i].events = POLLIN;
+    }
+
+    while (!__atomic_load_n(&xsk_break, __ATOMIC_RELAXED)) {
+	busy = 0;
+	for (i = 0; i < n; i++)
+	    busy += xsk_batch(&xsk_socks[index + i * xsk_workers], handler);
+	if (busy == 0 && poll(pfd, n, XSK_TIMEOUT) < 0 && errno != EINTR) {
+	    log_message("WARNING:  xsk:  poll (%s)\n", strerror(errno));
+	    break;
+	}
+    }
+
+    free(pfd);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: xsk_breakloop
+ * DESCRIPTION	: This function will make every xsk_loop()
+ *		: return once it is done with its current
+ *		: batch.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+xsk_breakloop (void)
+{
+    __atomic_store_n(&xsk_break, 1, __ATOMIC_RELAXED);
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: get_xsk_stats
+ * DESCRIPTION	: This function will return the counters of
+ *		: the sockets of one worker, or the sum over
+ *		: all sockets.
+ * INPUT	: 0 - Worker Number (-1 = all sockets)
+ * RETURN	: Pointer to XskStats
+ * ---------------------------------------------------------- */
+XskStats *
+get_xsk_stats (int index)
+{
+    static XskStats total;
+    int i;
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < xsk_count; i++) {
+	if (index >= 0 && i % xsk_workers != index)
+	    continue;
+	xsk_read_stats(&xsk_socks[i]);
+	total.packets += xsk_socks[i].stats.packets;
+	total.drops += xsk_socks[i].stats.drops;
+	total.fill_empty += xsk_socks[i].stats.fill_empty;
+	total.batches += xsk_socks[i].stats.batches;
+    }
+
+    return &total;
+}
+
+/* ----------------------------------------------------------
+ * FUNCTION	: end_xsk
+ * DESCRIPTION	: This function will detach the XDP program,
+ *		: close the sockets and free their memory.
+ * INPUT	: None!
+ * RETURN	: None!
+ * ---------------------------------------------------------- */
+void
+end_xsk (void)
+{
+    XskSocket *sock;
+    int i;
+
+    ebpf_xsk_detach();
+
+    for (i = 0; i < xsk_count; i++) {
+	sock = &xsk_socks[i];
+	if (sock->rx.map != NULL)
+	    munmap(sock->rx.map, sock->rx.map_len);
+	if (sock->comp.map != NULL)
+	    munmap(sock->comp.map, sock->comp.map_len);
+	if (sock->fill.map != NULL)
+	    munmap(sock->fill.map, sock->fill.map_len);
+	if (sock->fd >= 0)
+	    close(sock->fd);
+	if (sock->umem != NULL)
+	    munmap(sock->umem, (size_t)xsk_frames * XSK_FRAME_SIZE);
+    }
+
+    if (xsk_socks != NULL)
+	free(xsk_socks);
+    xsk_socks = NULL;
+    xsk_count = 0;
+    xsk_workers = 0;
+}
+
+#else /* HAVE_AF_XDP && HAVE_EBPF */
+
+XskStats xsk_stats;
+
+int
+init_xsk (const char *dev, int workers)
+{
+    log_message("WARNING:  xsk:  not supported on this system\n");
+    return -1;
+}
+
+int xsk_setfilter (struct bpf_program *filter) { return -1; }
+int xsk_snaplen (void) { return 0; }
+void xsk_loop (int index, RingHandler handler) { }
+void xsk_breakloop (void) { }
+XskStats *get_xsk_stats (int index) { return &xsk_stats; }
+void end_xsk (void) { }
+
+#endif /* HAVE_AF_XDP && HAVE_EBPF */
+
+/* vim:expandtab:cindent:smartindent:ts=4:tw=0:sw=4:
+ */
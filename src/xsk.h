@@ -0,0 +1,57 @@
+/*************************************************************************
+ * xsk.h
+ *
+ * This header file contains information relating to the xsk.c module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ **************************************************************************/
+#ifndef INCLUDED_XSK_H
+#define INCLUDED_XSK_H
+
+#include "global.h"
+#include "ring.h"
+
+/* DEFINES ----------------------------------------- */
+#define XSK_FRAMES 4096             /* Default UMEM frames per socket. */
+#define XSK_FRAME_SIZE 2048         /* Bytes per frame (largest packet + headroom). */
+#define XSK_BATCH 64                /* Descriptors handled per pass. */
+#define XSK_TIMEOUT 100             /* Poll timeout (ms). */
+
+
+/* DATA STRUCTURES --------------------------------- */
+
+/* --------------------------------------------------------------------------
+ * XskStats:  AF_XDP socket counters.
+ * -------------------------------------------------------------------------- */
+typedef struct _XskStats
+{
+    unsigned long packets;      /* Packets received. */
+    unsigned long drops;        /* Packets dropped because the RX ring was full. */
+    unsigned long fill_empty;   /* Times the kernel found no free frame. */
+    unsigned long batches;      /* Batches of descriptors processed. */
+} XskStats;
+
+
+/* PROTOTYPES -------------------------------------- */
+int init_xsk (const char *dev, int workers);
+int xsk_setfilter (struct bpf_program *filter);
+int xsk_snaplen (void);
+void xsk_loop (int index, RingHandler handler);
+void xsk_breakloop (void);
+XskStats *get_xsk_stats (int index);
+void end_xsk (void);
+
+#endif /* INCLUDED_XSK_H */